@@ -0,0 +1,205 @@
+#include "analysis_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unordered_set>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace chess {
+
+namespace {
+
+constexpr size_t kMaxMoves = 512;
+
+bool KeyLess(const AnalysisCacheEntry& a, const AnalysisCacheEntry& b) {
+  return static_cast<uint64_t>(a.key) < static_cast<uint64_t>(b.key);
+}
+
+void Collect(const TranspositionTable& table, Board& board, int ply,
+             std::unordered_set<int64_t>& seen,
+             std::vector<AnalysisCacheEntry>& entries) {
+  const int64_t key = board.HashKey();
+  if (!seen.insert(key).second) {
+    return;
+  }
+  HashTableEntry tt_entry;
+  const HashTableEntry* tte = table.Get(key, tt_entry);
+  if (tte == nullptr || tte->depth < kMinCacheDepth
+      || tte->packed_move == 0) {
+    return;
+  }
+
+  const PlayerColor color = board.GetTurn().GetColor();
+  const Team other_team = OtherTeam(board.GetTurn().GetTeam());
+  Move moves[kMaxMoves];
+  const size_t count = board.GetPseudoLegalMoves2(
+      moves, kMaxMoves, board.GetPieceList()[color]).count;
+  // The table checks only 16 bits of the key. Its move has to be one of the
+  // position's before the entry is kept for good.
+  if (std::none_of(moves, moves + count, [tte](const Move& move) {
+        return move.Pack() == tte->packed_move;
+      })) {
+    return;
+  }
+
+  AnalysisCacheEntry entry = {};
+  entry.key = key;
+  entry.packed_move = tte->packed_move;
+  entry.score = tte->score;
+  entry.depth = static_cast<uint8_t>(std::min(tte->depth, 255));
+  entry.bound = static_cast<uint8_t>(tte->bound);
+  entries.push_back(entry);
+  if (ply == kMaxCachePly) {
+    return;
+  }
+  for (size_t i = 0; i < count; i++) {
+    if (moves[i].GetStandardCapture().GetPieceType() == KING) {
+      continue;
+    }
+    board.MakeMove(moves[i]);
+    if (!board.KingPresent(color)
+        || !board.IsAttackedByTeam(other_team, board.GetKingRow(color),
+                                   board.GetKingCol(color))) {
+      Collect(table, board, ply + 1, seen, entries);
+    }
+    board.UndoMove();
+  }
+}
+
+}  // namespace
+
+std::unique_ptr<const AnalysisCache> AnalysisCache::Load(
+    const std::string& path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cout << "Can not open cache file " << path << std::endl;
+    return nullptr;
+  }
+  struct stat st;
+  const size_t file_size = fstat(fd, &st) == 0 ? st.st_size : 0;
+  if (file_size < kHeaderSize
+      || (file_size - kHeaderSize) % sizeof(AnalysisCacheEntry) != 0) {
+    std::cout << "Cache file " << path << " has a wrong size" << std::endl;
+    close(fd);
+    return nullptr;
+  }
+  void* mapping = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    std::cout << "Can not map cache file " << path << std::endl;
+    return nullptr;
+  }
+
+  std::unique_ptr<AnalysisCache> cache(new AnalysisCache());
+  cache->mapping_ = mapping;
+  cache->mapping_size_ = file_size;
+
+  const char* data = static_cast<const char*>(mapping);
+  uint32_t header[2];
+  uint64_t size = 0;
+  std::memcpy(header, data, sizeof(header));
+  std::memcpy(&size, data + sizeof(header), sizeof(size));
+  if (header[0] != kAnalysisCacheMagic || header[1] != kAnalysisCacheVersion
+      || size != (file_size - kHeaderSize) / sizeof(AnalysisCacheEntry)) {
+    std::cout << "Cache file " << path << " has an unknown format"
+              << std::endl;
+    return nullptr;
+  }
+  // Get() searches the keys by bisection and hands the entries to the search
+  // as they are, so a file that was not written by Save() is not trusted.
+  const auto* entries =
+      reinterpret_cast<const AnalysisCacheEntry*>(data + kHeaderSize);
+  for (size_t i = 0; i < size; i++) {
+    const AnalysisCacheEntry& entry = entries[i];
+    if ((i > 0 && !KeyLess(entries[i - 1], entry))
+        || entry.bound > UPPER_BOUND
+        || entry.depth < kMinCacheDepth) {
+      std::cout << "Cache file " << path << " has a bad entry at " << i
+                << std::endl;
+      return nullptr;
+    }
+  }
+  cache->entries_ = entries;
+  cache->size_ = size;
+  return cache;
+}
+
+bool AnalysisCache::Save(const std::string& path,
+                         std::vector<AnalysisCacheEntry> entries) {
+  // Deepest entry of each key first, then drop the others.
+  std::sort(entries.begin(), entries.end(),
+            [](const AnalysisCacheEntry& a, const AnalysisCacheEntry& b) {
+              return KeyLess(a, b) || (a.key == b.key && a.depth > b.depth);
+            });
+  entries.erase(
+      std::unique(entries.begin(), entries.end(),
+                  [](const AnalysisCacheEntry& a, const AnalysisCacheEntry& b) {
+                    return a.key == b.key;
+                  }),
+      entries.end());
+
+  // Written next to the file and renamed over it, so that a mapping of the
+  // old file stays valid.
+  const std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    const uint32_t header[2] = {kAnalysisCacheMagic, kAnalysisCacheVersion};
+    const uint64_t size = entries.size();
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    out.write(reinterpret_cast<const char*>(entries.data()),
+              entries.size() * sizeof(AnalysisCacheEntry));
+    if (!out) {
+      std::cout << "Can not write cache file " << tmp_path << std::endl;
+      return false;
+    }
+  }
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    std::cout << "Can not replace cache file " << path << std::endl;
+    return false;
+  }
+  return true;
+}
+
+AnalysisCache::~AnalysisCache() {
+  if (mapping_ != nullptr) {
+    munmap(mapping_, mapping_size_);
+  }
+}
+
+const HashTableEntry* AnalysisCache::Get(
+    int64_t key, HashTableEntry& entry) const {
+  AnalysisCacheEntry target = {};
+  target.key = key;
+  const AnalysisCacheEntry* it =
+      std::lower_bound(begin(), end(), target, KeyLess);
+  if (it == end() || it->key != key) {
+    return nullptr;
+  }
+  entry.key = key;
+  entry.packed_move = it->packed_move;
+  entry.depth = it->depth;
+  entry.score = it->score;
+  entry.eval = it->score;
+  entry.bound = static_cast<ScoreBound>(it->bound);
+  entry.is_pv = entry.bound == EXACT;
+  entry.generation = 0;
+  return &entry;
+}
+
+std::vector<AnalysisCacheEntry> CollectCacheEntries(
+    const TranspositionTable& table, Board& board) {
+  std::unordered_set<int64_t> seen;
+  std::vector<AnalysisCacheEntry> entries;
+  Collect(table, board, 1, seen, entries);
+  return entries;
+}
+
+}  // namespace chess
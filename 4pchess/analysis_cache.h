@@ -0,0 +1,82 @@
+#ifndef _ANALYSIS_CACHE_H_
+#define _ANALYSIS_CACHE_H_
+
+// Search results kept on disk across sessions.
+//
+// The file is a kHeaderSize byte header followed by AnalysisCacheEntry
+// records sorted by key as unsigned, little-endian, and is mapped read-only
+// into memory. The search probes it in the first kMaxCachePly plies before
+// the transposition table; "savecache" writes the deep table entries around
+// the current position into it, merged with the entries already there.
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "transposition_table.h"
+
+namespace chess {
+
+constexpr uint32_t kAnalysisCacheMagic = 0x43415034;  // "4PAC"
+constexpr uint32_t kAnalysisCacheVersion = 1;
+// Plies from the root at which the search probes the cache
+constexpr int kMaxCachePly = 4;
+// Shallower table entries are not worth keeping
+constexpr int kMinCacheDepth = 6;
+
+struct AnalysisCacheEntry {
+  int64_t key;
+  uint32_t packed_move;  // 0 = no move
+  int32_t score;
+  uint8_t depth;
+  uint8_t bound;  // ScoreBound
+  uint8_t reserved[6];
+};
+static_assert(sizeof(AnalysisCacheEntry) == 24);
+
+class AnalysisCache {
+ public:
+  static constexpr size_t kHeaderSize = 16;
+
+  // Maps the cache file at `path`. Prints the reason and returns nullptr if
+  // it can not be read or has the wrong format.
+  static std::unique_ptr<const AnalysisCache> Load(const std::string& path);
+
+  // Writes `entries` to `path`, keeping the deepest entry of each key.
+  // Returns false, after printing why, if the file can not be written.
+  static bool Save(const std::string& path,
+                   std::vector<AnalysisCacheEntry> entries);
+
+  ~AnalysisCache();
+  AnalysisCache(const AnalysisCache&) = delete;
+  AnalysisCache& operator=(const AnalysisCache&) = delete;
+
+  // Same contract as TranspositionTable::Get. The static eval of a cached
+  // position is unknown, `entry.eval` is its score.
+  const HashTableEntry* Get(int64_t key, HashTableEntry& entry) const;
+
+  const AnalysisCacheEntry* begin() const { return entries_; }
+  const AnalysisCacheEntry* end() const { return entries_ + size_; }
+  size_t size() const { return size_; }
+
+ private:
+  AnalysisCache() = default;
+
+  void* mapping_ = nullptr;
+  size_t mapping_size_ = 0;
+  const AnalysisCacheEntry* entries_ = nullptr;
+  size_t size_ = 0;
+};
+
+// Entries of `table` at least kMinCacheDepth deep for `board` and the
+// positions up to kMaxCachePly - 1 legal moves from it, stopping at
+// positions the table does not have.
+std::vector<AnalysisCacheEntry> CollectCacheEntries(
+    const TranspositionTable& table, Board& board);
+
+}  // namespace chess
+
+#endif  // _ANALYSIS_CACHE_H_
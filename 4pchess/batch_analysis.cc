@@ -0,0 +1,153 @@
+#include "batch_analysis.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "utils.h"
+
+namespace chess {
+
+namespace {
+
+struct BatchPosition {
+  size_t line_number;
+  std::string fen;
+};
+
+std::string PVString(const PVInfo& pv_info) {
+  std::string pv;
+  for (int i = 0; i < pv_info.GetDepth(); i++) {
+    if (!pv.empty()) {
+      pv += " ";
+    }
+    pv += pv_info.GetMove(i).PrettyStr();
+  }
+  return pv;
+}
+
+// How often the analysis looks at BatchAnalysisOptions::canceled.
+constexpr std::chrono::milliseconds kCancelCheckInterval(10);
+
+}  // namespace
+
+std::optional<size_t> RunBatchAnalysis(
+    const BatchAnalysisOptions& options, std::ostream& log) {
+  std::ifstream in(options.input_file);
+  if (!in) {
+    log << "info string Can not open " << options.input_file << std::endl;
+    return std::nullopt;
+  }
+  std::vector<BatchPosition> positions;
+  std::string line;
+  for (size_t line_number = 1; std::getline(in, line); line_number++) {
+    std::istringstream tokens(line);
+    std::string fen;
+    if (tokens >> fen && fen[0] != '#') {
+      positions.push_back({line_number, fen});
+    }
+  }
+
+  std::ofstream out(options.output_file);
+  if (!out) {
+    log << "info string Can not open " << options.output_file << std::endl;
+    return std::nullopt;
+  }
+
+  const int num_threads = std::clamp<int>(
+      options.num_threads, 1, std::max<size_t>(positions.size(), 1));
+  PlayerOptions player_options = options.player_options;
+  player_options.num_threads = 1;
+  player_options.enable_multithreading = false;
+  player_options.transposition_table_size = std::max<size_t>(
+      player_options.transposition_table_size / num_threads, 1);
+
+  std::atomic<size_t> next_position = 0;
+  std::atomic<size_t> num_analyzed = 0;
+  std::mutex out_mutex;
+  // The players of the workers, for canceling their searches, and the
+  // number of workers done, under players_mutex.
+  std::mutex players_mutex;
+  std::condition_variable done_cv;
+  std::vector<AlphaBetaPlayer*> players;
+  int num_done = 0;
+  bool canceled = false;
+  auto is_canceled = [&options]() {
+    return options.canceled != nullptr && options.canceled->load();
+  };
+  auto work = [&]() {
+    // Kept from position to position: the table stays useful for positions
+    // of the same game.
+    AlphaBetaPlayer player(player_options);
+    {
+      std::lock_guard lock(players_mutex);
+      if (canceled) {
+        player.CancelEvaluation();
+      }
+      players.push_back(&player);
+    }
+    Board board(Player(RED), {});
+    for (size_t i = next_position++; i < positions.size() && !is_canceled();
+         i = next_position++) {
+      const BatchPosition& position = positions[i];
+      if (!ParseFEN(position.fen, board)) {
+        std::lock_guard lock(out_mutex);
+        log << "info string Invalid FEN on line " << position.line_number
+            << ": " << position.fen << std::endl;
+        continue;
+      }
+      const int64_t nodes_start = player.GetNumEvaluations();
+      auto res = player.MakeMove(board, options.limits);
+      const int64_t nodes = player.GetNumEvaluations() - nodes_start;
+
+      std::ostringstream result;
+      result << position.line_number << "\t" << position.fen << "\t";
+      if (res.has_value() && std::get<1>(*res).has_value()) {
+        const int score = std::get<0>(*res);
+        result << std::get<1>(*res)->PrettyStr() << "\t"
+               << (board.TeamToPlay() == BLUE_GREEN ? -score : score)
+               << "\t" << std::get<2>(*res) << "\t" << nodes << "\t"
+               << PVString(player.GetPVInfo());
+      } else {
+        result << "none\t0\t0\t" << nodes << "\t";
+      }
+      std::lock_guard lock(out_mutex);
+      out << result.str() << std::endl;
+      num_analyzed++;
+    }
+    std::lock_guard lock(players_mutex);
+    players.erase(std::find(players.begin(), players.end(), &player));
+    num_done++;
+    done_cv.notify_one();
+  };
+
+  std::vector<std::thread> workers;
+  for (int i = 0; i < num_threads; i++) {
+    workers.emplace_back(work);
+  }
+  {
+    std::unique_lock lock(players_mutex);
+    while (!done_cv.wait_for(lock, kCancelCheckInterval,
+                             [&] { return num_done == num_threads; })) {
+      if (!canceled && is_canceled()) {
+        canceled = true;
+        for (AlphaBetaPlayer* player : players) {
+          player->CancelEvaluation();
+        }
+      }
+    }
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  return num_analyzed.load();
+}
+
+}  // namespace chess
@@ -0,0 +1,47 @@
+#ifndef _BATCH_ANALYSIS_H_
+#define _BATCH_ANALYSIS_H_
+
+// Analysis of many independent positions at once.
+//
+// Each worker thread runs its own single threaded player, with its own
+// thread state and its share of the table, and takes the next position from
+// the input when its search is done. Positions have nothing to share, so this
+// scales with the cores where one search over many threads does not.
+
+#include <atomic>
+#include <optional>
+#include <ostream>
+#include <string>
+
+#include "player.h"
+#include "time_manager.h"
+
+namespace chess {
+
+struct BatchAnalysisOptions {
+  std::string input_file;   // One FEN per line, '#' starts a comment
+  std::string output_file;
+  SearchLimits limits;      // Of each search
+  int num_threads = 1;
+  // Search settings of the workers. The table is split between them.
+  PlayerOptions player_options;
+  // If given, setting it ends the analysis: the searches under way stop and
+  // no more positions are started.
+  const std::atomic<bool>* canceled = nullptr;
+};
+
+// Analyzes every position of the input file and writes one line per
+// position to the output file as soon as its search ends:
+//
+//   <line>\t<fen>\t<best move>\t<score>\t<depth>\t<nodes>\t<pv>
+//
+// with the input line number first, since lines come in the order the
+// searches end. The score is for the side to move. Invalid FENs are
+// reported to `log` and skipped. Returns the number of positions analyzed,
+// or nullopt if a file can not be opened.
+std::optional<size_t> RunBatchAnalysis(
+    const BatchAnalysisOptions& options, std::ostream& log);
+
+}  // namespace chess
+
+#endif  // _BATCH_ANALYSIS_H_
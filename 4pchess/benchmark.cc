@@ -0,0 +1,325 @@
+#include "benchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "player.h"
+#include "utils.h"
+
+namespace chess {
+
+namespace {
+
+constexpr size_t kMaxMoves = 512;
+
+// The start position, an opening, a middlegame 31 plies into a depth 6
+// self-play game, and three positions from random games with captures, moved
+// kings and lost castling rights.
+constexpr const char* kBenchPositions[] = {
+  "R-0,0,0,0-1,1,1,1-1,1,1,1-0,0,0,0-0-3,yR,yN,yB,yK,yQ,yB,yN,yR,3/"
+  "3,yP,yP,yP,yP,yP,yP,yP,yP,3/14/bR,bP,10,gP,gR/bN,bP,10,gP,gN/"
+  "bB,bP,10,gP,gB/bQ,bP,10,gP,gK/bK,bP,10,gP,gQ/bB,bP,10,gP,gB/"
+  "bN,bP,10,gP,gN/bR,bP,10,gP,gR/14/3,rP,rP,rP,rP,rP,rP,rP,rP,3/"
+  "3,rR,rN,rB,rQ,rK,rB,rN,rR,3",
+  "Y-0,0,0,0-1,1,1,1-1,1,1,1-0,0,0,0-0-4,yR,yB,yK,yQ,yB,yN,yR,3/"
+  "3,yP,yP,yP,yP,yP,yP,yP,yP,3/5,yN,8/bR,bP,10,gP,gR/bN,bP,10,gP,gN/"
+  "bB,bP,10,gP,gB/bQ,2,bP,8,gP,gK/bK,bP,10,gP,gQ/bB,bP,10,gP,gB/"
+  "bN,bP,8,gP,2,gN/bR,3,bP,2,rP,2,gP,2,gR/3,rN,6,rN,3/"
+  "3,rP,rP,rP,rP,1,rP,rP,rP,3/3,rR,1,rB,rQ,rK,rB,1,rR,3",
+  "G-0,0,0,0-1,0,1,1-1,0,1,1-0,0,0,0-0-3,yR,2,yK,yQ,yB,yN,yR,3/"
+  "4,yP,yP,2,yP,yP,4/5,yN,4,yP,3/bR,bP,1,yP,2,yP,3,gP,2,gR/"
+  "bN,1,bP,4,yP,4,gP,gN/bB,bP,10,gP,gB/1,bP,10,gP,gK/1,bP,8,gP,1,gQ,1/"
+  "bQ,bK,2,bP,6,gP,2/bN,bB,bP,8,rP,2/bR,2,bP,3,rP,3,gN,gP,gR/"
+  "6,rP,3,rN,3/3,rP,rP,rP,2,rP,rP,4/3,rR,rN,rB,rQ,rK,rB,1,rR,3",
+  "R-0,0,0,0-1,0,1,1-1,0,1,1-0,0,0,0-0-3,yR,yN,yB,yK,1,gN,yN,4/"
+  "3,yP,yP,yP,yP,1,yP,5/7,yP,6/bR,bP,12/bN,1,bP,9,gP,1/bB,bP,10,gP,gB/"
+  "bQ,11,gP,gK/bK,bP,10,gP,gQ/bB,bP,10,gP,gB/bR,bP,10,gP,gN/"
+  "1,bP,5,rP,4,gP,gR/3,rP,rP,9/6,rP,rQ,rP,rP,yR,3/3,rR,rN,rB,1,rK,1,rN,rR,3",
+  "R-0,0,0,0-0,1,1,1-0,1,1,1-0,0,0,0-0-6,yK,2,yN,yR,3/5,yP,yP,3,yP,3/"
+  "4,yP,yN,1,yP,gB,5/bR,bP,yB,7,gR,3/10,gP,2,gN/11,gP,2/2,bP,9,gP,gK/"
+  "bK,bP,1,bN,8,gP,1/bB,2,bP,6,gP,2,gB/bN,bP,10,rB,gN/1,bR,1,rN,8,gP,gR/"
+  "6,rP,rP,rN,rP,4/3,rP,rP,rP,2,rK,5/3,rR,1,rB,rQ,7",
+  "R-0,0,0,0-1,0,0,0-1,0,0,0-0,0,0,0-0-4,yN,4,yN,yR,3/5,yK,3,yP,4/4,yP,9/"
+  "bR,bP,3,yP,1,yP,2,yP,3/2,bP,9,gP,gN/1,bQ,bP,9,gP,gB/1,bP,8,gP,3/"
+  "5,bP,3,gN,3,gK/1,bP,12/bK,3,rP,5,rQ,3/bR,bP,3,rP,1,rP,2,gP,1,gR,1/"
+  "3,rP,2,rB,7/3,rR,2,rP,1,rP,rP,rN,3/4,rN,2,rK,6",
+};
+
+// Makes `move` and returns true if it does not leave the mover's king
+// attacked; otherwise the move is taken back.
+bool MakeLegalMove(Board& board, const Move& move) {
+  const PlayerColor color = board.GetTurn().GetColor();
+  const Team other_team = OtherTeam(board.GetTurn().GetTeam());
+  board.MakeMove(move);
+  if (board.KingPresent(color)
+      && board.IsAttackedByTeam(other_team,
+                                board.GetKingRow(color),
+                                board.GetKingCol(color))) {
+    board.UndoMove();
+    return false;
+  }
+  return true;
+}
+
+size_t GenerateMoves(Board& board, Move* moves) {
+  return board.GetPseudoLegalMoves2(
+      moves, kMaxMoves, board.GetPieceList()[board.GetTurn().GetColor()]).count;
+}
+
+int64_t ElapsedMs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+uint64_t NodesPerSecond(uint64_t nodes, int64_t ms) {
+  return nodes * 1000 / std::max<int64_t>(ms, 1);
+}
+
+uint64_t AddToSignature(uint64_t signature, uint64_t value) {
+  return (signature ^ value) * 1099511628211ull;
+}
+
+void PrintSignature(uint64_t signature, std::ostream& out) {
+  out << std::hex << std::setw(16) << std::setfill('0') << signature
+      << std::dec << std::setfill(' ');
+}
+
+std::shared_ptr<Board> ParseBenchPosition(const char* fen) {
+  auto board = ParseBoardFromFEN(fen);
+  if (board == nullptr) {
+    std::cout << "Invalid bench position " << fen << std::endl;
+    abort();
+  }
+  return board;
+}
+
+}  // namespace
+
+uint64_t Perft(Board& board, int depth) {
+  if (depth <= 0) {
+    return 1;
+  }
+  Move moves[kMaxMoves];
+  const size_t count = GenerateMoves(board, moves);
+  uint64_t nodes = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (moves[i].GetStandardCapture().GetPieceType() == KING) {
+      nodes++;
+      continue;
+    }
+    if (!MakeLegalMove(board, moves[i])) {
+      continue;
+    }
+    nodes += Perft(board, depth - 1);
+    board.UndoMove();
+  }
+  return nodes;
+}
+
+uint64_t PerftDivide(Board& board, int depth, std::ostream& out) {
+  const auto start = std::chrono::steady_clock::now();
+  Move moves[kMaxMoves];
+  const size_t count = GenerateMoves(board, moves);
+  uint64_t nodes = 0;
+  for (size_t i = 0; i < count; i++) {
+    uint64_t move_nodes = 1;
+    if (moves[i].GetStandardCapture().GetPieceType() != KING) {
+      if (!MakeLegalMove(board, moves[i])) {
+        continue;
+      }
+      move_nodes = Perft(board, depth - 1);
+      board.UndoMove();
+    }
+    out << moves[i].PrettyStr() << ": " << move_nodes << std::endl;
+    nodes += move_nodes;
+  }
+  const int64_t ms = ElapsedMs(start);
+  out << "nodes " << nodes << " time " << ms
+      << " nps " << NodesPerSecond(nodes, ms) << std::endl;
+  return nodes;
+}
+
+uint64_t RunBench(int depth, std::ostream& out) {
+  uint64_t total_nodes = 0;
+  uint64_t signature = 14695981039346656037ull;  // FNV-1a over the counts
+  const auto start = std::chrono::steady_clock::now();
+  int index = 0;
+  for (const char* fen : kBenchPositions) {
+    auto board = ParseBenchPosition(fen);
+    const uint64_t nodes = Perft(*board, depth);
+    out << "position " << index++ << " nodes " << nodes << std::endl;
+    total_nodes += nodes;
+    signature = AddToSignature(signature, nodes);
+  }
+  const int64_t ms = ElapsedMs(start);
+  out << "bench depth " << depth << " nodes " << total_nodes
+      << " time " << ms << " nps " << NodesPerSecond(total_nodes, ms)
+      << " signature ";
+  PrintSignature(signature, out);
+  out << std::endl;
+  return signature;
+}
+
+uint64_t RunSearchBench(int depth, std::ostream& out) {
+  PlayerOptions options;
+  options.num_threads = 1;
+  uint64_t total_nodes = 0;
+  uint64_t signature = 14695981039346656037ull;
+  int64_t total_ms = 0;
+  int index = 0;
+  for (const char* fen : kBenchPositions) {
+    auto board = ParseBenchPosition(fen);
+    AlphaBetaPlayer player(options);
+    const auto start = std::chrono::steady_clock::now();
+    std::optional<Move> best_move;
+    if (auto res = player.MakeMove(*board, depth); res.has_value()) {
+      best_move = std::get<1>(*res);
+    }
+    total_ms += ElapsedMs(start);
+    const uint64_t nodes = player.GetNumEvaluations();
+    out << "position " << index++ << " nodes " << nodes << " bestmove "
+        << (best_move.has_value() ? best_move->PrettyStr() : "none")
+        << std::endl;
+    total_nodes += nodes;
+    signature = AddToSignature(signature, nodes);
+    if (best_move.has_value()) {
+      signature = AddToSignature(signature, best_move->Pack());
+    }
+  }
+  out << "bench search depth " << depth << " nodes " << total_nodes
+      << " time " << total_ms << " nps " << NodesPerSecond(total_nodes, total_ms)
+      << " signature ";
+  PrintSignature(signature, out);
+  out << std::endl;
+  return signature;
+}
+
+namespace {
+
+struct SmpResult {
+  double ms = 0;
+  int64_t nodes = 0;
+  int64_t tt_probes = 0;
+  int64_t tt_hits = 0;
+  int depth = 0;
+  std::optional<Move> best_move;
+  std::vector<int64_t> thread_nodes;
+};
+
+SmpResult RunSmpSearch(const char* fen, int depth, int num_threads) {
+  PlayerOptions options;
+  options.num_threads = num_threads;
+  options.enable_multithreading = num_threads > 1;
+  auto board = ParseBenchPosition(fen);
+  AlphaBetaPlayer player(options);
+  SmpResult result;
+  const auto start = std::chrono::steady_clock::now();
+  if (auto res = player.MakeMove(*board, depth); res.has_value()) {
+    result.best_move = std::get<1>(*res);
+    result.depth = std::get<2>(*res);
+  }
+  result.ms = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - start).count();
+  for (const auto& counts : player.GetThreadSearchCounts()) {
+    result.nodes += counts.nodes;
+    result.tt_probes += counts.tt_probes;
+    result.tt_hits += counts.tt_hits;
+    result.thread_nodes.push_back(counts.nodes);
+  }
+  return result;
+}
+
+double Ratio(double numerator, double denominator) {
+  return denominator > 0 ? numerator / denominator : 0;
+}
+
+std::string BestMoveStr(const std::optional<Move>& move) {
+  return move.has_value() ? move->PrettyStr() : "none";
+}
+
+}  // namespace
+
+void RunSmpBench(int depth, int max_threads, std::ostream& out) {
+  std::vector<int> thread_counts;
+  for (int threads = 1; threads < max_threads; threads *= 2) {
+    thread_counts.push_back(threads);
+  }
+  thread_counts.push_back(std::max(max_threads, 1));
+
+  const std::ios_base::fmtflags flags = out.flags();
+  out << std::fixed << std::setprecision(3);
+  out << "{\"depth\": " << depth << ", \"runs\": [";
+  std::vector<SmpResult> single_thread;
+  double single_thread_ms = 0;
+  double single_thread_nps = 0;
+  for (size_t run = 0; run < thread_counts.size(); run++) {
+    const int threads = thread_counts[run];
+    double total_ms = 0;
+    int64_t total_nodes = 0;
+    int64_t tt_probes = 0;
+    int64_t tt_hits = 0;
+    int agreeing = 0;
+    int compared = 0;
+    out << (run > 0 ? "," : "") << "\n  {\"threads\": " << threads
+        << ", \"positions\": [";
+    int index = 0;
+    for (const char* fen : kBenchPositions) {
+      const SmpResult result = RunSmpSearch(fen, depth, threads);
+      if (run == 0) {
+        single_thread.push_back(result);
+      }
+      const std::string best_move = BestMoveStr(result.best_move);
+      // Best moves of different depths say nothing about the threads.
+      std::optional<bool> agrees;
+      if (result.depth == single_thread[index].depth) {
+        agrees = best_move == BestMoveStr(single_thread[index].best_move);
+        agreeing += *agrees;
+        compared++;
+      }
+      total_ms += result.ms;
+      total_nodes += result.nodes;
+      tt_probes += result.tt_probes;
+      tt_hits += result.tt_hits;
+      out << (index > 0 ? "," : "") << "\n    {\"index\": " << index
+          << ", \"depth\": " << result.depth
+          << ", \"time_ms\": " << result.ms
+          << ", \"nodes\": " << result.nodes
+          << ", \"nps\": " << static_cast<int64_t>(
+              Ratio(result.nodes * 1000.0, result.ms))
+          << ", \"tt_hit_rate\": " << Ratio(result.tt_hits, result.tt_probes)
+          << ", \"bestmove\": \"" << best_move << "\""
+          << ", \"agrees\": "
+          << (!agrees.has_value() ? "null" : *agrees ? "true" : "false")
+          << ", \"thread_nodes\": [";
+      for (size_t i = 0; i < result.thread_nodes.size(); i++) {
+        out << (i > 0 ? ", " : "") << result.thread_nodes[i];
+      }
+      out << "]}";
+      index++;
+    }
+    const double nps = Ratio(total_nodes * 1000.0, total_ms);
+    if (run == 0) {
+      single_thread_ms = total_ms;
+      single_thread_nps = nps;
+    }
+    out << "],\n   \"time_ms\": " << total_ms
+        << ", \"nodes\": " << total_nodes
+        << ", \"nps\": " << static_cast<int64_t>(nps)
+        << ", \"speedup\": " << Ratio(single_thread_ms, total_ms)
+        << ", \"nps_speedup\": " << Ratio(nps, single_thread_nps)
+        << ", \"tt_hit_rate\": " << Ratio(tt_hits, tt_probes)
+        << ", \"compared\": " << compared
+        << ", \"bestmove_agreement\": " << Ratio(agreeing, compared) << "}";
+  }
+  out << "\n]}" << std::endl;
+  out.flags(flags);
+}
+
+}  // namespace chess
@@ -0,0 +1,45 @@
+#ifndef _BENCHMARK_H_
+#define _BENCHMARK_H_
+
+// Move generation and search benchmarks run inside the engine, so that the numbers are
+// not skewed by process start-up and the UCI pipe.
+
+#include <cstdint>
+#include <ostream>
+
+#include "board.h"
+
+namespace chess {
+
+// Number of leaves of the legal move tree `depth` plies deep. A move that
+// captures a king ends its line and counts as one leaf.
+uint64_t Perft(Board& board, int depth);
+
+// Prints the perft count below each legal root move, then the total.
+uint64_t PerftDivide(Board& board, int depth, std::ostream& out);
+
+// Perft to `depth` over a fixed suite of positions. Prints the count of each
+// position, the total, nodes per second and a signature of the counts, and
+// returns the signature. The counts only change with the move generator, so
+// a changed signature means a changed generator.
+uint64_t RunBench(int depth, std::ostream& out);
+
+// Single threaded iterative deepening search to `depth` of each position of
+// the bench suite, with a fresh table each. Prints the nodes per position,
+// the total, nodes per second and a signature of the node counts and best
+// moves, and returns the signature. Also the training run of `make pgo`.
+uint64_t RunSearchBench(int depth, std::ostream& out);
+
+// Searches the bench suite to `depth` with 1, 2, 4, ... and `max_threads`
+// threads, a fresh player for each position. Prints one JSON document with,
+// per thread count and position, the time to depth, nodes, nodes per thread,
+// nodes per second, table hit rate and best move, and per thread count the
+// totals, the speedup in time to depth and in nodes per second over one
+// thread and how many best moves agree with the one-thread search. Only the
+// positions where both completed the same depth are compared; "compared"
+// counts them and "agrees" is null for the others.
+void RunSmpBench(int depth, int max_threads, std::ostream& out);
+
+}  // namespace chess
+
+#endif  // _BENCHMARK_H_
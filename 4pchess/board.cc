@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <array>
 #include <cassert>
 #include <cmath>
 #include <cstdlib>
@@ -7,6 +8,7 @@
 #include <optional>
 #include <ostream>
 #include <sstream>
+#include <type_traits>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -27,8 +29,6 @@ namespace chess {
     1   // KNIGHT
   };
 
-std::chrono::nanoseconds Board::total_time{0};
-size_t Board::call_count = 0;
 int Piece::invalid_piece_count = 0;
 
 constexpr int kMobilityMultiplier = 5;
@@ -36,7 +36,7 @@ Piece Piece::kNoPiece = Piece(Piece::kRawNoPiece);
 CastlingRights CastlingRights::kMissingRights = CastlingRights();
 
 const Piece& PlacedPiece::GetPiece(const Board& board) const {
-  return board.location_to_piece_[row_][col_];
+  return board.mailbox_[ToSquare(row_, col_)];
 }
 
 struct Coords {
@@ -97,103 +97,420 @@ int64_t rand64() {
 }  // namespace
 
 
-std::pair<int8_t, int8_t> Board::GetAttacker(Team team, int8_t row, int8_t col) const {
-  int loc_row = row;
-  int loc_col = col;
+namespace {
 
-  // Orthogonal (rook/queen) - 4 directions
-  constexpr std::array<std::pair<int, int>, 4> orthogonal = {{
-      {0, 1}, {1, 0}, {0, -1}, {-1, 0}
-  }};
-  for (const auto& [dr, dc] : orthogonal) {
-      int row = loc_row + dr;
-      int col = loc_col + dc;
-      while (IsLegalLocation(row, col)) {
-          const auto piece = GetPiece(row, col);
-          if (piece.Present()) {
-              if (piece.GetTeam() == team) {
-                  PieceType type = piece.GetPieceType();
-                  if (type == QUEEN || type == ROOK) return {row, col};
-              }
-              break;
-          }
-          row += dr;
-          col += dc;
+// Consolidated direction data for pawn movement and captures
+// Indexed by PlayerColor (RED=0, BLUE=1, YELLOW=2, GREEN=3)
+struct PawnDirectionData {
+  int8_t delta_row;         // Row delta for forward movement
+  int8_t delta_col;         // Column delta for forward movement
+  int8_t capture1_row;      // Row delta for first capture direction
+  int8_t capture1_col;      // Column delta for first capture direction
+  int8_t capture2_row;      // Row delta for second capture direction
+  int8_t capture2_col;      // Column delta for second capture direction
+};
+
+constexpr PawnDirectionData kPawnDirections[4] = {
+  // y direction 0 top, 13 bottom
+  // all colors capture to the left (first capture)
+  // RED: moves up, captures up-left and up-right
+  {-1, 0, -1, -1, -1, 1},
+  // BLUE: moves right, captures up-right and down-right
+  {0, 1, -1, 1, 1, 1},
+  // YELLOW: moves down, captures down-left and down-right
+  {1, 0, 1, 1, 1, -1},
+  // GREEN: moves left, captures down-left and up-left
+  {0, -1, 1, -1, -1, -1}
+};
+
+constexpr int8_t kStartingRow[4] = {12, -1, 1, -1};  // RED, BLUE, YELLOW, GREEN
+constexpr int8_t kStartingCol[4] = {-1, 1, -1, 12};  // -1 means not used
+constexpr int8_t kPromotionRow[4] = {0, -1, 13, -1};   // RED, BLUE, YELLOW, GREEN
+constexpr int8_t kPromotionCol[4] = {-1, 13, -1, 0};   // -1 means not used
+
+// Board geometry tables. Everything below is generated at compile time from
+// kLegalPositions and the mailbox layout, so it lives in rodata and costs
+// nothing at startup.
+
+constexpr int Step(int delta_row, int delta_col) {
+  return delta_row * kMailboxWidth + delta_col;
+}
+
+constexpr bool IsPlayable(int square) {
+  if (square < 0 || square >= kMailboxSize) return false;
+  const int row = SquareRow(square);
+  const int col = SquareCol(square);
+  return row >= 0 && row < 14 && col < 14 && kLegalPositions[row][col];
+}
+
+// The eight ray directions: diagonals first, then orthogonals, in the order
+// queens generate their moves. Bishops use the first four, rooks the last four.
+constexpr int kNumRays = 8;
+constexpr int kRaySteps[kNumRays] = {
+  Step(1, 1), Step(1, -1), Step(-1, 1), Step(-1, -1),
+  Step(0, 1), Step(0, -1), Step(1, 0), Step(-1, 0)};
+constexpr int kFirstDiagonalRay = 0;
+constexpr int kFirstOrthogonalRay = 4;
+
+constexpr int OppositeRay(int ray) {
+  return ray < kFirstOrthogonalRay ? 3 - ray : ray ^ 1;
+}
+static_assert([] {
+  for (int ray = 0; ray < kNumRays; ray++) {
+    if (kRaySteps[ray] + kRaySteps[OppositeRay(ray)] != 0) return false;
+  }
+  return true;
+}());
+
+// Number of playable squares along each ray before it runs off the board or
+// into a cut corner.
+constexpr auto kRayLength = [] {
+  std::array<std::array<uint8_t, kNumRays>, kMailboxSize> table{};
+  for (int square = 0; square < kMailboxSize; square++) {
+    if (!IsPlayable(square)) continue;
+    for (int ray = 0; ray < kNumRays; ray++) {
+      int length = 0;
+      for (int to = square + kRaySteps[ray]; IsPlayable(to); to += kRaySteps[ray]) {
+        length++;
       }
+      table[square][ray] = length;
+    }
+  }
+  return table;
+}();
+
+// Most moves a single piece can have: a queen on an otherwise empty board.
+constexpr int kMaxPieceMoves = [] {
+  int most = 0;
+  for (int square = 0; square < kMailboxSize; square++) {
+    int moves = 0;
+    for (int ray = 0; ray < kNumRays; ray++) moves += kRayLength[square][ray];
+    most = std::max(most, moves);
   }
+  return most;
+}();
 
-  // Diagonal (bishop/queen) - 4 directions
-  constexpr std::array<std::pair<int, int>, 4> diagonal = {{
-      {1, 1}, {1, -1}, {-1, -1}, {-1, 1}
-  }};
-  for (const auto& [dr, dc] : diagonal) {
-      int row = loc_row + dr;
-      int col = loc_col + dc;
-      while (IsLegalLocation(row, col)) {
-          const auto piece = GetPiece(row, col);
-          if (piece.Present()) {
-              if (piece.GetTeam() == team) {
-                  PieceType type = piece.GetPieceType();
-                  if (type == QUEEN || type == BISHOP) return {row, col};
-              }
-              break;
-          }
-          row += dr;
-          col += dc;
+// Playable destinations of a fixed set of steps, per square, in step order.
+struct SquareList {
+  uint8_t count;
+  int16_t squares[8];
+};
+
+template <size_t N>
+constexpr std::array<SquareList, kMailboxSize> MakeTargets(const int (&steps)[N]) {
+  std::array<SquareList, kMailboxSize> table{};
+  for (int square = 0; square < kMailboxSize; square++) {
+    if (!IsPlayable(square)) continue;
+    for (int step : steps) {
+      if (IsPlayable(square + step)) {
+        auto& list = table[square];
+        list.squares[list.count++] = square + step;
       }
+    }
   }
+  return table;
+}
 
-  // Check for knight attacks
-  constexpr std::array<std::pair<int, int>, 8> knight_moves = {{
-    {1, 2}, {1, -2}, {-1, 2}, {-1, -2}, {2, 1}, {2, -1}, {-2, 1}, {-2, -1}
-  }};
-
-  for (const auto& [dr, dc] : knight_moves) {
-    int row = loc_row + dr;
-    int col = loc_col + dc;
-    if (IsLegalLocation(row, col)) {
-      const auto piece = GetPiece(row, col);
-      if (piece.Present() &&
-          piece.GetTeam() == team &&
-          piece.GetPieceType() == KNIGHT) {
-        return {row, col};
+// Knight jumps in move generation order.
+constexpr int kKnightMoveSteps[8] = {
+  Step(2, 1), Step(2, -1), Step(-2, 1), Step(-2, -1),
+  Step(1, 2), Step(1, -2), Step(-1, 2), Step(-1, -2)};
+// King steps in move generation order: up-left, up-right, down-left,
+// down-right, then up, left, right, down.
+constexpr int kKingDiagonalSteps[4] = {
+  Step(-1, -1), Step(-1, 1), Step(1, -1), Step(1, 1)};
+constexpr int kKingOrthogonalSteps[4] = {
+  Step(-1, 0), Step(0, -1), Step(0, 1), Step(1, 0)};
+
+constexpr auto kKnightTargets = MakeTargets(kKnightMoveSteps);
+constexpr auto kKingDiagonalTargets = MakeTargets(kKingDiagonalSteps);
+constexpr auto kKingOrthogonalTargets = MakeTargets(kKingOrthogonalSteps);
+
+// Steps, relative to an attacked square, to the squares from which a pawn of
+// each color attacks it: the reverse of that color's capture directions.
+constexpr auto kPawnAttackerSteps = [] {
+  std::array<std::array<int, 2>, 4> table{};
+  for (int color = 0; color < 4; color++) {
+    const auto& dir = kPawnDirections[color];
+    table[color][0] = -Step(dir.capture1_row, dir.capture1_col);
+    table[color][1] = -Step(dir.capture2_row, dir.capture2_col);
+  }
+  return table;
+}();
+
+// Indexed by (row, col) difference + 13: the step that leads from one square
+// to the other if they share a rank, file or diagonal, 0 otherwise. Mailbox
+// index differences alias on a 14-wide board, hence rows and columns.
+constexpr auto kLineStep = [] {
+  std::array<std::array<int8_t, 27>, 27> table{};
+  for (int dr = -13; dr <= 13; dr++) {
+    for (int dc = -13; dc <= 13; dc++) {
+      if ((dr == 0 && dc == 0) ||
+          (dr != 0 && dc != 0 && dr != dc && dr != -dc)) {
+        continue;
       }
+      table[dr + 13][dc + 13] = Step((dr > 0) - (dr < 0), (dc > 0) - (dc < 0));
     }
   }
+  return table;
+}();
 
-  // Combined pawn attack check - simplified
-  constexpr std::pair<int, int> pawn_attacks[4][2] = {
-      {{-1, -1}, {-1, 1}},   // Red attacks up-left, up-right
-      {{1, -1}, {1, 1}},     // Yellow attacks down-left, down-right
-      {{-1, 1}, {1, 1}},     // Blue attacks up-right, down-right
-      {{-1, -1}, {1, -1}}    // Green attacks up-left, down-left
-  };
+inline int LineStep(int from, int to) {
+  return kLineStep[SquareRow(to) - SquareRow(from) + 13]
+                  [SquareCol(to) - SquareCol(from) + 13];
+}
 
-  if (team == RED_YELLOW) {
-      // Check Red (color 0) and Yellow (color 2) pawns only
-      for (int color : {0, 2}) {
-          for (int j = 0; j < 2; ++j) {
-              const auto& [dr, dc] = pawn_attacks[color][j];
-              int row = loc_row + dr, col = loc_col + dc;
-              if (IsLegalLocation(row, col)) {
-                  const auto piece = GetPiece(row, col);
-                  if (piece.GetRaw() == Piece::kRawPawn[color])
-                      return {row, col};
-              }
-          }
+inline bool IsOrthogonalStep(int step) {
+  return step == 1 || step == -1 || step == kMailboxWidth || step == -kMailboxWidth;
+}
+
+inline bool IsKnightJump(int from, int to) {
+  const int dr = SquareRow(to) - SquareRow(from);
+  const int dc = SquareCol(to) - SquareCol(from);
+  return dr * dr + dc * dc == 5;
+}
+
+inline bool IsPromotionSquare(PlayerColor color, int square) {
+  return (color & 1) == 0 ? SquareRow(square) == kPromotionRow[color]
+                          : SquareCol(square) == kPromotionCol[color];
+}
+
+// Returns the first occupied square along a ray, or -1 if the ray ends empty.
+inline int FirstOccupied(const Piece* mailbox, int square, int ray) {
+  const int step = kRaySteps[ray];
+  for (int n = kRayLength[square][ray]; n > 0; n--) {
+    square += step;
+    if (mailbox[square].Present()) return square;
+  }
+  return -1;
+}
+
+inline bool IsSlider(Piece piece, PieceType slider) {
+  const PieceType type = piece.GetPieceType();
+  return type == QUEEN || type == slider;
+}
+
+inline std::pair<int8_t, int8_t> ToLocation(int square) {
+  return {SquareRow(square), SquareCol(square)};
+}
+
+// Emits the quiet moves along one slider ray and the capture that ends it.
+template <Board::MoveGenType kGen>
+inline Move* AddSliderMoves(
+    const Piece* mailbox, int8_t from_row, int8_t from_col, int from,
+    int ray, Team my_team, Move* current) {
+  const int step = kRaySteps[ray];
+  int to = from;
+  for (int n = kRayLength[from][ray]; n > 0; n--) {
+    to += step;
+    const Piece target = mailbox[to];
+    if (target.Present()) {
+      if (kGen != Board::QUIETS && target.GetTeam() != my_team) {
+        new (current++) Move(from_row, from_col, SquareRow(to), SquareCol(to), target.GetRaw());
       }
-  } else {
-      // Check Blue (color 1) and Green (color 3) pawns only
-      for (int color : {1, 3}) {
-          for (int j = 0; j < 2; ++j) {
-              const auto& [dr, dc] = pawn_attacks[color][j];
-              int row = loc_row + dr, col = loc_col + dc;
-              if (IsLegalLocation(row, col)) {
-                  const auto piece = GetPiece(row, col);
-                  if (piece.GetRaw() == Piece::kRawPawn[color])
-                      return {row, col};
-              }
-          }
+      break;
+    }
+    if (kGen != Board::CAPTURES) {
+      new (current++) Move(from_row, from_col, SquareRow(to), SquareCol(to), 0);
+    }
+  }
+  return current;
+}
+
+// King steps while in check: no castling.
+inline Move* AddKingMovesInCheck(
+    const Piece* mailbox, int8_t from_row, int8_t from_col, int from,
+    Team my_team, Move* current) {
+  const SquareList& diagonal = kKingDiagonalTargets[from];
+  for (int i = 0; i < diagonal.count; i++) {
+    const int to = diagonal.squares[i];
+    const Piece captured = mailbox[to];
+    if (captured.Missing() || captured.GetTeam() != my_team) {
+      new (current++) Move(from_row, from_col, SquareRow(to), SquareCol(to), captured.GetRaw());
+    }
+  }
+  const SquareList& orthogonal = kKingOrthogonalTargets[from];
+  for (int i = 0; i < orthogonal.count; i++) {
+    const int to = orthogonal.squares[i];
+    const Piece captured = mailbox[to];
+    if (captured.Missing()) {
+      new (current++) Move(from_row, from_col, SquareRow(to), SquareCol(to), 0);
+    } else if (captured.GetTeam() != my_team) {
+      new (current++) Move(from_row, from_col, SquareRow(to), SquareCol(to), captured.GetRaw());
+    }
+  }
+  return current;
+}
+
+// Whether a non-king piece could move from `from` to `to` in one move, given
+// the current occupancy. `to` is either empty or holds an enemy piece. Only
+// used for check evasions, where there are just a few candidate squares.
+inline bool CanReach(
+    const Piece* mailbox, PieceType type, PlayerColor color, int from, int to) {
+  switch (type) {
+    case QUEEN:
+    case ROOK:
+    case BISHOP: {
+      const int step = LineStep(from, to);
+      if (step == 0) return false;
+      if (type != QUEEN && (type == ROOK) != IsOrthogonalStep(step)) return false;
+      for (int square = from + step; square != to; square += step) {
+        if (mailbox[square].Present()) return false;
+      }
+      return true;
+    }
+    case KNIGHT:
+      return IsKnightJump(from, to);
+    case PAWN: {
+      // DOES NOT HANDLE EN PASSANT!
+      const auto& dir = kPawnDirections[color];
+      const int forward_step = Step(dir.delta_row, dir.delta_col);
+      if (mailbox[to].Present()) {
+        return to == from + Step(dir.capture1_row, dir.capture1_col) ||
+               to == from + Step(dir.capture2_row, dir.capture2_col);
+      }
+      if (to == from + forward_step) return true;
+      const bool not_moved = (color & 1) == 0
+          ? SquareRow(from) == kStartingRow[color]
+          : SquareCol(from) == kStartingCol[color];
+      return not_moved && to == from + 2 * forward_step &&
+             mailbox[from + forward_step].Missing();
+    }
+    default:
+      return false;
+  }
+}
+
+// Square of the least valuable piece of `color` that attacks `square`, or -1.
+inline int LeastValuableAttacker(
+    const Piece* mailbox, PlayerColor color, int square) {
+  for (int j = 0; j < 2; ++j) {
+    const int target = square + kPawnAttackerSteps[color][j];
+    if (mailbox[target].GetRaw() == Piece::kRawPawn[color]) return target;
+  }
+
+  const Piece knight(color, KNIGHT);
+  const SquareList& knights = kKnightTargets[square];
+  for (int i = 0; i < knights.count; i++) {
+    if (mailbox[knights.squares[i]] == knight) return knights.squares[i];
+  }
+
+  int slider = -1;
+  PieceType slider_type = NO_PIECE;
+  for (int ray = 0; ray < 8; ray++) {
+    const int target = FirstOccupied(mailbox, square, ray);
+    if (target < 0) continue;
+    const Piece piece = mailbox[target];
+    const PieceType type = piece.GetPieceType();
+    if (piece.GetColor() == color && type < slider_type &&
+        IsSlider(piece, ray < kFirstOrthogonalRay ? BISHOP : ROOK)) {
+      slider = target;
+      slider_type = type;
+    }
+  }
+  if (slider >= 0) return slider;
+
+  const Piece king(color, KING);
+  for (const auto* targets : {&kKingDiagonalTargets[square], &kKingOrthogonalTargets[square]}) {
+    for (int i = 0; i < targets->count; i++) {
+      if (mailbox[targets->squares[i]] == king) return targets->squares[i];
+    }
+  }
+  return -1;
+}
+
+}  // namespace
+
+int Board::StaticExchange(const Move& move) {
+  const int to = ToSquare(move.ToRow(), move.ToCol());
+  const int from = ToSquare(move.FromRow(), move.FromCol());
+
+  // Pieces that took part are lifted off the mailbox so that the attackers
+  // behind them show up, and put back at the end.
+  constexpr int kMaxExchanges = 32;
+  int lifted[kMaxExchanges];
+  Piece lifted_pieces[kMaxExchanges];
+  int num_lifted = 0;
+  auto lift = [&](int square) {
+    lifted[num_lifted] = square;
+    lifted_pieces[num_lifted++] = mailbox_[square];
+    mailbox_[square] = Piece(Piece::kRawNoPiece);
+  };
+
+  int gain[kMaxExchanges];
+  gain[0] = kPieceEvaluations[move.GetCapturePiece().GetPieceType()];
+  int on_square = kPieceEvaluations[mailbox_[from].GetPieceType()];
+  PlayerColor color = mailbox_[from].GetColor();
+  lift(from);
+
+  // After a player captures, the next player and the one after the partner
+  // are the opponents that get a turn before the capturing team moves again.
+  int d = 0;
+  while (d + 1 < kMaxExchanges) {
+    int attacker = -1;
+    PlayerColor next = color;
+    for (int k : {1, 3}) {
+      next = static_cast<PlayerColor>((color + k) & 3);
+      attacker = LeastValuableAttacker(mailbox_, next, to);
+      if (attacker >= 0) break;
+    }
+    if (attacker < 0) break;
+    d++;
+    gain[d] = on_square - gain[d - 1];
+    on_square = kPieceEvaluations[mailbox_[attacker].GetPieceType()];
+    color = next;
+    lift(attacker);
+    if (std::max(-gain[d - 1], gain[d]) < 0) break;
+  }
+
+  while (num_lifted > 0) {
+    num_lifted--;
+    mailbox_[lifted[num_lifted]] = lifted_pieces[num_lifted];
+  }
+
+  // Each side may stop the exchange instead of recapturing.
+  for (; d > 0; d--) {
+    gain[d - 1] = -std::max(-gain[d - 1], gain[d]);
+  }
+  return gain[0];
+}
+
+std::pair<int8_t, int8_t> Board::GetAttacker(Team team, int8_t row, int8_t col) const {
+  const int square = ToSquare(row, col);
+
+  // Orthogonal (rook/queen) - 4 directions
+  for (int ray = kFirstOrthogonalRay; ray < kFirstOrthogonalRay + 4; ray++) {
+    const int target = FirstOccupied(mailbox_, square, ray);
+    if (target < 0) continue;
+    const Piece piece = mailbox_[target];
+    if (piece.GetTeam() == team && IsSlider(piece, ROOK)) return ToLocation(target);
+  }
+
+  // Diagonal (bishop/queen) - 4 directions
+  for (int ray = kFirstDiagonalRay; ray < kFirstDiagonalRay + 4; ray++) {
+    const int target = FirstOccupied(mailbox_, square, ray);
+    if (target < 0) continue;
+    const Piece piece = mailbox_[target];
+    if (piece.GetTeam() == team && IsSlider(piece, BISHOP)) return ToLocation(target);
+  }
+
+  // Check for knight attacks
+  const SquareList& knights = kKnightTargets[square];
+  for (int i = 0; i < knights.count; i++) {
+    const Piece piece = mailbox_[knights.squares[i]];
+    if (piece.Present() &&
+        piece.GetTeam() == team &&
+        piece.GetPieceType() == KNIGHT) {
+      return ToLocation(knights.squares[i]);
+    }
+  }
+
+  // Pawns of both colors of the team (Red/Yellow or Blue/Green)
+  for (int color = team; color < 4; color += 2) {
+      for (int j = 0; j < 2; ++j) {
+          const int target = square + kPawnAttackerSteps[color][j];
+          if (mailbox_[target].GetRaw() == Piece::kRawPawn[color])
+              return ToLocation(target);
       }
   }
 
@@ -201,188 +518,86 @@ std::pair<int8_t, int8_t> Board::GetAttacker(Team team, int8_t row, int8_t col)
 }
 
 std::pair<int8_t, int8_t> Board::GetAttackerForOneColor(PlayerColor color, int8_t row, int8_t col) const {
-  int loc_row = row;
-  int loc_col = col;
+  // Missing kings are passed in as (-1, -1).
+  if (row < 0) return {-1, -1};
+  const int square = ToSquare(row, col);
 
   // Orthogonal (rook/queen) - 4 directions
-  constexpr std::array<std::pair<int, int>, 4> orthogonal = {{
-      {0, 1}, {1, 0}, {0, -1}, {-1, 0}
-  }};
-  for (const auto& [dr, dc] : orthogonal) {
-      int row = loc_row + dr;
-      int col = loc_col + dc;
-      while (IsLegalLocation(row, col)) {
-          const auto piece = GetPiece(row, col);
-          if (piece.Present()) {
-              if (piece.GetColor() == color) {
-                  PieceType type = piece.GetPieceType();
-                  if (type == QUEEN || type == ROOK) return {row, col};
-              }
-              break;
-          }
-          row += dr;
-          col += dc;
-      }
+  for (int ray = kFirstOrthogonalRay; ray < kFirstOrthogonalRay + 4; ray++) {
+    const int target = FirstOccupied(mailbox_, square, ray);
+    if (target < 0) continue;
+    const Piece piece = mailbox_[target];
+    if (piece.GetColor() == color && IsSlider(piece, ROOK)) return ToLocation(target);
   }
 
   // Diagonal (bishop/queen) - 4 directions
-  constexpr std::array<std::pair<int, int>, 4> diagonal = {{
-      {1, 1}, {1, -1}, {-1, -1}, {-1, 1}
-  }};
-  for (const auto& [dr, dc] : diagonal) {
-      int row = loc_row + dr;
-      int col = loc_col + dc;
-      while (IsLegalLocation(row, col)) {
-          const auto piece = GetPiece(row, col);
-          if (piece.Present()) {
-              if (piece.GetColor() == color) {
-                  PieceType type = piece.GetPieceType();
-                  if (type == QUEEN || type == BISHOP) return {row, col};
-              }
-              break;
-          }
-          row += dr;
-          col += dc;
-      }
+  for (int ray = kFirstDiagonalRay; ray < kFirstDiagonalRay + 4; ray++) {
+    const int target = FirstOccupied(mailbox_, square, ray);
+    if (target < 0) continue;
+    const Piece piece = mailbox_[target];
+    if (piece.GetColor() == color && IsSlider(piece, BISHOP)) return ToLocation(target);
   }
 
   // Check for knight attacks
-  constexpr std::array<std::pair<int, int>, 8> knight_moves = {{
-    {1, 2}, {1, -2}, {-1, 2}, {-1, -2}, {2, 1}, {2, -1}, {-2, 1}, {-2, -1}
-  }};
-
-  for (const auto& [dr, dc] : knight_moves) {
-    int row = loc_row + dr;
-    int col = loc_col + dc;
-    if (IsLegalLocation(row, col)) {
-      const auto piece = GetPiece(row, col);
-      if (piece.Present() &&
-          piece.GetColor() == color &&
-          piece.GetPieceType() == KNIGHT) {
-        return {row, col};
-      }
+  const SquareList& knights = kKnightTargets[square];
+  for (int i = 0; i < knights.count; i++) {
+    const Piece piece = mailbox_[knights.squares[i]];
+    if (piece.Present() &&
+        piece.GetColor() == color &&
+        piece.GetPieceType() == KNIGHT) {
+      return ToLocation(knights.squares[i]);
     }
   }
 
-  // Combined pawn attack check - simplified
-  constexpr std::pair<int, int> pawn_attacks[4][2] = {
-      {{-1, -1}, {-1, 1}},   // Red attacks up-left, up-right
-      {{1, -1}, {1, 1}},     // Yellow attacks down-left, down-right
-      {{-1, 1}, {1, 1}},     // Blue attacks up-right, down-right
-      {{-1, -1}, {1, -1}}    // Green attacks up-left, down-left
-  };
-
   // Check only the specific color's pawns
   for (int j = 0; j < 2; ++j) {
-      const auto& [dr, dc] = pawn_attacks[color][j];
-      int row = loc_row + dr, col = loc_col + dc;
-      if (IsLegalLocation(row, col)) {
-          const auto piece = GetPiece(row, col);
-          if (piece.GetRaw() == Piece::kRawPawn[color])
-              return {row, col};
-      }
+      const int target = square + kPawnAttackerSteps[color][j];
+      if (mailbox_[target].GetRaw() == Piece::kRawPawn[color])
+          return ToLocation(target);
   }
 
   return {-1, -1};
 }
 
+// Same scan as GetAttacker in exactly the reverse order, so the two only
+// return the same square when there is a single attacker.
 std::pair<int8_t, int8_t> Board::GetRevAttacker(Team team, int8_t row, int8_t col) const {
-  int loc_row = row;
-  int loc_col = col;
+  const int square = ToSquare(row, col);
 
   // Pawn attacks (now first)
-  constexpr std::pair<int, int> pawn_attacks[4][2] = {
-      {{-1, -1}, {-1, 1}},   // Red
-      {{-1, 1}, {1, 1}},     // Blue
-      {{1, -1}, {1, 1}},     // Yellow
-      {{-1, -1}, {1, -1}}    // Green
-  };
-
-  if (team == RED_YELLOW) {
-      for (int color : {2, 0}) {  // Yellow first, then Red
-          for (int j = 1; j >= 0; --j) {  // reversed within each color
-              const auto& [dr, dc] = pawn_attacks[color][j];
-              int row = loc_row + dr, col = loc_col + dc;
-              if (IsLegalLocation(row, col)) {
-                  const auto piece = GetPiece(row, col);
-                  if (piece.GetRaw() == Piece::kRawPawn[color])
-                      return {row, col};
-              }
-          }
-      }
-  } else {
-      for (int color : {3, 1}) {  // Green first, then Blue
-          for (int j = 1; j >= 0; --j) {  // reversed within each color
-              const auto& [dr, dc] = pawn_attacks[color][j];
-              int row = loc_row + dr, col = loc_col + dc;
-              if (IsLegalLocation(row, col)) {
-                  const auto piece = GetPiece(row, col);
-                  if (piece.GetRaw() == Piece::kRawPawn[color])
-                      return {row, col};
-              }
-          }
+  for (int color = team + 2; color >= 0; color -= 2) {
+      for (int j = 1; j >= 0; --j) {  // reversed within each color
+          const int target = square + kPawnAttackerSteps[color][j];
+          if (mailbox_[target].GetRaw() == Piece::kRawPawn[color])
+              return ToLocation(target);
       }
   }
 
   // Knight moves (reversed)
-  constexpr std::array<std::pair<int, int>, 8> knight_moves = {{
-    {-2, -1}, {-2, 1}, {2, -1}, {2, 1},
-    {-1, -2}, {-1, 2}, {1, -2}, {1, 2}
-  }};
-
-  for (const auto& [dr, dc] : knight_moves) {
-    int row = loc_row + dr;
-    int col = loc_col + dc;
-    if (IsLegalLocation(row, col)) {
-      const auto piece = GetPiece(row, col);
-      if (piece.Present() &&
-          piece.GetTeam() == team &&
-          piece.GetPieceType() == KNIGHT) {
-        return {row, col};
-      }
+  const SquareList& knights = kKnightTargets[square];
+  for (int i = knights.count - 1; i >= 0; --i) {
+    const Piece piece = mailbox_[knights.squares[i]];
+    if (piece.Present() &&
+        piece.GetTeam() == team &&
+        piece.GetPieceType() == KNIGHT) {
+      return ToLocation(knights.squares[i]);
     }
   }
 
   // Diagonal (reversed)
-  constexpr std::array<std::pair<int, int>, 4> diagonal = {{
-      {-1, 1}, {-1, -1}, {1, -1}, {1, 1}
-  }};
-  for (const auto& [dr, dc] : diagonal) {
-      int row = loc_row + dr;
-      int col = loc_col + dc;
-      while (IsLegalLocation(row, col)) {
-          const auto piece = GetPiece(row, col);
-          if (piece.Present()) {
-              if (piece.GetTeam() == team) {
-                  PieceType type = piece.GetPieceType();
-                  if (type == QUEEN || type == BISHOP) return {row, col};
-              }
-              break;
-          }
-          row += dr;
-          col += dc;
-      }
+  for (int ray = kFirstDiagonalRay + 3; ray >= kFirstDiagonalRay; ray--) {
+    const int target = FirstOccupied(mailbox_, square, ray);
+    if (target < 0) continue;
+    const Piece piece = mailbox_[target];
+    if (piece.GetTeam() == team && IsSlider(piece, BISHOP)) return ToLocation(target);
   }
 
   // Orthogonal (reversed, now last)
-  constexpr std::array<std::pair<int, int>, 4> orthogonal = {{
-      {-1, 0}, {0, -1}, {1, 0}, {0, 1}
-  }};
-  for (const auto& [dr, dc] : orthogonal) {
-      int row = loc_row + dr;
-      int col = loc_col + dc;
-      while (IsLegalLocation(row, col)) {
-          const auto piece = GetPiece(row, col);
-          if (piece.Present()) {
-              if (piece.GetTeam() == team) {
-                  PieceType type = piece.GetPieceType();
-                  if (type == QUEEN || type == ROOK) return {row, col};
-              }
-              break;
-          }
-          row += dr;
-          col += dc;
-      }
+  for (int ray = kFirstOrthogonalRay + 3; ray >= kFirstOrthogonalRay; ray--) {
+    const int target = FirstOccupied(mailbox_, square, ray);
+    if (target < 0) continue;
+    const Piece piece = mailbox_[target];
+    if (piece.GetTeam() == team && IsSlider(piece, ROOK)) return ToLocation(target);
   }
 
   return {-1, -1};
@@ -390,100 +605,40 @@ std::pair<int8_t, int8_t> Board::GetRevAttacker(Team team, int8_t row, int8_t co
 
 // Optimized version of GetAttackers2 for limit=1 that returns as soon as it finds an attacker
 bool Board::IsAttackedByTeam(Team team, int8_t loc_row, int8_t loc_col) const {
+  const int square = ToSquare(loc_row, loc_col);
 
-// Orthogonal (rook/queen) - 4 directions
-constexpr std::array<std::pair<int8_t, int8_t>, 4> orthogonal = {{
-    {0, 1}, {1, 0}, {0, -1}, {-1, 0}
-}};
-for (const auto& [dr, dc] : orthogonal) {
-    int8_t row = loc_row + dr;
-    int8_t col = loc_col + dc;
-    while (IsLegalLocation(row, col)) {
-        const auto piece = GetPiece(row, col);
-        if (piece.Present()) {
-            if (piece.GetTeam() == team) {
-                PieceType type = piece.GetPieceType();
-                if (type == QUEEN || type == ROOK) return true;
-            }
-            break;
-        }
-        row += dr;
-        col += dc;
-    }
-}
-
-// Diagonal (bishop/queen) - 4 directions  
-constexpr std::array<std::pair<int8_t, int8_t>, 4> diagonal = {{
-    {1, 1}, {1, -1}, {-1, -1}, {-1, 1}
-}};
-for (const auto& [dr, dc] : diagonal) {
-    int8_t row = loc_row + dr;
-    int8_t col = loc_col + dc;
-    while (IsLegalLocation(row, col)) {
-        const auto piece = GetPiece(row, col);
-        if (piece.Present()) {
-            if (piece.GetTeam() == team) {
-                PieceType type = piece.GetPieceType();
-                if (type == QUEEN || type == BISHOP) return true;
-            }
-            break;
-        }
-        row += dr;
-        col += dc;
-    }
-}
+  // Orthogonal (rook/queen) - 4 directions
+  for (int ray = kFirstOrthogonalRay; ray < kFirstOrthogonalRay + 4; ray++) {
+    const int target = FirstOccupied(mailbox_, square, ray);
+    if (target < 0) continue;
+    const Piece piece = mailbox_[target];
+    if (piece.GetTeam() == team && IsSlider(piece, ROOK)) return true;
+  }
+
+  // Diagonal (bishop/queen) - 4 directions
+  for (int ray = kFirstDiagonalRay; ray < kFirstDiagonalRay + 4; ray++) {
+    const int target = FirstOccupied(mailbox_, square, ray);
+    if (target < 0) continue;
+    const Piece piece = mailbox_[target];
+    if (piece.GetTeam() == team && IsSlider(piece, BISHOP)) return true;
+  }
 
   // Check for knight attacks
-  constexpr std::array<std::pair<int8_t, int8_t>, 8> knight_moves = {{
-    {1, 2}, {1, -2}, {-1, 2}, {-1, -2}, {2, 1}, {2, -1}, {-2, 1}, {-2, -1}
-  }};
-
-  for (const auto& [dr, dc] : knight_moves) {
-    int8_t row = loc_row + dr;
-    int8_t col = loc_col + dc;
-    if (IsLegalLocation(row, col)) {
-      const auto piece = GetPiece(row, col);
-      if (piece.Present() && 
-          piece.GetTeam() == team && 
-          piece.GetPieceType() == KNIGHT) {
-        return true;
-      }
+  const SquareList& knights = kKnightTargets[square];
+  for (int i = 0; i < knights.count; i++) {
+    const Piece piece = mailbox_[knights.squares[i]];
+    if (piece.Present() &&
+        piece.GetTeam() == team &&
+        piece.GetPieceType() == KNIGHT) {
+      return true;
     }
   }
 
-  // Combined pawn attack check - simplified
-  constexpr std::pair<int8_t, int8_t> pawn_attacks[4][2] = {
-      {{-1, -1}, {-1, 1}},   // Red attacks up-left, up-right
-      {{1, -1}, {1, 1}},     // Yellow attacks down-left, down-right  
-      {{-1, 1}, {1, 1}},     // Blue attacks up-right, down-right
-      {{-1, -1}, {1, -1}}    // Green attacks up-left, down-left
-  };
-
-  if (team == RED_YELLOW) {
-      // Check Red (color 0) and Yellow (color 2) pawns only
-      for (int color : {0, 2}) {
-          for (int j = 0; j < 2; ++j) {
-              const auto& [dr, dc] = pawn_attacks[color][j];
-              int8_t row = loc_row + dr, col = loc_col + dc;
-              if (IsLegalLocation(row, col)) {
-                  const auto piece = GetPiece(row, col);
-                  if (piece.GetRaw() == Piece::kRawPawn[color])
-                      return true;
-              }
-          }
-      }
-  } else {
-      // Check Blue (color 1) and Green (color 3) pawns only
-      for (int color : {1, 3}) {
-          for (int j = 0; j < 2; ++j) {
-              const auto& [dr, dc] = pawn_attacks[color][j];
-              int8_t row = loc_row + dr, col = loc_col + dc;
-              if (IsLegalLocation(row, col)) {
-                  const auto piece = GetPiece(row, col);
-                  if (piece.GetRaw() == Piece::kRawPawn[color])
-                      return true;
-              }
-          }
+  // Pawns of both colors of the team (Red/Yellow or Blue/Green)
+  for (int color = team; color < 4; color += 2) {
+      for (int j = 0; j < 2; ++j) {
+          if (mailbox_[square + kPawnAttackerSteps[color][j]].GetRaw() == Piece::kRawPawn[color])
+              return true;
       }
   }
 
@@ -534,1554 +689,437 @@ Board::KingCaptureInfo Board::CanCaptureKing() const {
     return {-1, -1, -1, -1, NO_PIECE};
 }
 
-Board::MoveGenResult Board::GetPseudoLegalMoves2(
-    Move* buffer,
-    size_t limit,
-    const std::vector<PlacedPiece>& pieces,
-    const std::optional<Move>& pv_move) {
-
-    MoveGenResult result{0, -1};
-
-    if (buffer == nullptr && limit == 0) {
-      for (int i = 0; i < 4; ++i) {
-          result.mobility_counts[i] = 20;  // Each player has 20 legal moves initially
-          result.threat_counts[i] = 0;     // No immediate threats in starting position
+// Emits the moves of the piece on `from` for a side that is not in check.
+// CAPTURES keeps standard and en passant captures, QUIETS everything else
+// (including promotions and castling); both together are ALL_MOVES, in the
+// same order.
+template <Board::MoveGenType kGen>
+Move* Board::AddPieceMoves(Move* current, int from) const {
+  const PlayerColor current_color = GetTurn().GetColor();
+  const Team my_team = GetTeam(current_color);
+  const int8_t from_row = SquareRow(from);
+  const int8_t from_col = SquareCol(from);
+  const PieceType type = mailbox_[from].GetPieceType();
+
+  switch (type) {
+    case QUEEN:   {
+      for (int ray = kFirstDiagonalRay; ray < kFirstDiagonalRay + 4; ray++) {
+        current = AddSliderMoves<kGen>(mailbox_, from_row, from_col, from, ray, my_team, current);
       }
-      return result;
-    }
-
-    if (buffer == nullptr || limit == 0) return result;
-
-    //auto pstart = std::chrono::high_resolution_clock::now();
-
-    const PlayerColor current_color = GetTurn().GetColor();
-    const Team my_team = GetTeam(current_color);
-
-    const int8_t king_row = GetKingRow(current_color);
-    const int8_t king_col = GetKingCol(current_color);
-
-    if (!KingPresent(current_color)) {
-      return result;
-    }
-
-    auto attacker = GetAttacker(OtherTeam(my_team), king_row, king_col);
-
-    bool has_pv_move = pv_move.has_value();
-    int pv_index = -1;  // -1 means PV move not found
-    const bool in_check = KingPresent(current_color) && attacker.first != -1;
-    const auto attacking_piece = in_check ? location_to_piece_[attacker.first][attacker.second] : Piece(Piece::kRawNoPiece);
-    const PieceType att_type = attacking_piece.GetPieceType();
-
-    // Check for double check using reversed search
-    bool double_check = false;
-    if (in_check) {
-        auto second_attacker = GetRevAttacker(OtherTeam(my_team), king_row, king_col);
-        double_check = second_attacker.first != -1 && (second_attacker.first != attacker.first || second_attacker.second != attacker.second);
-    }
-
-    Move* current = buffer;
-
-    int threats = 0;
-
-    // Consolidated direction data for pawn movement and captures
-    // Indexed by PlayerColor (RED=0, BLUE=1, YELLOW=2, GREEN=3)
-    struct PawnDirectionData {
-      int8_t delta_row;         // Row delta for forward movement
-      int8_t delta_col;         // Column delta for forward movement
-      int8_t capture1_row;      // Row delta for first capture direction
-      int8_t capture1_col;      // Column delta for first capture direction
-      int8_t capture2_row;      // Row delta for second capture direction
-      int8_t capture2_col;      // Column delta for second capture direction
-    };
-    
-    static constexpr PawnDirectionData kPawnDirections[4] = {
-      // y direction 0 top, 13 bottom
-      // all colors capture to the left (first capture)
-      // RED: moves up, captures up-left and up-right
-      {-1, 0, -1, -1, -1, 1},
-      // BLUE: moves right, captures up-right and down-right
-      {0, 1, -1, 1, 1, 1},
-      // YELLOW: moves down, captures down-left and down-right
-      {1, 0, 1, 1, 1, -1},
-      // GREEN: moves left, captures down-left and up-left
-      {0, -1, 1, -1, -1, -1}
-    };
-
-    static constexpr int8_t kStartingRow[4] = {12, -1, 1, -1};  // RED, BLUE, YELLOW, GREEN
-    static constexpr int8_t kStartingCol[4] = {-1, 1, -1, 12};  // -1 means not used
-    static constexpr int8_t kPromotionRow[4] = {0, -1, 13, -1};   // RED, BLUE, YELLOW, GREEN
-    static constexpr int8_t kPromotionCol[4] = {-1, 13, -1, 0};   // -1 means not used
-
-    for (const auto& placed_piece : piece_list_[current_color]) {
-      const int8_t from_row = placed_piece.GetRow();
-      const int8_t from_col = placed_piece.GetCol();
-        const auto& piece = location_to_piece_[from_row][from_col];
-        const PieceType type = piece.GetPieceType();
-
-        if (double_check && type != KING) [[unlikely]] continue;
-        
-        size_t before_count = current - buffer;
-
-        if (!in_check) [[likely]] {
-        // Generate moves for this piece
-        switch (type) {
-            case QUEEN:   {
-              {
-                int8_t r = from_row + 1;
-                int8_t c = from_col + 1;
-                while (true) {
-                  if (!IsLegalLocation(r, c)) break;
-                  const Piece captured = location_to_piece_[r][c];
-                  if (captured.Present()) {
-                    if (captured.GetTeam() != my_team) {
-                      new (current++) Move(from_row, from_col, r, c, captured.GetRaw());
-                      threats += 16;
-                    }
-                    threats += 4;
-                    break;
-                  }
-                  new (current++) Move(from_row, from_col, r, c, 0);
-                  threats++;
-                  r++;
-                  c++;
-                }
-              }
-              
-              // Direction 2: Down-Left (1, -1)
-              {
-                int8_t r = from_row + 1;
-                int8_t c = from_col - 1;
-                while (true) {
-                  if (!IsLegalLocation(r, c)) break;
-                  const Piece captured = location_to_piece_[r][c];
-                  if (captured.Present()) {
-                    if (captured.GetTeam() != my_team) {
-                      new (current++) Move(from_row, from_col, r, c, captured.GetRaw());
-                      threats += 16;
-                    }
-                    threats += 4;
-                    break;
-                  }
-                  new (current++) Move(from_row, from_col, r, c, 0);
-                  threats++;
-                  r++;
-                  c--;
-                }
-              }
-              
-              // Direction 3: Up-Right (-1, 1)
-              {
-                int8_t r = from_row - 1;
-                int8_t c = from_col + 1;
-                while (true) {
-                  if (!IsLegalLocation(r, c)) break;
-                  const Piece captured = location_to_piece_[r][c];
-                  if (captured.Present()) {
-                    if (captured.GetTeam() != my_team) {
-                      new (current++) Move(from_row, from_col, r, c, captured.GetRaw());
-                      threats += 16;
-                    }
-                    threats += 4;
-                    break;
-                  }
-                  new (current++) Move(from_row, from_col, r, c, 0);
-                  threats++;
-                  r--;
-                  c++;
-                }
-              }
-              
-              // Direction 4: Up-Left (-1, -1)
-              {
-                int8_t r = from_row - 1;
-                int8_t c = from_col - 1;
-                while (true) {
-                  if (!IsLegalLocation(r, c)) break;
-                  const Piece captured = location_to_piece_[r][c];
-                  if (captured.Present()) {
-                    if (captured.GetTeam() != my_team) {
-                      new (current++) Move(from_row, from_col, r, c, captured.GetRaw());
-                      threats += 16;
-                    }
-                    threats += 4;
-                    break;
-                  }
-                  new (current++) Move(from_row, from_col, r, c, 0);
-                  threats++;
-                  r--;
-                  c--;
-                }
-              }
-
-              // Direction 1: Right (0, 1)
-              {
-                  int8_t c = from_col + 1;
-                  while (true) {
-                      if (!IsLegalLocation(from_row, c)) break;
-                      const Piece captured = location_to_piece_[from_row][c];
-                      if (captured.Present()) {
-                          if (captured.GetTeam() != my_team) {
-                              new (current++) Move(from_row, from_col, from_row, c, captured.GetRaw());
-                              threats += 16;
-                          }
-                          threats += 4;
-                          break;
-                      }
-                      new (current++) Move(from_row, from_col, from_row, c, 0);
-                      threats++;
-                      c++;
-                  }
-              }
-
-              // Direction 2: Left (0, -1)
-              {
-                  int8_t c = from_col - 1;
-                  while (true) {
-                      if (!IsLegalLocation(from_row, c)) break;
-                      const Piece captured = location_to_piece_[from_row][c];
-                      if (captured.Present()) {
-                          if (captured.GetTeam() != my_team) {
-                              new (current++) Move(from_row, from_col, from_row, c, captured.GetRaw());
-                              threats += 16;
-                          }
-                          threats += 4;
-                          break;
-                      }
-                      new (current++) Move(from_row, from_col, from_row, c, 0);
-                      threats++;
-                      c--;
-                  }
-              }
-
-              // Direction 3: Down (1, 0)
-              {
-                  int8_t r = from_row + 1;
-                  while (true) {
-                      if (!IsLegalLocation(r, from_col)) break;
-                      const Piece captured = location_to_piece_[r][from_col];
-                      if (captured.Present()) {
-                          if (captured.GetTeam() != my_team) {
-                              new (current++) Move(from_row, from_col, r, from_col, captured.GetRaw());
-                              threats += 16;
-                          }
-                          threats += 4;
-                          break;
-                      }
-                      new (current++) Move(from_row, from_col, r, from_col, 0);
-                      threats++;
-                      r++;
-                  }
-              }
-
-              // Direction 4: Up (-1, 0)
-              {
-                  int8_t r = from_row - 1;
-                  while (true) {
-                      if (!IsLegalLocation(r, from_col)) break;
-                      const Piece captured = location_to_piece_[r][from_col];
-                      if (captured.Present()) {
-                          if (captured.GetTeam() != my_team) {
-                              new (current++) Move(from_row, from_col, r, from_col, captured.GetRaw());
-                              threats += 16;
-                          }
-                          threats += 4;
-                          break;
-                      }
-                      new (current++) Move(from_row, from_col, r, from_col, 0);
-                      threats++;
-                      r--;
-                  }
-              }
-            } break;
-            case ROOK: {
-              // Direction 1: Right (0, 1)
-              {
-                  int8_t c = from_col + 1;
-                  while (true) {
-                      if (!IsLegalLocation(from_row, c)) break;
-                      const Piece captured = location_to_piece_[from_row][c];
-                      if (captured.Present()) {
-                          if (captured.GetTeam() != my_team) {
-                              new (current++) Move(from_row, from_col, from_row, c, captured.GetRaw());
-                              threats += 16;
-                          }
-                          threats += 4;
-                          break;
-                      }
-                      new (current++) Move(from_row, from_col, from_row, c, 0);
-                      threats++;
-                      c++;
-                  }
-              }
-
-              // Direction 2: Left (0, -1)
-              {
-                  int8_t c = from_col - 1;
-                  while (true) {
-                      if (!IsLegalLocation(from_row, c)) break;
-                      const Piece captured = location_to_piece_[from_row][c];
-                      if (captured.Present()) {
-                          if (captured.GetTeam() != my_team) {
-                              new (current++) Move(from_row, from_col, from_row, c, captured.GetRaw());
-                              threats += 16;
-                          }
-                          threats += 4;
-                          break;
-                      }
-                      new (current++) Move(from_row, from_col, from_row, c, 0);
-                      threats++;
-                      c--;
-                  }
-              }
-
-              // Direction 3: Down (1, 0)
-              {
-                  int8_t r = from_row + 1;
-                  while (true) {
-                      if (!IsLegalLocation(r, from_col)) break;
-                      const Piece captured = location_to_piece_[r][from_col];
-                      if (captured.Present()) {
-                          if (captured.GetTeam() != my_team) {
-                              new (current++) Move(from_row, from_col, r, from_col, captured.GetRaw());
-                              threats += 16;
-                          }
-                          threats += 4;
-                          break;
-                      }
-                      new (current++) Move(from_row, from_col, r, from_col, 0);
-                      threats++;
-                      r++;
-                  }
-              }
-
-              // Direction 4: Up (-1, 0)
-              {
-                  int8_t r = from_row - 1;
-                  while (true) {
-                      if (!IsLegalLocation(r, from_col)) break;
-                      const Piece captured = location_to_piece_[r][from_col];
-                      if (captured.Present()) {
-                          if (captured.GetTeam() != my_team) {
-                              new (current++) Move(from_row, from_col, r, from_col, captured.GetRaw());
-                              threats += 16;
-                          }
-                          threats += 4;
-                          break;
-                      }
-                      new (current++) Move(from_row, from_col, r, from_col, 0);
-                      threats++;
-                      r--;
-                  }
-              }
-            } break;
-            case BISHOP: { 
-              // Direction 1: Down-Right (1, 1)
-              {
-                int8_t r = from_row + 1;
-                int8_t c = from_col + 1;
-                while (true) {
-                  if (!IsLegalLocation(r, c)) break;
-                  const Piece captured = location_to_piece_[r][c];
-                  if (captured.Present()) {
-                    if (captured.GetTeam() != my_team) {
-                      new (current++) Move(from_row, from_col, r, c, captured.GetRaw());
-                      threats += 16;
-                    }
-                    threats += 4;
-                    break;
-                  }
-                  new (current++) Move(from_row, from_col, r, c, 0);
-                  threats++;
-                  r++;
-                  c++;
-                }
-              }
-              
-              // Direction 2: Down-Left (1, -1)
-              {
-                int8_t r = from_row + 1;
-                int8_t c = from_col - 1;
-                while (true) {
-                  if (!IsLegalLocation(r, c)) break;
-                  const Piece captured = location_to_piece_[r][c];
-                  if (captured.Present()) {
-                    if (captured.GetTeam() != my_team) {
-                      new (current++) Move(from_row, from_col, r, c, captured.GetRaw());
-                      threats += 16;
-                    }
-                    threats += 4;
-                    break;
-                  }
-                  new (current++) Move(from_row, from_col, r, c, 0);
-                  threats++;
-                  r++;
-                  c--;
-                }
-              }
-              
-              // Direction 3: Up-Right (-1, 1)
-              {
-                int8_t r = from_row - 1;
-                int8_t c = from_col + 1;
-                while (true) {
-                  if (!IsLegalLocation(r, c)) break;
-                  const Piece captured = location_to_piece_[r][c];
-                  if (captured.Present()) {
-                    if (captured.GetTeam() != my_team) {
-                      new (current++) Move(from_row, from_col, r, c, captured.GetRaw());
-                      threats += 16;
-                    }
-                    threats += 4;
-                    break;
-                  }
-                  new (current++) Move(from_row, from_col, r, c, 0);
-                  threats++;
-                  r--;
-                  c++;
-                }
-              }
-              
-              // Direction 4: Up-Left (-1, -1)
-              {
-                int8_t r = from_row - 1;
-                int8_t c = from_col - 1;
-                while (true) {
-                  if (!IsLegalLocation(r, c)) break;
-                  const Piece captured = location_to_piece_[r][c];
-                  if (captured.Present()) {
-                    if (captured.GetTeam() != my_team) {
-                      new (current++) Move(from_row, from_col, r, c, captured.GetRaw());
-                      threats += 16;
-                    }
-                    threats += 4;
-                    break;
-                  }
-                  new (current++) Move(from_row, from_col, r, c, 0);
-                  threats++;
-                  r--;
-                  c--;
-                }
-              }
-            } break;
-            case PAWN: {
-              // Get direction data for current color
-              const PawnDirectionData& dir = kPawnDirections[static_cast<int>(current_color)];
-              const int8_t delta_row = dir.delta_row;
-              const int8_t delta_col = dir.delta_col;
-              
-              
-              // Precompute all possible target squares
-              const int8_t forward_row = from_row + delta_row;
-              const int8_t forward_col = from_col + delta_col;
-              const bool is_forward_legal = IsLegalLocation(forward_row, forward_col);
-
-              // Cache piece lookup only if the location is legal
-              const Piece forward_piece = is_forward_legal ? 
-                  location_to_piece_[forward_row][forward_col] : Piece::kNoPiece;
-
-              // Precompute capture squares and cache their pieces
-              const int8_t capture1_row = from_row + dir.capture1_row;
-              const int8_t capture1_col = from_col + dir.capture1_col;
-              const bool is_capture1_legal = IsLegalLocation(capture1_row, capture1_col);
-              const Piece capture1_piece = is_capture1_legal ? 
-                  location_to_piece_[capture1_row][capture1_col] : Piece::kNoPiece;
-
-              const int8_t capture2_row = from_row + dir.capture2_row;
-              const int8_t capture2_col = from_col + dir.capture2_col;
-              const bool is_capture2_legal = IsLegalLocation(capture2_row, capture2_col);
-              const Piece capture2_piece = is_capture2_legal ? 
-                  location_to_piece_[capture2_row][capture2_col] : Piece::kNoPiece;
-
-              // Later in the code:
-              bool not_moved = (current_color == RED || current_color == YELLOW) 
-                  ? (from_row == kStartingRow[static_cast<int>(current_color)])
-                  : (from_col == kStartingCol[static_cast<int>(current_color)]);
-              
-              // Promotion detection: each color promotes on different edges
-              const bool is_promotion = (current_color == RED || current_color == YELLOW) 
-                  ? (forward_row == kPromotionRow[static_cast<int>(current_color)])
-                  : (forward_col == kPromotionCol[static_cast<int>(current_color)]);
-                
-              if (!forward_piece.Present()) [[likely]] {
-                // Handle promotion or regular move
-                if (is_promotion) [[unlikely]] {
-                  new (current++) Move(from_row, from_col, forward_row, forward_col, 0, QUEEN);
-                } else {
-                  //*current++ = Move(from, forward1);
-                  new (current++) Move(from_row, from_col, forward_row, forward_col, 0);
-                }
-                
-                // Double step from starting position
-                if (not_moved) {
-                  const int8_t forward2_row = from_row + delta_row * 2;
-                  const int8_t forward2_col = from_col + delta_col * 2;
-                  
-                  // Only check the double move if the single move square was empty
-                  const Piece forward2_piece = location_to_piece_[forward2_row][forward2_col];
-                  if (!forward2_piece.Present()) {
-                    //*current++ = Move(from, forward2);
-                    new (current++) Move(from_row, from_col, forward2_row, forward2_col, 0);
-                  }
-                }
-              }
-              
-              // First capture direction
-              if (is_capture1_legal) {
-                
-                // En passant double capture check using lookup tables
-                static constexpr int8_t kEpEdgeValue[4] = {3, 3, 10, 10};  // RED, BLUE, YELLOW, GREEN
-                static constexpr PlayerColor kEpEnemyColor[4] = {BLUE, YELLOW, GREEN, RED};
-                const bool is_ep_capture = !capture1_piece.Present() &&
-                    ((current_color & 1) == 0 ? from_col : from_row) == kEpEdgeValue[current_color] &&
-                    ((current_color & 1) == 0 ? en_passant_targets_[kEpEnemyColor[current_color]].row
-                                              : en_passant_targets_[kEpEnemyColor[current_color]].col) ==
-                        ((current_color & 1) == 0 ? capture1_row : capture1_col);
-                if (is_ep_capture) {
-                  new (current++) Move(from_row, from_col, capture1_row, capture1_col, forward_row, forward_col, forward_piece.GetRaw());
-                } else {
-                  // Regular capture - use cached piece
-                  if (capture1_piece.Present() && capture1_piece.GetTeam() != my_team) {
-                    //Handle promotion on capture or regular capture
-                    if (is_promotion) [[unlikely]] {
-                      new (current++) Move(from_row, from_col, capture1_row, capture1_col, capture1_piece.GetRaw(), QUEEN);
-                    } else {
-                      //*current++ = Move(from, capture1_loc, captured1);
-                      new (current++) Move(from_row, from_col, capture1_row, capture1_col, capture1_piece.GetRaw());
-                    }
-                  }
-                }
-              }
-
-              // Second capture direction
-              if (is_capture2_legal) {
-
-                // En passant double capture check using lookup tables (reversed edge values and enemy colors)
-                static constexpr int8_t kEpEdgeValue2[4] = {10, 10, 3, 3};  // RED, BLUE, YELLOW, GREEN
-                static constexpr PlayerColor kEpEnemyColor2[4] = {GREEN, RED, BLUE, YELLOW};
-                const bool is_ep_capture2 = !capture2_piece.Present() &&
-                    ((current_color & 1) == 0 ? from_col : from_row) == kEpEdgeValue2[current_color] &&
-                    ((current_color & 1) == 0 ? en_passant_targets_[kEpEnemyColor2[current_color]].row
-                                              : en_passant_targets_[kEpEnemyColor2[current_color]].col) ==
-                        ((current_color & 1) == 0 ? capture2_row : capture2_col);
-                if (is_ep_capture2) {
-                  new (current++) Move(from_row, from_col, capture2_row, capture2_col, forward_row, forward_col, forward_piece.GetRaw());
-                } else {
-                  // Regular capture - use cached piece
-                  if (capture2_piece.Present() && capture2_piece.GetTeam() != my_team) {
-                    // Handle promotion on capture or regular capture
-                    if (is_promotion) [[unlikely]] {
-                      new (current++) Move(from_row, from_col, capture2_row, capture2_col, capture2_piece.GetRaw(), QUEEN);
-                    } else {
-                      //*current++ = Move(from, to2, captured2);
-                      new (current++) Move(from_row, from_col, capture2_row, capture2_col, capture2_piece.GetRaw());
-                    }
-                  }
-                }
-              }
-            } break;
-            case KNIGHT: { 
-              // (+2, +1)
-              if (IsLegalLocation(from_row + 2, from_col + 1)) {
-                  const Piece p = location_to_piece_[from_row + 2][from_col + 1];
-                  if (p.Present()) {
-                      if (p.GetTeam() != my_team) {
-                          new (current++) Move(from_row, from_col, from_row + 2, from_col + 1, p.GetRaw());
-                          threats += 16;
-                      }
-                      threats += 1;
-                  } else {
-                      new (current++) Move(from_row, from_col, from_row + 2, from_col + 1, 0);
-                  }
-              }
-              // (+2, -1)
-              if (IsLegalLocation(from_row + 2, from_col - 1)) {
-                  const Piece p = location_to_piece_[from_row + 2][from_col - 1];
-                  if (p.Present()) {
-                      if (p.GetTeam() != my_team) {
-                          new (current++) Move(from_row, from_col, from_row + 2, from_col - 1, p.GetRaw());
-                          threats += 16;
-                      }
-                      threats += 1;
-                  } else {
-                      new (current++) Move(from_row, from_col, from_row + 2, from_col - 1, 0);
-                  }
-              }
-              // (-2, +1)
-              if (IsLegalLocation(from_row - 2, from_col + 1)) {
-                  const Piece p = location_to_piece_[from_row - 2][from_col + 1];
-                  if (p.Present()) {
-                      if (p.GetTeam() != my_team) {
-                          new (current++) Move(from_row, from_col, from_row - 2, from_col + 1, p.GetRaw());
-                          threats += 16;
-                      }
-                      threats += 1;
-                  } else {
-                      new (current++) Move(from_row, from_col, from_row - 2, from_col + 1, 0);
-                  }
-              }
-              // (-2, -1)
-              if (IsLegalLocation(from_row - 2, from_col - 1)) {
-                  const Piece p = location_to_piece_[from_row - 2][from_col - 1];
-                  if (p.Present()) {
-                      if (p.GetTeam() != my_team) {
-                          new (current++) Move(from_row, from_col, from_row - 2, from_col - 1, p.GetRaw());
-                          threats += 16;
-                      }
-                      threats += 1;
-                  } else {
-                      new (current++) Move(from_row, from_col, from_row - 2, from_col - 1, 0);
-                  }
-              }
-              // (+1, +2)
-              if (IsLegalLocation(from_row + 1, from_col + 2)) {
-                  const Piece p = location_to_piece_[from_row + 1][from_col + 2];
-                  if (p.Present()) {
-                      if (p.GetTeam() != my_team) {
-                          new (current++) Move(from_row, from_col, from_row + 1, from_col + 2, p.GetRaw());
-                          threats += 16;
-                      }
-                      threats += 1;
-                  } else {
-                      new (current++) Move(from_row, from_col, from_row + 1, from_col + 2, 0);
-                  }
-              }
-              // (+1, -2)
-              if (IsLegalLocation(from_row + 1, from_col - 2)) {
-                  const Piece p = location_to_piece_[from_row + 1][from_col - 2];
-                  if (p.Present()) {
-                      if (p.GetTeam() != my_team) {
-                          new (current++) Move(from_row, from_col, from_row + 1, from_col - 2, p.GetRaw());
-                          threats += 16;
-                      }
-                      threats += 1;
-                  } else {
-                      new (current++) Move(from_row, from_col, from_row + 1, from_col - 2, 0);
-                  }
-              }
-              // (-1, +2)
-              if (IsLegalLocation(from_row - 1, from_col + 2)) {
-                  const Piece p = location_to_piece_[from_row - 1][from_col + 2];
-                  if (p.Present()) {
-                      if (p.GetTeam() != my_team) {
-                          new (current++) Move(from_row, from_col, from_row - 1, from_col + 2, p.GetRaw());
-                          threats += 16;
-                      }
-                      threats += 1;
-                  } else {
-                      new (current++) Move(from_row, from_col, from_row - 1, from_col + 2, 0);
-                  }
-              }
-              // (-1, -2)
-              if (IsLegalLocation(from_row - 1, from_col - 2)) {
-                  const Piece p = location_to_piece_[from_row - 1][from_col - 2];
-                  if (p.Present()) {
-                      if (p.GetTeam() != my_team) {
-                          new (current++) Move(from_row, from_col, from_row - 1, from_col - 2, p.GetRaw());
-                          threats += 16;
-                      }
-                      threats += 1;
-                  } else {
-                      new (current++) Move(from_row, from_col, from_row - 1, from_col - 2, 0);
-                  }
-              }
-  
-            } break;
-            case KING: {
-               //current = GetKingMovesNoCheck(current, location, current_color, my_team);
-  const Team enemy_team = OtherTeam(my_team);
-  
-  const CastlingRights& castling_rights = castling_rights_[current_color];
-
-    // up-left
-    if (IsLegalLocation(from_row - 1, from_col - 1)) {
-      //if (!IsAttackedByTeam(enemy_team, {row - 1, col - 1})) {
-        const Piece captured = location_to_piece_[from_row - 1][from_col - 1];
-        if (captured.Missing() || captured.GetTeam() != my_team) {
-            //*current++ = Move(from, {row - 1, col - 1}, captured, castling_rights);
-            new (current++) Move(from_row, from_col, from_row -1, from_col - 1, captured.GetRaw(), castling_rights);
+      for (int ray = kFirstOrthogonalRay; ray < kFirstOrthogonalRay + 4; ray++) {
+        current = AddSliderMoves<kGen>(mailbox_, from_row, from_col, from, ray, my_team, current);
+      }
+    } break;
+    case ROOK: {
+      for (int ray = kFirstOrthogonalRay; ray < kFirstOrthogonalRay + 4; ray++) {
+        current = AddSliderMoves<kGen>(mailbox_, from_row, from_col, from, ray, my_team, current);
+      }
+    } break;
+    case BISHOP: { 
+      for (int ray = kFirstDiagonalRay; ray < kFirstDiagonalRay + 4; ray++) {
+        current = AddSliderMoves<kGen>(mailbox_, from_row, from_col, from, ray, my_team, current);
+      }
+    } break;
+    case PAWN: {
+      // Get direction data for current color
+      const PawnDirectionData& dir = kPawnDirections[static_cast<int>(current_color)];
+      const int8_t delta_row = dir.delta_row;
+      const int8_t delta_col = dir.delta_col;
+      const int forward_step = delta_row * kMailboxWidth + delta_col;
+
+
+      // Precompute all possible target squares
+      const int8_t forward_row = from_row + delta_row;
+      const int8_t forward_col = from_col + delta_col;
+      const Piece forward_piece = mailbox_[from + forward_step];
+
+      // Precompute capture squares and cache their pieces
+      const int8_t capture1_row = from_row + dir.capture1_row;
+      const int8_t capture1_col = from_col + dir.capture1_col;
+      const Piece capture1_piece = mailbox_[ToSquare(capture1_row, capture1_col)];
+
+      const int8_t capture2_row = from_row + dir.capture2_row;
+      const int8_t capture2_col = from_col + dir.capture2_col;
+      const Piece capture2_piece = mailbox_[ToSquare(capture2_row, capture2_col)];
+
+      // Later in the code:
+      bool not_moved = (current_color == RED || current_color == YELLOW) 
+          ? (from_row == kStartingRow[static_cast<int>(current_color)])
+          : (from_col == kStartingCol[static_cast<int>(current_color)]);
+
+      // Promotion detection: each color promotes on different edges
+      const bool is_promotion = (current_color == RED || current_color == YELLOW) 
+          ? (forward_row == kPromotionRow[static_cast<int>(current_color)])
+          : (forward_col == kPromotionCol[static_cast<int>(current_color)]);
+
+      if (kGen != CAPTURES && !forward_piece.Present()) [[likely]] {
+        // Handle promotion or regular move
+        if (is_promotion) [[unlikely]] {
+          new (current++) Move(from_row, from_col, forward_row, forward_col, 0, QUEEN);
+        } else {
+          new (current++) Move(from_row, from_col, forward_row, forward_col, 0);
         }
-      //}
-    }
 
-    // up-right
-    if (IsLegalLocation(from_row - 1, from_col + 1)) {
-        const Piece captured = location_to_piece_[from_row - 1][from_col + 1];
-        if (captured.Missing() || captured.GetTeam() != my_team) {
-            //*current++ = Move(from, {row - 1, col + 1}, captured, castling_rights);
-            new (current++) Move(from_row, from_col, from_row -1, from_col + 1, captured.GetRaw(), castling_rights);
+        // Double step from starting position
+        if (not_moved) {
+          // Only check the double move if the single move square was empty
+          const Piece forward2_piece = mailbox_[from + 2 * forward_step];
+          if (!forward2_piece.Present()) {
+            new (current++) Move(from_row, from_col,
+                from_row + delta_row * 2, from_col + delta_col * 2, 0);
+          }
         }
-    }
+      }
 
-    // down-left
-    if (IsLegalLocation(from_row + 1, from_col - 1)) {
-        const Piece captured = location_to_piece_[from_row + 1][from_col - 1];
-        if (captured.Missing() || captured.GetTeam() != my_team) {
-            //*current++ = Move(from, {row + 1, col - 1}, captured, castling_rights);
-            new (current++) Move(from_row, from_col, from_row + 1, from_col - 1, captured.GetRaw(), castling_rights);
+      // First capture direction
+      if (kGen != QUIETS && !capture1_piece.OffBoard()) {
+
+        // En passant double capture check using lookup tables
+        static constexpr int8_t kEpEdgeValue[4] = {3, 3, 10, 10};  // RED, BLUE, YELLOW, GREEN
+        static constexpr PlayerColor kEpEnemyColor[4] = {BLUE, YELLOW, GREEN, RED};
+        const bool is_ep_capture = !capture1_piece.Present() &&
+            ((current_color & 1) == 0 ? from_col : from_row) == kEpEdgeValue[current_color] &&
+            ((current_color & 1) == 0 ? en_passant_targets_[kEpEnemyColor[current_color]].row
+                                      : en_passant_targets_[kEpEnemyColor[current_color]].col) ==
+                ((current_color & 1) == 0 ? capture1_row : capture1_col) &&
+            // The pawn may have been captured since it double-stepped.
+            forward_piece == Piece(kEpEnemyColor[current_color], PAWN);
+        if (is_ep_capture) {
+          *current++ = Move::EnPassant(from_row, from_col, capture1_row, capture1_col, forward_piece.GetRaw());
+        } else if (capture1_piece.IsEnemyOf(my_team)) {
+          // Handle promotion on capture or regular capture
+          if (is_promotion) [[unlikely]] {
+            new (current++) Move(from_row, from_col, capture1_row, capture1_col, capture1_piece.GetRaw(), QUEEN);
+          } else {
+            new (current++) Move(from_row, from_col, capture1_row, capture1_col, capture1_piece.GetRaw());
+          }
         }
-    }
+      }
 
-    // down-right
-    if (IsLegalLocation(from_row + 1, from_col + 1)) {
-        const Piece captured = location_to_piece_[from_row + 1][from_col + 1];
-        if (captured.Missing() || captured.GetTeam() != my_team) {
-            //*current++ = Move(from, {row + 1, col + 1}, captured, castling_rights);
-            new (current++) Move(from_row, from_col, from_row + 1, from_col + 1, captured.GetRaw(), castling_rights);
+      // Second capture direction
+      if (kGen != QUIETS && !capture2_piece.OffBoard()) {
+
+        // En passant double capture check using lookup tables (reversed edge values and enemy colors)
+        static constexpr int8_t kEpEdgeValue2[4] = {10, 10, 3, 3};  // RED, BLUE, YELLOW, GREEN
+        static constexpr PlayerColor kEpEnemyColor2[4] = {GREEN, RED, BLUE, YELLOW};
+        const bool is_ep_capture2 = !capture2_piece.Present() &&
+            ((current_color & 1) == 0 ? from_col : from_row) == kEpEdgeValue2[current_color] &&
+            ((current_color & 1) == 0 ? en_passant_targets_[kEpEnemyColor2[current_color]].row
+                                      : en_passant_targets_[kEpEnemyColor2[current_color]].col) ==
+                ((current_color & 1) == 0 ? capture2_row : capture2_col) &&
+            // The pawn may have been captured since it double-stepped.
+            forward_piece == Piece(kEpEnemyColor2[current_color], PAWN);
+        if (is_ep_capture2) {
+          *current++ = Move::EnPassant(from_row, from_col, capture2_row, capture2_col, forward_piece.GetRaw());
+        } else if (capture2_piece.IsEnemyOf(my_team)) {
+          // Handle promotion on capture or regular capture
+          if (is_promotion) [[unlikely]] {
+            new (current++) Move(from_row, from_col, capture2_row, capture2_col, capture2_piece.GetRaw(), QUEEN);
+          } else {
+            new (current++) Move(from_row, from_col, capture2_row, capture2_col, capture2_piece.GetRaw());
+          }
         }
-    }
-
-    // up
-    if (IsLegalLocation(from_row - 1, from_col)) {
-      const Piece captured = location_to_piece_[from_row - 1][from_col];
-      if (captured.Missing()) {
-        //*current++ = Move(from, {row - 1, col});
-        new (current++) Move(from_row, from_col, from_row - 1, from_col, 0);
-
-        // Blue queenside castling
-        if (current_color == BLUE &&
-            castling_rights.Queenside() && 
-            !location_to_piece_[4][0].Present() && // knight
-            !location_to_piece_[5][0].Present() && // bishop
-            //!location_to_piece_[6][0].Present() && // queen, empty!
-            (location_to_piece_[3][0].GetRaw() == Piece::kRawBlueRook) &&
-            !IsAttackedByTeam(enemy_team, 6, 0) // queen
-            ) {
-            new (current++) Move(
-                7, 0,  // king_from
-                5, 0,  // king_to
-                3, 0, 6, 0,  // rook_from, rook_to
-                castling_rights
-            );
+      }
+    } break;
+    case KNIGHT: { 
+      const SquareList& targets = kKnightTargets[from];
+      for (int i = 0; i < targets.count; i++) {
+        const int to = targets.squares[i];
+        const Piece p = mailbox_[to];
+        if (p.Present()) {
+            if (kGen != QUIETS && p.GetTeam() != my_team) {
+                new (current++) Move(from_row, from_col, SquareRow(to), SquareCol(to), p.GetRaw());
+            }
+        } else if (kGen != CAPTURES) {
+            new (current++) Move(from_row, from_col, SquareRow(to), SquareCol(to), 0);
         }
-
-        // Green kingside castling
-        if (current_color == GREEN &&
-            castling_rights.Kingside() &&
-            !location_to_piece_[4][13].Present() && // knight
-            //!location_to_piece_[4][13].Present() && // bishop, empty!
-            (location_to_piece_[3][13].GetRaw() == Piece::kRawGreenRook) &&
-            !IsAttackedByTeam(enemy_team, 5, 13)) {  // bishop
-            
-            new (current++) Move(
-                6, 13,  // king_from
-                4, 13,  // king_to
-                3, 13, 5, 13,  // rook_from, rook_to
-                castling_rights
-            );
+      }
+    } break;
+    case KING: {
+      const Team enemy_team = OtherTeam(my_team);
+
+      const CastlingRights& castling_rights = castling_rights_[current_color];
+
+      // up-left, up-right, down-left, down-right
+      const SquareList& diagonal = kKingDiagonalTargets[from];
+      for (int i = 0; i < diagonal.count; i++) {
+        const int to = diagonal.squares[i];
+        const Piece captured = mailbox_[to];
+        if (captured.Missing() ? kGen != CAPTURES
+                               : kGen != QUIETS && captured.GetTeam() != my_team) {
+          new (current++) Move(from_row, from_col, SquareRow(to), SquareCol(to), captured.GetRaw());
         }
-      } else if (captured.GetTeam() != my_team) {
-        //*current++ = Move(from, {row - 1, col}, captured, castling_rights);
-        new (current++) Move(from_row, from_col, from_row - 1, from_col, captured.GetRaw(), castling_rights);
       }
-    }
 
-    // left
-    if (IsLegalLocation(from_row, from_col - 1)) {
-      const Piece captured = location_to_piece_[from_row][from_col - 1];
-      if (captured.Missing()) {
-        //*current++ = Move(from, {row, col - 1});
-        new (current++) Move(from_row, from_col, from_row, from_col - 1, 0);
+      // up
+      {
+        const Piece captured = mailbox_[from - kMailboxWidth];
+        if (kGen != CAPTURES && captured.Missing()) {
+          new (current++) Move(from_row, from_col, from_row - 1, from_col, 0);
 
-        // Red queenside castling - optimized
-        if (current_color == RED &&
-            castling_rights.Queenside() &&
-            !location_to_piece_[13][4].Present() && // knight
-            !location_to_piece_[13][5].Present() && // bishop
-            // queen square is empty
-            (location_to_piece_[13][3].GetRaw() == Piece::kRawRedRook) &&
-            !IsAttackedByTeam(enemy_team, 13, 6))  // queen
-          {
-            
-            new (current++) Move(
-              13, 7,  // king_from
-              13, 5,  // king_to
-              13, 3, 13, 6,  // rook_from, rook_to
-              castling_rights
-            );
+          // Blue queenside castling
+          if (current_color == BLUE &&
+              castling_rights.Queenside() && 
+              !GetPiece(4, 0).Present() && // knight
+              !GetPiece(5, 0).Present() && // bishop
+              // queen square is empty
+              (GetPiece(3, 0).GetRaw() == Piece::kRawBlueRook) &&
+              !IsAttackedByTeam(enemy_team, 6, 0) // queen
+              ) {
+              *current++ = Move::Castling(
+                  7, 0,  // king_from
+                  5, 0);  // king_to
+          }
+
+          // Green kingside castling
+          if (current_color == GREEN &&
+              castling_rights.Kingside() &&
+              !GetPiece(4, 13).Present() && // knight
+              // bishop square is empty
+              (GetPiece(3, 13).GetRaw() == Piece::kRawGreenRook) &&
+              !IsAttackedByTeam(enemy_team, 5, 13)) {  // bishop
+
+              *current++ = Move::Castling(
+                  6, 13,  // king_from
+                  4, 13);  // king_to
+          }
+        } else if (kGen != QUIETS && captured.IsEnemyOf(my_team)) {
+          new (current++) Move(from_row, from_col, from_row - 1, from_col, captured.GetRaw());
         }
-        // YELLOW kingside castling - optimized
-        if (current_color == YELLOW &&
-            castling_rights.Kingside() &&
-            !location_to_piece_[0][4].Present() && // knight
-            // bishop is empty
-            (location_to_piece_[0][3].GetRaw() == Piece::kRawYellowRook) &&
-            !IsAttackedByTeam(enemy_team, 0, 5)) {  // bishop
-      
-            new (current++) Move(
-                0, 6,  // king_from
-                0, 4,  // king_to
-                0, 3, 0, 5,  // rook_from, rook_to
-                castling_rights
-            );
-        }   
-      } else if (captured.GetTeam() != my_team) {
-        //*current++ = Move(from, {row, col - 1}, captured, castling_rights);
-        new (current++) Move(from_row, from_col, from_row, from_col - 1, captured.GetRaw(), castling_rights);
       }
-    }
 
-    // right
-    if (IsLegalLocation(from_row, from_col + 1)) {
-      const Piece captured = location_to_piece_[from_row][from_col + 1];
-      if (captured.Missing()) {
-        //*current++ = Move(from, {row, col + 1});
-        new (current++) Move(from_row, from_col, from_row, from_col + 1, 0);
-
-        // RED kingside castling - optimized
-        if (current_color == RED &&
-            castling_rights.Kingside() &&
-            !location_to_piece_[13][9].Present() &&  // knight
-            // bishop empty
-            (location_to_piece_[13][10].GetRaw() == Piece::kRawRedRook) &&
-            !IsAttackedByTeam(enemy_team, 13, 8)) {  // bishop
-            
-            new (current++) Move(
-                13, 7,  // king_from
-                13, 9,  // king_to
-                13, 10, 13, 8,  // rook_from, rook_to
-                castling_rights
-            );
-        }
-        // YELLOW queenside castling - optimized
-        if (current_color == YELLOW &&
-            castling_rights.Queenside() &&
-            !location_to_piece_[0][9].Present() &&  // knight
-            !location_to_piece_[0][8].Present() &&  // bishop
-            // queen empty
-            (location_to_piece_[0][10].GetRaw() == Piece::kRawYellowRook) &&
-            !IsAttackedByTeam(enemy_team, 0, 7))  // queen
+      // left
+      {
+        const Piece captured = mailbox_[from - 1];
+        if (kGen != CAPTURES && captured.Missing()) {
+          new (current++) Move(from_row, from_col, from_row, from_col - 1, 0);
+
+          // Red queenside castling - optimized
+          if (current_color == RED &&
+              castling_rights.Queenside() &&
+              !GetPiece(13, 4).Present() && // knight
+              !GetPiece(13, 5).Present() && // bishop
+              // queen square is empty
+              (GetPiece(13, 3).GetRaw() == Piece::kRawRedRook) &&
+              !IsAttackedByTeam(enemy_team, 13, 6))  // queen
             {
-            
-            new (current++) Move(
-                0, 6,  // king_from
-                0, 8,  // king_to
-                0, 10, 0, 7,  // rook_from, rook_to
-                castling_rights
-            );
+
+              *current++ = Move::Castling(
+                13, 7,  // king_from
+                13, 5);  // king_to
+          }
+          // YELLOW kingside castling - optimized
+          if (current_color == YELLOW &&
+              castling_rights.Kingside() &&
+              !GetPiece(0, 4).Present() && // knight
+              // bishop is empty
+              (GetPiece(0, 3).GetRaw() == Piece::kRawYellowRook) &&
+              !IsAttackedByTeam(enemy_team, 0, 5)) {  // bishop
+
+              *current++ = Move::Castling(
+                  0, 6,  // king_from
+                  0, 4);  // king_to
+          }   
+        } else if (kGen != QUIETS && captured.IsEnemyOf(my_team)) {
+          new (current++) Move(from_row, from_col, from_row, from_col - 1, captured.GetRaw());
         }
-      } else if (captured.GetTeam() != my_team) {
-        //*current++ = Move(from, {row, col + 1}, captured, castling_rights);
-        new (current++) Move(from_row, from_col, from_row, from_col + 1, captured.GetRaw(), castling_rights);
       }
-    }
-  // down
-    if (IsLegalLocation(from_row + 1, from_col)) {
 
-      const Piece captured = location_to_piece_[from_row + 1][from_col];
-      if (captured.Missing()) {
-        //*current++ = Move(from, {row + 1, col});
-        new (current++) Move(from_row, from_col, from_row + 1, from_col, 0);
+      // right
+      {
+        const Piece captured = mailbox_[from + 1];
+        if (kGen != CAPTURES && captured.Missing()) {
+          new (current++) Move(from_row, from_col, from_row, from_col + 1, 0);
 
-        // BLUE kingside castling
-          if (current_color == BLUE &&
+          // RED kingside castling - optimized
+          if (current_color == RED &&
               castling_rights.Kingside() &&
-              !location_to_piece_[9][0].Present() &&  // knight
-              (location_to_piece_[10][0].GetRaw() == Piece::kRawBlueRook) &&
-              !IsAttackedByTeam(enemy_team, 8, 0)) {  // bishop
-        
-          new (current++) Move(
-              7, 0,  // king_from
-              9, 0,  // king_to
-              10, 0, 8, 0,  // rook_from, rook_to
-              castling_rights
-            );
-        }
-        // GREEN queenside castling
-        if (current_color == GREEN &&
-          castling_rights.Queenside() &&
-          // queen empty
-          !location_to_piece_[8][13].Present() && // bishop
-          !location_to_piece_[9][13].Present() && // knight
-          (location_to_piece_[10][13].GetRaw() == Piece::kRawGreenRook) &&
-          !IsAttackedByTeam(enemy_team, 7, 13))  // queen
-          {  // King's path
-    
-          new (current++) Move(
-              6, 13,  // king_from
-              8, 13,  // king_to
-              10, 13, 7, 13,  // rook_from, rook_to
-              castling_rights
-            );
+              !GetPiece(13, 9).Present() &&  // knight
+              // bishop empty
+              (GetPiece(13, 10).GetRaw() == Piece::kRawRedRook) &&
+              !IsAttackedByTeam(enemy_team, 13, 8)) {  // bishop
+
+              *current++ = Move::Castling(
+                  13, 7,  // king_from
+                  13, 9);  // king_to
+          }
+          // YELLOW queenside castling - optimized
+          if (current_color == YELLOW &&
+              castling_rights.Queenside() &&
+              !GetPiece(0, 9).Present() &&  // knight
+              !GetPiece(0, 8).Present() &&  // bishop
+              // queen empty
+              (GetPiece(0, 10).GetRaw() == Piece::kRawYellowRook) &&
+              !IsAttackedByTeam(enemy_team, 0, 7))  // queen
+              {
+
+              *current++ = Move::Castling(
+                  0, 6,  // king_from
+                  0, 8);  // king_to
+          }
+        } else if (kGen != QUIETS && captured.IsEnemyOf(my_team)) {
+          new (current++) Move(from_row, from_col, from_row, from_col + 1, captured.GetRaw());
         }
-      } else if (captured.GetTeam() != my_team) {
-        //*current++ = Move(from, {row + 1, col}, captured, castling_rights);
-        new (current++) Move(from_row, from_col, from_row + 1, from_col, captured.GetRaw(), castling_rights);
       }
-    }
-            } break;
-            default: assert(false && "Movegen: Invalid piece type");
-        }
 
-      } else if ( // in_check [[unlikely]]
-          att_type == QUEEN ||
-          att_type == ROOK ||
-          att_type == BISHOP
-        ) {
-
-        // List all squares between king and attacker (for blocking moves)
-        int8_t king_row_local = king_row;
-        int8_t king_col_local = king_col;
-        int8_t att_row = attacker.first;
-        int8_t att_col = attacker.second;
-        
-        int8_t drow = (att_row > king_row_local) ? 1 : (att_row < king_row_local) ? -1 : 0;
-        int8_t dcol = (att_col > king_col_local) ? 1 : (att_col < king_col_local) ? -1 : 0;
-        
-        // Iterate through all squares between king and attacker
-        int8_t r = king_row_local + drow;
-        int8_t c = king_col_local + dcol;
-        while (r != att_row || c != att_col) {
-
-            int8_t row_diff = r - from_row;
-            int8_t col_diff = c - from_col;
-
-            switch (type) {
-              case QUEEN: {
-                
-                if ((row_diff == 0 || col_diff == 0) && (row_diff != 0 || col_diff != 0)) {
-                    int8_t row_step = (row_diff > 0) ? 1 : (row_diff < 0) ? -1 : 0;
-                    int8_t col_step = (col_diff > 0) ? 1 : (col_diff < 0) ? -1 : 0;
-                    
-                    bool blocked = false;
-                    int8_t tr = from_row + row_step;
-                    int8_t tc = from_col + col_step;
-                    while (tr != r || tc != c) {
-                        if (!IsLegalLocation(tr, tc) || location_to_piece_[tr][tc].Present()) {
-                            blocked = true;
-                            break;
-                        }
-                        tr += row_step;
-                      tc += col_step;
-                  }
-                  
-                  if (!blocked) {
-                      new (current++) Move(from_row, from_col, r, c, 0);
-                      threats += 16;
-                  }
-                }
-
-                if (row_diff && (row_diff == col_diff || row_diff == -col_diff)) {
-                    int8_t row_step = (row_diff > 0) ? 1 : -1;
-                    int8_t col_step = (col_diff > 0) ? 1 : -1;
-                    
-                    bool blocked = false;
-                    int8_t tr = from_row + row_step;
-                    int8_t tc = from_col + col_step;
-                    while (tr != r || tc != c) {
-                        if (!IsLegalLocation(tr,tc) || location_to_piece_[tr][tc].Present()) {
-                            blocked = true;
-                            break;
-                        }
-                        tr += row_step;
-                        tc += col_step;
-                    }
-                    
-                    if (!blocked) {
-                        new (current++) Move(from_row, from_col, r, c, 0);
-                        threats += 16;
-                    }
-                }
-              } break;
-              case BISHOP: {
-                
-                if (row_diff && (row_diff == col_diff || row_diff == -col_diff)) {
-                    int8_t row_step = (row_diff > 0) ? 1 : -1;
-                    int8_t col_step = (col_diff > 0) ? 1 : -1;
-                    
-                    bool blocked = false;
-                    int8_t tr = from_row + row_step;
-                    int8_t tc = from_col + col_step;
-                    while (tr != r || tc != c) {
-                        if (!IsLegalLocation(tr,tc) || location_to_piece_[tr][tc].Present()) {
-                            blocked = true;
-                            break;
-                        }
-                        tr += row_step;
-                        tc += col_step;
-                      }
-                      
-                      if (!blocked) {
-                          new (current++) Move(from_row, from_col, r, c, 0);
-                          threats += 16;
-                      }
-                  }
-                } break;
-                case ROOK: {
-                
-                  if ((row_diff == 0 || col_diff == 0) && (row_diff != 0 || col_diff != 0)) {
-                    int8_t row_step = (row_diff > 0) ? 1 : (row_diff < 0) ? -1 : 0;
-                    int8_t col_step = (col_diff > 0) ? 1 : (col_diff < 0) ? -1 : 0;
-                    
-                    bool blocked = false;
-                    int8_t tr = from_row + row_step;
-                    int8_t tc = from_col + col_step;
-                    while (tr != r || tc != c) {
-                        if (!IsLegalLocation(tr, tc) || location_to_piece_[tr][tc].Present()) {
-                            blocked = true;
-                            break;
-                        }
-                        tr += row_step;
-                      tc += col_step;
-                  }
-                  
-                  if (!blocked) {
-                      new (current++) Move(from_row, from_col, r, c, 0);
-                      threats += 16;
-                  }
-              }
-            } break;
-            case KNIGHT: {
-              uint8_t dr = r > from_row ? r - from_row : from_row - r;
-              uint8_t dc = c > from_col ? c - from_col : from_col - c;
-              
-              if (dr * dc == 2) {
-                  new (current++) Move(from_row, from_col, r, c, 0);
-                  threats += 16;
-              }
-            } break;
-            case PAWN: {
-              
-              switch (current_color) {
-                case RED:
-                  // RED moves up (-1, 0), starts at row 12
-                  if (row_diff == -1 && col_diff == 0) {
-                      new (current++) Move(from_row, from_col, r, c, 0);
-                      threats += 16;
-                  } else if (row_diff == -2 && col_diff == 0 && from_row == 12) {
-                      if (location_to_piece_[from_row - 1][c].Missing()) {
-                          new (current++) Move(from_row, from_col, r, c, 0);
-                          threats += 16;
-                      }
-                  }
-                  break;
-                case BLUE:
-                  // BLUE moves right (0, +1), starts at col 1
-                  if (row_diff == 0 && col_diff == 1) {
-                      new (current++) Move(from_row, from_col, r, c, 0);
-                      threats += 16;
-                  } else if (row_diff == 0 && col_diff == 2 && from_col == 1) {
-                      if (location_to_piece_[r][from_col + 1].Missing()) {
-                          new (current++) Move(from_row, from_col, r, c, 0);
-                          threats += 16;
-                      }
-                  }
-                  break;
-                case YELLOW:
-                  // YELLOW moves down (+1, 0), starts at row 1
-                  if (row_diff == 1 && col_diff == 0) {
-                      new (current++) Move(from_row, from_col, r, c, 0);
-                      threats += 16;
-                  } else if (row_diff == 2 && col_diff == 0 && from_row == 1) {
-                      if (location_to_piece_[from_row + 1][c].Missing()) {
-                          new (current++) Move(from_row, from_col, r, c, 0);
-                          threats += 16;
-                      }
-                  }
-                  break;
-                case GREEN:
-                  // GREEN moves left (0, -1), starts at col 12
-                  if (row_diff == 0 && col_diff == -1) {
-                      new (current++) Move(from_row, from_col, r, c, 0);
-                      threats += 16;
-                  } else if (row_diff == 0 && col_diff == -2 && from_col == 12) {
-                      if (location_to_piece_[r][from_col - 1].Missing()) {
-                          new (current++) Move(from_row, from_col, r, c, 0);
-                          threats += 16;
-                      }
-                  }
-                  break;
-                default: break;
-              }
-            } break;
-            default: ;
-            }
+      // down
+      {
+        const Piece captured = mailbox_[from + kMailboxWidth];
+        if (kGen != CAPTURES && captured.Missing()) {
+          new (current++) Move(from_row, from_col, from_row + 1, from_col, 0);
 
-            r += drow;
-            c += dcol;
-        }
+          // BLUE kingside castling
+            if (current_color == BLUE &&
+                castling_rights.Kingside() &&
+                !GetPiece(9, 0).Present() &&  // knight
+                (GetPiece(10, 0).GetRaw() == Piece::kRawBlueRook) &&
+                !IsAttackedByTeam(enemy_team, 8, 0)) {  // bishop
 
+            *current++ = Move::Castling(
+                7, 0,  // king_from
+                9, 0);  // king_to
+          }
+          // GREEN queenside castling
+          if (current_color == GREEN &&
+            castling_rights.Queenside() &&
+            // queen empty
+            !GetPiece(8, 13).Present() && // bishop
+            !GetPiece(9, 13).Present() && // knight
+            (GetPiece(10, 13).GetRaw() == Piece::kRawGreenRook) &&
+            !IsAttackedByTeam(enemy_team, 7, 13))  // queen
+            {  // King's path
 
-        // capture attacker
-        int8_t row_diff = att_row - from_row;
-        int8_t col_diff = att_col - from_col;
-        switch (type) {
-
-            case QUEEN:   {
-                  bool occupied = false;
-                  if (row_diff != 0 && (row_diff == col_diff || row_diff == -col_diff)) {
-                      int8_t row_step = row_diff > 0 ? 1 : -1;
-                      int8_t col_step = col_diff > 0 ? 1 : -1;
-                      int8_t tr = from_row + row_step;
-                      int8_t tc = from_col + col_step;
-                      while (tr != att_row && tc != att_col) {
-                          if (location_to_piece_[tr][tc].Present()) {
-                            occupied = true;
-                            break;
-                          }
-                          tr += row_step;
-                          tc += col_step;
-                      }
-                      if (!occupied) {
-                        new (current++) Move(from_row, from_col, att_row, att_col, attacking_piece.GetRaw());
-                        threats += 16;
-                      }
-                  }
-
-                  occupied = false;
-                  if (from_row == att_row) {
-                      int8_t step = (att_col > from_col) ? 1 : -1;
-                      for (int8_t tc = from_col + step; tc != att_col; tc += step) {
-                          if (location_to_piece_[from_row][tc].Present()) {
-                            occupied = true;
-                            break;
-                          }
-                      }
-                      if (occupied == true) {
-                        new (current++) Move(from_row, from_col, att_row, att_col, attacking_piece.GetRaw());
-                        threats += 16;
-                      }
-                  } else if (from_col == att_col) {
-                      int8_t step = (att_row > from_row) ? 1 : -1;
-                      for (int8_t tr = from_row + step; tr != att_row; tr += step) {
-                          if (location_to_piece_[tr][from_col].Present()) {
-                            occupied = true;
-                            break;
-                          }
-                      }
-                      if (occupied == true) {
-                        new (current++) Move(from_row, from_col, att_row, att_col, attacking_piece.GetRaw());
-                        threats += 16;
-                      }
-                  }
-              } break;
-            case ROOK: {
-                  bool occupied = false;
-                  if (from_row == att_row) {
-                      int8_t step = (att_col > from_col) ? 1 : -1;
-                      for (int8_t tc = from_col + step; tc != att_col; tc += step) {
-                          if (location_to_piece_[from_row][tc].Present()) {
-                            occupied = true;
-                            break;
-                          }
-                      }
-                      if (occupied == true) {
-                        new (current++) Move(from_row, from_col, att_row, att_col, attacking_piece.GetRaw());
-                        threats += 16;
-                      }
-                  } else if (from_col == att_col) {
-                      int8_t step = (att_row > from_row) ? 1 : -1;
-                      for (int8_t tr = from_row + step; tr != att_row; tr += step) {
-                          if (location_to_piece_[tr][from_col].Present()) {
-                            occupied = true;
-                            break;
-                          }
-                      }
-                      if (occupied == true) {
-                        new (current++) Move(from_row, from_col, att_row, att_col, attacking_piece.GetRaw());
-                        threats += 16;
-                      }
-                  }
-              }  break;
-            case BISHOP:  {
-                  bool occupied = false;
-                  if (row_diff != 0 && (row_diff == col_diff || row_diff == -col_diff)) {
-                      int8_t row_step = row_diff > 0 ? 1 : -1;
-                      int8_t col_step = col_diff > 0 ? 1 : -1;
-                      int8_t tr = from_row + row_step;
-                      int8_t tc = from_col + col_step;
-                      while (tr != att_row && tc != att_col) {
-                          if (location_to_piece_[tr][tc].Present()) {
-                            occupied = true;
-                            break;
-                          }
-                          tr += row_step;
-                          tc += col_step;
-                      }
-                      if (!occupied) {
-                        new (current++) Move(from_row, from_col, att_row, att_col, attacking_piece.GetRaw());
-                        threats += 16;
-                      }
-                  }
-            } break;
-            case PAWN: {
-                
-                switch (current_color) {
-                    case RED:
-                        // RED captures up-left (-1,-1) and up-right (-1,+1)
-                        if (row_diff == -1 && (col_diff == -1 || col_diff == 1)) {
-                            new (current++) Move(from_row, from_col, att_row, att_col, attacking_piece.GetRaw());
-                            threats += 16;
-                        }
-                        break;
-                    case BLUE:
-                        // BLUE captures up-right (-1,+1) and down-right (+1,+1)
-                        if (col_diff == 1 && (row_diff == -1 || row_diff == 1)) {
-                            new (current++) Move(from_row, from_col, att_row, att_col, attacking_piece.GetRaw());
-                            threats += 16;
-                        }
-                        break;
-                    case YELLOW:
-                        // YELLOW captures down-right (+1,+1) and down-left (+1,-1)
-                        if (row_diff == 1 && (col_diff == 1 || col_diff == -1)) {
-                            new (current++) Move(from_row, from_col, att_row, att_col, attacking_piece.GetRaw());
-                            threats += 16;
-                        }
-                        break;
-                    case GREEN:
-                        // GREEN captures down-left (+1,-1) and up-left (-1,-1)
-                        if (col_diff == -1 && (row_diff == 1 || row_diff == -1)) {
-                            new (current++) Move(from_row, from_col, att_row, att_col, attacking_piece.GetRaw());
-                            threats += 16;
-                        }
-                        break;
-                    default: break;
-                }
-            } break;
-            case KNIGHT:  {
-              uint8_t dr = r > from_row ? r - from_row : from_row - r;
-              uint8_t dc = c > from_col ? c - from_col : from_col - c;
-              
-              if (dr * dc == 2) {
-                    new (current++) Move(from_row, from_col, att_row, att_col, attacking_piece.GetRaw());
-                    threats += 16;
-                }
-            } break;
-            case KING: {
-              // just move/capture in all 8 directions
-                //current = GetKingMovesCheck(current, location, current_color, my_team);
-  const Team enemy_team = OtherTeam(my_team);
-  
-  const CastlingRights& castling_rights = castling_rights_[current_color];
-
-    // up-left
-    if (IsLegalLocation(from_row - 1, from_col - 1)) {
-      //if (!IsAttackedByTeam(enemy_team, {row - 1, col - 1})) {
-        const Piece captured = location_to_piece_[from_row - 1][from_col - 1];
-        if (captured.Missing() || captured.GetTeam() != my_team) {
-            new (current++) Move(from_row, from_col, from_row -1, from_col - 1, captured.GetRaw(), castling_rights);
+            *current++ = Move::Castling(
+                6, 13,  // king_from
+                8, 13);  // king_to
+          }
+        } else if (kGen != QUIETS && captured.IsEnemyOf(my_team)) {
+          new (current++) Move(from_row, from_col, from_row + 1, from_col, captured.GetRaw());
         }
-      //}
-    }
+      }
+    } break;
+    default: assert(false && "Movegen: Invalid piece type");
+  }
+  return current;
+}
 
-    // up-right
-    if (IsLegalLocation(from_row - 1, from_col + 1)) {
-        const Piece captured = location_to_piece_[from_row - 1][from_col + 1];
-        if (captured.Missing() || captured.GetTeam() != my_team) {
-            new (current++) Move(from_row, from_col, from_row -1, from_col + 1, captured.GetRaw(), castling_rights);
-        }
+size_t Board::GetPseudoLegalMoves(Move* buffer, MoveGenType type) const {
+  Move* current = buffer;
+  for (const auto& placed_piece : piece_list_[GetTurn().GetColor()]) {
+    const int from = ToSquare(placed_piece.GetRow(), placed_piece.GetCol());
+    switch (type) {
+      case CAPTURES: current = AddPieceMoves<CAPTURES>(current, from); break;
+      case QUIETS: current = AddPieceMoves<QUIETS>(current, from); break;
+      default: current = AddPieceMoves<ALL_MOVES>(current, from); break;
     }
+  }
+  return current - buffer;
+}
 
-    // down-left
-    if (IsLegalLocation(from_row + 1, from_col - 1)) {
-        const Piece captured = location_to_piece_[from_row + 1][from_col - 1];
-        if (captured.Missing() || captured.GetTeam() != my_team) {
-            new (current++) Move(from_row, from_col, from_row + 1, from_col - 1, captured.GetRaw(), castling_rights);
-        }
-    }
+bool Board::InCheck() const {
+  const PlayerColor color = GetTurn().GetColor();
+  return KingPresent(color) &&
+      GetAttacker(OtherTeam(GetTeam(color)), king_row_[color], king_col_[color]).first != -1;
+}
 
-    // down-right
-    if (IsLegalLocation(from_row + 1, from_col + 1)) {
-        const Piece captured = location_to_piece_[from_row + 1][from_col + 1];
-        if (captured.Missing() || captured.GetTeam() != my_team) {
-            new (current++) Move(from_row, from_col, from_row + 1, from_col + 1, captured.GetRaw(), castling_rights);
-        }
+std::optional<Move> Board::ToPseudoLegalMove(const Move& move) const {
+  const Piece piece = mailbox_[ToSquare(move.FromRow(), move.FromCol())];
+  if (piece.Missing() || piece.OffBoard() || piece.GetColor() != GetTurn().GetColor()) {
+    return std::nullopt;
+  }
+  Move moves[kMaxPieceMoves];
+  const size_t count =
+      AddPieceMoves<ALL_MOVES>(moves, ToSquare(move.FromRow(), move.FromCol())) - moves;
+  const uint32_t packed = move.Pack();
+  for (size_t i = 0; i < count; i++) {
+    if (moves[i].Pack() == packed) {
+      return moves[i];
     }
+  }
+  return std::nullopt;
+}
 
-    // up
-    if (IsLegalLocation(from_row - 1, from_col)) {
-      const Piece captured = location_to_piece_[from_row - 1][from_col];
-      if (captured.Missing()) {
-        new (current++) Move(from_row, from_col, from_row - 1, from_col, 0);
-      } else if (captured.GetTeam() != my_team) {
-        new (current++) Move(from_row, from_col, from_row - 1, from_col, captured.GetRaw(), castling_rights);
-      }
-    }
+Board::MoveGenResult Board::GetPseudoLegalMoves2(
+    Move* buffer,
+    size_t limit,
+    const PieceList& pieces,
+    const std::optional<Move>& pv_move) {
+
+    MoveGenResult result{0, -1};
+
+    if (buffer == nullptr || limit == 0) return result;
 
-    // left
-    if (IsLegalLocation(from_row, from_col - 1)) {
-      const Piece captured = location_to_piece_[from_row][from_col - 1];
-      if (captured.Missing()) {
-        new (current++) Move(from_row, from_col, from_row, from_col - 1, 0);
-      } else if (captured.GetTeam() != my_team) {
-        new (current++) Move(from_row, from_col, from_row, from_col - 1, captured.GetRaw(), castling_rights);
-      }
-    }
+    const PlayerColor current_color = GetTurn().GetColor();
+    const Team my_team = GetTeam(current_color);
 
-    // right
-    if (IsLegalLocation(from_row, from_col + 1)) {
-      const Piece captured = location_to_piece_[from_row][from_col + 1];
-      if (captured.Missing()) {
-        new (current++) Move(from_row, from_col, from_row, from_col + 1, 0);
-      } else if (captured.GetTeam() != my_team) {
-        new (current++) Move(from_row, from_col, from_row, from_col + 1, captured.GetRaw(), castling_rights);
-      }
-    }
-  // down
-    if (IsLegalLocation(from_row + 1, from_col)) {
+    const int8_t king_row = GetKingRow(current_color);
+    const int8_t king_col = GetKingCol(current_color);
 
-      const Piece captured = location_to_piece_[from_row + 1][from_col];
-      if (captured.Missing()) {
-        new (current++) Move(from_row, from_col, from_row + 1, from_col, 0);
-      } else if (captured.GetTeam() != my_team) {
-        new (current++) Move(from_row, from_col, from_row + 1, from_col, captured.GetRaw(), castling_rights);
-      }
+    if (!KingPresent(current_color)) {
+      return result;
     }
-            } break;
-            default: assert(false && "Movegen: Invalid piece type");
-        }
 
-      } else if ( // can only capture the attacker
-        att_type == KNIGHT ||
-        att_type == PAWN
-      ) {
-        const int8_t att_row = attacker.first;
-        const int8_t att_col = attacker.second;
-        const int8_t king_row_local = king_row;
-        const int8_t king_col_local = king_col;
-
-        // Direction from king to attacker
-        int8_t drow = (att_row > king_row_local) ? 1 : (att_row < king_row_local) ? -1 : 0;
-        int8_t dcol = (att_col > king_col_local) ? 1 : (att_col < king_col_local) ? -1 : 0;
-
-        int8_t row_diff = att_row - from_row;
-        int8_t col_diff = att_col - from_col;
-
-        switch (type) {
-            case QUEEN:   {
-                  bool occupied = false;
-                  if (row_diff != 0 && (row_diff == col_diff || row_diff == -col_diff)) {
-                      int8_t row_step = row_diff > 0 ? 1 : -1;
-                      int8_t col_step = col_diff > 0 ? 1 : -1;
-                      int8_t tr = from_row + row_step;
-                      int8_t tc = from_col + col_step;
-                      while (tr != att_row && tc != att_col) {
-                          if (location_to_piece_[tr][tc].Present()) {
-                            occupied = true;
-                            break;
-                          }
-                          tr += row_step;
-                          tc += col_step;
-                      }
-                      if (!occupied) {
-                        new (current++) Move(from_row, from_col, att_row, att_col, attacking_piece.GetRaw());
-                        threats += 16;
-                      }
-                  }
-
-                  occupied = false;
-                  if (from_row == att_row) {
-                      int8_t step = (att_col > from_col) ? 1 : -1;
-                      for (int8_t tc = from_col + step; tc != att_col; tc += step) {
-                          if (location_to_piece_[from_row][tc].Present()) {
-                            occupied = true;
-                            break;
-                          }
-                      }
-                      if (occupied == true) {
-                        new (current++) Move(from_row, from_col, att_row, att_col, attacking_piece.GetRaw());
-                        threats += 16;
-                      }
-                  } else if (from_col == att_col) {
-                      int8_t step = (att_row > from_row) ? 1 : -1;
-                      for (int8_t tr = from_row + step; tr != att_row; tr += step) {
-                          if (location_to_piece_[tr][from_col].Present()) {
-                            occupied = true;
-                            break;
-                          }
-                      }
-                      if (occupied == true) {
-                        new (current++) Move(from_row, from_col, att_row, att_col, attacking_piece.GetRaw());
-                        threats += 16;
-                      }
-                  }
-              } break;
-            case ROOK:    {
-                  bool occupied = false;
-                  if (from_row == att_row) {
-                      int8_t step = (att_col > from_col) ? 1 : -1;
-                      for (int8_t tc = from_col + step; tc != att_col; tc += step) {
-                          if (location_to_piece_[from_row][tc].Present()) {
-                            occupied = true;
-                            break;
-                          }
-                      }
-                      if (occupied == true) {
-                        new (current++) Move(from_row, from_col, att_row, att_col, attacking_piece.GetRaw());
-                        threats += 16;
-                      }
-                  } else if (from_col == att_col) {
-                      int8_t step = (att_row > from_row) ? 1 : -1;
-                      for (int8_t tr = from_row + step; tr != att_row; tr += step) {
-                          if (location_to_piece_[tr][from_col].Present()) {
-                            occupied = true;
-                            break;
-                          }
-                      }
-                      if (occupied == true) {
-                        new (current++) Move(from_row, from_col, att_row, att_col, attacking_piece.GetRaw());
-                        threats += 16;
-                      }
-                  }
-              }
-              break;
-            case BISHOP:  {
-                  bool occupied = false;
-                  if (row_diff != 0 && (row_diff == col_diff || row_diff == -col_diff)) {
-                      int8_t row_step = row_diff > 0 ? 1 : -1;
-                      int8_t col_step = col_diff > 0 ? 1 : -1;
-                      int8_t tr = from_row + row_step;
-                      int8_t tc = from_col + col_step;
-                      while (tr != att_row && tc != att_col) {
-                          if (location_to_piece_[tr][tc].Present()) {
-                            occupied = true;
-                            break;
-                          }
-                          tr += row_step;
-                          tc += col_step;
-                      }
-                      if (!occupied) {
-                        new (current++) Move(from_row, from_col, att_row, att_col, attacking_piece.GetRaw());
-                        threats += 16;
-                      }
-                  }
-              } break;
-            case PAWN:    {
-                // DOES NOT HANDLE EN PASSANT!
-                
-                switch (current_color) {
-                    case RED:
-                        // RED captures up-left (-1,-1) and up-right (-1,+1)
-                        if (row_diff == -1 && (col_diff == -1 || col_diff == 1)) {
-                            new (current++) Move(from_row, from_col, att_row, att_col, attacking_piece.GetRaw());
-                            threats += 16;
-                        }
-                        break;
-                    case BLUE:
-                        // BLUE captures up-right (-1,+1) and down-right (+1,+1)
-                        if (col_diff == 1 && (row_diff == -1 || row_diff == 1)) {
-                            new (current++) Move(from_row, from_col, att_row, att_col, attacking_piece.GetRaw());
-                            threats += 16;
-                        }
-                        break;
-                    case YELLOW:
-                        // YELLOW captures down-right (+1,+1) and down-left (+1,-1)
-                        if (row_diff == 1 && (col_diff == 1 || col_diff == -1)) {
-                            new (current++) Move(from_row, from_col, att_row, att_col, attacking_piece.GetRaw());
-                            threats += 16;
-                        }
-                        break;
-                    case GREEN:
-                        // GREEN captures down-left (+1,-1) and up-left (-1,-1)
-                        if (col_diff == -1 && (row_diff == 1 || row_diff == -1)) {
-                            new (current++) Move(from_row, from_col, att_row, att_col, attacking_piece.GetRaw());
-                            threats += 16;
-                        }
-                        break;
-                    default: break;
-                }
-            } break;
-            case KNIGHT:  {
-                uint8_t dr = row_diff > 0 ? row_diff : -row_diff;
-                uint8_t dc = col_diff > 0 ? col_diff : -col_diff;
-                
-                if (dr * dc == 2) {
-                    new (current++) Move(from_row, from_col, att_row, att_col, attacking_piece.GetRaw());
-                    threats += 16;
-                }
-            } break;
-            case KING:    {
-              // just move/capture in all 8 directions
-              //current = GetKingMovesCheck(current, location, current_color, my_team);
-  const Team enemy_team = OtherTeam(my_team);
-  
-  const CastlingRights& castling_rights = castling_rights_[current_color];
+    auto attacker = GetAttacker(OtherTeam(my_team), king_row, king_col);
 
-    // up-left
-    if (IsLegalLocation(from_row - 1, from_col - 1)) {
-        const Piece captured = location_to_piece_[from_row - 1][from_col - 1];
-        if (captured.Missing() || captured.GetTeam() != my_team) {
-            new (current++) Move(from_row, from_col, from_row -1, from_col - 1, captured.GetRaw(), castling_rights);
-        }
-    }
+    bool has_pv_move = pv_move.has_value();
+    int pv_index = -1;  // -1 means PV move not found
+    const bool in_check = KingPresent(current_color) && attacker.first != -1;
+    const auto attacking_piece = in_check ? mailbox_[ToSquare(attacker.first, attacker.second)] : Piece(Piece::kRawNoPiece);
+    const PieceType att_type = attacking_piece.GetPieceType();
 
-    // up-right
-    if (IsLegalLocation(from_row - 1, from_col + 1)) {
-        const Piece captured = location_to_piece_[from_row - 1][from_col + 1];
-        if (captured.Missing() || captured.GetTeam() != my_team) {
-            new (current++) Move(from_row, from_col, from_row -1, from_col + 1, captured.GetRaw(), castling_rights);
-        }
+    // Check for double check using reversed search
+    bool double_check = false;
+    if (in_check) {
+        auto second_attacker = GetRevAttacker(OtherTeam(my_team), king_row, king_col);
+        double_check = second_attacker.first != -1 && (second_attacker.first != attacker.first || second_attacker.second != attacker.second);
     }
 
-    // down-left
-    if (IsLegalLocation(from_row + 1, from_col - 1)) {
-        const Piece captured = location_to_piece_[from_row + 1][from_col - 1];
-        if (captured.Missing() || captured.GetTeam() != my_team) {
-            new (current++) Move(from_row, from_col, from_row + 1, from_col - 1, captured.GetRaw(), castling_rights);
-        }
-    }
+    Move* current = buffer;
 
-    // down-right
-    if (IsLegalLocation(from_row + 1, from_col + 1)) {
-        const Piece captured = location_to_piece_[from_row + 1][from_col + 1];
-        if (captured.Missing() || captured.GetTeam() != my_team) {
-            new (current++) Move(from_row, from_col, from_row + 1, from_col + 1, captured.GetRaw(), castling_rights);
-        }
-    }
+    // Check evasion targets: the squares between a checking slider and the
+    // king, walked from the king outwards, and the checking piece itself.
+    const int attacker_square = in_check ? ToSquare(attacker.first, attacker.second) : -1;
+    const int block_step = (att_type == QUEEN || att_type == ROOK || att_type == BISHOP)
+        ? LineStep(ToSquare(king_row, king_col), attacker_square) : 0;
 
-    // up
-    if (IsLegalLocation(from_row - 1, from_col)) {
-      const Piece captured = location_to_piece_[from_row - 1][from_col];
-      if (captured.Missing()) {
-        new (current++) Move(from_row, from_col, from_row - 1, from_col, 0);
-      } else if (captured.GetTeam() != my_team) {
-        new (current++) Move(from_row, from_col, from_row - 1, from_col, captured.GetRaw(), castling_rights);
-      }
-    }
+    for (const auto& placed_piece : piece_list_[current_color]) {
+      const int8_t from_row = placed_piece.GetRow();
+      const int8_t from_col = placed_piece.GetCol();
+      const int from = ToSquare(from_row, from_col);
+        const auto& piece = mailbox_[from];
+        const PieceType type = piece.GetPieceType();
 
-    // left
-    if (IsLegalLocation(from_row, from_col - 1)) {
-      const Piece captured = location_to_piece_[from_row][from_col - 1];
-      if (captured.Missing()) {
-        new (current++) Move(from_row, from_col, from_row, from_col - 1, 0);
-      } else if (captured.GetTeam() != my_team) {
-        new (current++) Move(from_row, from_col, from_row, from_col - 1, captured.GetRaw(), castling_rights);
-      }
-    }
+        if (double_check && type != KING) [[unlikely]] continue;
 
-    // right
-    if (IsLegalLocation(from_row, from_col + 1)) {
-      const Piece captured = location_to_piece_[from_row][from_col + 1];
-      if (captured.Missing()) {
-        new (current++) Move(from_row, from_col, from_row, from_col + 1, 0);
-      } else if (captured.GetTeam() != my_team) {
-        new (current++) Move(from_row, from_col, from_row, from_col + 1, captured.GetRaw(), castling_rights);
-      }
-    }
-  // down
-    if (IsLegalLocation(from_row + 1, from_col)) {
+        if (!in_check) [[likely]] {
+        current = AddPieceMoves<ALL_MOVES>(current, from);
 
-      const Piece captured = location_to_piece_[from_row + 1][from_col];
-      if (captured.Missing()) {
-        new (current++) Move(from_row, from_col, from_row + 1, from_col, 0);
-      } else if (captured.GetTeam() != my_team) {
-        new (current++) Move(from_row, from_col, from_row + 1, from_col, captured.GetRaw(), castling_rights);
-      }
-    }
-             }
-            break;
-            default: assert(false && "Movegen: Invalid piece type");
-        }
+      } else if (type == KING) {
+        current = AddKingMovesInCheck(mailbox_, from_row, from_col, from, my_team, current);
+      } else {
+        if (block_step != 0) {
+          for (int to = ToSquare(king_row, king_col) + block_step; to != attacker_square; to += block_step) {
+            if (CanReach(mailbox_, type, current_color, from, to)) {
+              if (type == PAWN && IsPromotionSquare(current_color, to)) [[unlikely]] {
+                new (current++) Move(from_row, from_col, SquareRow(to), SquareCol(to), 0, QUEEN);
+              } else {
+                new (current++) Move(from_row, from_col, SquareRow(to), SquareCol(to), 0);
+              }
+            }
+          }
         }
 
-        
-        // Count all moves for mobility
-        size_t after_count = current - buffer;
-        int moves_added = (after_count - before_count);
-        result.mobility_counts[current_color] += moves_added;
+        // capture attacker
+        if (CanReach(mailbox_, type, current_color, from, attacker_square)) {
+          if (type == PAWN && IsPromotionSquare(current_color, attacker_square)) [[unlikely]] {
+            new (current++) Move(from_row, from_col, attacker.first, attacker.second, attacking_piece.GetRaw(), QUEEN);
+          } else {
+            new (current++) Move(from_row, from_col, attacker.first, attacker.second, attacking_piece.GetRaw());
+          }
+        }
+      }
     }
 
-    result.threat_counts[current_color] = threats;
-        
     result.count = current - buffer;
 
     // Check if the PV move was generated
@@ -2100,14 +1138,6 @@ Board::MoveGenResult Board::GetPseudoLegalMoves2(
     result.pv_index = pv_index;
     //result.in_check = in_check;
 
-
-    //static std::chrono::nanoseconds total_time{0};
-    //static size_t call_count = 0;
-    //auto pgen_end = std::chrono::high_resolution_clock::now();
-    //total_time += std::chrono::duration_cast<std::chrono::nanoseconds>(pgen_end - pstart);
-    //if (++call_count % 100000 == 0) {
-    //    std::cout << "---[MoveGen] Avg: " << (total_time.count() / call_count) << " ns, Calls: " << call_count << std::endl;
-    //}
     return result;
 }
 
@@ -2123,6 +1153,219 @@ void Board::InitializeHash() {
   UpdateTurnHash(static_cast<int>(GetTurn().GetColor()));
 }
 
+// Activity counts what the unchecked move generator would emit: a mobility
+// point per move, and for sliders and knights the threat weights the
+// evaluation was tuned with (a point per quiet slider square, a bonus for the
+// piece a ray or jump lands on and a larger one when it can be captured).
+// Castling and en passant are left out.
+Board::Activity Board::ComputeRayActivity(int square, int ray) const {
+  const Team team = mailbox_[square].GetTeam();
+  const int step = kRaySteps[ray];
+  Activity activity;
+  for (int n = kRayLength[square][ray]; n > 0; n--) {
+    square += step;
+    const Piece target = mailbox_[square];
+    if (target.Present()) {
+      if (target.GetTeam() != team) {
+        activity.mobility++;
+        activity.threats += 16;
+      }
+      activity.threats += 4;
+      break;
+    }
+    activity.mobility++;
+    activity.threats++;
+  }
+  return activity;
+}
+
+Board::Activity Board::ComputeStepActivity(int square) const {
+  const Piece piece = mailbox_[square];
+  const Team team = piece.GetTeam();
+  Activity activity;
+
+  switch (piece.GetPieceType()) {
+    case KNIGHT: {
+      const SquareList& targets = kKnightTargets[square];
+      for (int i = 0; i < targets.count; i++) {
+        const Piece target = mailbox_[targets.squares[i]];
+        if (target.Present()) {
+          if (target.GetTeam() != team) {
+            activity.mobility++;
+            activity.threats += 16;
+          }
+          activity.threats += 1;
+        } else {
+          activity.mobility++;
+        }
+      }
+    } break;
+    case PAWN: {
+      const PlayerColor color = piece.GetColor();
+      const auto& dir = kPawnDirections[color];
+      const int forward = square + Step(dir.delta_row, dir.delta_col);
+      if (mailbox_[forward].Missing()) {
+        activity.mobility++;
+        const bool not_moved = (color & 1) == 0
+            ? SquareRow(square) == kStartingRow[color]
+            : SquareCol(square) == kStartingCol[color];
+        if (not_moved && mailbox_[2 * forward - square].Missing()) {
+          activity.mobility++;
+        }
+      }
+      activity.mobility +=
+          mailbox_[square + Step(dir.capture1_row, dir.capture1_col)].IsEnemyOf(team);
+      activity.mobility +=
+          mailbox_[square + Step(dir.capture2_row, dir.capture2_col)].IsEnemyOf(team);
+    } break;
+    case KING: {
+      for (const auto* targets : {&kKingDiagonalTargets[square], &kKingOrthogonalTargets[square]}) {
+        for (int i = 0; i < targets->count; i++) {
+          const Piece target = mailbox_[targets->squares[i]];
+          activity.mobility += target.Missing() || target.GetTeam() != team;
+        }
+      }
+    } break;
+    default: break;
+  }
+  return activity;
+}
+
+void Board::SetActivity(int square, int slot, Activity activity) {
+  Activity& current = activity_[square][slot];
+  const int color = activity_color_[square];
+  mobility_[color] += activity.mobility - current.mobility;
+  threats_[color] += activity.threats - current.threats;
+  current = activity;
+}
+
+void Board::RefreshActivity(int square) {
+  for (int slot = 0; slot <= kStepActivity; slot++) {
+    SetActivity(square, slot, Activity{});
+  }
+  const Piece piece = mailbox_[square];
+  if (piece.Missing()) {
+    return;
+  }
+  activity_color_[square] = piece.GetColor();
+  switch (piece.GetPieceType()) {
+    case QUEEN:
+    case ROOK:
+    case BISHOP: {
+      const PieceType type = piece.GetPieceType();
+      const int first_ray = type == ROOK ? kFirstOrthogonalRay : kFirstDiagonalRay;
+      const int last_ray = type == BISHOP ? kFirstOrthogonalRay : kNumRays;
+      for (int ray = first_ray; ray < last_ray; ray++) {
+        SetActivity(square, ray, ComputeRayActivity(square, ray));
+      }
+    } break;
+    default:
+      SetActivity(square, kStepActivity, ComputeStepActivity(square));
+      break;
+  }
+}
+
+void Board::RefreshActivityAround(const int* squares, int count) {
+  for (int k = 0; k < count; k++) {
+    RefreshActivity(squares[k]);
+  }
+
+  for (int k = 0; k < count; k++) {
+    const int square = squares[k];
+
+    // Only the ray of a slider that runs through the square changes.
+    for (int ray = 0; ray < kNumRays; ray++) {
+      const int slider = FirstOccupied(mailbox_, square, ray);
+      if (slider >= 0 &&
+          IsSlider(mailbox_[slider], ray < kFirstOrthogonalRay ? BISHOP : ROOK)) {
+        const int back = OppositeRay(ray);
+        SetActivity(slider, back, ComputeRayActivity(slider, back));
+      }
+    }
+
+    // Knights and kings that can step onto it
+    const SquareList& knights = kKnightTargets[square];
+    for (int i = 0; i < knights.count; i++) {
+      const int from = knights.squares[i];
+      if (mailbox_[from].Present() && mailbox_[from].GetPieceType() == KNIGHT) {
+        SetActivity(from, kStepActivity, ComputeStepActivity(from));
+      }
+    }
+    for (const auto* targets : {&kKingDiagonalTargets[square], &kKingOrthogonalTargets[square]}) {
+      for (int i = 0; i < targets->count; i++) {
+        const int from = targets->squares[i];
+        if (mailbox_[from].Present() && mailbox_[from].GetPieceType() == KING) {
+          SetActivity(from, kStepActivity, ComputeStepActivity(from));
+        }
+      }
+    }
+
+    // Pawns that push onto or through it, or capture onto it
+    for (int color = 0; color < 4; color++) {
+      const auto& dir = kPawnDirections[color];
+      const int forward_step = Step(dir.delta_row, dir.delta_col);
+      for (int from : {square - forward_step, square - 2 * forward_step,
+                       square + kPawnAttackerSteps[color][0],
+                       square + kPawnAttackerSteps[color][1]}) {
+        if (mailbox_[from].GetRaw() == Piece::kRawPawn[color]) {
+          SetActivity(from, kStepActivity, ComputeStepActivity(from));
+        }
+      }
+    }
+  }
+}
+
+// MakeMove and UndoMove only record the squares a move touches. Squares of
+// moves made since the last flush sit on top of dirty_squares_, so undoing
+// such a move before anyone reads the counts just drops them again.
+void Board::MarkActivityDirty(const Move& move, bool undo) {
+  int changed[4] = {ToSquare(move.FromRow(), move.FromCol()),
+                    ToSquare(move.ToRow(), move.ToCol())};
+  int num_changed = 2;
+  if (move.GetEnpassantCapture().Present()) {
+    changed[num_changed++] = ToSquare(move.GetEnpassantTargetRow(), move.GetEnpassantTargetCol());
+  }
+  if (move.IsCastling()) {
+    changed[num_changed++] = ToSquare(move.RookFromRow(), move.RookFromCol());
+    changed[num_changed++] = ToSquare(move.RookToRow(), move.RookToCol());
+  }
+
+  // num_moves_ still counts the move while it is being undone.
+  const size_t ply = undo ? num_moves_ - 1 : num_moves_;
+  if (undo && ply >= activity_ply_) {
+    num_dirty_squares_ -= num_changed;
+    return;
+  }
+  if (num_dirty_squares_ + num_changed > kMaxDirtySquares) {
+    FlushActivity();
+    RefreshActivityAround(changed, num_changed);
+  } else {
+    for (int i = 0; i < num_changed; i++) {
+      dirty_squares_[num_dirty_squares_++] = changed[i];
+    }
+  }
+  if (undo || num_dirty_squares_ == 0) {
+    activity_ply_ = ply;
+  }
+}
+
+void Board::FlushDirtySquares() {
+  int squares[kMaxDirtySquares];
+  int count = 0;
+  uint64_t seen[(kMailboxSize + 63) / 64] = {};
+  for (int i = 0; i < num_dirty_squares_; i++) {
+    const int square = dirty_squares_[i];
+    const uint64_t bit = uint64_t{1} << (square & 63);
+    if (!(seen[square >> 6] & bit)) {
+      seen[square >> 6] |= bit;
+      squares[count++] = square;
+    }
+  }
+  RefreshActivityAround(squares, count);
+  num_dirty_squares_ = 0;
+  activity_ply_ = num_moves_;
+}
+
 void Board::MakeMove(const Move& move) {
   // Cases:
   // 1. Move
@@ -2136,11 +1379,25 @@ void Board::MakeMove(const Move& move) {
   const auto from_col = move.FromCol();
   const auto to_row = move.ToRow();
   const auto to_col = move.ToCol();
-  const Piece piece = location_to_piece_[from_row][from_col];
+  const Piece piece = mailbox_[ToSquare(from_row, from_col)];
   const PlayerColor color = piece.GetColor();
   const PieceType piece_type = piece.GetPieceType();
   const Team team = piece.GetTeam();
 
+  UndoRecord& record = undo_stack_[num_moves_ & (kMaxUndoPlies - 1)];
+  record.move = move;
+  record.hash_key = hash_key_;
+  record.pawn_king_key = pawn_king_key_;
+  record.castling_rights = castling_rights_[color];
+  record.en_passant_target = en_passant_targets_[color];
+  record.piece_square_evaluation = piece_square_evaluation_;
+  if (piece_square_table_ != nullptr) {
+    UpdatePieceSquareEvaluation(move, piece);
+  }
+  if (network_ != nullptr) {
+    UpdateAccumulator(move, piece, /*undo=*/false);
+  }
+
   // Handle en passant target for the current player
   en_passant_targets_[color] = EnPassantTarget{};
   if (piece_type == PAWN) {
@@ -2164,23 +1421,23 @@ void Board::MakeMove(const Move& move) {
     const auto ep_capture_team = ep_capture.GetTeam();
 
     //RemovePiece(move.To());
-    int8_t idx = piece_list_index_[ep_target_row][ep_target_col];
+    int8_t idx = piece_list_index_[ToSquare(ep_target_row, ep_target_col)];
     if (idx >= 0) {
       // Swap with last element to avoid O(n) erase
       int8_t last_idx = piece_list_[ep_capture_color].size() - 1;
       piece_list_[ep_capture_color][idx] = piece_list_[ep_capture_color][last_idx];
       // Update index of the moved piece
       PlacedPiece& moved = piece_list_[ep_capture_color][idx];
-      piece_list_index_[moved.GetRow()][moved.GetCol()] = idx;
+      piece_list_index_[ToSquare(moved.GetRow(), moved.GetCol())] = idx;
       piece_list_[ep_capture_color].pop_back();
-      piece_list_index_[ep_target_row][ep_target_col] = -1;
+      piece_list_index_[ToSquare(ep_target_row, ep_target_col)] = -1;
     } else {
         std::cout << "MakeMove en passant: Failed to find captured piece in piece_list_" << std::endl;
         abort();
     }
 
     UpdatePieceHash(ep_capture, ep_target_row, ep_target_col);
-    location_to_piece_[ep_target_row][ep_target_col] = Piece(Piece::kRawNoPiece);
+    mailbox_[ToSquare(ep_target_row, ep_target_col)] = Piece(Piece::kRawNoPiece);
 
     // Update piece eval
     int piece_eval = kPieceEvaluations[PAWN];
@@ -2201,23 +1458,23 @@ void Board::MakeMove(const Move& move) {
     const auto capture_type = standard_capture.GetPieceType();
 
     //RemovePiece(move.To());
-    int8_t idx = piece_list_index_[to_row][to_col];
+    int8_t idx = piece_list_index_[ToSquare(to_row, to_col)];
     if (idx >= 0) {
       // Swap with last element to avoid O(n) erase
       int8_t last_idx = piece_list_[capture_color].size() - 1;
       piece_list_[capture_color][idx] = piece_list_[capture_color][last_idx];
       // Update index of the moved piece
       PlacedPiece& moved = piece_list_[capture_color][idx];
-      piece_list_index_[moved.GetRow()][moved.GetCol()] = idx;
+      piece_list_index_[ToSquare(moved.GetRow(), moved.GetCol())] = idx;
       piece_list_[capture_color].pop_back();
-      piece_list_index_[to_row][to_col] = -1;
+      piece_list_index_[ToSquare(to_row, to_col)] = -1;
     } else {
         std::cout << "MakeMove Failed to find captured piece in piece_list_" << std::endl;
         abort();
     }
 
     UpdatePieceHash(standard_capture, to_row, to_col);
-    location_to_piece_[to_row][to_col] = Piece(Piece::kRawNoPiece);
+    mailbox_[ToSquare(to_row, to_col)] = Piece(Piece::kRawNoPiece);
 
     // Update king location
     if (capture_type == KING) {
@@ -2235,18 +1492,18 @@ void Board::MakeMove(const Move& move) {
   }
 
   // Update the piece's location in piece_list_ using index lookup
-  int8_t idx = piece_list_index_[from_row][from_col];
+  int8_t idx = piece_list_index_[ToSquare(from_row, from_col)];
   if (idx >= 0) {
     piece_list_[color][idx] = PlacedPiece(to_row, to_col);
-    piece_list_index_[from_row][from_col] = -1;
-    piece_list_index_[to_row][to_col] = idx;
+    piece_list_index_[ToSquare(from_row, from_col)] = -1;
+    piece_list_index_[ToSquare(to_row, to_col)] = idx;
   } else {
     std::cout << "MakeMove Failed to find moving piece in piece_list_" << std::endl;
     abort();
   }
 
   UpdatePieceHash(piece, from_row, from_col);
-  location_to_piece_[from_row][from_col] = Piece(Piece::kRawNoPiece);
+  mailbox_[ToSquare(from_row, from_col)] = Piece(Piece::kRawNoPiece);
 
   // Update king location
   if (piece_type == KING) {
@@ -2257,7 +1514,7 @@ void Board::MakeMove(const Move& move) {
 
   //SetPiece(to, piece);
   // Update the board
-  location_to_piece_[to_row][to_col] = piece;
+  mailbox_[ToSquare(to_row, to_col)] = piece;
 
   UpdatePieceHash(piece, to_row, to_col);
   // Update king location
@@ -2275,13 +1532,13 @@ void Board::MakeMove(const Move& move) {
     const Piece promoted_piece(promoted_raw);
     
     // Replace in piece_list_ (piece stays at same position, no index change needed)
-    int8_t idx = piece_list_index_[to_row][to_col];
+    int8_t idx = piece_list_index_[ToSquare(to_row, to_col)];
     if (idx >= 0) {
       piece_list_[color][idx] = PlacedPiece(to_row, to_col);
     }
     
     // Replace on board
-    location_to_piece_[to_row][to_col] = promoted_piece;
+    mailbox_[ToSquare(to_row, to_col)] = promoted_piece;
     
     // Update piece hash: remove pawn, add promoted piece
     UpdatePieceHash(piece, to_row, to_col);  // Remove pawn hash
@@ -2297,7 +1554,7 @@ void Board::MakeMove(const Move& move) {
     player_piece_evaluations_[color] += promotion_eval;
   }
 
-  if (move.RookFromRow() >= 0) {
+  if (move.IsCastling()) {
     castling_rights_[color] = CastlingRights(false, false);
 
     // Handle the rook move for castling
@@ -2307,18 +1564,18 @@ void Board::MakeMove(const Move& move) {
     const int8_t rook_to_col = move.RookToCol();
 
     // Get the rook piece from its original position
-    const auto rook_piece = location_to_piece_[rook_from_row][rook_from_col];
+    const auto rook_piece = mailbox_[ToSquare(rook_from_row, rook_from_col)];
 
     // Move the rook to its new position
-    location_to_piece_[rook_from_row][rook_from_col] = Piece(Piece::kRawNoPiece);
-    location_to_piece_[rook_to_row][rook_to_col] = rook_piece;
+    mailbox_[ToSquare(rook_from_row, rook_from_col)] = Piece(Piece::kRawNoPiece);
+    mailbox_[ToSquare(rook_to_row, rook_to_col)] = rook_piece;
     
     // Update the rook's position in the piece list
-    int8_t rook_idx = piece_list_index_[rook_from_row][rook_from_col];
+    int8_t rook_idx = piece_list_index_[ToSquare(rook_from_row, rook_from_col)];
     if (rook_idx >= 0) {
       piece_list_[rook_piece.GetColor()][rook_idx] = PlacedPiece(rook_to_row, rook_to_col);
-      piece_list_index_[rook_from_row][rook_from_col] = -1;
-      piece_list_index_[rook_to_row][rook_to_col] = rook_idx;
+      piece_list_index_[ToSquare(rook_from_row, rook_from_col)] = -1;
+      piece_list_index_[ToSquare(rook_to_row, rook_to_col)] = rook_idx;
     }
     
     // Update piece hash for the rook move
@@ -2331,7 +1588,9 @@ void Board::MakeMove(const Move& move) {
   UpdateTurnHash((t+1)%4);
 
   turn_ = GetNextPlayer(GetTurn());
-  moves_.push_back(move);
+  num_moves_++;
+  num_undoable_ = std::min(num_undoable_ + 1, kMaxUndoPlies);
+  MarkActivityDirty(move, /*undo=*/false);
 }
 
 
@@ -2343,31 +1602,35 @@ void Board::UndoMove() {
   // 4. Promotion
   // 5. Castling (rights, rook move)
 
-  const Move& move = moves_.back();
+  if (num_undoable_ == 0) {
+    std::cout << "UndoMove: no move to undo" << std::endl;
+    abort();
+  }
+  const UndoRecord& record = LastUndoRecord();
+  const Move& move = record.move;
 
   const auto to_row = move.ToRow();
   const auto to_col = move.ToCol();
   const auto from_row = move.FromRow();
   const auto from_col = move.FromCol();
 
-  const auto piece = location_to_piece_[to_row][to_col];
+  const auto piece = mailbox_[ToSquare(to_row, to_col)];
   
   const PlayerColor color = piece.GetColor();
                        
   // Find and update the moved piece's location in one pass
   // Update the piece's location using index lookup
-  int8_t idx = piece_list_index_[to_row][to_col];
+  int8_t idx = piece_list_index_[ToSquare(to_row, to_col)];
   if (idx >= 0) {
     piece_list_[color][idx] = PlacedPiece(from_row, from_col);
-    piece_list_index_[to_row][to_col] = -1;
-    piece_list_index_[from_row][from_col] = idx;
+    piece_list_index_[ToSquare(to_row, to_col)] = -1;
+    piece_list_index_[ToSquare(from_row, from_col)] = idx;
   } else {
       std::cout << "Failed to find moved piece in piece_list_ during UndoMove" << std::endl;
       std::abort();
   }
 
-  UpdatePieceHash(piece, to_row, to_col);
-  location_to_piece_[to_row][to_col] = Piece(Piece::kRawNoPiece);
+  mailbox_[ToSquare(to_row, to_col)] = Piece(Piece::kRawNoPiece);
 
   // end remove
 
@@ -2378,18 +1641,14 @@ void Board::UndoMove() {
   if (promotion_type != NO_PIECE) {
     // Create original pawn piece (optimized with precomputed raw bits)
     const Piece pawn_piece(Piece::kRawPawn[color]);
-    location_to_piece_[from_row][from_col] = pawn_piece;
+    mailbox_[ToSquare(from_row, from_col)] = pawn_piece;
     
     // Replace promoted piece with pawn in piece_list_ (piece stays at same position, no index change needed)
-    int8_t idx = piece_list_index_[from_row][from_col];
+    int8_t idx = piece_list_index_[ToSquare(from_row, from_col)];
     if (idx >= 0) {
       piece_list_[color][idx] = PlacedPiece(from_row, from_col);
     }
     
-    // Update hash: remove promoted piece, add pawn
-    UpdatePieceHash(piece, from_row, from_col);  // Remove promoted piece
-    UpdatePieceHash(Piece::kRawPawn[color], from_row, from_col);  // Add pawn hash
-    
     // Update evaluation: subtract promoted piece, add pawn
     const int undo_promotion_eval = kPieceEvaluations[PAWN] - kPieceEvaluations[promotion_type];
     const Team team = piece.GetTeam();
@@ -2400,13 +1659,11 @@ void Board::UndoMove() {
     }
     player_piece_evaluations_[color] += undo_promotion_eval;
   } else {
-    location_to_piece_[from_row][from_col] = piece;
-    UpdatePieceHash(piece, from_row, from_col);
+    mailbox_[ToSquare(from_row, from_col)] = piece;
   }
 
   // Update king location
   if (piece.GetPieceType() == KING) {
-    castling_rights_[color] = CastlingRights(false, false);
     king_row_[color] = from_row;
     king_col_[color] = from_col;
   }
@@ -2417,11 +1674,10 @@ void Board::UndoMove() {
     const int8_t ep_target_row = move.GetEnpassantTargetRow();
     const int8_t ep_target_col = move.GetEnpassantTargetCol();
     const PlayerColor ep_color = ep_capture.GetColor();
-    location_to_piece_[ep_target_row][ep_target_col] = ep_capture;
+    mailbox_[ToSquare(ep_target_row, ep_target_col)] = ep_capture;
     int8_t idx = piece_list_[ep_color].size();
-    piece_list_[ep_color].emplace_back(ep_target_row, ep_target_col);
-    piece_list_index_[ep_target_row][ep_target_col] = idx;
-    UpdatePieceHash(ep_capture, ep_target_row, ep_target_col);
+    piece_list_[ep_color].push_back(PlacedPiece(ep_target_row, ep_target_col));
+    piece_list_index_[ToSquare(ep_target_row, ep_target_col)] = idx;
     
     const int piece_eval = kPieceEvaluations[PAWN];
     const int sign = (ep_capture.GetTeam() == RED_YELLOW) ? 1 : -1;
@@ -2434,11 +1690,10 @@ void Board::UndoMove() {
   if (standard_capture.Present()) {
       const PlayerColor capture_color = standard_capture.GetColor();
       const PieceType capture_type = standard_capture.GetPieceType();
-      location_to_piece_[to_row][to_col] = standard_capture;
+      mailbox_[ToSquare(to_row, to_col)] = standard_capture;
       int8_t idx = piece_list_[capture_color].size();
-      piece_list_[capture_color].emplace_back(to_row, to_col);
-      piece_list_index_[to_row][to_col] = idx;
-      UpdatePieceHash(standard_capture, to_row, to_col);
+      piece_list_[capture_color].push_back(PlacedPiece(to_row, to_col));
+      piece_list_index_[ToSquare(to_row, to_col)] = idx;
       // Update king location if needed
       if (capture_type == KING) {
           king_row_[capture_color] = to_row;
@@ -2452,13 +1707,12 @@ void Board::UndoMove() {
       player_piece_evaluations_[capture_color] += piece_eval;
   }
 
-  // Clear en passant target for the current player when undoing a move
-  en_passant_targets_[color] = EnPassantTarget{};
-
-  if (move.RookFromRow() >= 0) {
-
-    castling_rights_[color] = move.GetInitialCastlingRights();
+  // The mover's castling rights and en passant target, and the hash key,
+  // come back from the record rather than being recomputed.
+  castling_rights_[color] = record.castling_rights;
+  en_passant_targets_[color] = record.en_passant_target;
 
+  if (move.IsCastling()) {
     // Undo the rook move for castling
     const int8_t rook_from_row = move.RookFromRow();
     const int8_t rook_from_col = move.RookFromCol();
@@ -2466,34 +1720,36 @@ void Board::UndoMove() {
     const int8_t rook_to_col = move.RookToCol();
 
     // Get the rook piece from its current position
-    const auto rook_piece = location_to_piece_[rook_to_row][rook_to_col];
+    const auto rook_piece = mailbox_[ToSquare(rook_to_row, rook_to_col)];
 
     // Move the rook back to its original position
-    location_to_piece_[rook_to_row][rook_to_col] = Piece(Piece::kRawNoPiece);
-    location_to_piece_[rook_from_row][rook_from_col] = rook_piece;
+    mailbox_[ToSquare(rook_to_row, rook_to_col)] = Piece(Piece::kRawNoPiece);
+    mailbox_[ToSquare(rook_from_row, rook_from_col)] = rook_piece;
 
     // Update the rook's position in the piece list
     // Update the rook's position using index lookup
-    int8_t rook_idx = piece_list_index_[rook_to_row][rook_to_col];
+    int8_t rook_idx = piece_list_index_[ToSquare(rook_to_row, rook_to_col)];
     if (rook_idx >= 0) {
       piece_list_[rook_piece.GetColor()][rook_idx] = PlacedPiece(rook_from_row, rook_from_col);
-      piece_list_index_[rook_to_row][rook_to_col] = -1;
-      piece_list_index_[rook_from_row][rook_from_col] = rook_idx;
+      piece_list_index_[ToSquare(rook_to_row, rook_to_col)] = -1;
+      piece_list_index_[ToSquare(rook_from_row, rook_from_col)] = rook_idx;
     }
-
-    // Update piece hash for the rook move
-    UpdatePieceHash(rook_piece, rook_to_row, rook_to_col);
-    UpdatePieceHash(rook_piece, rook_from_row, rook_from_col);
   }
   
   turn_ = (color == RED)    ? kRedPlayer :
         (color == BLUE)   ? kBluePlayer :
         (color == YELLOW) ? kYellowPlayer :
         kGreenPlayer;
-  moves_.pop_back();
-  int t = static_cast<int>(color);
-  UpdateTurnHash(t);
-  UpdateTurnHash((t+1)%4);
+  hash_key_ = record.hash_key;
+  pawn_king_key_ = record.pawn_king_key;
+  piece_square_evaluation_ = record.piece_square_evaluation;
+  if (network_ != nullptr) {
+    UpdateAccumulator(
+        move, mailbox_[ToSquare(move.FromRow(), move.FromCol())], /*undo=*/true);
+  }
+  MarkActivityDirty(move, /*undo=*/true);
+  num_moves_--;
+  num_undoable_--;
 }
 
 Team Board::TeamToPlay() const {
@@ -2511,95 +1767,320 @@ int Board::PieceEvaluation() const {
   return piece_evaluation_;
 }
 
+void Board::SetPieceSquareTable(const PieceSquareTable* table) {
+  piece_square_table_ = table;
+  piece_square_evaluation_ = 0;
+  if (table == nullptr) {
+    return;
+  }
+  for (int color = 0; color < 4; color++) {
+    for (const auto& placed_piece : piece_list_[color]) {
+      const int row = placed_piece.GetRow();
+      const int col = placed_piece.GetCol();
+      piece_square_evaluation_ +=
+        PieceSquareValue(mailbox_[ToSquare(row, col)], row, col);
+    }
+  }
+}
+
+void Board::UpdatePieceSquareEvaluation(const Move& move, Piece piece) {
+  const int from_row = move.FromRow();
+  const int from_col = move.FromCol();
+  const int to_row = move.ToRow();
+  const int to_col = move.ToCol();
+  int delta = -PieceSquareValue(piece, from_row, from_col);
+  const PieceType promotion_type = move.GetPromotionPieceType();
+  if (promotion_type != NO_PIECE) {
+    delta += PieceSquareValue(
+        Piece(piece.GetColor(), promotion_type), to_row, to_col);
+  } else {
+    delta += PieceSquareValue(piece, to_row, to_col);
+  }
+  if (move.IsEnPassant()) {
+    delta -= PieceSquareValue(move.GetEnpassantCapture(),
+                              move.GetEnpassantTargetRow(),
+                              move.GetEnpassantTargetCol());
+  } else if (move.IsCapture()) {
+    delta -= PieceSquareValue(move.GetCapturePiece(), to_row, to_col);
+  }
+  if (move.IsCastling()) {
+    const Piece rook(piece.GetColor(), ROOK);
+    delta += PieceSquareValue(rook, move.RookToRow(), move.RookToCol())
+           - PieceSquareValue(rook, move.RookFromRow(), move.RookFromCol());
+  }
+  piece_square_evaluation_ += delta;
+}
+
+void Board::SetNetwork(const nnue::Network* network) {
+  network_ = network;
+  if (network == nullptr) {
+    return;
+  }
+  network->Reset(accumulator_);
+  for (int color = 0; color < 4; color++) {
+    for (const auto& placed_piece : piece_list_[color]) {
+      const int row = placed_piece.GetRow();
+      const int col = placed_piece.GetCol();
+      AddFeature(mailbox_[ToSquare(row, col)], row, col);
+    }
+  }
+}
+
+void Board::UpdateAccumulator(const Move& move, Piece piece, bool undo) {
+  // At most two pieces leave and two arrive (castling, or a capture).
+  struct Change {
+    Piece piece;
+    int row;
+    int col;
+  };
+  Change removed[2];
+  Change added[2];
+  int num_removed = 0;
+  int num_added = 0;
+
+  removed[num_removed++] = {piece, move.FromRow(), move.FromCol()};
+  const PieceType promotion_type = move.GetPromotionPieceType();
+  added[num_added++] = {
+    promotion_type != NO_PIECE ? Piece(piece.GetColor(), promotion_type) : piece,
+    move.ToRow(), move.ToCol()};
+  if (move.IsEnPassant()) {
+    removed[num_removed++] = {move.GetEnpassantCapture(),
+                              move.GetEnpassantTargetRow(),
+                              move.GetEnpassantTargetCol()};
+  } else if (move.IsCapture()) {
+    removed[num_removed++] = {move.GetCapturePiece(), move.ToRow(), move.ToCol()};
+  } else if (move.IsCastling()) {
+    const Piece rook(piece.GetColor(), ROOK);
+    removed[num_removed++] = {rook, move.RookFromRow(), move.RookFromCol()};
+    added[num_added++] = {rook, move.RookToRow(), move.RookToCol()};
+  }
+
+  if (undo) {
+    for (int i = 0; i < num_added; i++) {
+      SubFeature(added[i].piece, added[i].row, added[i].col);
+    }
+    for (int i = 0; i < num_removed; i++) {
+      AddFeature(removed[i].piece, removed[i].row, removed[i].col);
+    }
+  } else {
+    for (int i = 0; i < num_removed; i++) {
+      SubFeature(removed[i].piece, removed[i].row, removed[i].col);
+    }
+    for (int i = 0; i < num_added; i++) {
+      AddFeature(added[i].piece, added[i].row, added[i].col);
+    }
+  }
+}
+
 int Board::PieceEvaluation(PlayerColor color) const {
   return player_piece_evaluations_[color];
 }
 
+// Helper threads and searches copy whole boards.
+static_assert(std::is_trivially_copyable_v<Board>);
+
 Board::Board(
     Player turn,
     std::unordered_map<std::pair<int8_t, int8_t>, Piece> location_to_piece,
     std::optional<std::unordered_map<Player, CastlingRights>> castling_rights,
     std::optional<EnpassantInitialization> enp)
   : turn_(std::move(turn)) {
-  // Initialize en passant targets for all players
-  for (int i = 0; i < 4; ++i) {
-    en_passant_targets_[i] = EnPassantTarget{};
+  Clear(turn_);
+  if (castling_rights.has_value()) {
+    for (const auto& [player, rights] : *castling_rights) {
+      castling_rights_[player.GetColor()] = rights;
+    }
   }
+  if (enp.has_value()) {
+    SetEnpassantInitialization(*enp);
+  }
+  for (const auto& [location, piece] : location_to_piece) {
+    if (!AddPiece(location.first, location.second, piece)) {
+      std::cout << "Board: can not place a piece at " << (int)location.first
+                << "," << (int)location.second << std::endl;
+      abort();
+    }
+  }
+  FinishSetup();
+}
 
+void Board::Clear(Player turn) {
+  turn_ = turn;
+  // Fill the mailbox with sentinels, then open up the playable squares.
+  // piece_list_index_ is -1 wherever there is no piece.
+  for (int square = 0; square < kMailboxSize; square++) {
+    mailbox_[square] = Piece(Piece::kRawOffBoard);
+    piece_list_index_[square] = -1;
+    for (int slot = 0; slot <= kStepActivity; slot++) {
+      activity_[square][slot] = Activity{};
+    }
+    activity_color_[square] = 0;
+  }
+  for (int row = 0; row < 14; row++) {
+    for (int col = 0; col < 14; col++) {
+      if (kLegalPositions[row][col]) {
+        mailbox_[ToSquare(row, col)] = Piece(Piece::kRawNoPiece);
+      }
+    }
+  }
   for (int color = 0; color < 4; color++) {
+    piece_list_[color] = PieceList();
     castling_rights_[color] = CastlingRights(false, false);
-    if (castling_rights.has_value()) {
-      auto& cr = *castling_rights;
-      Player pl(static_cast<PlayerColor>(color));
-      auto it = cr.find(pl);
-      if (it != cr.end()) {
-        castling_rights_[color] = it->second;
-      }
+    en_passant_targets_[color] = EnPassantTarget{};
+    player_piece_evaluations_[color] = 0;
+    king_row_[color] = -1;
+    king_col_[color] = -1;
+    mobility_[color] = 0;
+    threats_[color] = 0;
+  }
+  enp_ = EnpassantInitialization();
+  num_moves_ = 0;
+  num_undoable_ = 0;
+  piece_evaluation_ = 0;
+  piece_square_evaluation_ = 0;
+  hash_key_ = 0;
+  pawn_king_key_ = 0;
+  num_dirty_squares_ = 0;
+  activity_ply_ = 0;
+}
+
+bool Board::AddPiece(int8_t row, int8_t col, Piece piece) {
+  const PlayerColor color = piece.GetColor();
+  if (!IsLegalLocation(row, col) || GetPiece(row, col).Present()
+      || piece_list_[color].size() == PieceList::kMaxPieces) {
+    return false;
+  }
+  const int square = ToSquare(row, col);
+  mailbox_[square] = piece;
+  piece_list_index_[square] = piece_list_[color].size();
+  piece_list_[color].push_back(PlacedPiece(row, col));
+  const int value = kPieceEvaluations[static_cast<int>(piece.GetPieceType())];
+  piece_evaluation_ += piece.GetTeam() == RED_YELLOW ? value : -value;
+  player_piece_evaluations_[color] += value;
+  if (piece.GetPieceType() == KING) {
+    king_row_[color] = row;
+    king_col_[color] = col;
+  }
+  return true;
+}
+
+void Board::SetEnpassantInitialization(const EnpassantInitialization& enp) {
+  enp_ = enp;
+  for (int color = 0; color < 4; color++) {
+    en_passant_targets_[color] = EnPassantTarget{};
+    if (enp.enp_moves[color].has_value()) {
+      const Move& move = *enp.enp_moves[color];
+      en_passant_targets_[color] = EnPassantTarget{
+        static_cast<int8_t>((move.FromRow() + move.ToRow()) / 2),
+        static_cast<int8_t>((move.FromCol() + move.ToCol()) / 2)};
     }
   }
-  if (enp.has_value()) {
-    enp_ = std::move(*enp);
+}
+
+void Board::FinishSetup() {
+  for (int color = 0; color < 4; color++) {
+    for (const auto& placed_piece : piece_list_[color]) {
+      RefreshActivity(ToSquare(placed_piece.GetRow(), placed_piece.GetCol()));
+    }
   }
-  for (int i = 0; i < 4; i++) {
-    piece_list_.push_back(std::vector<PlacedPiece>());
-    piece_list_[i].reserve(16);
-    king_row_[i] = -1;
-    king_col_[i] = -1;
+  InitializeHash();
+  if (piece_square_table_ != nullptr) {
+    SetPieceSquareTable(piece_square_table_);
   }
+  if (network_ != nullptr) {
+    SetNetwork(network_);
+  }
+}
+
+namespace {
 
-  // Initialize piece_list_index_ to -1 (no piece at any position)
+// Layout of the serialized position.
+constexpr size_t kSerializedTypes = 0;        // 160 nibbles
+constexpr size_t kSerializedColors = 80;      // 160 times 2 bits
+constexpr size_t kSerializedTurn = 120;
+constexpr size_t kSerializedCastling = 121;   // Bit 2c kingside, 2c+1 queenside
+constexpr size_t kSerializedEnpassant = 122;  // row * 14 + col, or kNoSquare
+constexpr size_t kSerializedEnd = 126;        // Zero up to kSerializedSize
+constexpr uint8_t kNoSquare = 0xff;
+
+}  // namespace
+
+void Board::Serialize(uint8_t* out) const {
+  for (size_t i = 0; i < kSerializedSize; i++) {
+    out[i] = 0;
+  }
+  int index = 0;  // Of the playable square
   for (int row = 0; row < 14; row++) {
     for (int col = 0; col < 14; col++) {
-      piece_list_index_[row][col] = -1;
-    }
-  }
-
-  for (const auto& it : location_to_piece) {
-    const auto& location = it.first;
-    const auto& piece = it.second;
-    PlayerColor color = piece.GetColor();
-    location_to_piece_[location.first][location.second] = piece;
-    int8_t idx = piece_list_[piece.GetColor()].size();
-    piece_list_[piece.GetColor()].push_back(PlacedPiece(
-          location.first, location.second));
-    piece_list_index_[location.first][location.second] = idx;
-    PieceType piece_type = piece.GetPieceType();
-    if (piece.GetTeam() == RED_YELLOW) {
-      piece_evaluation_ += kPieceEvaluations[static_cast<int>(piece_type)];
-    } else {
-      piece_evaluation_ -= kPieceEvaluations[static_cast<int>(piece_type)];
+      if (!kLegalPositions[row][col]) {
+        continue;
+      }
+      const Piece piece = GetPiece(row, col);
+      if (piece.Present()) {
+        out[kSerializedTypes + index / 2] |=
+          (piece.GetPieceType() + 1) << (4 * (index % 2));
+        out[kSerializedColors + index / 4] |=
+          piece.GetColor() << (2 * (index % 4));
+      }
+      index++;
     }
-    player_piece_evaluations_[piece.GetColor()] += kPieceEvaluations[static_cast<int>(piece_type)];
-    if (piece.GetPieceType() == KING) {
-      king_row_[color] = location.first;
-      king_col_[color] = location.second;
+  }
+  out[kSerializedTurn] = turn_.GetColor();
+  for (int color = 0; color < 4; color++) {
+    out[kSerializedCastling] |=
+      (castling_rights_[color].Kingside() ? 1 : 0) << (2 * color);
+    out[kSerializedCastling] |=
+      (castling_rights_[color].Queenside() ? 1 : 0) << (2 * color + 1);
+    const EnPassantTarget& target = en_passant_targets_[color];
+    out[kSerializedEnpassant + color] =
+      target.row >= 0 ? target.row * 14 + target.col : kNoSquare;
+  }
+}
+
+bool Board::Deserialize(const uint8_t* in) {
+  bool valid = in[kSerializedTurn] < 4;
+  for (size_t i = kSerializedEnd; i < kSerializedSize; i++) {
+    valid = valid && in[i] == 0;
+  }
+  Clear(Player(valid ? static_cast<PlayerColor>(in[kSerializedTurn]) : RED));
+
+  int index = 0;
+  for (int row = 0; valid && row < 14; row++) {
+    for (int col = 0; valid && col < 14; col++) {
+      if (!kLegalPositions[row][col]) {
+        continue;
+      }
+      const int type = in[kSerializedTypes + index / 2] >> (4 * (index % 2)) & 0xf;
+      const int color = in[kSerializedColors + index / 4] >> (2 * (index % 4)) & 3;
+      if (type > 0) {
+        valid = type <= KING + 1 && AddPiece(
+            row, col, Piece(static_cast<PlayerColor>(color),
+                            static_cast<PieceType>(type - 1)));
+      } else {
+        valid = color == 0;
+      }
+      index++;
     }
   }
 
-  /*
-  struct {
-    bool operator()(const PlacedPiece& a, const PlacedPiece& b) {
-      // this doesn't need to be fast.
-      int piece_move_order_scores[6];
-      piece_move_order_scores[PAWN] = 1;
-      piece_move_order_scores[KNIGHT] = 2;
-      piece_move_order_scores[BISHOP] = 3;
-      piece_move_order_scores[ROOK] = 4;
-      piece_move_order_scores[QUEEN] = 5;
-      piece_move_order_scores[KING] = 0;
-
-      int order_a = piece_move_order_scores[a.GetPiece(*this).GetPieceType()];
-      int order_b = piece_move_order_scores[b.GetPiece(*this).GetPieceType()];
-      return order_a < order_b;
-    }
-  } customLess;
-
-  for (auto& placed_pieces : piece_list_) {
-    std::sort(placed_pieces.begin(), placed_pieces.end(), customLess);
+  for (int color = 0; valid && color < 4; color++) {
+    castling_rights_[color] = CastlingRights(
+        in[kSerializedCastling] >> (2 * color) & 1,
+        in[kSerializedCastling] >> (2 * color + 1) & 1);
+    const uint8_t square = in[kSerializedEnpassant + color];
+    if (square != kNoSquare) {
+      valid = square < 14 * 14 && IsLegalLocation(square / 14, square % 14);
+      en_passant_targets_[color] = EnPassantTarget{
+        static_cast<int8_t>(square / 14), static_cast<int8_t>(square % 14)};
+    }
   }
-  */
 
-  InitializeHash();
+  if (!valid) {
+    Clear(Player(RED));
+    return false;
+  }
+  FinishSetup();
+  return true;
 }
 
 inline Team GetTeam(PlayerColor color) {
@@ -2783,7 +2264,7 @@ std::ostream& operator<<(
   for (int i = 0; i < 14; i++) {
     for (int j = 0; j < 14; j++) {
       if (board.IsLegalLocation(i, j)) {
-        const auto piece = board.location_to_piece_[i][j];
+        const auto piece = board.mailbox_[ToSquare(i, j)];
         if (piece.Missing()) {
           os << ".";
         } else {
@@ -2798,9 +2279,10 @@ std::ostream& operator<<(
 
   os << "Turn: " << board.GetTurn() << std::endl;
 
-  os << "All moves: " << std::endl;
-  for (const auto& move : board.moves_) {
-    os << move << std::endl;
+  os << "Last moves: " << std::endl;
+  for (int ply = board.num_moves_ - board.num_undoable_;
+       ply < board.num_moves_; ply++) {
+    os << board.undo_stack_[ply & (Board::kMaxUndoPlies - 1)].move << std::endl;
   }
   return os;
 }
@@ -2815,83 +2297,36 @@ Team OtherTeam(Team team) {
 
 std::string Move::PrettyStr() const {
   std::string s;
-  s += ('a' + from_col_);
-  s += std::to_string(14 - from_row_);  // Assuming row 0 is at top (rank 14)
+  s += ('a' + FromCol());
+  s += std::to_string(14 - FromRow());  // Assuming row 0 is at top (rank 14)
   s += "-";
-  s += ('a' + to_col_);
-  s += std::to_string(14 - to_row_);
-  if (promotion_piece_type_ != NO_PIECE) {
-    s += "=" + ToStr(promotion_piece_type_);
+  s += ('a' + ToCol());
+  s += std::to_string(14 - ToRow());
+  if (GetPromotionPieceType() != NO_PIECE) {
+    s += "=" + ToStr(GetPromotionPieceType());
   }
   return s;
 }
 
-uint32_t Move::Pack() const {
-  uint32_t packed = 0;
-  packed |= (static_cast<uint32_t>(from_row_) & 0xF);
-  packed |= (static_cast<uint32_t>(from_col_) & 0xF) << 4;
-  packed |= (static_cast<uint32_t>(to_row_) & 0xF) << 8;
-  packed |= (static_cast<uint32_t>(to_col_) & 0xF) << 12;
-  packed |= (static_cast<uint32_t>(promotion_piece_type_) & 0x7) << 16;
-  if (rook_from_row_ >= 0) {
-    packed |= (1u << 19);  // Is castling
-  }
-  if (en_passant_capture_.Present()) {
-    packed |= (1u << 20);  // Is en passant
-  }
-  return packed;
-}
-
 Move Move::Unpack(uint32_t packed, const Board& board) {
-  int8_t from_r = packed & 0xF;
-  int8_t from_c = (packed >> 4) & 0xF;
-  int8_t to_r = (packed >> 8) & 0xF;
-  int8_t to_c = (packed >> 12) & 0xF;
-  PieceType promotion = static_cast<PieceType>((packed >> 16) & 0x7);
-  bool is_castling = (packed >> 19) & 1;
-  bool is_en_passant = (packed >> 20) & 1;
-
-  if (is_castling) {
-    // For castling, we need to determine the rook move based on king's movement
-    CastlingRights rights = board.GetCastlingRights(board.GetTurn());
-    // Rook move is derived from king's from/to
-    if (to_c > from_c) {  // Kingside
-      return Move(from_r, from_c, to_r, to_c, from_r, 13, from_r, to_c - 1, rights);
-    } else {  // Queenside
-      return Move(from_r, from_c, to_r, to_c, from_r, 0, from_r, to_c + 1, rights);
-    }
-  }
-
-  if (is_en_passant) {
-    // En passant: capture piece is on a different square than destination
-    const Piece& moving_piece = board.location_to_piece_[from_r][from_c];
-    // The captured pawn is one square behind the destination
-    int8_t captured_row = moving_piece.GetColor() == RED ? to_r - 1 :
-                          moving_piece.GetColor() == YELLOW ? to_r + 1 :
-                          moving_piece.GetColor() == BLUE ? to_r : to_r;
-    int8_t captured_col = moving_piece.GetColor() == BLUE ? to_c - 1 :
-                          moving_piece.GetColor() == GREEN ? to_c + 1 : to_c;
-    if (moving_piece.GetColor() == RED || moving_piece.GetColor() == YELLOW) {
-      captured_row = (moving_piece.GetColor() == RED) ? to_r - 1 : to_r + 1;
-      captured_col = to_c;
-    } else {
-      captured_row = to_r;
-      captured_col = (moving_piece.GetColor() == BLUE) ? to_c - 1 : to_c + 1;
-    }
-    const Piece& captured = board.location_to_piece_[captured_row][captured_col];
-    return Move(from_r, from_c, to_r, to_c, captured_row, captured_col, captured.GetRaw());
+  // Only the captured piece is missing from the packed form.
+  Move move;
+  move.bits_ = packed & kPackMask;
+  int capture_square = ToSquare(move.ToRow(), move.ToCol());
+  if (packed & kEnPassantBit) {
+    // The pawn in front of the mover; red and yellow pawns move along columns.
+    const Piece& moving_piece = board.mailbox_[ToSquare(move.FromRow(), move.FromCol())];
+    capture_square = (moving_piece.GetColor() & 1) == 0
+        ? ToSquare(move.ToRow(), move.FromCol())
+        : ToSquare(move.FromRow(), move.ToCol());
   }
-
-  // Standard move or promotion
-  // en passant promotion not implemented
-  const Piece& captured = board.location_to_piece_[to_r][to_c];
-  if (promotion != NO_PIECE) {
-    return Move(from_r, from_c, to_r, to_c, captured.GetRaw(), promotion);
+  if (!(packed & kCastlingBit)) {
+    const Piece& captured = board.mailbox_[capture_square];
+    if (captured.Present() && !captured.OffBoard()) {
+      move.bits_ |= uint32_t{captured.GetRaw()} << kCaptureShift;
+    }
   }
-
-  // Regular move with possible capture
-  int8_t capture_raw = captured.Missing() ? Piece::kRawNoPiece : captured.GetRaw();
-  return Move(from_r, from_c, to_r, to_c, capture_raw);
+  return move;
 }
 
 void Board::PrintBoard() const {
@@ -2906,7 +2341,7 @@ void Board::PrintBoard() const {
     for (int col = 0; col < 14; ++col) {
       const Piece& piece = GetPiece(row, col);
       
-      if (piece.Missing()) {
+      if (piece.Missing() || piece.OffBoard()) {
         std::cout << ". ";
       } else {
         // Use different colors for different players
@@ -2982,22 +2417,47 @@ std::string Board::ToFEN() const {
   // Part 5: Halfmove clock (unused, set to 0)
   fen << "-0";
 
-  // Part 6: Piece placement (14 rows)
+  // Part 6: En passant, as the double steps, only if there is a target
+  bool has_enpassant = false;
+  for (int i = 0; i < 4; i++) {
+    has_enpassant = has_enpassant || en_passant_targets_[i].row >= 0;
+  }
+  if (has_enpassant) {
+    static constexpr int8_t kForward[4][2] = {{-1, 0}, {0, 1}, {1, 0}, {0, -1}};
+    fen << "-{'enPassant':(";
+    for (int i = 0; i < 4; i++) {
+      if (i > 0) fen << ",";
+      fen << "'";
+      if (en_passant_targets_[i].row >= 0) {
+        // Convert to square notation (file a-n, rank 1-14)
+        const int row = en_passant_targets_[i].row;
+        const int col = en_passant_targets_[i].col;
+        fen << static_cast<char>('a' + col - kForward[i][1]) << 14 - (row - kForward[i][0])
+            << ":" << static_cast<char>('a' + col + kForward[i][1]) << 14 - (row + kForward[i][0]);
+      }
+      fen << "'";
+    }
+    fen << ")}";
+  }
+
+  // Part 7: Piece placement (14 rows, the squares separated by commas)
   fen << "-";
   for (int row = 0; row < 14; row++) {
     if (row > 0) fen << "/";
 
     int empty_count = 0;
+    bool first = true;
     for (int col = 0; col < 14; col++) {
-      const Piece& piece = location_to_piece_[row][col];
+      const Piece& piece = mailbox_[ToSquare(row, col)];
 
-      if (piece.Missing()) {
+      if (piece.Missing() || piece.OffBoard()) {
         empty_count++;
       } else {
         // Output empty count if any
         if (empty_count > 0) {
-          fen << empty_count;
+          fen << (first ? "" : ",") << empty_count;
           empty_count = 0;
+          first = false;
         }
 
         // Output piece
@@ -3021,29 +2481,14 @@ std::string Board::ToFEN() const {
           default:     piece_char = 'P'; break;
         }
 
-        fen << color_char << piece_char;
+        fen << (first ? "" : ",") << color_char << piece_char;
+        first = false;
       }
     }
 
     // Output trailing empty count
     if (empty_count > 0) {
-      fen << empty_count;
-    }
-  }
-
-  // Part 7: En passant targets
-  fen << "-";
-  for (int i = 0; i < 4; i++) {
-    if (i > 0) fen << ",";
-    if (en_passant_targets_[i].row >= 0) {
-      int8_t row = en_passant_targets_[i].row;
-      int8_t col = en_passant_targets_[i].col;
-      // Convert to square notation (file a-n, rank 1-14)
-      char file = 'a' + col;
-      int rank = 14 - row;
-      fen << file << rank;
-    } else {
-      fen << "";
+      fen << (first ? "" : ",") << empty_count;
     }
   }
 
@@ -3,6 +3,7 @@
 
 // Classes for a 4-player teams chess board (chess.com variant).
 
+#include <array>
 #include <functional>
 #include <memory>
 #include <optional>
@@ -16,6 +17,8 @@
 #include <execinfo.h>  // For backtrace
 #include <cstdlib>     // For free
 
+#include "nnue.h"
+
 namespace chess {
 
 class Board;
@@ -158,6 +161,19 @@ class Piece {
   // Formula: 0 (since present bit is 0)
   static constexpr uint8_t kRawNoPiece = 0;
 
+  // Raw bits of the sentinel that fills the off-board squares of the padded
+  // mailbox. It is "present" so ray walks stop on it, its piece type (7) never
+  // matches a real piece, and bit 0 (unused by real pieces) marks it.
+  static constexpr uint8_t kRawOffBoard = 0b10011101;
+
+  bool OffBoard() const { return GetRaw() == kRawOffBoard; }
+
+  // True only for a real piece of the other team: empty squares, own pieces
+  // and off-board sentinels all fail the single mask test.
+  bool IsEnemyOf(Team team) const {
+    return (GetRaw() & 0b10100001) == (0b10000000 | ((team ^ 1) << 5));
+  }
+
   // Static helpers to extract color/piece type from raw bits (bypasses virtual calls)
   static constexpr PlayerColor ExtractColor(uint8_t raw_bits) {
     return static_cast<PlayerColor>((raw_bits & 0b01100000) >> 5);
@@ -195,6 +211,17 @@ struct std::hash<std::pair<int8_t, int8_t>>
 
 namespace chess {
 
+  // Padded mailbox geometry. Each board row is stored in 16 slots and two
+  // sentinel rows are added above and below, so that any king, knight or
+  // slider step from a playable square lands inside the array. The cut
+  // corners, columns 14-15 and the padding rows hold Piece::kRawOffBoard.
+  constexpr int kMailboxWidth = 16;
+  constexpr int kMailboxSize = (14 + 4) * kMailboxWidth;
+
+  constexpr int ToSquare(int row, int col) { return (row + 2) * kMailboxWidth + col; }
+  constexpr int8_t SquareRow(int square) { return (square >> 4) - 2; }
+  constexpr int8_t SquareCol(int square) { return square & 15; }
+
   // Precomputed legal positions for 4-player chess board
   // 1 = legal, 0 = illegal
   static constexpr bool kLegalPositions[14][14] = {
@@ -256,177 +283,135 @@ class CastlingRights {
   //bool queenside_ = true;
 };
 
+// A move packed into 32 bits:
+//   bits  0-15: from row, from col, to row, to col (4 bits each)
+//   bits 16-18: promotion piece type (NO_PIECE if none)
+//   bit  19:    castling; the rook squares follow from the king's
+//   bit  20:    en passant; the captured pawn is in front of the mover
+//   bits 24-31: raw bits of the captured piece (kRawNoPiece if none)
+// The low 21 bits are the Pack() form stored in the transposition table.
 class Move {
  public:
   Move() = default;
 
-  // Raw constructor for castling - bypasses validation/overhead for performance (caller must ensure valid)
-  Move(int8_t king_from_r, int8_t king_from_c, int8_t king_to_r, int8_t king_to_c,
-       int8_t rook_from_r, int8_t rook_from_c, int8_t rook_to_r, int8_t rook_to_c,
-       CastlingRights initial_castling_rights) noexcept
-      : from_row_(king_from_r),
-        from_col_(king_from_c),
-        to_row_(king_to_r),
-        to_col_(king_to_c),
-        rook_from_row_(rook_from_r),
-        rook_from_col_(rook_from_c),
-        rook_to_row_(rook_to_r),
-        rook_to_col_(rook_to_c),
-        initial_castling_rights_(std::move(initial_castling_rights)) { }
-
   // Raw constructor - bypasses validation/overhead for performance (caller must ensure valid)
   Move(int8_t from_r, int8_t from_c, int8_t to_r, int8_t to_c,
        int8_t capture_raw) noexcept
-      : from_row_(from_r),
-        from_col_(from_c),
-        to_row_(to_r),
-        to_col_(to_c),
-        standard_capture_(capture_raw),
-        rook_from_row_(-1),
-        rook_from_col_(-1),
-        rook_to_row_(-1),
-        rook_to_col_(-1) { }
-
-  // Raw constructor with castling rights - for king moves
-  Move(int8_t from_r, int8_t from_c, int8_t to_r, int8_t to_c,
-       int8_t capture_raw, CastlingRights castling_rights) noexcept
-      : from_row_(from_r),
-        from_col_(from_c),
-        to_row_(to_r),
-        to_col_(to_c),
-        standard_capture_(capture_raw),
-        rook_from_row_(-1),
-        rook_from_col_(-1),
-        rook_to_row_(-1),
-        rook_to_col_(-1),
-        initial_castling_rights_(std::move(castling_rights)) { }
+      : bits_(Squares(from_r, from_c, to_r, to_c)
+              | (uint32_t{NO_PIECE} << kPromotionShift)
+              | (uint32_t{static_cast<uint8_t>(capture_raw)} << kCaptureShift)) { }
 
   // Raw constructor for promotion moves
   Move(int8_t from_r, int8_t from_c, int8_t to_r, int8_t to_c,
        int8_t capture_raw, PieceType promotion_type) noexcept
-      : from_row_(from_r),
-        from_col_(from_c),
-        to_row_(to_r),
-        to_col_(to_c),
-        standard_capture_(capture_raw),
-        promotion_piece_type_(promotion_type),
-        rook_from_row_(-1),
-        rook_from_col_(-1),
-        rook_to_row_(-1),
-        rook_to_col_(-1) { }
-
-  // Raw constructor for en passant moves
-  Move(int8_t from_r, int8_t from_c, int8_t to_r, int8_t to_c,
-       int8_t ep_row, int8_t ep_col, int8_t ep_capture_raw) noexcept
-      : from_row_(from_r),
-        from_col_(from_c),
-        to_row_(to_r),
-        to_col_(to_c),
-        standard_capture_(),
-        en_passant_capture_(ep_capture_raw),
-        ep_target_row_(ep_row),
-        ep_target_col_(ep_col),
-        rook_from_row_(-1),
-        rook_from_col_(-1),
-        rook_to_row_(-1),
-        rook_to_col_(-1) { }
-
-  int8_t FromRow() const { return from_row_; }
-  int8_t FromCol() const { return from_col_; }
-  int8_t ToRow() const { return to_row_; }
-  int8_t ToCol() const { return to_col_; }
+      : bits_(Squares(from_r, from_c, to_r, to_c)
+              | (uint32_t{static_cast<uint8_t>(promotion_type)} << kPromotionShift)
+              | (uint32_t{static_cast<uint8_t>(capture_raw)} << kCaptureShift)) { }
+
+  // King move of a castling; the rook move is derived from it.
+  static Move Castling(int8_t king_from_r, int8_t king_from_c,
+                       int8_t king_to_r, int8_t king_to_c) noexcept {
+    Move move(king_from_r, king_from_c, king_to_r, king_to_c, 0);
+    move.bits_ |= kCastlingBit;
+    return move;
+  }
+
+  // Pawn capture onto an empty square of the pawn in front of the mover.
+  static Move EnPassant(int8_t from_r, int8_t from_c, int8_t to_r, int8_t to_c,
+                        int8_t ep_capture_raw) noexcept {
+    Move move(from_r, from_c, to_r, to_c, ep_capture_raw);
+    move.bits_ |= kEnPassantBit;
+    return move;
+  }
+
+  int8_t FromRow() const { return bits_ & 0xF; }
+  int8_t FromCol() const { return (bits_ >> 4) & 0xF; }
+  int8_t ToRow() const { return (bits_ >> 8) & 0xF; }
+  int8_t ToCol() const { return (bits_ >> 12) & 0xF; }
   Piece GetStandardCapture() const {
-    return standard_capture_;
+    return (bits_ & kEnPassantBit) ? Piece(Piece::kRawNoPiece) : CaptureBits();
   }
   bool IsStandardCapture() const {
-    return standard_capture_.Present();
+    return GetStandardCapture().Present();
   }
   PieceType GetPromotionPieceType() const {
-    return promotion_piece_type_;
+    return static_cast<PieceType>((bits_ >> kPromotionShift) & 0x7);
+  }
+  bool IsEnPassant() const { return bits_ & kEnPassantBit; }
+  // The captured pawn stands on the square in front of the mover. Red and
+  // yellow pawns move along columns and capture blue and green ones.
+  int8_t GetEnpassantTargetRow() const {
+    if (!IsEnPassant()) return -1;
+    return (CaptureBits().GetColor() & 1) ? ToRow() : FromRow();
+  }
+  int8_t GetEnpassantTargetCol() const {
+    if (!IsEnPassant()) return -1;
+    return (CaptureBits().GetColor() & 1) ? FromCol() : ToCol();
   }
-  int8_t GetEnpassantTargetRow() const { return ep_target_row_; }
-  int8_t GetEnpassantTargetCol() const { return ep_target_col_; }
   Piece GetEnpassantCapture() const {
-    return en_passant_capture_;
-  }
-  int8_t RookFromRow() const { return rook_from_row_; }
-  int8_t RookFromCol() const { return rook_from_col_; }
-  int8_t RookToRow() const { return rook_to_row_; }
-  int8_t RookToCol() const { return rook_to_col_; }
-  CastlingRights GetInitialCastlingRights() const {
-    return initial_castling_rights_;
-  }
-
-  bool IsCapture() const {
-    return standard_capture_.Present() || en_passant_capture_.Present();
-  }
-  Piece GetCapturePiece() const {
-    return standard_capture_.Present() ? standard_capture_ : en_passant_capture_;
-  }
-
-  bool operator==(const Move& other) const {
-  return from_row_ == other.from_row_
-      && from_col_ == other.from_col_
-      && to_row_ == other.to_row_
-      && to_col_ == other.to_col_
-      && standard_capture_ == other.standard_capture_
-      && promotion_piece_type_ == other.promotion_piece_type_
-      && ep_target_row_ == other.ep_target_row_
-      && ep_target_col_ == other.ep_target_col_
-      && en_passant_capture_ == other.en_passant_capture_
-      && rook_from_row_ == other.rook_from_row_
-      && rook_from_col_ == other.rook_from_col_
-      && rook_to_row_ == other.rook_to_row_
-      && rook_to_col_ == other.rook_to_col_
-      && initial_castling_rights_ == other.initial_castling_rights_;
-  }
-  bool operator!=(const Move& other) const {
-    return !(*this == other);
+    return IsEnPassant() ? CaptureBits() : Piece(Piece::kRawNoPiece);
   }
+  // The king moves two squares toward the rook, which stands on the first
+  // playable square of the edge (3 or 10) and lands next to the king's
+  // starting square.
+  bool IsCastling() const { return bits_ & kCastlingBit; }
+  int8_t RookFromRow() const {
+    if (!IsCastling()) return -1;
+    return FromRow() == ToRow() ? FromRow() : (ToRow() > FromRow() ? 10 : 3);
+  }
+  int8_t RookFromCol() const {
+    if (!IsCastling()) return -1;
+    return FromCol() == ToCol() ? FromCol() : (ToCol() > FromCol() ? 10 : 3);
+  }
+  int8_t RookToRow() const {
+    if (!IsCastling()) return -1;
+    return (FromRow() + ToRow()) / 2;
+  }
+  int8_t RookToCol() const {
+    if (!IsCastling()) return -1;
+    return (FromCol() + ToCol()) / 2;
+  }
+
+  bool IsCapture() const { return CaptureBits().Present(); }
+  Piece GetCapturePiece() const { return CaptureBits(); }
+
+  bool operator==(const Move& other) const { return bits_ == other.bits_; }
+  bool operator!=(const Move& other) const { return bits_ != other.bits_; }
   //int ManhattanDistance() const;
   friend std::ostream& operator<<(
       std::ostream& os, const Move& move);
   std::string PrettyStr() const;
 
-  // Packed representation for transposition table (32 bits)
-  // Bits 0-7: from square (0-195, 196=invalid)
-  // Bits 8-15: to square (0-195, 196=invalid)
+  // Packed representation for transposition table (21 bits)
+  // Bits 0-7: from square (row, col)
+  // Bits 8-15: to square (row, col)
   // Bits 16-18: promotion piece type (0-6)
   // Bit 19: is castling
   // Bit 20: is en passant
-  // Bits 21-31: reserved (0)
-  uint32_t Pack() const;
+  uint32_t Pack() const { return bits_ & kPackMask; }
   static Move Unpack(uint32_t packed, const Board& board);
 
  private:
+  static constexpr int kPromotionShift = 16;
+  static constexpr uint32_t kCastlingBit = 1u << 19;
+  static constexpr uint32_t kEnPassantBit = 1u << 20;
+  static constexpr uint32_t kPackMask = (1u << 21) - 1;
+  static constexpr int kCaptureShift = 24;
+
+  static constexpr uint32_t Squares(
+      int8_t from_r, int8_t from_c, int8_t to_r, int8_t to_c) {
+    return (uint32_t(from_r) & 0xF) | ((uint32_t(from_c) & 0xF) << 4)
+        | ((uint32_t(to_r) & 0xF) << 8) | ((uint32_t(to_c) & 0xF) << 12);
+  }
+  Piece CaptureBits() const {
+    return Piece(static_cast<int8_t>(bits_ >> kCaptureShift));
+  }
 
-  int8_t from_row_;
-  int8_t from_col_;
-  int8_t to_row_;
-  int8_t to_col_;
-
-  // Capture
-  Piece standard_capture_; // 1
-
-  // Promotion
-  PieceType promotion_piece_type_ = NO_PIECE; // 1
-
-  // En-passant
-  Piece en_passant_capture_;  // 1
-  int8_t ep_target_row_ = -1;
-  int8_t ep_target_col_ = -1;
-
-  // For castling moves
-  int8_t rook_from_row_ = -1;
-  int8_t rook_from_col_ = -1;
-  int8_t rook_to_row_ = -1;
-  int8_t rook_to_col_ = -1;
-
-  // Castling rights before the move
-  CastlingRights initial_castling_rights_; // 1
-
+  uint32_t bits_ = uint32_t{NO_PIECE} << kPromotionShift;
 };
 
+static_assert(sizeof(Move) == 4);
+
 enum GameResult {
   IN_PROGRESS = 0,
   WIN_RY = 1,
@@ -455,6 +440,29 @@ class PlacedPiece {
   int8_t col_;
 };
 
+// Fixed-capacity list of the locations of one color's pieces. Moves only
+// ever take pieces off a list or put back ones that were taken, so the
+// capacity of the initial setup is never exceeded.
+class PieceList {
+ public:
+  static constexpr int kMaxPieces = 16;
+
+  const PlacedPiece* begin() const { return pieces_; }
+  const PlacedPiece* end() const { return pieces_ + size_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  PlacedPiece& operator[](size_t i) { return pieces_[i]; }
+  const PlacedPiece& operator[](size_t i) const { return pieces_[i]; }
+  void push_back(const PlacedPiece& placed_piece) {
+    pieces_[size_++] = placed_piece;
+  }
+  void pop_back() { size_--; }
+
+ private:
+  PlacedPiece pieces_[kMaxPieces];
+  int8_t size_ = 0;
+};
+
 struct EnpassantInitialization {
   // Indexed by PlayerColor
   std::optional<Move> enp_moves[4] = {std::nullopt, std::nullopt, std::nullopt, std::nullopt};
@@ -481,17 +489,26 @@ class Board {
   struct MoveGenResult {
     size_t count;
     int pv_index;  // -1 if PV move not found
-    int mobility_counts[4] = {0};  // One for each player color
-    int threat_counts[4] = {0};    // One for each player color
     bool in_check = false;
   };
   
   MoveGenResult GetPseudoLegalMoves2(
     Move* buffer,
     size_t limit,
-    const std::vector<PlacedPiece>& pieces,
+    const PieceList& pieces,
     const std::optional<Move>& pv_move = std::nullopt);
 
+  // Staged generation for a side that is not in check: CAPTURES are standard
+  // and en passant captures, QUIETS everything else, including promotions and
+  // castling. In check use GetPseudoLegalMoves2, which only emits evasions.
+  enum MoveGenType { ALL_MOVES, CAPTURES, QUIETS };
+  size_t GetPseudoLegalMoves(Move* buffer, MoveGenType type) const;
+  bool InCheck() const;
+  // The move of the side to move with the same from/to squares, promotion
+  // and castling/en passant flags, exactly as the generator would emit it
+  // when not in check, or nullopt if it is not pseudo-legal here.
+  std::optional<Move> ToPseudoLegalMove(const Move& move) const;
+
   struct KingCaptureInfo {
     int8_t from_row;
     int8_t from_col;
@@ -505,9 +522,33 @@ class Board {
   Team TeamToPlay() const;
   int PieceEvaluation() const;
   int PieceEvaluation(PlayerColor color) const;
+  // Piece-square table in centipawns, [color][piece_type][row][col], for the
+  // owner of the piece. The board keeps a pointer to it.
+  using PieceSquareTable = int[4][6][14][14];
+  // Installs `table` (or nullptr for none) and sums it over the pieces on the
+  // board. MakeMove keeps the sum up to date from then on.
+  void SetPieceSquareTable(const PieceSquareTable* table);
+  // Sum of the table over the red/yellow pieces minus the blue/green ones.
+  int PieceSquareEvaluation() const { return piece_square_evaluation_; }
+  // Installs `network` (or nullptr for none) and fills the accumulator from
+  // the pieces on the board. MakeMove and UndoMove update it from then on.
+  void SetNetwork(const nnue::Network* network);
+  bool HasNetwork() const { return network_ != nullptr; }
+  // Network evaluation in centipawns for the side to move's team.
+  int NetworkEvaluation() const {
+    return network_->Evaluate(accumulator_, turn_.GetTeam());
+  }
   int MobilityEvaluation();
   int MobilityEvaluation(const Player& player);
   const Player& GetTurn() const { return turn_; }
+
+  // Pseudo-mobility and threat terms of a color's pieces. They count like the
+  // unchecked move generator, without castling and en passant, and regardless
+  // of whose turn it is. Only the pieces around the squares changed since the
+  // last read are refreshed.
+  int Mobility(PlayerColor color) { FlushActivity(); return mobility_[color]; }
+  int Threats(PlayerColor color) { FlushActivity(); return threats_[color]; }
+
   bool IsAttackedByTeam(
       Team team,
       int8_t loc_row,
@@ -525,30 +566,33 @@ class Board {
       int8_t cd
       ) const {
     const bool is_orthogonal = (rd == 0) || (cd == 0);
-    // Start scanning from the piece's original location (now empty)
-    int8_t row = from_row + rd;
-    int8_t col = from_col + cd;
-    while (IsLegalLocation(row, col)) {
-        const auto piece = GetPiece(row, col);
-        if (piece.Present()) {
-            if (piece.GetTeam() == team) {
-                PieceType type = piece.GetPieceType();
-                if (is_orthogonal) {
-                    if (type == QUEEN || type == ROOK) return true;
-                } else { // diagonal
-                    if (type == QUEEN || type == BISHOP) return true;
-                }
-            }
-            break;  // Blocked by any piece
+    const int step = rd * kMailboxWidth + cd;
+    // Start scanning from the piece's original location (now empty); the
+    // sentinel squares end the walk at the edge of the board.
+    int square = ToSquare(from_row, from_col) + step;
+    while (mailbox_[square].Missing()) {
+        square += step;
+    }
+    const auto piece = mailbox_[square];
+    if (piece.GetTeam() == team) {
+        PieceType type = piece.GetPieceType();
+        if (is_orthogonal) {
+            if (type == QUEEN || type == ROOK) return true;
+        } else { // diagonal
+            if (type == QUEEN || type == BISHOP) return true;
         }
-        row += rd;
-        col += cd;
     }
     return false;
   }
 
   std::pair<int8_t, int8_t> GetAttacker(Team team, int8_t row, int8_t col) const;
 
+  // Static exchange evaluation of a capture: the material the capturing side
+  // wins or loses (negative) once the recaptures on the target square are
+  // played out with the least valuable attacker each time. Opponents recapture
+  // in turn order. Promotions are ignored.
+  int StaticExchange(const Move& move);
+
   std::pair<int8_t, int8_t> GetAttackerForOneColor(PlayerColor color, int8_t row, int8_t col) const;
 
   std::pair<int8_t, int8_t> GetRevAttacker(Team team, int8_t row, int8_t col) const;
@@ -558,25 +602,57 @@ class Board {
   bool KingPresent(PlayerColor color) const { return king_row_[color] >= 0; }
 
   const Piece& GetPiece(int row, int col) const {
-    return location_to_piece_[row][col];
+    return mailbox_[ToSquare(row, col)];
   }
+  const Piece& GetPiece(int square) const { return mailbox_[square]; }
 
   int64_t HashKey() const { return hash_key_; }
+  // Hash of the pawns and kings alone, for caching terms that depend on
+  // nothing else, such as the pawn shield.
+  int64_t PawnKingKey() const { return pawn_king_key_; }
 
   std::string ToFEN() const;
 
   static std::shared_ptr<Board> CreateStandardSetup();
+
+  // Sets up a position in place, without the maps of the constructor: Clear,
+  // then AddPiece for every piece, then FinishSetup. The piece-square table
+  // and network, if installed, stay installed.
+  void Clear(Player turn);
+  // Returns false if the square is not playable or taken, or if the color
+  // has no room for another piece.
+  bool AddPiece(int8_t row, int8_t col, Piece piece);
+  void SetCastlingRights(PlayerColor color, CastlingRights rights) {
+    castling_rights_[color] = rights;
+  }
+  // Also sets the en passant targets, the squares the pawns skipped.
+  void SetEnpassantInitialization(const EnpassantInitialization& enp);
+  void FinishSetup();
+
+  // Fixed-size binary encoding of the position, for bulk I/O: a nibble per
+  // playable square with its piece type (0 for none), two bits per square
+  // with the color, then the side to move, castling rights and en passant
+  // targets. The move history is not part of it.
+  static constexpr size_t kSerializedSize = 128;
+  void Serialize(uint8_t* out) const;
+  // Sets up the position written by Serialize. Returns false if `in` is not
+  // such an encoding, in which case the board is left cleared.
+  bool Deserialize(const uint8_t* in);
 //  bool operator==(const Board& other) const;
 //  bool operator!=(const Board& other) const;
   const CastlingRights& GetCastlingRights(const Player& player) const;
 
+  // Only the last kMaxUndoPlies moves can be undone.
+  static constexpr int kMaxUndoPlies = 512;
   void MakeMove(const Move& move);
   void UndoMove();
   bool LastMoveWasCapture() const {
-    return !moves_.empty() && moves_.back().GetStandardCapture().Present();
+    return num_undoable_ > 0
+        && LastUndoRecord().move.GetStandardCapture().Present();
   }
-  int NumMoves() const { return moves_.size(); }
-  const std::vector<Move>& Moves() { return moves_; }
+  int NumMoves() const { return num_moves_; }
+  // Hash key of the position before the last move; there must be one.
+  int64_t HashKeyBeforeLastMove() const { return LastUndoRecord().hash_key; }
 
   // Print the current board state to stdout
   void PrintBoard() const;
@@ -584,9 +660,6 @@ class Board {
   friend std::ostream& operator<<(
       std::ostream& os, const Board& board);
 
-  static std::chrono::nanoseconds total_time;
-  static size_t call_count;
-
 
   bool IsLegalLocation(int row, int col) const {
     // Bounds check first (faster to fail fast for out-of-bounds)
@@ -597,7 +670,7 @@ class Board {
   }
 
   const EnpassantInitialization& GetEnpassantInitialization() { return enp_; }
-  const std::vector<std::vector<PlacedPiece>>& GetPieceList() { return piece_list_; };
+  const std::array<PieceList, 4>& GetPieceList() const { return piece_list_; }
 
   // Static hash tables (shared across all Board instances for thread compatibility)
   static int64_t piece_hashes_[4][6][14][14];
@@ -609,40 +682,127 @@ class Board {
 
   void InitializeHash();
   void UpdatePieceHash(const Piece& piece, int8_t row, int8_t col) {
-    hash_key_ ^= piece_hashes_[piece.GetColor()][piece.GetPieceType()]
-      [row][col];
+    UpdatePieceHash(piece.GetColor(), piece.GetPieceType(), row, col);
   }
   void UpdatePieceHash(uint8_t raw_bits, int8_t row, int8_t col) {
-    hash_key_ ^= piece_hashes_[Piece::ExtractColor(raw_bits)][Piece::ExtractPieceType(raw_bits)]
-      [row][col];
+    UpdatePieceHash(Piece::ExtractColor(raw_bits),
+                    Piece::ExtractPieceType(raw_bits), row, col);
+  }
+  void UpdatePieceHash(PlayerColor color, PieceType piece_type,
+                       int8_t row, int8_t col) {
+    const int64_t hash = piece_hashes_[color][piece_type][row][col];
+    hash_key_ ^= hash;
+    // Without a branch: all ones for pawns and kings, else zero.
+    pawn_king_key_ ^= hash & -static_cast<int64_t>(
+        piece_type == PAWN || piece_type == KING);
   }
   void UpdateTurnHash(int turn) {
     hash_key_ ^= turn_hashes_[turn];
   }
 
+  // Mobility and threat contribution of one ray of a slider, or of all the
+  // steps of a knight, pawn or king.
+  struct Activity {
+    int16_t mobility = 0;
+    int16_t threats = 0;
+  };
+  static constexpr int kStepActivity = 8;  // Slot after the eight rays
+  Activity ComputeRayActivity(int square, int ray) const;
+  Activity ComputeStepActivity(int square) const;
+  void SetActivity(int square, int slot, Activity activity);
+  // Recomputes every slot of the piece on `square`, or clears them.
+  void RefreshActivity(int square);
+  // Refreshes the pieces whose moves depend on the occupancy of `squares`:
+  // the pieces on them, the slider rays running through them, and the
+  // knights, kings and pawns that step onto them.
+  void RefreshActivityAround(const int* squares, int count);
+  void MarkActivityDirty(const Move& move, bool undo);
+  void FlushActivity() {
+    if (num_dirty_squares_ > 0) FlushDirtySquares();
+  }
+  void FlushDirtySquares();
+  // Adds the table change of `move`, made by `piece`, before it is made.
+  void UpdatePieceSquareEvaluation(const Move& move, Piece piece);
+  // Applies the feature changes of `move`, made by `piece`, to the
+  // accumulator, or takes them back if `undo`.
+  void UpdateAccumulator(const Move& move, Piece piece, bool undo);
+  void AddFeature(Piece piece, int row, int col) {
+    network_->AddFeature(accumulator_, Feature(piece, row, col, 0),
+                         Feature(piece, row, col, 1));
+  }
+  void SubFeature(Piece piece, int row, int col) {
+    network_->SubFeature(accumulator_, Feature(piece, row, col, 0),
+                         Feature(piece, row, col, 1));
+  }
+  static int Feature(Piece piece, int row, int col, int perspective) {
+    return nnue::FeatureIndex(perspective, piece.GetColor(),
+                              piece.GetPieceType(), row, col);
+  }
+  template <MoveGenType kGen>
+  Move* AddPieceMoves(Move* current, int from) const;
+
+  struct EnPassantTarget {
+    int8_t row = -1;
+    int8_t col = -1;
+  };
+  // State before a move that UndoMove cannot recover from the move itself.
+  struct UndoRecord {
+    Move move;
+    int64_t hash_key;
+    int64_t pawn_king_key;
+    CastlingRights castling_rights;  // Of the side that moved
+    EnPassantTarget en_passant_target;
+    int piece_square_evaluation;
+  };
+  // Table value of `piece` on (row, col), signed for its team.
+  int PieceSquareValue(Piece piece, int row, int col) const {
+    const int value = (*piece_square_table_)[piece.GetColor()]
+                                            [piece.GetPieceType()][row][col];
+    return piece.GetTeam() == RED_YELLOW ? value : -value;
+  }
+  static_assert((kMaxUndoPlies & (kMaxUndoPlies - 1)) == 0);
+  const UndoRecord& LastUndoRecord() const {
+    return undo_stack_[(num_moves_ - 1) & (kMaxUndoPlies - 1)];
+  }
+
   friend class Move;
   friend class PlacedPiece;
 
   Player turn_;
 
-  Piece location_to_piece_[14][14];
-  std::vector<std::vector<PlacedPiece>> piece_list_;
-  int8_t piece_list_index_[14][14];  // Maps (row,col) to index in piece_list_[color], -1 if empty
+  Piece mailbox_[kMailboxSize];  // Indexed by ToSquare(row, col)
+  std::array<PieceList, 4> piece_list_;
+  int8_t piece_list_index_[kMailboxSize];  // Maps square to index in piece_list_[color], -1 if empty
 
   CastlingRights castling_rights_[4];
   EnpassantInitialization enp_;
-  std::vector<Move> moves_; // list of moves from beginning of game
+  // Ring of the last moves, the one made at ply p at p % kMaxUndoPlies.
+  UndoRecord undo_stack_[kMaxUndoPlies];
+  int num_moves_ = 0;     // Plies made since the setup
+  int num_undoable_ = 0;  // Records in undo_stack_, at most kMaxUndoPlies
   int piece_evaluation_ = 0;
   int player_piece_evaluations_[4] = {0, 0, 0, 0}; // one per player
+  const PieceSquareTable* piece_square_table_ = nullptr;  // Not owned
+  int piece_square_evaluation_ = 0;
+  const nnue::Network* network_ = nullptr;  // Not owned
+  nnue::Accumulator accumulator_;
 
   int64_t hash_key_ = 0;
+  int64_t pawn_king_key_ = 0;
   int8_t king_row_[4] = {-1, -1, -1, -1};
   int8_t king_col_[4] = {-1, -1, -1, -1};
-  struct EnPassantTarget {
-    int8_t row = -1;
-    int8_t col = -1;
-  };
   EnPassantTarget en_passant_targets_[4];  // One for each player color
+
+  Activity activity_[kMailboxSize][kStepActivity + 1];  // Indexed by square
+  int8_t activity_color_[kMailboxSize] = {};  // Owner of activity_[square]
+  int mobility_[4] = {0, 0, 0, 0};  // Sum of activity_ per color
+  int threats_[4] = {0, 0, 0, 0};
+  // Squares touched by the moves made or undone since the counts were last
+  // refreshed; those made since then are on top, from ply activity_ply_ on.
+  static constexpr int kMaxDirtySquares = 64;
+  int16_t dirty_squares_[kMaxDirtySquares];
+  int num_dirty_squares_ = 0;
+  size_t activity_ply_ = 0;
 };
 
 // Helper functions
@@ -0,0 +1,96 @@
+#include "checkmate_discovery.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace chess {
+
+namespace {
+
+// The writer sleeps this long when the rings are empty, and writes at
+// least this often.
+constexpr auto kWriterInterval = std::chrono::milliseconds(50);
+// Written as soon as the batch is this large.
+constexpr size_t kWriteBatchBytes = 1 << 16;
+
+}  // namespace
+
+CheckmateDiscovery::CheckmateDiscovery(
+    const std::string& path, int max_checkmates, int num_threads)
+  : max_checkmates_(max_checkmates), file_(path),
+    seen_(std::max(max_checkmates, 1)), writer_board_(Player(RED), {}) {
+  for (int i = 0; i < std::max(num_threads, 1); i++) {
+    rings_.push_back(std::make_unique<Ring>());
+  }
+  if (file_.is_open()) {
+    writer_ = std::thread(&CheckmateDiscovery::WriterLoop, this);
+  }
+}
+
+CheckmateDiscovery::~CheckmateDiscovery() {
+  quit_ = true;
+  if (writer_.joinable()) {
+    writer_.join();
+  }
+}
+
+bool CheckmateDiscovery::Add(size_t thread_id, const Board& board) {
+  Ring& ring = *rings_[thread_id];
+  const size_t head = ring.head.load(std::memory_order_relaxed);
+  // A full ring drops the checkmate before it is marked as seen, so that it
+  // can be found again.
+  if (!IsOpen()
+      || head - ring.tail.load(std::memory_order_acquire) == Ring::kSize
+      || num_discovered_.load(std::memory_order_relaxed) >= max_checkmates_
+      || !seen_.Insert(board.HashKey())) {
+    return false;
+  }
+
+  board.Serialize(ring.records[head % Ring::kSize].position);
+  ring.head.store(head + 1, std::memory_order_release);
+
+  return num_discovered_.fetch_add(1) + 1 == max_checkmates_;
+}
+
+void CheckmateDiscovery::WriterLoop() {
+  std::string batch;
+  auto last_write = std::chrono::steady_clock::now();
+  while (true) {
+    // Read before draining, so that nothing added before quit_ is missed.
+    const bool quit = quit_.load();
+    const size_t drained = Drain(batch);
+    const auto now = std::chrono::steady_clock::now();
+    if (!batch.empty()
+        && (quit || batch.size() >= kWriteBatchBytes
+            || now - last_write >= kWriterInterval)) {
+      file_ << batch;
+      file_.flush();
+      batch.clear();
+      last_write = now;
+    }
+    if (quit) {
+      return;
+    }
+    if (drained == 0) {
+      std::this_thread::sleep_for(kWriterInterval);
+    }
+  }
+}
+
+size_t CheckmateDiscovery::Drain(std::string& out) {
+  size_t drained = 0;
+  for (auto& ring : rings_) {
+    const size_t head = ring->head.load(std::memory_order_acquire);
+    size_t tail = ring->tail.load(std::memory_order_relaxed);
+    for (; tail != head; tail++) {
+      writer_board_.Deserialize(ring->records[tail % Ring::kSize].position);
+      out += writer_board_.ToFEN();
+      out += '\n';
+      drained++;
+    }
+    ring->tail.store(tail, std::memory_order_release);
+  }
+  return drained;
+}
+
+}  // namespace chess
@@ -0,0 +1,74 @@
+#ifndef _CHECKMATE_DISCOVERY_H_
+#define _CHECKMATE_DISCOVERY_H_
+
+// Writes the checkmates the search comes across to a file, for puzzles.
+//
+// The search threads only copy the position into a ring buffer of their own
+// after checking its key against a lock-free set. A writer thread turns the
+// positions into FENs and writes them in batches, so that neither the file
+// nor a lock holds up the search.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "board.h"
+#include "key_set.h"
+
+namespace chess {
+
+class CheckmateDiscovery {
+ public:
+  // Writes to `path` for `num_threads` search threads, until
+  // `max_checkmates` have been found.
+  CheckmateDiscovery(const std::string& path, int max_checkmates,
+                     int num_threads);
+  // Writes what is still buffered.
+  ~CheckmateDiscovery();
+  CheckmateDiscovery(const CheckmateDiscovery&) = delete;
+  CheckmateDiscovery& operator=(const CheckmateDiscovery&) = delete;
+
+  bool IsOpen() const { return file_.is_open(); }
+
+  // Called by search thread `thread_id` with a position where the side to
+  // move is checkmated. Returns true for the checkmate that reaches the
+  // maximum, after which the search should stop.
+  bool Add(size_t thread_id, const Board& board);
+
+  int NumDiscovered() const { return num_discovered_.load(); }
+
+ private:
+  struct Record {
+    uint8_t position[Board::kSerializedSize];  // Board::Serialize
+  };
+
+  // Single producer, single consumer.
+  struct Ring {
+    static constexpr size_t kSize = 256;
+    Record records[kSize];
+    std::atomic<size_t> head = 0;  // Next to write, by the search thread
+    std::atomic<size_t> tail = 0;  // Next to read, by the writer
+  };
+
+  void WriterLoop();
+  // Moves the records of all rings to `out` as FEN lines. Returns how many.
+  size_t Drain(std::string& out);
+
+  const int max_checkmates_;
+  std::ofstream file_;
+  ConcurrentKeySet seen_;
+  std::vector<std::unique_ptr<Ring>> rings_;
+  std::atomic<int> num_discovered_ = 0;
+  std::atomic<bool> quit_ = false;
+  std::thread writer_;
+  Board writer_board_;  // The writer's, to turn records into FENs
+};
+
+}  // namespace chess
+
+#endif  // _CHECKMATE_DISCOVERY_H_
@@ -1,12 +1,54 @@
 // Command line interface for the engine.
 // Supports UCI: https://gist.github.com/DOBRO/2592c6dad754ba67e6dcaec8c90165bf
+//
+//   cli                    UCI on stdin and stdout
+//   cli --server <socket> [--threads N] [--hash MB]
+//                          UCI sessions for many clients on a Unix socket
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <thread>
 
 #include "command_line.h"
+#include "server.h"
+#include "utils.h"
 
 
 int main(int argc, char* argv[]) {
-  chess::CommandLine command_line;
-  command_line.Run();
-  return 0;
-}
+  if (argc == 1) {
+    chess::CommandLine command_line;
+    command_line.Run();
+    return 0;
+  }
 
+  chess::ServerOptions options;
+  options.num_threads =
+      std::max<int>(std::thread::hardware_concurrency(), 1);
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (i + 1 == argc) {
+      std::cout << "Missing value of " << arg << std::endl;
+      return 1;
+    }
+    const std::string value = argv[++i];
+    if (arg == "--server") {
+      options.socket_path = value;
+      continue;
+    }
+    auto val = chess::ParseInt(value);
+    if (!val.has_value() || *val < 1) {
+      std::cout << "Invalid value of " << arg << ": " << value << std::endl;
+      return 1;
+    }
+    if (arg == "--threads") {
+      options.num_threads = *val;
+    } else if (arg == "--hash") {
+      options.hash_mb = *val;
+    } else {
+      std::cout << "Unknown argument " << arg << std::endl;
+      return 1;
+    }
+  }
+  return chess::RunServer(options) ? 0 : 1;
+}
@@ -1,5 +1,6 @@
 #include "command_line.h"
 
+#include <algorithm>
 #include <chrono>
 #include <exception>
 #include <iostream>
@@ -12,6 +13,9 @@
 #include <unordered_map>
 #include <vector>
 
+#include "analysis_cache.h"
+#include "batch_analysis.h"
+#include "benchmark.h"
 #include "player.h"
 #include "transposition_table.h"
 #include "board.h"
@@ -22,6 +26,9 @@ namespace chess {
 
 constexpr char kEngineName[] = "4pChess 0.1";
 constexpr char kAuthorName[] = "Louis O.";
+constexpr int kDefaultBenchDepth = 4;
+constexpr int kDefaultSearchBenchDepth = 10;
+constexpr int kDefaultSmpBenchDepth = 12;
 
 using std::chrono::milliseconds;
 using std::chrono::system_clock;
@@ -40,24 +47,46 @@ std::string LowerCase(const std::string& s) {
 
 std::string GetPVStr(const AlphaBetaPlayer& player) {
   std::string pv;
-  const PVInfo* pv_info = &player.GetPVInfo();
-  while (pv_info != nullptr) {
-    auto best_move = pv_info->GetBestMove();
-    if (best_move.has_value()) {
-      if (!pv.empty()) {
-        pv += " ";
-      }
-      pv += best_move->PrettyStr();
+  const PVInfo& pv_info = player.GetPVInfo();
+  for (int i = 0; i < pv_info.GetDepth(); i++) {
+    if (!pv.empty()) {
+      pv += " ";
     }
-    pv_info = pv_info->GetChild().get();
+    pv += pv_info.GetMove(i).PrettyStr();
   }
   return pv;
 }
 
+// Some legal move of the side to move, for a search that ended before it
+// had a result.
+std::optional<Move> AnyLegalMove(Board& board) {
+  constexpr size_t kMaxMoves = 512;
+  Move moves[kMaxMoves];
+  const PlayerColor color = board.GetTurn().GetColor();
+  const Team other_team = OtherTeam(board.GetTurn().GetTeam());
+  const size_t count = board.GetPseudoLegalMoves2(
+      moves, kMaxMoves, board.GetPieceList()[color]).count;
+  for (size_t i = 0; i < count; i++) {
+    board.MakeMove(moves[i]);
+    const bool legal = !board.KingPresent(color)
+      || !board.IsAttackedByTeam(other_team, board.GetKingRow(color),
+                                 board.GetKingCol(color));
+    board.UndoMove();
+    if (legal) {
+      return moves[i];
+    }
+  }
+  return std::nullopt;
+}
+
 }  // namespace
 
-CommandLine::CommandLine() {
+CommandLine::CommandLine(
+    std::istream& in, std::ostream& out, SharedResources shared)
+  : in_(in), out_(out), shared_(std::move(shared)) {
   player_options_.num_threads = 2;
+  player_options_.shared_transposition_table = shared_.transposition_table;
+  player_options_.search_pool = shared_.search_pool;
   // Initialize the board with standard setup
   board_ = Board::CreateStandardSetup();
 }
@@ -66,12 +95,32 @@ void CommandLine::Run() {
   // Runs on main thread
   player_ = std::make_shared<AlphaBetaPlayer>(player_options_);
   ResetBoard();
-  while (running_) {
-    std::string line;
-    std::getline(std::cin, line);
+  std::string line;
+  while (running_ && std::getline(in_, line)) {
     std::vector<std::string> parts = SplitStrOnWhitespace(line);
     HandleCommand(line, parts);
   }
+  // A client of a server that went away is not waited for. On stdin the end
+  // of input may follow "go" right away, as with a piped command.
+  if (running_ && shared_.search_pool == nullptr) {
+    std::unique_ptr<std::thread> thread;
+    {
+      std::lock_guard lock(mutex_);
+      thread = std::move(thread_);
+    }
+    if (thread != nullptr) {
+      thread->join();
+    }
+  }
+  StopEvaluation();
+}
+
+void CommandLine::SendInfoMessage(const std::string& message) {
+  out_ << "info string " << message << std::endl;
+}
+
+void CommandLine::SendInvalidCommandMessage(const std::string& line) {
+  SendInfoMessage("invalid command: '" + line + "'");
 }
 
 void CommandLine::SetBoard(std::shared_ptr<Board> board) {
@@ -80,19 +129,39 @@ void CommandLine::SetBoard(std::shared_ptr<Board> board) {
 }
 
 void CommandLine::StopEvaluation() {
-  std::lock_guard lock(mutex_);
-  if (thread_ != nullptr) {
-    if (player_ != nullptr) {
-      player_->SetCanceled(true);
-    }
-    thread_->join();
-    thread_.reset();
-    if (player_ != nullptr) {
-      player_->SetCanceled(false);
-    }
+  std::unique_ptr<std::thread> thread;
+  std::shared_ptr<AlphaBetaPlayer> player;
+  {
+    std::lock_guard lock(mutex_);
+    thread = std::move(thread_);
+    player = player_;
+    pondering_ = false;
+  }
+  if (thread == nullptr) {
+    return;
+  }
+  ponder_cv_.notify_all();
+  // Joined without the lock, which the search thread takes when it starts.
+  if (player != nullptr) {
+    player->SetCanceled(true);
+  }
+  stopping_ = true;
+  thread->join();
+  stopping_ = false;
+  if (player != nullptr) {
+    player->SetCanceled(false);
   }
 }
 
+void CommandLine::ResetPlayer() {
+  // The running search belongs to the old player, which has to be the one
+  // that is canceled.
+  StopEvaluation();
+  auto player = std::make_shared<AlphaBetaPlayer>(player_options_);
+  std::lock_guard lock(mutex_);
+  player_ = std::move(player);
+}
+
 void CommandLine::ResetBoard() {
   std::lock_guard lock(mutex_);
   board_ = Board::CreateStandardSetup();
@@ -105,8 +174,10 @@ void CommandLine::SetEvaluationOptions(const EvaluationOptions& options) {
 
 void CommandLine::StartEvaluation() {
   std::lock_guard lock(mutex_);
-  thread_ = std::make_unique<std::thread>([this]() {
-    int depth = 1;
+  pondering_ = options_.ponder.value_or(false);
+  const int num_threads = player_options_.enable_multithreading
+    ? player_options_.num_threads : 1;
+  thread_ = std::make_unique<std::thread>([this, num_threads]() {
     std::shared_ptr<Board> board;
     std::shared_ptr<AlphaBetaPlayer> player;
     EvaluationOptions options;
@@ -143,131 +214,79 @@ void CommandLine::StartEvaluation() {
     }
     */
 
+    SearchLimits limits;
+    limits.depth = options.depth;
+    limits.movetime = options.movetime;
+    limits.nodes = options.nodes;
+    limits.time[RED] = options.red_time;
+    limits.time[BLUE] = options.blue_time;
+    limits.time[YELLOW] = options.yellow_time;
+    limits.time[GREEN] = options.green_time;
+    limits.inc[RED] = options.red_inc;
+    limits.inc[BLUE] = options.blue_inc;
+    limits.inc[YELLOW] = options.yellow_inc;
+    limits.inc[GREEN] = options.green_inc;
+    limits.moves_to_go = options.moves_to_go;
+    limits.infinite = options.infinite.value_or(false);
+    limits.ponder = options.ponder.value_or(false);
+    limits.threads = num_threads;
+    // In a server the search may wait for searchers of the pool, with its
+    // clock running, and get fewer than num_threads.
     auto start = system_clock::now();
-    int num_eval_start = player->GetNumEvaluations();
-    std::optional<Move> best_move;
 
-    std::optional<milliseconds> time_limit;
-
-    while (!player->IsCanceled()
-           && (!options.depth.has_value() || depth <= *options.depth)
-           && depth < 100) {
-      // start again from the same board position
-      auto res = player->MakeMove(*board, depth);
-
-      if (res.has_value()) {
-        auto duration_ms = duration_cast<milliseconds>(
-            system_clock::now() - start);
-        int num_evals = player->GetNumEvaluations() - num_eval_start;
-        std::optional<int> nps;
-        if (duration_ms.count() > 0) {
-          nps = (int) (((float)num_evals) / (duration_ms.count() / 1000.0));
-        }
-        int score_centipawn = std::get<0>(*res);
-        if (board->GetTurn().GetTeam() == BLUE_GREEN) {
-          score_centipawn = -score_centipawn;
-        }
-        std::string pv = GetPVStr(*player);
-
-        /*
-        // Print the board when a new depth is reached
-        static int last_depth = 0;
-        if (depth > last_depth) {
-          last_depth = depth;
-          std::cout << "\n";  // Add a newline before the board
-          
-          // Create a copy of the board to apply the PV
-          std::shared_ptr<Board> board_copy = std::make_shared<Board>(*board_);
-          
-          // Apply the PV moves to the board copy
-          const PVInfo* pv_info = &player->GetPVInfo();
-          while (pv_info != nullptr) {
-            auto best_move = pv_info->GetBestMove();
-            if (best_move.has_value()) {
-              board_copy->MakeMove(*best_move);
-            }
-            pv_info = pv_info->GetChild().get();
-          }
-          
-          // Print the board after applying the PV
-          board_copy->PrintBoard();
-          std::cout << "Searching depth " << depth << "...\n";
-        }
-        */
-
-        std::cout
-          << "info"
-          << " depth " << depth
-          << " time " << duration_ms.count()
-          << " nodes " << num_evals
-          << " pv " << pv
-          << " score " << score_centipawn;
-        if (nps.has_value()) {
-          std::cout << " nps " << *nps;
-        }
-        std::cout << std::endl;
-
-        best_move = std::get<1>(*res);
-
-        if (std::abs(score_centipawn) == kMateValue) {
-          std::cout << "checkmate score" << std::endl;
-          abort();
-          // Verify the mate line by walking back through the PV
-          std::vector<Move> pv_moves;
-          const PVInfo* pv_info = &player->GetPVInfo();
-          while (pv_info != nullptr) {
-            auto best_move_pv = pv_info->GetBestMove();
-            if (best_move_pv.has_value()) {
-              pv_moves.push_back(*best_move_pv);
-            }
-            pv_info = pv_info->GetChild().get();
-          }
-
-          if (pv_moves.size() > 0) {
-            bool mate_verified = true;
-            // Use PV-based depth for verification
-            // Walk back from the end, verifying from each position
-            // stop one move before the final position
-            for (size_t skip_last = 1; skip_last < pv_moves.size(); ++skip_last) {
-              std::shared_ptr<Board> board_copy = std::make_shared<Board>(*board);
-              int verify_depth = std::min(30, (int)skip_last + 10);
-              // Apply all moves except the last 'skip_last' moves
-              for (size_t i = 0; i < pv_moves.size() - skip_last; ++i) {
-                board_copy->MakeMove(pv_moves[i]);
-              }
-              // Run verification search from this position with PV-based depth
-              std::cout << "verifying " << verify_depth << std::endl;
-              auto verify_res = player->MakeMove(*board_copy, verify_depth);
-              if (verify_res.has_value()) {
-                int verify_score = std::get<0>(*verify_res);
-                if (board_copy->GetTurn().GetTeam() == BLUE_GREEN) {
-                  verify_score = -verify_score;
-                }
-                if (std::abs(verify_score) != kMateValue) {
-                  mate_verified = false;
-                  break;
-                }
-              } else {
-                mate_verified = false;
-                break;
-              }
-            }
-            if (mate_verified) {
-              break;
-            }
-          }
-        }
+    int64_t num_eval_start = player->GetNumEvaluations();
+    const bool blue_green = board->GetTurn().GetTeam() == BLUE_GREEN;
 
-      } else {
-        break;
+    const IterationCallback on_iteration = [&](int depth, int score) {
+      auto duration_ms = duration_cast<milliseconds>(
+          system_clock::now() - start);
+      int64_t num_evals = player->GetNumEvaluations() - num_eval_start;
+      std::optional<int64_t> nps;
+      if (duration_ms.count() > 0) {
+        nps = num_evals * 1000 / duration_ms.count();
       }
+      int score_centipawn = blue_green ? -score : score;
+
+      out_
+        << "info"
+        << " depth " << depth
+        << " time " << duration_ms.count()
+        << " nodes " << num_evals
+        << " pv " << GetPVStr(*player)
+        << " score " << score_centipawn;
+      if (nps.has_value()) {
+        out_ << " nps " << *nps;
+      }
+      out_ << std::endl;
+    };
+    auto res = player->MakeMove(*board, limits, on_iteration);
 
-      depth++;
+    std::optional<Move> best_move;
+    if (res.has_value()) {
+      best_move = std::get<1>(*res);
     }
 
+    {
+      // A ponder search that ends by itself reports only after ponderhit or
+      // stop.
+      std::unique_lock lock(mutex_);
+      ponder_cv_.wait(lock, [this] { return !pondering_; });
+    }
+
+    // The GUI waits for a bestmove after every go.
+    if (!best_move.has_value()) {
+      best_move = AnyLegalMove(*board);
+    }
     if (best_move.has_value()) {
-      std::cout << "bestmove " << best_move->PrettyStr() << std::endl;
-      best_move = std::nullopt;
+      out_ << "bestmove " << best_move->PrettyStr();
+      const PVInfo& pv_info = player->GetPVInfo();
+      if (res.has_value() && pv_info.GetDepth() >= 2
+          && pv_info.GetMove(0) == *best_move) {
+        out_ << " ponder " << pv_info.GetMove(1).PrettyStr();
+      }
+      out_ << std::endl;
+    } else {
+      out_ << "bestmove 0000" << std::endl;
     }
 
   });
@@ -302,9 +321,9 @@ void CommandLine::HandleCommand(
       }
     }
 
-    std::cout << "Starting checkmate discovery mode..." << std::endl;
-    std::cout << "Max checkmates: " << max_checkmates << std::endl;
-    std::cout << "Output file: " << output_file << std::endl;
+    out_ << "Starting checkmate discovery mode..." << std::endl;
+    out_ << "Max checkmates: " << max_checkmates << std::endl;
+    out_ << "Output file: " << output_file << std::endl;
 
     // Enable checkmate discovery mode
     player_options_.checkmate_discovery_mode = true;
@@ -312,8 +331,7 @@ void CommandLine::HandleCommand(
     player_options_.checkmate_output_file = output_file;
 
     // Recreate player with new options
-    StopEvaluation();
-    player_ = std::make_shared<AlphaBetaPlayer>(player_options_);
+    ResetPlayer();
 
     // Reset to starting position
     ResetBoard();
@@ -328,18 +346,24 @@ void CommandLine::HandleCommand(
   }
   const auto& command = parts[0];
   if (command == "uci") {
-    std::cout << "id name " << kEngineName << std::endl;
-    std::cout << "id author " << kAuthorName << std::endl;
+    out_ << "id name " << kEngineName << std::endl;
+    out_ << "id author " << kAuthorName << std::endl;
 
     // Allowed options
-    std::cout << "option name Hash type spin default 100"
+    out_ << "option name Hash type spin default 100"
       << std::endl; // size in MB
-    std::cout << "option name UCI_ShowCurrLine type check default false"
+    out_ << "option name UCI_ShowCurrLine type check default false"
+      << std::endl;
+    out_ << "option name EvalFile type string default <empty>"
+      << std::endl;
+    out_ << "option name Ponder type check default false"
+      << std::endl;
+    out_ << "option name CacheFile type string default <empty>"
       << std::endl;
 
-    std::cout << "uciok" << std::endl;
+    out_ << "uciok" << std::endl;
   } else if (command == "isready") {
-    std::cout << "readyok" << std::endl;
+    out_ << "readyok" << std::endl;
   } else if (command == "setoption") {
     if (parts.size() != 5) {
       SendInvalidCommandMessage(line);
@@ -355,15 +379,19 @@ void CommandLine::HandleCommand(
               "Hash MB must be non-negative, given: " + option_value);
           return;
         }
-        size_t size = *val * 1000000 / sizeof(HashTableEntry);
-        if (size != player_options_.transposition_table_size) {
+        size_t size = *val * 1000000 / TranspositionTable::kEntrySize;
+        if (shared_.transposition_table != nullptr) {
+          SendInfoMessage("Hash is set by the server");
+        } else if (size != player_options_.transposition_table_size) {
           player_options_.transposition_table_size = size;
-          player_ = std::make_shared<AlphaBetaPlayer>(player_options_);
+          ResetPlayer();
         }
       } else {
         SendInvalidCommandMessage("Can not parse int: " + option_value);
         return;
       }
+    } else if (option_name == "ponder") {
+      // The GUI decides when to ponder, nothing to set up
     } else if (option_name == "uci_showcurrline") {
       if (option_value == "true") {
         show_current_line_ = true;
@@ -390,8 +418,31 @@ void CommandLine::HandleCommand(
       if (n_threads != player_options_.num_threads) {
         player_options_.num_threads = n_threads;
         player_options_.enable_multithreading = n_threads > 1;
-        player_ = std::make_shared<AlphaBetaPlayer>(player_options_);
+        ResetPlayer();
+      }
+    } else if (option_name == "evalfile") {
+      // <empty> goes back to the handcrafted evaluation.
+      std::shared_ptr<const nnue::Network> network;
+      if (option_value != "<empty>") {
+        network = nnue::Network::Load(option_value);
+        if (network == nullptr) {
+          SendInvalidCommandMessage("Can not load EvalFile: " + option_value);
+          return;
+        }
+      }
+      player_options_.network = network;
+      ResetPlayer();
+    } else if (option_name == "cachefile") {
+      std::shared_ptr<const AnalysisCache> cache;
+      if (option_value != "<empty>") {
+        cache = AnalysisCache::Load(option_value);
+        if (cache == nullptr) {
+          SendInvalidCommandMessage("Can not load CacheFile: " + option_value);
+          return;
+        }
       }
+      player_options_.analysis_cache = cache;
+      ResetPlayer();
     } else {
       SendInvalidCommandMessage("Unrecognized option: " + option_name);
       return;
@@ -399,8 +450,11 @@ void CommandLine::HandleCommand(
     StopEvaluation();
 
   } else if (command == "ucinewgame") {
-    // stop evaluation, if any, and create a new player / board
+    // stop evaluation, if any, and reset the player / board
     StopEvaluation();
+    if (player_ != nullptr) {
+      player_->NewGame();
+    }
     ResetBoard();
   } else if (command == "position") {
 
@@ -467,7 +521,15 @@ void CommandLine::HandleCommand(
     option_name_to_value["rtime"] = &options.red_time;
     option_name_to_value["btime"] = &options.blue_time;
     option_name_to_value["ytime"] = &options.yellow_time;
+    option_name_to_value["gtime"] = &options.green_time;
+    option_name_to_value["rinc"] = &options.red_inc;
+    option_name_to_value["binc"] = &options.blue_inc;
+    option_name_to_value["yinc"] = &options.yellow_inc;
+    option_name_to_value["ginc"] = &options.green_inc;
+    option_name_to_value["movestogo"] = &options.moves_to_go;
+    option_name_to_value["movetime"] = &options.movetime;
     option_name_to_value["depth"] = &options.depth;
+    option_name_to_value["nodes"] = &options.nodes;
     option_name_to_value["mate"] = &options.mate;
 
     while (cmd_id < parts.size()) {
@@ -484,11 +546,18 @@ void CommandLine::HandleCommand(
         *value = ParseInt(int_str);
         if (!value->has_value()) {
           SendInvalidCommandMessage("Can not parse integer: {}" + int_str);
+          return;
         }
         cmd_id += 2;
       } else if (option_name == "infinite") { 
         options.infinite = true;
         cmd_id++;
+      } else if (option_name == "ponder") {
+        options.ponder = true;
+        cmd_id++;
+      } else {
+        SendInvalidCommandMessage(line);
+        return;
       }
 
     }
@@ -497,6 +566,175 @@ void CommandLine::HandleCommand(
     SetEvaluationOptions(options);
     StartEvaluation();
 
+  } else if (command == "perft") {
+    // perft [divide] <depth>, on the current position
+    const bool divide = parts.size() == 3 && parts[1] == "divide";
+    std::optional<int> depth;
+    if (parts.size() == (divide ? 3u : 2u)) {
+      depth = ParseInt(parts.back());
+    }
+    if (!depth.has_value() || *depth < 1) {
+      SendInvalidCommandMessage(line);
+      return;
+    }
+    StopEvaluation();
+    Board board = *board_;
+    if (divide) {
+      PerftDivide(board, *depth, out_);
+    } else {
+      const auto start = std::chrono::steady_clock::now();
+      const uint64_t nodes = Perft(board, *depth);
+      const auto ms = duration_cast<milliseconds>(
+          std::chrono::steady_clock::now() - start).count();
+      out_ << "nodes " << nodes << " time " << ms
+        << " nps " << nodes * 1000 / std::max<int64_t>(ms, 1) << std::endl;
+    }
+  } else if (command == "savecache") {
+    // savecache <file>: deep table entries around the current position,
+    // merged with the loaded cache file
+    if (parts.size() != 2) {
+      SendInvalidCommandMessage(line);
+      return;
+    }
+    StopEvaluation();
+    const auto* tt = player_->GetTranspositionTable();
+    if (tt == nullptr) {
+      SendInvalidCommandMessage("No transposition table to save");
+      return;
+    }
+    Board board = *board_;
+    std::vector<AnalysisCacheEntry> entries = CollectCacheEntries(*tt, board);
+    const size_t num_new = entries.size();
+    if (player_options_.analysis_cache != nullptr) {
+      entries.insert(entries.end(), player_options_.analysis_cache->begin(),
+                     player_options_.analysis_cache->end());
+    }
+    if (AnalysisCache::Save(parts[1], std::move(entries))) {
+      SendInfoMessage("saved " + std::to_string(num_new)
+                      + " positions to " + parts[1]);
+    }
+  } else if (command == "analyze") {
+    // analyze file=<in> out=<out> [depth=N] [nodes=N] [movetime=N]
+    //   [threads=N]
+    BatchAnalysisOptions batch;
+    batch.num_threads = std::max<int>(std::thread::hardware_concurrency(), 1);
+    batch.player_options = player_options_;
+    for (size_t i = 1; i < parts.size(); i++) {
+      const size_t eq = parts[i].find('=');
+      if (eq == std::string::npos) {
+        SendInvalidCommandMessage(line);
+        return;
+      }
+      const std::string name = parts[i].substr(0, eq);
+      const std::string value = parts[i].substr(eq + 1);
+      if (name == "file" || name == "out") {
+        (name == "file" ? batch.input_file : batch.output_file) = value;
+        continue;
+      }
+      auto val = ParseInt(value);
+      if (!val.has_value() || *val < 1) {
+        SendInvalidCommandMessage(line);
+        return;
+      }
+      if (name == "depth") {
+        batch.limits.depth = *val;
+      } else if (name == "nodes") {
+        batch.limits.nodes = *val;
+      } else if (name == "movetime") {
+        batch.limits.movetime = *val;
+      } else if (name == "threads") {
+        batch.num_threads = *val;
+      } else {
+        SendInvalidCommandMessage(line);
+        return;
+      }
+    }
+    if (batch.input_file.empty() || batch.output_file.empty()
+        || (!batch.limits.depth.has_value() && !batch.limits.nodes.has_value()
+            && !batch.limits.movetime.has_value())) {
+      SendInvalidCommandMessage(line);
+      return;
+    }
+    // Runs on the evaluation thread like a search, so that "stop" and
+    // "quit" still get read.
+    StopEvaluation();
+    batch.canceled = &stopping_;
+    std::lock_guard lock(mutex_);
+    // In a server each search of the workers borrows a searcher of the
+    // pool.
+    thread_ = std::make_unique<std::thread>([this, batch]() {
+      const auto start = std::chrono::steady_clock::now();
+      auto num_analyzed = RunBatchAnalysis(batch, out_);
+      if (num_analyzed.has_value()) {
+        const auto ms = duration_cast<milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        SendInfoMessage("analyzed " + std::to_string(*num_analyzed)
+                        + " positions in " + std::to_string(ms) + " ms");
+      }
+    });
+  } else if (command == "bench" && parts.size() >= 2 && parts[1] == "smp") {
+    // bench smp [depth] [max threads]
+    std::optional<int> depth = kDefaultSmpBenchDepth;
+    std::optional<int> max_threads =
+        std::max<int>(std::thread::hardware_concurrency(), 1);
+    if (parts.size() >= 3) {
+      depth = ParseInt(parts[2]);
+    }
+    if (parts.size() >= 4) {
+      max_threads = ParseInt(parts[3]);
+    }
+    if (parts.size() > 4 || !depth.has_value() || *depth < 1
+        || !max_threads.has_value() || *max_threads < 1) {
+      SendInvalidCommandMessage(line);
+      return;
+    }
+    StopEvaluation();
+    RunSmpBench(*depth, *max_threads, out_);
+  } else if (command == "bench") {
+    // bench [search] [depth]
+    const bool search = parts.size() >= 2 && parts[1] == "search";
+    const size_t num_args = parts.size() - (search ? 2 : 1);
+    std::optional<int> depth =
+        search ? kDefaultSearchBenchDepth : kDefaultBenchDepth;
+    if (num_args == 1) {
+      depth = ParseInt(parts.back());
+    }
+    if (num_args > 1 || !depth.has_value() || *depth < 1) {
+      SendInvalidCommandMessage(line);
+      return;
+    }
+    StopEvaluation();
+    if (search) {
+      RunSearchBench(*depth, out_);
+    } else {
+      RunBench(*depth, out_);
+    }
+  } else if (command == "debug") {
+    // debug stats [clear]
+    if (parts.size() < 2 || parts.size() > 3 || parts[1] != "stats"
+        || (parts.size() == 3 && parts[2] != "clear")) {
+      SendInvalidCommandMessage(line);
+      return;
+    }
+    if (!kSearchStatsEnabled) {
+      SendInfoMessage("search statistics need a build with make STATS=1");
+    }
+    if (player_ != nullptr) {
+      if (parts.size() == 3) {
+        player_->ClearSearchStats();
+      } else {
+        PrintSearchStats(player_->GetSearchStats(), out_);
+      }
+    }
+  } else if (command == "ponderhit") {
+    // the predicted move was played: the ponder search goes on with the
+    // clock running
+    std::lock_guard lock(mutex_);
+    if (pondering_) {
+      pondering_ = false;
+      player_->PonderHit();
+      ponder_cv_.notify_all();
+    }
   } else if (command == "stop") {
     // cancel current search, if any
     StopEvaluation();
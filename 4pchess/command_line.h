@@ -3,12 +3,19 @@
 // Command line interface for the engine.
 // Supports UCI: https://gist.github.com/DOBRO/2592c6dad754ba67e6dcaec8c90165bf
 
+#include <atomic>
+#include <condition_variable>
+#include <iostream>
+#include <istream>
 #include <memory>
 #include <mutex>
+#include <ostream>
 #include <thread>
 
 #include "player.h"
 #include "board.h"
+#include "search_pool.h"
+#include "transposition_table.h"
 #include "utils.h"
 
 
@@ -35,25 +42,49 @@ struct EvaluationOptions {
 };
 
 
+// What the sessions of a server share (server.h). Unset for the command
+// line on stdin.
+struct SharedResources {
+  std::shared_ptr<TranspositionTable> transposition_table;
+  // The players search with its searchers (search_pool.h).
+  std::shared_ptr<SearchPool> search_pool;
+};
+
 class CommandLine {
  public:
 
-  CommandLine();
+  // Reads commands from `in` until "quit" or the end of input.
+  CommandLine(std::istream& in = std::cin, std::ostream& out = std::cout,
+              SharedResources shared = {});
 
   void Run();
 
  private:
+  // Same as the ones of utils.h, written to out_.
+  void SendInfoMessage(const std::string& message);
+  void SendInvalidCommandMessage(const std::string& line);
   void StopEvaluation();
+  // Stops the evaluation, then replaces the player by a new one made with
+  // player_options_.
+  void ResetPlayer();
   void ResetBoard();
   void SetEvaluationOptions(const EvaluationOptions& options);
   void StartEvaluation();
-  void MakePonderMove();
   void HandleCommand(
       const std::string& line,
       const std::vector<std::string>& parts);
   void SetBoard(std::shared_ptr<Board> board);
 
+  std::istream& in_;
+  std::ostream& out_;
+  SharedResources shared_;
+  // Set while StopEvaluation waits, for an analysis to end.
+  std::atomic<bool> stopping_ = false;
+
   std::mutex mutex_;
+  // Set while a "go ponder" search waits for ponderhit, under mutex_.
+  bool pondering_ = false;
+  std::condition_variable ponder_cv_;
 
   // Thread used to run evaluation
   std::unique_ptr<std::thread> thread_;
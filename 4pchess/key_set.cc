@@ -0,0 +1,76 @@
+#include "key_set.h"
+
+#include <algorithm>
+#include <bit>
+
+namespace chess {
+
+namespace {
+
+uint64_t MixKey(uint64_t key) {
+  // Zobrist keys are random already, but their low bits also pick the
+  // transposition table slot. Multiplying spreads the high bits down.
+  return key * 0x9E3779B97F4A7C15ull;
+}
+
+}  // namespace
+
+ConcurrentKeySet::ConcurrentKeySet(size_t capacity) {
+  const size_t num_slots = std::bit_ceil(std::max<size_t>(capacity * 2, 64));
+  slots_ = std::make_unique<std::atomic<uint64_t>[]>(num_slots);
+  for (size_t i = 0; i < num_slots; i++) {
+    slots_[i].store(kEmpty, std::memory_order_relaxed);
+  }
+  mask_ = num_slots - 1;
+  capacity_ = num_slots / 2;
+}
+
+bool ConcurrentKeySet::Insert(int64_t key) {
+  const uint64_t k = static_cast<uint64_t>(key);
+  if (k == kEmpty) {
+    if (has_zero_.exchange(true, std::memory_order_relaxed)) {
+      return false;
+    }
+    size_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+  // Kept at most half full, so that probe runs stay short.
+  if (size() >= capacity_) {
+    return false;
+  }
+  size_t i = MixKey(k) >> 32 & mask_;
+  for (size_t probes = 0; probes <= mask_; probes++, i = (i + 1) & mask_) {
+    uint64_t current = slots_[i].load(std::memory_order_relaxed);
+    if (current == kEmpty
+        && slots_[i].compare_exchange_strong(
+            current, k, std::memory_order_relaxed)) {
+      size_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+    // Either the slot was taken, or another thread just took it.
+    if (current == k) {
+      return false;
+    }
+  }
+  return false;
+}
+
+bool ConcurrentKeySet::Contains(int64_t key) const {
+  const uint64_t k = static_cast<uint64_t>(key);
+  if (k == kEmpty) {
+    return has_zero_.load(std::memory_order_relaxed);
+  }
+  size_t i = MixKey(k) >> 32 & mask_;
+  for (size_t probes = 0; probes <= mask_; probes++, i = (i + 1) & mask_) {
+    const uint64_t current = slots_[i].load(std::memory_order_relaxed);
+    if (current == k) {
+      return true;
+    }
+    if (current == kEmpty) {
+      return false;
+    }
+  }
+  return false;
+}
+
+}  // namespace chess
@@ -0,0 +1,38 @@
+#ifndef _KEY_SET_H_
+#define _KEY_SET_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace chess {
+
+// Set of 64-bit keys that threads insert into without locks. Open
+// addressing with linear probing in twice as many slots as keys, so that a
+// lookup is a relaxed load of one slot most of the time. Once the capacity
+// is reached, Insert fails.
+class ConcurrentKeySet {
+ public:
+  // Room for at least `capacity` keys.
+  explicit ConcurrentKeySet(size_t capacity);
+
+  // Returns true if `key` was not in the set yet and is now.
+  bool Insert(int64_t key);
+  bool Contains(int64_t key) const;
+  size_t size() const { return size_.load(std::memory_order_relaxed); }
+
+ private:
+  // Key 0 marks an empty slot, so the key 0 is kept apart.
+  static constexpr uint64_t kEmpty = 0;
+
+  std::unique_ptr<std::atomic<uint64_t>[]> slots_;
+  size_t mask_;
+  size_t capacity_;
+  std::atomic<bool> has_zero_ = false;
+  std::atomic<size_t> size_ = 0;
+};
+
+}  // namespace chess
+
+#endif  // _KEY_SET_H_
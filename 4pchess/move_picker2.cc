@@ -1,6 +1,185 @@
 // move_picker2.cc
 #include "move_picker2.h"
 
+#include <array>
+
+#if MOVE_PICKER_SIMD
+#include <immintrin.h>
+#endif
+
 namespace chess {
 
-}  // namespace chess
\ No newline at end of file
+namespace {
+
+void ScoreCapturesScalar(
+    const Board* board, const Move* moves, int* scores, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    scores[i] = CaptureScore(board, moves[i]);
+  }
+}
+
+void ScoreQuietsScalar(
+    const Board* board, const QuietHistory& history,
+    const Move* moves, int* scores, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    scores[i] = QuietScore(board, history, moves[i]);
+  }
+}
+
+}  // namespace
+
+#if MOVE_PICKER_SIMD
+
+// Moves are read as their packed form: from row/col in the low byte, to
+// row/col in the next one and the captured piece's raw bits in the top byte.
+static_assert(sizeof(Move) == sizeof(uint32_t));
+static_assert(sizeof(Piece) == 1);
+
+namespace {
+
+// nnue::SquareIndex of row * 16 + col, for the gathers.
+constexpr std::array<int, 14 * 16> kSquareIndex = [] {
+  std::array<int, 14 * 16> index = {};
+  for (int row = 0; row < 14; row++) {
+    for (int col = 0; col < 16; col++) {
+      index[row * 16 + col] = col < 14 ? nnue::SquareIndex(row, col) : -1;
+    }
+  }
+  return index;
+}();
+
+// Piece type of the raw piece bits in the low byte of each lane.
+__attribute__((target("avx2")))
+__m256i PieceTypes(__m256i raw) {
+  return _mm256_and_si256(_mm256_srli_epi32(raw, 2), _mm256_set1_epi32(7));
+}
+
+// Raw bits of the pieces on the from squares of 8 moves. Reads 4 bytes per
+// square, which stays inside the mailbox since its last rows are padding.
+__attribute__((target("avx2")))
+__m256i MovedPieces(const Board* board, __m256i moves) {
+  const __m256i nibble = _mm256_set1_epi32(0xF);
+  const __m256i from_row = _mm256_and_si256(moves, nibble);
+  const __m256i from_col = _mm256_and_si256(_mm256_srli_epi32(moves, 4), nibble);
+  // ToSquare(row, col) = (row + 2) * 16 + col
+  const __m256i square = _mm256_add_epi32(
+      _mm256_slli_epi32(_mm256_add_epi32(from_row, _mm256_set1_epi32(2)), 4),
+      from_col);
+  const int* mailbox = reinterpret_cast<const int*>(&board->GetPiece(0));
+  return _mm256_i32gather_epi32(mailbox, square, 1);
+}
+
+// nnue::SquareIndex of a 4-bit row in the low and a column in the high
+// nibble.
+__attribute__((target("avx2")))
+__m256i HistorySquare(__m256i row_col) {
+  const __m256i nibble = _mm256_set1_epi32(0xF);
+  const __m256i square = _mm256_or_si256(
+      _mm256_slli_epi32(_mm256_and_si256(row_col, nibble), 4),
+      _mm256_and_si256(_mm256_srli_epi32(row_col, 4), nibble));
+  return _mm256_i32gather_epi32(kSquareIndex.data(), square, 4);
+}
+
+// x * nnue::kNumSquares = x * 128 + x * 32
+__attribute__((target("avx2")))
+__m256i TimesNumSquares(__m256i x) {
+  static_assert(nnue::kNumSquares == 128 + 32);
+  return _mm256_add_epi32(_mm256_slli_epi32(x, 7), _mm256_slli_epi32(x, 5));
+}
+
+// The int16_t entries of `table` at `index`. The 4-byte reads end at most
+// one entry past the indexed one, which the tables leave room for, and the
+// low half is the entry.
+__attribute__((target("avx2")))
+__m256i GatherHistory(const int16_t* table, __m256i index) {
+  const __m256i entries = _mm256_i32gather_epi32(
+      reinterpret_cast<const int*>(table), index, 2);
+  return _mm256_srai_epi32(_mm256_slli_epi32(entries, 16), 16);
+}
+
+__attribute__((target("avx2")))
+void ScoreCapturesAvx2(
+    const Board* board, const Move* moves, int* scores, size_t count) {
+  // Same values as CaptureScore, NO_PIECE and the unused slot last.
+  const __m256i piece_values = _mm256_setr_epi32(1, 6, 8, 10, 20, 200, 0, 0);
+  const __m256i base = _mm256_set1_epi32(30000);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m256i packed = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(moves + i));
+    const __m256i victim = _mm256_permutevar8x32_epi32(
+        piece_values, PieceTypes(_mm256_srli_epi32(packed, 24)));
+    const __m256i aggressor = _mm256_permutevar8x32_epi32(
+        piece_values, PieceTypes(MovedPieces(board, packed)));
+    const __m256i score = _mm256_sub_epi32(
+        _mm256_add_epi32(base, _mm256_slli_epi32(victim, 3)), aggressor);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(scores + i), score);
+  }
+  for (; i < count; i++) {
+    scores[i] = CaptureScore(board, moves[i]);
+  }
+}
+
+__attribute__((target("avx2")))
+void ScoreQuietsAvx2(
+    const Board* board, const QuietHistory& history,
+    const Move* moves, int* scores, size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m256i packed = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(moves + i));
+    const __m256i piece_type = PieceTypes(MovedPieces(board, packed));
+    const __m256i from_sq = HistorySquare(packed);
+    const __m256i to_sq = HistorySquare(_mm256_srli_epi32(packed, 8));
+    const __m256i butterfly = GatherHistory(
+        history.butterfly, _mm256_add_epi32(TimesNumSquares(from_sq), to_sq));
+    const __m256i continuation = GatherHistory(
+        history.continuation,
+        _mm256_add_epi32(TimesNumSquares(piece_type), to_sq));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(scores + i),
+                        _mm256_add_epi32(butterfly, continuation));
+  }
+  for (; i < count; i++) {
+    scores[i] = QuietScore(board, history, moves[i]);
+  }
+}
+
+bool CpuHasAvx2() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+
+}  // namespace
+
+#endif
+
+namespace {
+
+using ScoreCapturesFn = void (*)(const Board*, const Move*, int*, size_t);
+using ScoreQuietsFn = void (*)(
+    const Board*, const QuietHistory&, const Move*, int*, size_t);
+
+#if MOVE_PICKER_SIMD
+const bool kUseAvx2 = CpuHasAvx2();
+const ScoreCapturesFn kScoreCaptures =
+    kUseAvx2 ? ScoreCapturesAvx2 : ScoreCapturesScalar;
+const ScoreQuietsFn kScoreQuiets = kUseAvx2 ? ScoreQuietsAvx2 : ScoreQuietsScalar;
+#else
+const ScoreCapturesFn kScoreCaptures = ScoreCapturesScalar;
+const ScoreQuietsFn kScoreQuiets = ScoreQuietsScalar;
+#endif
+
+}  // namespace
+
+void ScoreCaptures(
+    const Board* board, const Move* moves, int* scores, size_t count) {
+  kScoreCaptures(board, moves, scores, count);
+}
+
+void ScoreQuiets(
+    const Board* board, const QuietHistory& history,
+    const Move* moves, int* scores, size_t count) {
+  kScoreQuiets(board, history, moves, scores, count);
+}
+
+}  // namespace chess
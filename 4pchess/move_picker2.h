@@ -3,226 +3,308 @@
 #define MOVE_PICKER2_H
 
 #include "board.h"
-#include <vector>
-#include <algorithm>
-#include <cmath>
+#include <cstdint>
 #include <optional>
-#include <mutex>
-#include <chrono>
-#include <iostream>
+#include <utility>
+
+// On x86 the moves are scored 8 at a time with AVX2 if the CPU running the
+// binary has it, whatever the build flags. Build with -DMOVE_PICKER_SIMD=0 to
+// use the scalar loops anyway.
+#ifndef MOVE_PICKER_SIMD
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define MOVE_PICKER_SIMD 1
+#else
+#define MOVE_PICKER_SIMD 0
+#endif
+#endif
 
 namespace chess {
 
+// What the quiets of a node are ordered by, both indexed by
+// nnue::SquareIndex: the history of the side to move, [from][to], and the
+// continuation history of the replies to the previous move, [piece_type][to].
+// The rows belong to the thread that searches the node.
+struct QuietHistory {
+    const int16_t* butterfly;     // nnue::kNumSquares^2 entries
+    const int16_t* continuation;  // 6 * nnue::kNumSquares entries
+};
+
+// Staged move picker. Moves come out in the order
+//   PV move, TT move,
+//   captures (MVV-LVA),
+//   killers, counter-move,
+//   quiets (history),
+// and each stage is only generated once the previous one is used up, so a
+// node that fails high on an early move never generates its quiets. In check
+// all evasions are generated at once and ordered with the same scores.
 struct MovePicker2 {
-    const Move* moves;     // Pointer to moves array (not owned)
-    const Board* board;    // Pointer to the board (needed to get piece types)
-    size_t count;          // Total number of moves
-    size_t current;        // Current move index
-    const Move* pv_move;   // PV move to prioritize
-    const Move* tt_move;   // TT move to try after PV move
-    int phase;             // Current phase (0=PV, 1=TT, 2=Remaining)
-    int16_t (*history_heuristic)[224][224]; // Pointer to current ply's history heuristic [piece_type][from_sq][to_sq] where sq = row*16+col
-    std::vector<size_t> move_indices;   // To store sorted indices of remaining moves
-    bool remaining_sorted; // Whether remaining moves are already sorted
-    size_t sorted_current; // Current position in sorted order
+    static constexpr size_t kMaxMoves = 512;
+    static constexpr int kMaxSpecialMoves = 5;  // PV, TT, 2 killers, counter
+
+    enum Stage {
+        SPECIAL_MOVES,
+        GENERATE_CAPTURES,
+        CAPTURES,
+        REFUTATIONS,
+        GENERATE_QUIETS,
+        QUIETS,
+        GENERATE_EVASIONS,
+        EVASIONS,
+        DONE,
+    };
+
+    Board* board;
+    Move* moves;           // Move buffer of at least kMaxMoves (not owned)
+    QuietHistory history;
+    int stage;
+
+    // Candidates from outside the generator, validated before they are
+    // returned: PV and TT first, then the killers and counter-move.
+    Move candidates[kMaxSpecialMoves];
+    int num_candidates;
+    int num_refutations;   // Trailing candidates that must be quiet
+    int next_candidate;
+
+    // Packed form of candidates already returned, skipped in later stages.
+    uint32_t returned[kMaxSpecialMoves];
+    int num_returned;
+    Move current_special;
+
+    size_t count;          // Moves generated so far in `moves`
+    size_t current;        // Next unpicked move of the current stage
+    int scores[kMaxMoves];
 };
-// Initialize with board, moves, and optional PV move
+
+// Initialize with the board, a move buffer and optional ordering hints.
+// Killers and the counter-move only count when they are quiet and
+// pseudo-legal in this position.
 inline void InitMovePicker2(
     MovePicker2* picker,
-    const Board* board,
-    const Move* moves,
-    size_t count,
-    const Move* pv_move,
-    const Move* tt_move = nullptr,
-    int16_t (*history_heuristic)[224][224] = nullptr)
+    Board* board,
+    Move* moves,
+    const std::optional<Move>& pv_move,
+    const std::optional<Move>& tt_move,
+    const QuietHistory& history,
+    const Move* refutations = nullptr,
+    int num_refutations = 0)
 {
     picker->board = board;
     picker->moves = moves;
-    picker->count = count;
+    picker->history = history;
+    picker->num_candidates = 0;
+    picker->next_candidate = 0;
+    picker->num_returned = 0;
+    picker->count = 0;
     picker->current = 0;
-    picker->pv_move = pv_move;
-    picker->tt_move = tt_move;
-    picker->phase = 0;
-    picker->remaining_sorted = false;
-    picker->history_heuristic = history_heuristic;
-    picker->sorted_current = 0;
-    
-    // Initialize move indices
-    picker->move_indices.resize(count);
-    for (size_t i = 0; i < count; i++) {
-        picker->move_indices[i] = i;
+
+    if (pv_move.has_value()) {
+        picker->candidates[picker->num_candidates++] = *pv_move;
+    }
+    if (tt_move.has_value()) {
+        picker->candidates[picker->num_candidates++] = *tt_move;
     }
+    picker->num_refutations = num_refutations;
+    for (int i = 0; i < num_refutations; i++) {
+        picker->candidates[picker->num_candidates++] = refutations[i];
+    }
+    picker->stage = board->InCheck() ? MovePicker2::GENERATE_EVASIONS
+                                     : MovePicker2::SPECIAL_MOVES;
 }
 
-// Check if a move exists in the move list (excluding already processed moves)
-inline bool MoveExists(const Move* moves, size_t start, size_t end, const Move& move) {
-    for (size_t i = start; i < end; ++i) {
-        if (moves[i] == move) {
+inline bool AlreadyReturned(const MovePicker2* picker, uint32_t packed) {
+    for (int i = 0; i < picker->num_returned; i++) {
+        if (picker->returned[i] == packed) {
             return true;
         }
     }
     return false;
 }
 
+// Returns the next candidate before `end` that is pseudo-legal here and not
+// returned yet, in the form the generator emits it, or nullptr.
+inline const Move* NextCandidate(MovePicker2* picker, int end, bool quiet_only) {
+    while (picker->next_candidate < end) {
+        const Move& candidate = picker->candidates[picker->next_candidate++];
+        const uint32_t packed = candidate.Pack();
+        if (AlreadyReturned(picker, packed)) {
+            continue;
+        }
+        auto move = picker->board->ToPseudoLegalMove(candidate);
+        if (!move.has_value() || (quiet_only && move->IsCapture())) {
+            continue;
+        }
+        picker->returned[picker->num_returned++] = packed;
+        picker->current_special = *move;
+        return &picker->current_special;
+    }
+    return nullptr;
+}
+
+inline int CaptureScore(const Board* board, const Move& move) {
+    // MVV-LVA: Most Valuable Victim - Least Valuable Aggressor
+    // Piece values scaled down: PAWN=1, KNIGHT=6, BISHOP=8, ROOK=10, QUEEN=20, KING=200
+    static constexpr int piece_values[6] = {1, 6, 8, 10, 20, 200};
+    const PieceType aggressor = board->GetPiece(move.FromRow(), move.FromCol()).GetPieceType();
+    const PieceType victim = move.GetCapturePiece().GetPieceType();
+    return 30000 + (piece_values[victim] << 3) - piece_values[aggressor];
+}
+
+inline int QuietScore(const Board* board, const QuietHistory& history,
+                      const Move& move) {
+    const PieceType pt = board->GetPiece(move.FromRow(), move.FromCol()).GetPieceType();
+    const int from_sq = nnue::SquareIndex(move.FromRow(), move.FromCol());
+    const int to_sq = nnue::SquareIndex(move.ToRow(), move.ToCol());
+    return history.butterfly[from_sq * nnue::kNumSquares + to_sq]
+         + history.continuation[pt * nnue::kNumSquares + to_sq];
+}
+
+// scores[i] = CaptureScore / QuietScore of moves[i], for a whole stage at
+// once (move_picker2.cc).
+void ScoreCaptures(const Board* board, const Move* moves, int* scores, size_t count);
+void ScoreQuiets(const Board* board, const QuietHistory& history,
+                 const Move* moves, int* scores, size_t count);
+
+// Moves the best scored move of [current, count) to the front of the range
+// and returns it, or nullptr when the range is exhausted. Partial selection
+// sorts only as far as the search actually gets, which for captures at a cut
+// node is usually the first one.
+inline const Move* PickBest(MovePicker2* picker) {
+    while (picker->current < picker->count) {
+        size_t best = picker->current;
+        for (size_t i = best + 1; i < picker->count; i++) {
+            if (picker->scores[i] > picker->scores[best]) {
+                best = i;
+            }
+        }
+        const size_t first = picker->current++;
+        std::swap(picker->moves[first], picker->moves[best]);
+        std::swap(picker->scores[first], picker->scores[best]);
+        const Move& move = picker->moves[first];
+        if (picker->num_returned == 0 || !AlreadyReturned(picker, move.Pack())) {
+            return &move;
+        }
+    }
+    return nullptr;
+}
+
+// Quiets are usually searched to the end once they are reached, so they are
+// sorted at once, by insertion since the lists are short.
+inline void SortMoves(MovePicker2* picker, size_t begin, size_t end) {
+    for (size_t i = begin + 1; i < end; i++) {
+        const Move move = picker->moves[i];
+        const int score = picker->scores[i];
+        size_t j = i;
+        while (j > begin && picker->scores[j - 1] < score) {
+            picker->moves[j] = picker->moves[j - 1];
+            picker->scores[j] = picker->scores[j - 1];
+            j--;
+        }
+        picker->moves[j] = move;
+        picker->scores[j] = score;
+    }
+}
+
+inline const Move* PickNext(MovePicker2* picker) {
+    while (picker->current < picker->count) {
+        const Move& move = picker->moves[picker->current++];
+        if (picker->num_returned == 0 || !AlreadyReturned(picker, move.Pack())) {
+            return &move;
+        }
+    }
+    return nullptr;
+}
+
 // Get next move, returns nullptr when done
 inline const Move* GetNextMove2(MovePicker2* picker) {
+    switch (picker->stage) {
+        case MovePicker2::SPECIAL_MOVES: {
+            const Move* move = NextCandidate(
+                picker, picker->num_candidates - picker->num_refutations, false);
+            if (move != nullptr) {
+                return move;
+            }
+            picker->stage++;
+        } [[fallthrough]];
 
-    while (true) {
-        switch (picker->phase) {
-            // Phase 0: Return PV move if available
-            case 0:
-                picker->phase++;
-                if (picker->pv_move) {
-                    return picker->pv_move;
-                }
-                // Fall through to next phase if no PV move
+        case MovePicker2::GENERATE_CAPTURES: {
+            picker->count = picker->board->GetPseudoLegalMoves(
+                picker->moves, Board::CAPTURES);
+            ScoreCaptures(picker->board, picker->moves, picker->scores, picker->count);
+            picker->stage++;
+        } [[fallthrough]];
 
-            // Phase 1: Return TT move if available and different from PV
-            case 1:
-                picker->phase++;
-                if (picker->tt_move && picker->tt_move != picker->pv_move) {
-                    return picker->tt_move;
-                }
-                // Fall through to next phase if no TT move or same as PV
-
-            // Phase 2: Return remaining moves with history-aware ordering
-            case 2: {
-                // Sort remaining moves by combined score if not already sorted
-                // Calculate once and reuse
-                const size_t remaining_moves = picker->count - picker->current;
-
-                // Use remaining_moves in the conditions and calculations
-                if (!picker->remaining_sorted && 
-                    remaining_moves > 1) {  // Changed condition to use remaining_moves
-                    
-                    //static std::chrono::nanoseconds total_ordering_time{0};
-                    //static int orderings_count = 0;
-                    //const auto start = std::chrono::high_resolution_clock::now();
-                    
-                    struct ScoredMove {
-                        size_t idx;
-                        int16_t score;
-                        bool operator<(const ScoredMove& other) const {
-                            return score > other.score; // Sort descending
-                        }
-                    };
-                    
-                    std::vector<ScoredMove> scored_moves;
-                    scored_moves.reserve(remaining_moves);  // Use remaining_moves here
-
-                    // Calculate scores for remaining moves
-                    for (size_t i = 0; i < remaining_moves; i++) {
-                        const size_t move_idx = picker->current + i;
-                        const Move& move = picker->moves[move_idx];
-
-                        const bool is_capture = move.IsCapture();
-
-                        const Piece piece = picker->board->GetPiece(move.FromRow(), move.FromCol());
-                        const PieceType pt = piece.GetPieceType();
-
-                        if (is_capture) {
-
-                            // MVV-LVA: Most Valuable Victim - Least Valuable Aggressor
-                            // Get captured piece type
-                            const Piece captured_piece = move.GetCapturePiece();
-                            const PieceType victim_pt = captured_piece.GetPieceType();
-
-                            // Piece values scaled down: PAWN=1, KNIGHT=6, BISHOP=8, ROOK=10, QUEEN=20, KING=200
-                            static constexpr int16_t piece_values[6] = {1, 6, 8, 10, 20, 200};
-
-                            const int16_t victim_value = piece_values[victim_pt];
-                            const int16_t aggressor_value = piece_values[pt];
-
-                            const int16_t mvv_lva = (victim_value << 3) - aggressor_value;
-
-                            // Base capture score scaled to fit int16_t (max ~30,000)
-                            int16_t score = 30000 + mvv_lva;
-
-                            scored_moves.push_back({move_idx, score});
-                        }
-                        else { // non-catpures
-                            // Get move information
-                            const int from_sq = (move.FromRow() << 4) + move.FromCol();
-                            const int to_sq = (move.ToRow() << 4) + move.ToCol();
-                            int queen_idx = (pt == QUEEN) ? 1 : 0;
-                            int16_t hist_value = picker->history_heuristic[queen_idx][from_sq][to_sq];
-                            scored_moves.push_back({move_idx, hist_value});
-                        }
-                    }
-                    
-                    // Use insertion sort for small arrays, std::sort for larger ones
-                    if (scored_moves.size() <= 10) {
-                        for (size_t i = 1; i < scored_moves.size(); ++i) {
-                            auto key = scored_moves[i];
-                            int j = i - 1;
-                            while (j >= 0 && scored_moves[j].score < key.score) {
-                                scored_moves[j + 1] = scored_moves[j];
-                                j = j - 1;
-                            }
-                            scored_moves[j + 1] = key;
-                        }
-                    } else {
-                        static constexpr auto move_comparator = [](const auto& a, const auto& b) {
-                            return a.score > b.score;
-                        };
-                        std::sort(scored_moves.begin(), scored_moves.end(), move_comparator);
-                    }
-                    
-                    // Update move_indices with new order (write to beginning)
-                    for (size_t i = 0; i < scored_moves.size(); i++) {
-                        picker->move_indices[i] = scored_moves[i].idx;
-                    }
-                    
-                    picker->remaining_sorted = true;
-                    
-                    //const auto end = std::chrono::high_resolution_clock::now();
-                    //const auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
-                    //total_ordering_time += duration;
-                    //orderings_count++;
-                    
-                    //static size_t max_moves_ordered = 0;
-                    //size_t moves_this_time = picker->count - picker->current;
-                    //if (moves_this_time > max_moves_ordered) {
-                    //    max_moves_ordered = moves_this_time;
-                    //}
-                    
-                    //if (orderings_count % 100000 == 0) {
-                    //    std::cout << "--- -- [Move ordering] "
-                    //              << "Count: " << orderings_count << " "
-                    //              << "Avg: " << total_ordering_time.count() / orderings_count << "ns "
-                    //              << "Cur/Max moves: " << moves_this_time << "/" << max_moves_ordered << "\n";
-                    //}
-                }
-                
-                // Return next move in the sorted order
-                if (picker->sorted_current < picker->count) {
-                    size_t idx = picker->move_indices[picker->sorted_current++];
-
-                    /*
-                    if (idx >= picker->count) {
-                        std::cout << "Corrupted move index: " << idx << " >= " << picker->count << std::endl;
-                        abort();
-                    }
-                    */
-                    // Skip PV move if it appears in the move list
-                    if (picker->pv_move && picker->moves[idx] == *picker->pv_move) {
-                        continue; // Skip to next move
-                    }
-                    // Skip TT move if it appears in the move list (to avoid duplicates)
-                    if (picker->tt_move && picker->moves[idx] == *picker->tt_move) {
-                        continue; // Skip to next move
+        case MovePicker2::CAPTURES: {
+            const Move* move = PickBest(picker);
+            if (move != nullptr) {
+                return move;
+            }
+            picker->stage++;
+        } [[fallthrough]];
+
+        case MovePicker2::REFUTATIONS: {
+            const Move* move = NextCandidate(picker, picker->num_candidates, true);
+            if (move != nullptr) {
+                return move;
+            }
+            picker->stage++;
+        } [[fallthrough]];
+
+        case MovePicker2::GENERATE_QUIETS: {
+            const size_t begin = picker->count;
+            picker->count += picker->board->GetPseudoLegalMoves(
+                picker->moves + begin, Board::QUIETS);
+            ScoreQuiets(picker->board, picker->history,
+                        picker->moves + begin, picker->scores + begin,
+                        picker->count - begin);
+            SortMoves(picker, begin, picker->count);
+            picker->stage++;
+        } [[fallthrough]];
+
+        case MovePicker2::QUIETS: {
+            const Move* move = PickNext(picker);
+            if (move != nullptr) {
+                return move;
+            }
+            picker->stage = MovePicker2::DONE;
+            return nullptr;
+        }
+
+        case MovePicker2::GENERATE_EVASIONS: {
+            Board* board = picker->board;
+            picker->count = board->GetPseudoLegalMoves2(
+                picker->moves, MovePicker2::kMaxMoves,
+                board->GetPieceList()[board->GetTurn().GetColor()]).count;
+            for (size_t i = 0; i < picker->count; i++) {
+                const Move& move = picker->moves[i];
+                int score = move.IsCapture() ? CaptureScore(picker->board, move)
+                                             : QuietScore(picker->board, picker->history, move);
+                // PV and TT keep their priority among the evasions.
+                const int num_hints = picker->num_candidates - picker->num_refutations;
+                for (int j = 0; j < num_hints; j++) {
+                    if (picker->candidates[j].Pack() == move.Pack()) {
+                        score = 40000 - j;
+                        break;
                     }
-                    return &picker->moves[idx];
                 }
-                return nullptr;
+                picker->scores[i] = score;
             }
-                
-            default:
-                return nullptr;
+            picker->stage++;
+        } [[fallthrough]];
+
+        case MovePicker2::EVASIONS: {
+            const Move* move = PickBest(picker);
+            if (move != nullptr) {
+                return move;
+            }
+            picker->stage = MovePicker2::DONE;
+            return nullptr;
         }
+
+        default:
+            return nullptr;
     }
 }
 
 }  // namespace chess
 
-#endif  // MOVE_PICKER2_H
\ No newline at end of file
+#endif  // MOVE_PICKER2_H
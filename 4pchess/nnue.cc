@@ -0,0 +1,281 @@
+#include "nnue.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define NNUE_X86 1
+#include <immintrin.h>
+#else
+#define NNUE_X86 0
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace chess::nnue {
+
+namespace {
+
+constexpr size_t kFileSize = kHeaderSize
+  + kL1 * sizeof(int16_t)
+  + size_t{kNumFeatures} * kL1 * sizeof(int16_t)
+  + kL2 * 2 * kL1 + kL2 * sizeof(int32_t)
+  + kL3 * kL2 + kL3 * sizeof(int32_t)
+  + kL3 + sizeof(int32_t);
+
+static_assert(kL1 % 32 == 0 && kL2 % 32 == 0 && kL3 % 32 == 0);
+static_assert(SquareIndex(13, 10) == kNumSquares - 1);
+
+// The vector loops of the network. The AVX2 ones are compiled for AVX2
+// whatever the build flags and picked at start-up if the CPU has it, so one
+// x86-64 binary runs everywhere and uses AVX2 where it can.
+struct Kernels {
+  // row[i] += weights[i] (or -=) over kL1 entries.
+  void (*add_row)(int16_t* row, const int16_t* weights);
+  void (*sub_row)(int16_t* row, const int16_t* weights);
+  // out[i] = clamp(row[i], 0, 127) over kL1 entries.
+  void (*clip_row)(const int16_t* row, uint8_t* out);
+  // Sum of in[i] * weights[i] over n inputs in [0, 127], n a multiple of 32.
+  int32_t (*dot_product)(const uint8_t* in, const int8_t* weights, int n);
+};
+
+#if defined(__ARM_NEON)
+
+template <bool kAdd>
+void UpdateRowNeon(int16_t* row, const int16_t* weights) {
+  for (int i = 0; i < kL1; i += 8) {
+    const int16x8_t values = vld1q_s16(row + i);
+    const int16x8_t w = vld1q_s16(weights + i);
+    vst1q_s16(row + i, kAdd ? vaddq_s16(values, w) : vsubq_s16(values, w));
+  }
+}
+
+void ClipRowNeon(const int16_t* row, uint8_t* out) {
+  for (int i = 0; i < kL1; i += 8) {
+    const int16x8_t clipped = vminq_s16(
+        vmaxq_s16(vld1q_s16(row + i), vdupq_n_s16(0)), vdupq_n_s16(127));
+    vst1_u8(out + i, vmovn_u16(vreinterpretq_u16_s16(clipped)));
+  }
+}
+
+int32_t DotProductNeon(const uint8_t* in, const int8_t* weights, int n) {
+  int32x4_t sum = vdupq_n_s32(0);
+  for (int i = 0; i < n; i += 16) {
+    const int8x16_t x = vreinterpretq_s8_u8(vld1q_u8(in + i));
+    const int8x16_t w = vld1q_s8(weights + i);
+    sum = vpadalq_s16(sum, vmull_s8(vget_low_s8(x), vget_low_s8(w)));
+    sum = vpadalq_s16(sum, vmull_s8(vget_high_s8(x), vget_high_s8(w)));
+  }
+  return vaddvq_s32(sum);
+}
+
+#else
+
+template <bool kAdd>
+void UpdateRowScalar(int16_t* row, const int16_t* weights) {
+  for (int i = 0; i < kL1; i++) {
+    row[i] = static_cast<int16_t>(kAdd ? row[i] + weights[i] : row[i] - weights[i]);
+  }
+}
+
+void ClipRowScalar(const int16_t* row, uint8_t* out) {
+  for (int i = 0; i < kL1; i++) {
+    out[i] = static_cast<uint8_t>(std::clamp<int>(row[i], 0, 127));
+  }
+}
+
+int32_t DotProductScalar(const uint8_t* in, const int8_t* weights, int n) {
+  int32_t sum = 0;
+  for (int i = 0; i < n; i++) {
+    sum += in[i] * weights[i];
+  }
+  return sum;
+}
+
+#endif
+
+#if NNUE_X86
+
+template <bool kAdd>
+__attribute__((target("avx2")))
+void UpdateRowAvx2(int16_t* row, const int16_t* weights) {
+  for (int i = 0; i < kL1; i += 16) {
+    __m256i* values = reinterpret_cast<__m256i*>(row + i);
+    const __m256i w = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(weights + i));
+    *values = kAdd ? _mm256_add_epi16(*values, w) : _mm256_sub_epi16(*values, w);
+  }
+}
+
+__attribute__((target("avx2")))
+void ClipRowAvx2(const int16_t* row, uint8_t* out) {
+  const __m256i zero = _mm256_setzero_si256();
+  for (int i = 0; i < kL1; i += 32) {
+    const __m256i a = _mm256_load_si256(reinterpret_cast<const __m256i*>(row + i));
+    const __m256i b = _mm256_load_si256(
+        reinterpret_cast<const __m256i*>(row + i + 16));
+    // packs works per 128-bit lane, the permute restores the order.
+    const __m256i packed = _mm256_permute4x64_epi64(
+        _mm256_packs_epi16(a, b), 0xd8);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(out + i),
+                       _mm256_max_epi8(packed, zero));
+  }
+}
+
+__attribute__((target("avx2")))
+int32_t DotProductAvx2(const uint8_t* in, const int8_t* weights, int n) {
+  const __m256i ones = _mm256_set1_epi16(1);
+  __m256i sum = _mm256_setzero_si256();
+  for (int i = 0; i < n; i += 32) {
+    const __m256i x = _mm256_load_si256(reinterpret_cast<const __m256i*>(in + i));
+    const __m256i w = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(weights + i));
+    // Pairs of products fit in int16 since the inputs are at most 127.
+    sum = _mm256_add_epi32(
+        sum, _mm256_madd_epi16(_mm256_maddubs_epi16(x, w), ones));
+  }
+  __m128i sum128 = _mm_add_epi32(_mm256_castsi256_si128(sum),
+                                 _mm256_extracti128_si256(sum, 1));
+  sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, 0x4e));
+  sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, 0xb1));
+  return _mm_cvtsi128_si32(sum128);
+}
+
+#endif
+
+Kernels SelectKernels() {
+#if NNUE_X86
+  __builtin_cpu_init();  // Runs before the constructors that set it up
+  if (__builtin_cpu_supports("avx2")) {
+    return {UpdateRowAvx2<true>, UpdateRowAvx2<false>, ClipRowAvx2,
+            DotProductAvx2};
+  }
+#endif
+#if defined(__ARM_NEON)
+  return {UpdateRowNeon<true>, UpdateRowNeon<false>, ClipRowNeon,
+          DotProductNeon};
+#else
+  return {UpdateRowScalar<true>, UpdateRowScalar<false>, ClipRowScalar,
+          DotProductScalar};
+#endif
+}
+
+const Kernels kKernels = SelectKernels();
+
+// out = clamp((weights * in + biases) >> kWeightShift, 0, 127).
+void HiddenLayer(const uint8_t* in, int n, const int8_t* weights,
+                 const int32_t* biases, uint8_t* out, int m) {
+  for (int j = 0; j < m; j++) {
+    const int32_t sum = biases[j] + kKernels.dot_product(in, weights + j * n, n);
+    out[j] = static_cast<uint8_t>(std::clamp(sum >> kWeightShift, 0, 127));
+  }
+}
+
+}  // namespace
+
+std::unique_ptr<const Network> Network::Load(const std::string& path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cout << "Can not open network file " << path << std::endl;
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) != kFileSize) {
+    std::cout << "Network file " << path << " should have " << kFileSize
+              << " bytes" << std::endl;
+    close(fd);
+    return nullptr;
+  }
+  void* mapping = mmap(nullptr, kFileSize, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    std::cout << "Can not map network file " << path << std::endl;
+    return nullptr;
+  }
+
+  std::unique_ptr<Network> network(new Network());
+  network->mapping_ = mapping;
+  network->mapping_size_ = kFileSize;
+
+  const char* data = static_cast<const char*>(mapping);
+  uint32_t header[6];
+  std::memcpy(header, data, sizeof(header));
+  if (header[0] != kMagic || header[1] != kVersion
+      || header[2] != kNumFeatures || header[3] != kL1
+      || header[4] != kL2 || header[5] != kL3) {
+    std::cout << "Network file " << path
+              << " has an unknown format or dimensions" << std::endl;
+    return nullptr;
+  }
+
+  // The mapping is page aligned and every array starts at a multiple of its
+  // element size, which the vector code relies on only for the accumulator.
+  size_t offset = kHeaderSize;
+  auto take = [&](auto*& member, size_t count) {
+    member = reinterpret_cast<std::remove_reference_t<decltype(member)>>(
+        data + offset);
+    offset += count * sizeof(*member);
+  };
+  take(network->ft_biases_, kL1);
+  take(network->ft_weights_, size_t{kNumFeatures} * kL1);
+  take(network->l2_weights_, kL2 * 2 * kL1);
+  take(network->l2_biases_, kL2);
+  take(network->l3_weights_, kL3 * kL2);
+  take(network->l3_biases_, kL3);
+  take(network->out_weights_, kL3);
+  take(network->out_bias_, 1);
+  return network;
+}
+
+Network::~Network() {
+  if (mapping_ != nullptr) {
+    munmap(mapping_, mapping_size_);
+  }
+}
+
+void Network::Reset(Accumulator& accumulator) const {
+  for (int perspective = 0; perspective < 2; perspective++) {
+    std::memcpy(accumulator.values[perspective], ft_biases_,
+                kL1 * sizeof(int16_t));
+  }
+}
+
+void Network::AddFeature(
+    Accumulator& accumulator, int feature0, int feature1) const {
+  kKernels.add_row(accumulator.values[0],
+                   ft_weights_ + static_cast<size_t>(feature0) * kL1);
+  kKernels.add_row(accumulator.values[1],
+                   ft_weights_ + static_cast<size_t>(feature1) * kL1);
+}
+
+void Network::SubFeature(
+    Accumulator& accumulator, int feature0, int feature1) const {
+  kKernels.sub_row(accumulator.values[0],
+                   ft_weights_ + static_cast<size_t>(feature0) * kL1);
+  kKernels.sub_row(accumulator.values[1],
+                   ft_weights_ + static_cast<size_t>(feature1) * kL1);
+}
+
+int Network::Evaluate(const Accumulator& accumulator, int side_to_move) const {
+  alignas(32) uint8_t input[2 * kL1];
+  alignas(32) uint8_t hidden2[kL2];
+  alignas(32) uint8_t hidden3[kL3];
+
+  kKernels.clip_row(accumulator.values[side_to_move], input);
+  kKernels.clip_row(accumulator.values[1 - side_to_move], input + kL1);
+
+  HiddenLayer(input, 2 * kL1, l2_weights_, l2_biases_, hidden2, kL2);
+  HiddenLayer(hidden2, kL2, l3_weights_, l3_biases_, hidden3, kL3);
+  return (*out_bias_ + kKernels.dot_product(hidden3, out_weights_, kL3))
+    / kOutputScale;
+}
+
+}  // namespace chess::nnue
@@ -0,0 +1,108 @@
+#ifndef _NNUE_H_
+#define _NNUE_H_
+
+// Efficiently updatable neural network evaluation.
+//
+// The input layer has one feature per (color, piece type, square) over the
+// 160 squares of the board, seen from each team. A team sees the board turned
+// so that its first color (red or blue) sits on the bottom rank and colors
+// are numbered from that color in turn order, so both teams share the
+// weights. The board keeps one accumulator row per team and updates it
+// feature by feature as moves are made and undone; the layers after it are
+// small and run at every evaluation:
+//
+//   2 x kL1 (side to move first) -> clipped ReLU -> kL2 -> clipped ReLU
+//     -> kL3 -> clipped ReLU -> 1
+//
+// Weights are int16 in the input layer and int8 after it. The network file
+// is a kHeaderSize byte header followed by the arrays in the order of the
+// members of Network, little-endian, and is mapped read-only into memory.
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace chess::nnue {
+
+constexpr int kNumSquares = 160;
+constexpr int kNumFeatures = 4 * 6 * kNumSquares;
+constexpr int kL1 = 256;
+constexpr int kL2 = 32;
+constexpr int kL3 = 32;
+
+constexpr uint32_t kMagic = 0x4e4e5034;  // "4PNN"
+constexpr uint32_t kVersion = 1;
+constexpr size_t kHeaderSize = 64;
+// Hidden layer outputs are scaled down by 2^kWeightShift before clipping to
+// [0, 127], and the output by kOutputScale to get centipawns.
+constexpr int kWeightShift = 6;
+constexpr int kOutputScale = 16;
+
+// Index of (row, col) among the playable squares, row by row, or -1 in the
+// cut corners. The search's history tables are indexed by it as well.
+constexpr int SquareIndex(int row, int col) {
+  if ((row < 3 || row > 10) && (col < 3 || col > 10)) {
+    return -1;
+  }
+  // Rows 0-2 hold 8 squares each, rows 3-10 all 14.
+  if (row < 3) return row * 8 + col - 3;
+  if (row <= 10) return 24 + (row - 3) * 14 + col;
+  return 136 + (row - 11) * 8 + col - 3;
+}
+
+// Feature of a piece of `color` and `piece_type` on (row, col) for the team
+// whose first color is `perspective` (0 for red/yellow, 1 for blue/green).
+constexpr int FeatureIndex(int perspective, int color, int piece_type,
+                           int row, int col) {
+  if (perspective == 1) {
+    // A quarter turn that takes blue's back rank to red's.
+    const int turned_row = 13 - col;
+    col = row;
+    row = turned_row;
+  }
+  const int relative_color = (color - perspective + 4) % 4;
+  return (relative_color * 6 + piece_type) * kNumSquares + SquareIndex(row, col);
+}
+
+struct alignas(32) Accumulator {
+  int16_t values[2][kL1];  // Indexed by perspective
+};
+
+class Network {
+ public:
+  // Maps the network in `path`. Returns nullptr and prints the reason if the
+  // file can not be read or does not hold a network of these dimensions.
+  static std::unique_ptr<const Network> Load(const std::string& path);
+  ~Network();
+  Network(const Network&) = delete;
+  Network& operator=(const Network&) = delete;
+
+  // Sets both rows of `accumulator` to the biases.
+  void Reset(Accumulator& accumulator) const;
+  // Adds or subtracts the weights of `feature` in both perspectives. The
+  // features of the two teams are passed since they differ.
+  void AddFeature(Accumulator& accumulator, int feature0, int feature1) const;
+  void SubFeature(Accumulator& accumulator, int feature0, int feature1) const;
+  // Evaluation in centipawns for the team of perspective `side_to_move`.
+  int Evaluate(const Accumulator& accumulator, int side_to_move) const;
+
+ private:
+  Network() = default;
+
+  void* mapping_ = nullptr;
+  size_t mapping_size_ = 0;
+
+  const int16_t* ft_biases_ = nullptr;   // [kL1]
+  const int16_t* ft_weights_ = nullptr;  // [kNumFeatures][kL1]
+  const int8_t* l2_weights_ = nullptr;   // [kL2][2 * kL1]
+  const int32_t* l2_biases_ = nullptr;   // [kL2]
+  const int8_t* l3_weights_ = nullptr;   // [kL3][kL2]
+  const int32_t* l3_biases_ = nullptr;   // [kL3]
+  const int8_t* out_weights_ = nullptr;  // [kL3]
+  const int32_t* out_bias_ = nullptr;    // [1]
+};
+
+}  // namespace chess::nnue
+
+#endif  // _NNUE_H_
@@ -20,24 +20,22 @@
 #include "player.h"
 #include "transposition_table.h"
 #include "move_picker2.h"
+#include "search_pool.h"
+
+static_assert(chess::kBufferPartitionSize >= chess::MovePicker2::kMaxMoves,
+              "the move picker fills a whole buffer partition");
 
 // Macro to avoid function call overhead for leaf nodes (90% of calls)
-// Computes new_depth, checks if <= 0, and either returns eval or calls Search
+// Computes new_depth, checks if <= 0, and either resolves captures, returns
+// the eval or calls Search
 #define SEARCH_OR_EVAL(result, new_depth_var, ...) \
     do { \
-        if ((new_depth_var) <= 0) { \
-            result = std::make_tuple(-(ss->static_eval), std::nullopt); \
-        } else { \
+        if ((new_depth_var) > 0) { \
             result = Search(__VA_ARGS__); \
-        } \
-    } while(0)
-
-#define SEARCH_OR_EVAL_M(result, new_depth_var, ...) \
-    do { \
-        if ((new_depth_var) <= 0) { \
-            result = std::make_tuple(-(ss->static_eval), std::nullopt); \
+        } else if (options_.enable_qsearch) { \
+            result = QSearch(__VA_ARGS__); \
         } else { \
-            result = SearchM(__VA_ARGS__); \
+            result = std::make_tuple(-(ss->static_eval), std::nullopt); \
         } \
     } while(0)
 
@@ -46,98 +44,228 @@ namespace chess {
 namespace {
 std::string GetPVStrFromPVInfo(const PVInfo& pv_info) {
   std::string pv;
-  const PVInfo* current = &pv_info;
-  while (current != nullptr) {
-    auto best_move = current->GetBestMove();
-    if (best_move.has_value()) {
-      if (!pv.empty()) {
-        pv += " ";
-      }
-      pv += best_move->PrettyStr();
+  for (int i = 0; i < pv_info.GetDepth(); i++) {
+    if (!pv.empty()) {
+      pv += " ";
     }
-    current = current->GetChild().get();
+    pv += pv_info.GetMove(i).PrettyStr();
   }
   return pv;
 }
-}  // namespace
 
-std::chrono::nanoseconds AlphaBetaPlayer::total_time{0};
-std::chrono::nanoseconds AlphaBetaPlayer::total_timeA{0};
-std::chrono::nanoseconds AlphaBetaPlayer::total_timeA2{0};
-std::chrono::nanoseconds AlphaBetaPlayer::total_timeB{0};
-std::chrono::nanoseconds AlphaBetaPlayer::total_timeC{0};
-size_t AlphaBetaPlayer::call_count = 0;
-size_t AlphaBetaPlayer::call_countA = 0;
-size_t AlphaBetaPlayer::call_countA2 = 0;
-size_t AlphaBetaPlayer::call_countB = 0;
-size_t AlphaBetaPlayer::call_countC = 0;
+// Depth of the iterative deepening of a search without a depth limit.
+constexpr int kMaxSearchDepth = 64;
+// Each thread checks the time and node limits every this many nodes.
+constexpr int64_t kLimitCheckInterval = 1024;
+// A search continues the last one if its root is at most this many plies
+// down the last PV.
+constexpr int kMaxReusePlies = 8;
+
+// Depth skipping for Lazy SMP helpers: helper i searches runs of
+// kSkipSize[i] depths and skips the runs in between, phase shifted so the
+// helpers do not all search the same depth at the same time.
+constexpr int kSkipSize[] = {1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4};
+constexpr int kSkipPhase[] = {0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7};
+
+bool SkipDepth(size_t thread_id, int depth) {
+  const int i = (thread_id - 1) % 20;
+  return ((depth + kSkipPhase[i]) / kSkipSize[i]) % 2 != 0;
+}
+
+// Distinct for every player and game, for ThreadState::SetHistoryOwner.
+uint64_t NewHistoryOwner() {
+  static std::atomic<uint64_t> next_owner = 1;
+  return next_owner++;
+}
+
+// The move of an analysis cache entry if it is legal in `board`. A file that
+// does not belong to this engine version may hold anything.
+std::optional<Move> LegalCacheMove(Board& board, uint32_t packed_move) {
+  const std::optional<Move> move =
+      board.ToPseudoLegalMove(Move::Unpack(packed_move, board));
+  if (!move.has_value()) {
+    return std::nullopt;
+  }
+  const PlayerColor color = board.GetTurn().GetColor();
+  const Team other_team = OtherTeam(board.GetTurn().GetTeam());
+  board.MakeMove(*move);
+  const bool legal = !board.KingPresent(color)
+    || !board.IsAttackedByTeam(other_team, board.GetKingRow(color),
+                               board.GetKingCol(color));
+  board.UndoMove();
+  if (!legal) {
+    return std::nullopt;
+  }
+  return move;
+}
+}  // namespace
 
 AlphaBetaPlayer::AlphaBetaPlayer(std::optional<PlayerOptions> options) {
   if (options.has_value()) {
     options_ = *options;
   }
+  if (!options_.enable_transposition_table) {
+    // no table
+  } else if (options_.shared_transposition_table != nullptr) {
+    transposition_table_ = options_.shared_transposition_table;
+  } else if (options_.transposition_table_size > 0) {
+    transposition_table_ = std::make_shared<TranspositionTable>(
+        options_.transposition_table_size, options_.num_threads);
+  }
+
+  InitPieceSquareTable();
+
+  int num_threads = 1;
+  if (options_.enable_multithreading) {
+    num_threads = options_.num_threads;
+  }
+  assert(num_threads >= 1);
+  helper_results_.resize(num_threads);
+  history_owner_ = NewHistoryOwner();
+  // With a search pool the thread states are borrowed for each search.
+  if (options_.search_pool == nullptr) {
+    for (int i = 0; i < num_threads; i++) {
+      own_thread_states_.push_back(std::make_unique<ThreadState>(
+            options_, transposition_table_.get(), i));
+      thread_states_.push_back(own_thread_states_.back().get());
+    }
+    counts_at_borrow_.resize(num_threads);
+    for (int i = 1; i < num_threads; i++) {
+      helpers_.emplace_back(&AlphaBetaPlayer::HelperLoop, this, i);
+    }
+  }
 
-  /*
-  // Initialize checkmate discovery mode
   if (options_.checkmate_discovery_mode) {
-    checkmate_file_ = std::make_unique<std::ofstream>(options_.checkmate_output_file);
-    if (!checkmate_file_->is_open()) {
+    // Thread states are numbered by the pool, if there is one.
+    const int num_thread_ids = options_.search_pool == nullptr
+      ? num_threads : std::max(num_threads, options_.search_pool->Size());
+    checkmate_discovery_ = std::make_unique<CheckmateDiscovery>(
+        options_.checkmate_output_file, options_.max_checkmates_to_discover,
+        num_thread_ids);
+    if (!checkmate_discovery_->IsOpen()) {
       std::cerr << "Warning: Could not open checkmate output file: "
                 << options_.checkmate_output_file << std::endl;
-      checkmate_file_.reset();
+      checkmate_discovery_.reset();
     }
   }
-  */
 }
 
 AlphaBetaPlayer::~AlphaBetaPlayer() {
+  {
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    pool_quit_ = true;
+  }
+  pool_start_cv_.notify_all();
+  for (auto& helper : helpers_) {
+    helper.join();
+  }
+}
+
+// Small positional terms, the same for every color seen from its own side:
+// pawns and minor pieces prefer the center and kings stay on the back ranks.
+void AlphaBetaPlayer::InitPieceSquareTable() {
+  // By ring around the center, 0 for the middle 2x2 squares to 6 at the edge.
+  static constexpr int kKnightRing[7] = {20, 15, 10, 5, 0, -10, -20};
+  static constexpr int kBishopRing[7] = {10, 10, 5, 5, 0, -5, -10};
+  static constexpr int kKingAdvance[3] = {0, -10, -30};
+
+  for (int color = 0; color < 4; color++) {
+    for (int row = 0; row < 14; row++) {
+      for (int col = 0; col < 14; col++) {
+        const int ring =
+          (std::max(std::abs(2 * row - 13), std::abs(2 * col - 13)) - 1) / 2;
+        // Rows or columns away from this color's back rank
+        const int advance = color == RED ? 13 - row
+                          : color == BLUE ? col
+                          : color == YELLOW ? row
+                          : 13 - col;
+        auto& table = piece_square_table_[color];
+        table[PAWN][row][col] = ring <= 1 ? 10 : 0;
+        table[KNIGHT][row][col] = kKnightRing[ring];
+        table[BISHOP][row][col] = kBishopRing[ring];
+        table[ROOK][row][col] = 0;
+        table[QUEEN][row][col] = 0;
+        table[KING][row][col] = kKingAdvance[std::min(advance, 2)];
+      }
+    }
+  }
+}
+
+void AlphaBetaPlayer::NewGame() {
+  if (transposition_table_ != nullptr
+      && options_.shared_transposition_table == nullptr) {
+    transposition_table_->Clear(options_.num_threads);
+  }
+  pv_info_ = PVInfo();
+  last_root_.reset();
+  last_board_key_ = 0;
+  ResetHistoryHeuristics();
 }
 
 ThreadState::ThreadState(
-    PlayerOptions options, const Board& board, const PVInfo& pv_info)
-  : options_(options), root_board_(&board), pv_info_(pv_info) {
+    PlayerOptions options, TranspositionTable* transposition_table,
+    size_t thread_id)
+  : options_(options), thread_id_(thread_id),
+    transposition_table_(transposition_table) {
   move_buffer_ = new Move[kBufferPartitionSize * kBufferNumPartitions];
-  if (options_.transposition_table_size > 0) {
-    transposition_table_ = std::make_unique<TranspositionTable>(options_.transposition_table_size);
-  }
+  pv_table_ = new PVInfo[kMaxPly + 1];
 }
 
 ThreadState::~ThreadState() {
   delete[] move_buffer_;
+  delete[] pv_table_;
+}
+
+void ThreadState::NewSearch(const Board& board, const PVInfo& pv_info) {
+  root_board_ = &board;
+  pv_info_ = pv_info;
+  buffer_id_ = 0;
+}
+
+void ThreadState::AgeHistory(uint32_t generation) {
+  const uint32_t halvings = generation - history_generation_;
+  history_generation_ = generation;
+  if (halvings == 0) {
+    return;
+  }
+  if (halvings >= 16) {
+    std::memset(&history_, 0, sizeof(history_));
+    return;
+  }
+  // Halving n times rounds toward zero just like dividing by 2^n.
+  const int divisor = 1 << halvings;
+  for (auto& color_history : history_.butterfly) {
+    for (auto& from_history : color_history) {
+      for (auto& score : from_history) {
+        score /= divisor;
+      }
+    }
+  }
+  for (auto& piece_history : history_.continuation) {
+    for (auto& square_history : piece_history) {
+      for (auto& reply_history : square_history) {
+        for (auto& score : reply_history) {
+          score /= divisor;
+        }
+      }
+    }
+  }
 }
 
-ThreadState::ThreadState(ThreadState&& other) noexcept
-  : options_(other.options_),
-    root_board_(other.root_board_),
-    pv_info_(std::move(other.pv_info_)),
-    transposition_table_(std::move(other.transposition_table_)),
-    move_buffer_(other.move_buffer_),
-    buffer_id_(other.buffer_id_) {
-  other.move_buffer_ = nullptr;
-  other.buffer_id_ = 0;
-  std::memcpy(total_moves_, other.total_moves_, sizeof(total_moves_));
-  std::memcpy(n_threats, other.n_threats, sizeof(n_threats));
-  std::memcpy(move_gen_buffer_, other.move_gen_buffer_, sizeof(move_gen_buffer_));
-  std::memcpy(history_heuristic_, other.history_heuristic_, sizeof(history_heuristic_));
+void ThreadState::SetHistoryOwner(uint64_t owner, uint32_t generation) {
+  if (owner != history_owner_) {
+    ClearHistory();
+    history_owner_ = owner;
+    history_generation_ = generation;
+  }
 }
 
-ThreadState& ThreadState::operator=(ThreadState&& other) noexcept {
-  if (this != &other) {
-    delete[] move_buffer_;
-    options_ = other.options_;
-    root_board_ = other.root_board_;
-    pv_info_ = std::move(other.pv_info_);
-    transposition_table_ = std::move(other.transposition_table_);
-    move_buffer_ = other.move_buffer_;
-    buffer_id_ = other.buffer_id_;
-    other.move_buffer_ = nullptr;
-    other.buffer_id_ = 0;
-    std::memcpy(total_moves_, other.total_moves_, sizeof(total_moves_));
-    std::memcpy(n_threats, other.n_threats, sizeof(n_threats));
-    std::memcpy(move_gen_buffer_, other.move_gen_buffer_, sizeof(move_gen_buffer_));
-    std::memcpy(history_heuristic_, other.history_heuristic_, sizeof(history_heuristic_));
-  }
-  return *this;
+void ThreadState::ClearHistory() {
+  std::memset(&history_, 0, sizeof(history_));
+  for (auto& replies : counter_moves_) {
+    std::fill(std::begin(replies), std::end(replies), Move());
+  }
+  no_previous_counter_move_ = Move();
 }
 
 Move* ThreadState::GetNextMoveBufferPartition() {
@@ -153,12 +281,262 @@ void ThreadState::ReleaseMoveBufferPartition() {
   buffer_id_--;
 }
 
-void ThreadState::SetTranspositionTable(std::unique_ptr<TranspositionTable> tt) {
-  transposition_table_ = std::move(tt);
+// Pawn shield of all four kings, for red-yellow.
+int AlphaBetaPlayer::PawnShieldEvaluation(const Board& board) {
+  // Own pawns one and two steps in front of the king and its neighbours.
+  constexpr int kShieldBonus[2] = {12, 6};
+  // Forward row and column step of each color's pawns
+  constexpr int kForward[4][2] = {{-1, 0}, {0, 1}, {1, 0}, {0, -1}};
+
+  int eval = 0;
+  for (int color = 0; color < 4; color++) {
+    if (!board.KingPresent(static_cast<PlayerColor>(color))) {
+      continue;
+    }
+    const int king_row = board.GetKingRow(static_cast<PlayerColor>(color));
+    const int king_col = board.GetKingCol(static_cast<PlayerColor>(color));
+    const int forward_row = kForward[color][0];
+    const int forward_col = kForward[color][1];
+    int shield = 0;
+    for (int step = 1; step <= 2; step++) {
+      for (int side = -1; side <= 1; side++) {
+        // Sideways is across the forward direction.
+        const int row = king_row + step * forward_row + side * forward_col;
+        const int col = king_col + step * forward_col + side * forward_row;
+        if (row < 0 || row > 13 || col < 0 || col > 13) {
+          continue;
+        }
+        const Piece piece = board.GetPiece(row, col);
+        if (piece.Present() && !piece.OffBoard()
+            && piece.GetPieceType() == PAWN && piece.GetColor() == color) {
+          shield += kShieldBonus[step - 1];
+        }
+      }
+    }
+    eval += color % 2 == RED_YELLOW ? shield : -shield;
+  }
+  return eval;
+}
+
+// Static evaluation from the point of view of the side to move: material
+// plus the team mobility and threat terms.
+int AlphaBetaPlayer::Evaluate(
+    ThreadState& thread_state, Board& board, bool maximizing_player) {
+  if (board.HasNetwork()) {
+    // Already from the side to move, which is the maximizing player's team
+    // exactly when maximizing_player is set.
+    return board.NetworkEvaluation();
+  }
+  Team other_team = OtherTeam(board.GetTurn().GetTeam());
+  int eval = board.PieceEvaluation() + board.PieceSquareEvaluation();
+  
+  static const uint8_t LOG2_MOVES[256] = {
+      0, 0, 0, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3,
+      4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+      5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+      5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+      6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+      6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+      6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+      6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+      7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+      7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+      7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+      7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+      7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+      7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+      7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+      7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7
+  };
+
+  static const uint8_t LOG2_THREATS[64] = {
+      0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3, 4,
+      4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 5,
+      5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+      5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5
+  };
+
+  static const int8_t THREAT_SCORE[64] = {
+      -8, -8, -8, -8, -8, -8, -8, -8,
+      -8, -8, -8, -8, -8, -8, -8, -8,
+      -8, -8,
+      8, 16, 24, 32, 40, 48, 56,
+      -56, -48, -40, -32, -24, -16,
+      -50, -50, -50, -50, -50, -50, -50, -50,
+      -50, -50, -50, -50, -50, -50, -50, -50,
+      -50, -50, -50, -50, -50, -50, -50, -50,
+      -50, -50, -50, -50, -50, -50, -50, -50
+  };
+
+  int moves_eval;
+  int threat_eval;
+
+  int logR = LOG2_MOVES[std::min(board.Mobility(RED), 255)];
+  int logY = LOG2_MOVES[std::min(board.Mobility(YELLOW), 255)];
+  int logB = LOG2_MOVES[std::min(board.Mobility(BLUE), 255)];
+  int logG = LOG2_MOVES[std::min(board.Mobility(GREEN), 255)];
+
+  int logRY = (logR + logY) << 2;  // 4 * sum
+  int logBG = (logB + logG) << 2;
+
+  int lb, sign;
+  if (logRY > logBG) {
+    lb = logRY + 1;
+    sign = (other_team != RED_YELLOW) ? 1 : -1;
+  } else if (logBG > logRY) {
+    lb = logBG + 1;
+    sign = (other_team != RED_YELLOW) ? -1 : 1;
+  } else {
+    lb = logRY + 1;
+    sign = 0;
+  }
+  moves_eval = sign * (lb < 27 ? 10 : 5 * (lb - 25));
+
+  int logtR = LOG2_THREATS[board.Threats(RED) & 63];
+  int logtY = LOG2_THREATS[board.Threats(YELLOW) & 63];
+  int logtB = LOG2_THREATS[board.Threats(BLUE) & 63];
+  int logtG = LOG2_THREATS[board.Threats(GREEN) & 63];
+
+  int logtRY = (logtR + logtY) << 2;
+  int logtBG = (logtB + logtG) << 2;
+
+  int len_idx;
+  int threat_sign;
+  if (logtRY > logtBG) {
+    len_idx = logtRY;
+    threat_sign = (other_team != RED_YELLOW) ? 1 : -1;
+  } else if (logtBG > logtRY) {
+    len_idx = logtBG;
+    threat_sign = (other_team != RED_YELLOW) ? -1 : 1;
+  } else {
+    len_idx = 0;
+    threat_sign = 0;
+  }
+
+  len_idx = (len_idx < 0) ? 0 : (len_idx > 63 ? 63 : len_idx);
+  threat_eval = threat_sign * THREAT_SCORE[len_idx];
+
+  eval += moves_eval + threat_eval;
+
+  // Pawns and kings move far less often than the other pieces, so the
+  // shield is looked up by their key.
+  if (options_.enable_pawn_shield) {
+    const int64_t key = board.PawnKingKey();
+    const int* shield = thread_state.GetPawnShield(key);
+    if (shield != nullptr) {
+      eval += *shield;
+    } else {
+      const int score = PawnShieldEvaluation(board);
+      thread_state.SavePawnShield(key, score);
+      eval += score;
+    }
+  }
+
+  return maximizing_player ? eval : -eval;
 }
 
-std::unique_ptr<TranspositionTable> ThreadState::ReleaseTranspositionTable() {
-  return std::move(transposition_table_);
+std::optional<std::tuple<int, std::optional<Move>>> AlphaBetaPlayer::QSearch(
+    Stack* ss,
+    NodeType node_type,
+    ThreadState& thread_state,
+    Board& board,
+    int ply,
+    int depth,
+    int alpha,
+    int beta,
+    bool maximizing_player,
+    PVInfo& pv_info,
+    bool is_cut_node) {
+  thread_state.CountNode();
+  SEARCH_STAT(thread_state, QSEARCH_NODES);
+  // Most nodes are here, so the limits are checked here too. The search
+  // sees the cancel at its next node.
+  if ((thread_state.GetNumNodes() & (kLimitCheckInterval - 1)) == 0
+      && SearchLimitReached()) {
+    CancelEvaluation();
+  }
+  pv_info.Clear();
+
+  auto capture_info = board.CanCaptureKing();
+  if (capture_info.from_row != -1) {
+    return std::make_tuple(kMateValue, std::nullopt);
+  }
+
+  // Standing pat: the side to move does not have to capture. Far outside the
+  // window, material and piece-square terms are enough to decide, unless a
+  // network evaluates on a scale of its own.
+  constexpr int kLazyEvalMargin = 250;
+  int stand_pat = board.PieceEvaluation() + board.PieceSquareEvaluation();
+  stand_pat = maximizing_player ? stand_pat : -stand_pat;
+  if (!options_.enable_lazy_eval || board.HasNetwork()
+      || (stand_pat - kLazyEvalMargin < beta
+          && stand_pat + kLazyEvalMargin > alpha)) {
+    stand_pat = Evaluate(thread_state, board, maximizing_player);
+  }
+  ss->static_eval = stand_pat;
+  if (stand_pat >= beta || ply >= kMaxPly - 1) {
+    return std::make_tuple(stand_pat, std::nullopt);
+  }
+  alpha = std::max(alpha, stand_pat);
+
+  const PlayerColor player_color = board.GetTurn().GetColor();
+  const Team other_team = OtherTeam(board.GetTurn().GetTeam());
+  Move* moves = thread_state.GetNextMoveBufferPartition();
+  const size_t count = board.GetPseudoLegalMoves(moves, Board::CAPTURES);
+  int scores[MovePicker2::kMaxMoves];
+  ScoreCaptures(&board, moves, scores, count);
+
+  std::optional<Move> best_move;
+  PVInfo& child_pv_info = thread_state.GetPVAtPly(ply + 1);
+  for (size_t i = 0; i < count; i++) {
+    // Selection sort, MVV-LVA first
+    size_t best = i;
+    for (size_t j = i + 1; j < count; j++) {
+      if (scores[j] > scores[best]) {
+        best = j;
+      }
+    }
+    std::swap(moves[i], moves[best]);
+    std::swap(scores[i], scores[best]);
+    const Move move = moves[i];
+
+    // Delta pruning: even winning the piece outright cannot reach alpha.
+    constexpr int kDeltaMargin = 200;
+    if (stand_pat + kPieceEvaluations[move.GetCapturePiece().GetPieceType()]
+        + kDeltaMargin <= alpha) {
+      SEARCH_STAT(thread_state, QSEARCH_DELTA_PRUNED);
+      continue;
+    }
+    if (board.StaticExchange(move) < 0) {
+      SEARCH_STAT(thread_state, QSEARCH_SEE_PRUNED);
+      continue;
+    }
+
+    board.MakeMove(move);
+    if (board.KingPresent(player_color)
+        && board.IsAttackedByTeam(other_team,
+                                  board.GetKingRow(player_color),
+                                  board.GetKingCol(player_color))) {
+      board.UndoMove();
+      continue;
+    }
+    auto value_and_move_or = QSearch(
+        ss + 1, node_type, thread_state, board, ply + 1, depth - 1,
+        -beta, -alpha, !maximizing_player, child_pv_info, is_cut_node);
+    board.UndoMove();
+
+    int score = -std::get<0>(*value_and_move_or);
+    if (score > alpha) {
+      alpha = score;
+      best_move = move;
+      if (score >= beta) {
+        break;
+      }
+    }
+  }
+
+  thread_state.ReleaseMoveBufferPartition();
+  return std::make_tuple(alpha, best_move);
 }
 
 // Alpha-beta search with nega-max framework.
@@ -181,34 +559,66 @@ std::optional<std::tuple<int, std::optional<Move>>> AlphaBetaPlayer::Search(
     bool is_cut_node) {
 
 
-  num_nodes_++;
+  thread_state.CountNode();
+  if ((thread_state.GetNumNodes() & (kLimitCheckInterval - 1)) == 0
+      && SearchLimitReached()) {
+    CancelEvaluation();
+  }
   if (canceled_.load(std::memory_order_acquire)) {
     return std::nullopt;
   }
 
-  //auto startA = std::chrono::high_resolution_clock::now();
-
   Player player = board.GetTurn();
   PlayerColor player_color = player.GetColor();
   Team other_team = OtherTeam(player.GetTeam());
 
   bool is_root_node = ply == 1;
+  if (is_root_node) {
+    thread_state.SetPVHint(pvinfo);
+  } else {
+    pvinfo.Clear();
+  }
   bool is_pv_node = node_type != NonPV;
 
   //~60ns
   std::optional<Move> tt_move;
+  HashTableEntry tt_entry;
   const HashTableEntry* tte = nullptr;
   bool tt_hit = false;
   int64_t key = board.HashKey();
   auto* tt = thread_state.GetTranspositionTable();
-  if (tt != nullptr) {
-    tte = tt->Get(key);
+  // Results of earlier sessions come first near the root. An exact one that
+  // is deep enough ends the node even on the PV, so analyzed positions are
+  // answered at once. An entry whose move is not legal here is not used.
+  bool cache_hit = false;
+  std::optional<Move> cache_move;
+  if (ply <= kMaxCachePly && options_.analysis_cache != nullptr) {
+    tte = options_.analysis_cache->Get(key, tt_entry);
+    if (tte != nullptr && tte->depth >= depth && tte->packed_move != 0) {
+      cache_move = LegalCacheMove(board, tte->packed_move);
+    }
+    cache_hit = cache_move.has_value();
+  }
+  if (!cache_hit) {
+    tte = tt != nullptr ? tt->Get(key, tt_entry) : nullptr;
+    if (tt != nullptr) {
+      thread_state.CountTTProbe(tte != nullptr && tte->key == key);
+    }
   }
   if (tte != nullptr) {
     if (tte->key == key) { // valid entry
       tt_hit = true;
+      SEARCH_STAT(thread_state, TT_HITS);
+      if (cache_hit && tte->bound == EXACT && cache_move.has_value()) {
+        SEARCH_STAT(thread_state, CACHE_CUTOFFS);
+        const Move move = *cache_move;
+        PVInfo& child_pvinfo = thread_state.GetPVAtPly(ply + 1);
+        child_pvinfo.Clear();
+        pvinfo.Update(move, child_pvinfo);
+        return std::make_tuple(
+            std::min(beta, std::max(alpha, tte->score)), move);
+      }
       if (tte->depth >= depth) {
-        //num_cache_hits_++;
         // at non-PV nodes check for an early TT cutoff
         if (!is_root_node
             && !is_pv_node
@@ -216,7 +626,7 @@ std::optional<std::tuple<int, std::optional<Move>>> AlphaBetaPlayer::Search(
               || (tte->bound == LOWER_BOUND && tte->score >= beta)
               || (tte->bound == UPPER_BOUND && tte->score <= alpha))
             ) {
-
+          SEARCH_STAT(thread_state, TT_CUTOFFS);
           if (tte->packed_move != 0) {
               return std::make_tuple(
                   std::min(beta, std::max(alpha, tte->score)),
@@ -239,25 +649,11 @@ std::optional<std::tuple<int, std::optional<Move>>> AlphaBetaPlayer::Search(
     // king capture possible
     // capturing the king not always wins but it always ends the game
 
-    bool is_new_checkmate = false;
-
-    // First try a read-only check with shared lock
-    {
-      std::shared_lock<std::shared_mutex> lock(checkmate_mutex_);
-      is_new_checkmate = (checkmate_positions_.find(key) == checkmate_positions_.end());
-    }
-
-    // If it's a new checkmate, take exclusive lock to update
-    if (is_new_checkmate) {
-      std::unique_lock<std::shared_mutex> lock(checkmate_mutex_);
-      // Double-check in case another thread added it between our check and now
-      auto [it, inserted] = checkmate_positions_.insert(key);
-      is_new_checkmate = inserted;
-    }
+    checkmate_positions_.Insert(key);
 
+    // The side to move takes the king and wins.
     auto eval = kMateValue;
     //std::cout << "king capture" << std::endl;
-    eval = maximizing_player ? eval : -eval;
 
     const auto& target_piece = board.GetPiece(capture_info.to_row, capture_info.to_col);
     int8_t capture_raw = target_piece.GetRaw();
@@ -273,7 +669,7 @@ std::optional<std::tuple<int, std::optional<Move>>> AlphaBetaPlayer::Search(
 
   //~20ns
   int eval = 0;
-  if (tt_hit) {
+  if (tt_hit && !cache_hit) {
     if (tte->bound == UPPER_BOUND) {
       eval = board.PieceEvaluation();
       eval = maximizing_player ? eval : -eval;
@@ -281,150 +677,48 @@ std::optional<std::tuple<int, std::optional<Move>>> AlphaBetaPlayer::Search(
       eval = tte->eval;
     }
   } else {
-    eval = board.PieceEvaluation();
-    
-    static const uint8_t LOG2_MOVES[256] = {
-        0, 0, 0, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3,
-        4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
-        5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
-        5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
-        6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
-        6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
-        6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
-        6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
-        7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
-        7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
-        7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
-        7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
-        7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
-        7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
-        7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
-        7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7
-    };
-
-    static const uint8_t LOG2_THREATS[64] = {
-        0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3, 4,
-        4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 5,
-        5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
-        5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5
-    };
-
-    static const int8_t THREAT_SCORE[64] = {
-        -8, -8, -8, -8, -8, -8, -8, -8,
-        -8, -8, -8, -8, -8, -8, -8, -8,
-        -8, -8,
-        8, 16, 24, 32, 40, 48, 56,
-        -56, -48, -40, -32, -24, -16,
-        -50, -50, -50, -50, -50, -50, -50, -50,
-        -50, -50, -50, -50, -50, -50, -50, -50,
-        -50, -50, -50, -50, -50, -50, -50, -50,
-        -50, -50, -50, -50, -50, -50, -50, -50
-    };
-
-    int moves_eval;
-    int threat_eval;
-
-    int logR = LOG2_MOVES[thread_state.TotalMoves()[RED]];
-    int logY = LOG2_MOVES[thread_state.TotalMoves()[YELLOW]];
-    int logB = LOG2_MOVES[thread_state.TotalMoves()[BLUE]];
-    int logG = LOG2_MOVES[thread_state.TotalMoves()[GREEN]];
-
-    int logRY = (logR + logY) << 2;  // 4 * sum
-    int logBG = (logB + logG) << 2;
-
-    int lb, sign;
-    if (logRY > logBG) {
-      lb = logRY + 1;
-      sign = (other_team != RED_YELLOW) ? 1 : -1;
-    } else if (logBG > logRY) {
-      lb = logBG + 1;
-      sign = (other_team != RED_YELLOW) ? -1 : 1;
-    } else {
-      lb = logRY + 1;
-      sign = 0;
-    }
-    moves_eval = sign * (lb < 27 ? 10 : 5 * (lb - 25));
-
-    int logtR = LOG2_THREATS[thread_state.NThreats()[RED] & 63];
-    int logtY = LOG2_THREATS[thread_state.NThreats()[YELLOW] & 63];
-    int logtB = LOG2_THREATS[thread_state.NThreats()[BLUE] & 63];
-    int logtG = LOG2_THREATS[thread_state.NThreats()[GREEN] & 63];
-
-    int logtRY = (logtR + logtY) << 2;
-    int logtBG = (logtB + logtG) << 2;
-
-    int len_idx;
-    int threat_sign;
-    if (logtRY > logtBG) {
-      len_idx = logtRY;
-      threat_sign = (other_team != RED_YELLOW) ? 1 : -1;
-    } else if (logtBG > logtRY) {
-      len_idx = logtBG;
-      threat_sign = (other_team != RED_YELLOW) ? -1 : 1;
-    } else {
-      len_idx = 0;
-      threat_sign = 0;
-    }
-
-    len_idx = (len_idx < 0) ? 0 : (len_idx > 63 ? 63 : len_idx);
-    threat_eval = threat_sign * THREAT_SCORE[len_idx];
-
-    eval += moves_eval + threat_eval;
-
-    eval = maximizing_player ? eval : -eval;
+    eval = Evaluate(thread_state, board, maximizing_player);
   } 
   ss->static_eval = eval;
   ss->move_count = 0;
 
   std::optional<Move> best_move;
-  std::optional<Move> pv_move = pvinfo.GetBestMove();
+  std::optional<Move> pv_move = thread_state.GetPVHint(ply);
   Move* moves = thread_state.GetNextMoveBufferPartition();
 
-  // Generate moves with pieces
-  const auto& pieces = board.GetPieceList()[board.GetTurn().GetColor()];
-  auto result = board.GetPseudoLegalMoves2(
-    moves,
-    kBufferPartitionSize,
-    pieces,
-    pv_move);
-  thread_state.TotalMoves()[player_color] = result.mobility_counts[player_color];
-  thread_state.NThreats()[player_color] = result.threat_counts[player_color];
-  //bool in_check = result.in_check;
-
-  //~10ns
-  // Then initialize the move picker with the generated moves
-  MovePicker2 picker;
-  const Move* pv_ptr = (result.pv_index >= 0) ? &moves[result.pv_index] : nullptr;
-  size_t move_count2 = result.count;
-  const Move* tt_ptr = nullptr;
-  if (move_count2 > 0 && tt_move.has_value()) {
-    tt_ptr = &(*tt_move);
+  // Killers and the counter-move are tried after the captures.
+  Move refutations[3];
+  int num_refutations = 0;
+  if (options_.enable_killers) {
+    refutations[num_refutations++] = ss->killers[0];
+    refutations[num_refutations++] = ss->killers[1];
+  }
+  if (options_.enable_counter_move_heuristic) {
+    refutations[num_refutations++] =
+        thread_state.CounterMove((ss-1)->current_move);
   }
 
-  //~10ns
+  int16_t* continuation_history = options_.enable_continuation_history
+    ? thread_state.GetContinuationHistory(board, (ss-1)->current_move)
+    : nullptr;
+  const QuietHistory quiet_history = {
+    thread_state.GetHistory(player_color),
+    continuation_history != nullptr ? continuation_history
+                                    : thread_state.GetNoContinuationHistory(),
+  };
+
+  // Moves are generated stage by stage as the picker runs out of them.
+  MovePicker2 picker;
   InitMovePicker2(
     &picker,
     &board,
     moves,
-    move_count2,
-    pv_ptr,
-    tt_ptr,
-    reinterpret_cast<int16_t(*)[224][224]>(thread_state.GetHistoryHeuristic()));
-
-  //auto endA = std::chrono::high_resolution_clock::now();
-  //auto durationA = std::chrono::duration_cast<std::chrono::nanoseconds>(endA - startA);
-  //total_timeA += durationA;
-  //call_countA++;
-  //if (call_countA % 200000 == 0) {
-  //  auto avg_ns = total_timeA.count() / call_countA;
-
-  //  //std::cout << "--- [Search - before move]"
-  //  //          << "Average: " << avg_ns << " ns, "
-  //  //          << "Call count: " << call_countA << ", " 
-  //  //          << "cache hits: " << num_cache_hits_
-  //  //          << std::endl;
-  //}
-  
+    pv_move,
+    tt_move,
+    quiet_history,
+    refutations,
+    num_refutations);
+
   bool has_legal_moves = false;
   int move_count = 0;
   int invalid_moves = 0;
@@ -435,14 +729,17 @@ std::optional<std::tuple<int, std::optional<Move>>> AlphaBetaPlayer::Search(
     const Move* move_ptr = GetNextMove2(&picker);
     if (move_ptr == nullptr) break;
     const Move& move = *move_ptr;
-    //auto startA2 = std::chrono::high_resolution_clock::now();
 
     std::optional<std::tuple<int, std::optional<Move>>> value_and_move_or;
 
     const int8_t old_king_row = board.GetKingRow(player_color);
     const int8_t old_king_col = board.GetKingCol(player_color);
+    const int64_t nodes_before_move = thread_state.GetNumNodes();
     //~20ns
     board.MakeMove(move);
+    if (tt != nullptr) {
+      tt->Prefetch(board.HashKey());
+    }
 
     const int8_t king_row = board.GetKingRow(player_color);
     const int8_t king_col = board.GetKingCol(player_color);
@@ -464,6 +761,7 @@ std::optional<std::tuple<int, std::optional<Move>>> AlphaBetaPlayer::Search(
           rd, cd
         );
         if (is_king_in_check) { // invalid move
+          SEARCH_STAT(thread_state, ILLEGAL_MOVES);
           board.UndoMove();
           continue;
         }
@@ -473,47 +771,17 @@ std::optional<std::tuple<int, std::optional<Move>>> AlphaBetaPlayer::Search(
           other_team, king_row, king_col
         );
         if (is_king_in_check) { // invalid move
+          SEARCH_STAT(thread_state, ILLEGAL_MOVES);
           board.UndoMove();
           continue;
         }
     }
 
-    static std::atomic<int64_t> cm_skip_count{0};
     int64_t current_hash = board.HashKey();
     bool checkmate = IsKnownCheckmate(current_hash);
     if (checkmate) {
-        /*
-        // Checkmate discovery mode: export FEN to file
-        if (options_.checkmate_discovery_mode
-          && checkmate_file_
-          && checkmate_file_->is_open()
-        ) {
-          std::string fen = board.ToFEN();
-          bool is_new = false;
-          
-          // Check if this FEN has already been written
-          {
-            std::lock_guard<std::mutex> lock(discovered_fens_mutex_);
-            is_new = discovered_fens_.insert(fen).second;
-          }
-          
-          if (is_new) {
-            std::lock_guard<std::mutex> file_lock(checkmate_file_mutex_);
-            *checkmate_file_ << fen << std::endl;
-            checkmate_file_->flush();
-
-            int discovered = checkmates_discovered_.fetch_add(1) + 1;
-            if (discovered >= options_.max_checkmates_to_discover) {
-              canceled_ = true;
-              std::cout << "Checkmate discovery complete: found " << discovered << " checkmates" << std::endl;
-            }
-          }
-        }
-        */
+      SEARCH_STAT(thread_state, KNOWN_CHECKMATES);
       board.UndoMove();
-      cm_skip_count++;
-      //std::cout << "checkmate position "  << cm_skip_count << std::endl;
-      //abort();
       continue;
     }
 
@@ -521,42 +789,26 @@ std::optional<std::tuple<int, std::optional<Move>>> AlphaBetaPlayer::Search(
 
     ss->current_move = move;
 
-    std::shared_ptr<PVInfo> child_pvinfo;
-    if (move_count == 0 && pvinfo.GetChild() != nullptr) {
-      child_pvinfo = pvinfo.GetChild();
-    } else {
-      child_pvinfo = std::make_shared<PVInfo>();
+    // Only the first move continues the previous PV.
+    if (move_count > 0) {
+      thread_state.LeavePVHint(ply);
     }
+    PVInfo& child_pvinfo = thread_state.GetPVAtPly(ply + 1);
 
     ss->move_count = move_count++;
 
     int r = 1;
 
-    //auto endA2 = std::chrono::high_resolution_clock::now();
-    //auto durationA2 = std::chrono::duration_cast<std::chrono::nanoseconds>(endA2 - startA2);
-    //total_timeA2 += durationA2;
-    //call_countA2++;
-    //if (call_countA2 % 4000000 == 0) {
-    //  auto avg_ns = total_timeA2.count() / call_countA2;
-
-    //  std::cout //<< "---[Move - before recursion]"
-    //            //<< "Average: " << avg_ns << " ns, "
-    //            //<< "Call count: " << call_countA2 << std::endl
-    //            //<< "Singular searches: " << GetNumSingularExtensionSearches() << std::endl
-    //            //<< "Singular hits: " << GetNumSingularExtensions() << std::endl
-    //            << "CM skips: " << cm_skip_count << std::endl;
-    //}
-
     if (depth >= 5
         && tt_hit
         && (tte->bound == LOWER_BOUND)
         && tte->depth >= depth >> 1
         ) {
-      num_singular_extension_searches_.fetch_add(1, std::memory_order_relaxed);
-      
+      SEARCH_STAT(thread_state, SINGULAR_SEARCHES);
+
       int beta = tte->score;
 
-      PVInfo pvinfo;
+      PVInfo& pvinfo = thread_state.GetPVAtPly(ply + 1);
       auto res = Search(ss, NonPV, thread_state, board, ply+1,
         depth - 1 - (depth/2),
         beta - 100, beta,
@@ -566,18 +818,15 @@ std::optional<std::tuple<int, std::optional<Move>>> AlphaBetaPlayer::Search(
         int score = std::get<0>(*res);
         // If the search fails low, we didn't find a better move
         if (score < beta) {
-          num_singular_extensions_.fetch_add(1, std::memory_order_relaxed);
+          SEARCH_STAT(thread_state, SINGULAR_EXTENSIONS);
           r = -1;
         }
       }
     }
 
-    //static std::atomic<int64_t> capture_extension_count{0};
-    //static std::atomic<int64_t> check_extension_count{0};
-
     constexpr int kMaxExtensionsPerPath = 1;
-    if (depth < 2 && move.IsCapture() && ss->extension_count < kMaxExtensionsPerPath) {
-        //capture_extension_count++;
+    if (!options_.enable_qsearch
+        && depth < 2 && move.IsCapture() && ss->extension_count < kMaxExtensionsPerPath) {
         r = -1;
     }
 
@@ -591,16 +840,18 @@ std::optional<std::tuple<int, std::optional<Move>>> AlphaBetaPlayer::Search(
           - (depth/8)*(r > 0)*(depth>15)
           - (depth/16)*(r > 0)*(depth>31)
           + (r < 0);
+      SEARCH_STAT(thread_state, LMR_SEARCHES);
       SEARCH_OR_EVAL(value_and_move_or, new_depth,
           ss+1, NonPV, thread_state, board, ply + 1, new_depth,
           -alpha-1, -alpha, !maximizing_player,
-          *child_pvinfo, is_cut_node);
+          child_pvinfo, is_cut_node);
           
       if (value_and_move_or.has_value()) {
         int score = -std::get<0>(*value_and_move_or);
         
         // If the reduced search fails high, we need to research
         if (score > alpha) {
+          SEARCH_STAT(thread_state, LMR_RESEARCHES);
           
           // If the score is not failing high by much, try a reduced-window search first
           if (score < alpha + 100) {
@@ -614,7 +865,7 @@ std::optional<std::tuple<int, std::optional<Move>>> AlphaBetaPlayer::Search(
             SEARCH_OR_EVAL(value_and_move_or, new_depth,
                 ss+1, NonPV, thread_state, board, ply + 1, new_depth,
                 -alpha-50, -alpha, !maximizing_player,
-                *child_pvinfo, is_cut_node);
+                child_pvinfo, is_cut_node);
                 
             if (value_and_move_or && -std::get<0>(*value_and_move_or) > alpha) {
               // If the reduced window search still fails high, do a full search
@@ -626,7 +877,7 @@ std::optional<std::tuple<int, std::optional<Move>>> AlphaBetaPlayer::Search(
               SEARCH_OR_EVAL(value_and_move_or, new_depth,
                 ss+1, NonPV, thread_state, board, ply + 1, new_depth,
                 -beta, -alpha, !maximizing_player,
-                *child_pvinfo, is_cut_node);
+                child_pvinfo, is_cut_node);
             }
           } else {
             // Failing high by a lot, do a full search immediately
@@ -638,7 +889,7 @@ std::optional<std::tuple<int, std::optional<Move>>> AlphaBetaPlayer::Search(
             SEARCH_OR_EVAL(value_and_move_or, new_depth,
               ss+1, NonPV, thread_state, board, ply + 1, new_depth,
               -beta, -alpha, !maximizing_player,
-              *child_pvinfo, is_cut_node);
+              child_pvinfo, is_cut_node);
           }
         }
       }
@@ -661,9 +912,8 @@ std::optional<std::tuple<int, std::optional<Move>>> AlphaBetaPlayer::Search(
       SEARCH_OR_EVAL(value_and_move_or, new_depth,
           ss+1, PV, thread_state, board, ply + 1, new_depth,
           -beta, -alpha, !maximizing_player,
-          *child_pvinfo, is_cut_node);
+          child_pvinfo, is_cut_node);
     }
-    //auto startB = std::chrono::high_resolution_clock::now();
 
     board.UndoMove();
 
@@ -673,14 +923,23 @@ std::optional<std::tuple<int, std::optional<Move>>> AlphaBetaPlayer::Search(
     }
     int score = -std::get<0>(*value_and_move_or);
 
+    if (is_root_node && (score > alpha || !best_move.has_value())) {
+      thread_state.SetRootBestMoveNodes(
+          thread_state.GetNumNodes() - nodes_before_move);
+    }
+
     if (score >= beta) {
       alpha = beta;
       best_move = move;
-      pvinfo.SetChild(child_pvinfo);
-      pvinfo.SetBestMove(move);
+      pvinfo.Update(move, child_pvinfo);
       fail_low = false;
       fail_high = true;
       is_cut_node = true;
+      SEARCH_CUTOFF(thread_state, move_count - 1);
+
+      if (!move.IsCapture()) {
+        UpdateQuietStats(thread_state, ss, move);
+      }
 
       break; // cutoff
     }
@@ -688,38 +947,14 @@ std::optional<std::tuple<int, std::optional<Move>>> AlphaBetaPlayer::Search(
       fail_low = false;
       alpha = score;
       best_move = move;
-      pvinfo.SetChild(child_pvinfo);
-      pvinfo.SetBestMove(move);
+      pvinfo.Update(move, child_pvinfo);
     }
 
     if (!best_move.has_value()) {
       best_move = move;
-      pvinfo.SetChild(child_pvinfo);
-      pvinfo.SetBestMove(move);
+      pvinfo.Update(move, child_pvinfo);
     }
-    //auto endB = std::chrono::high_resolution_clock::now();
-    //auto durationB = std::chrono::duration_cast<std::chrono::nanoseconds>(endB - startB);
-    //total_timeB += durationB;
-    //call_countB++;
-    //// Track full searches and checkmate searches
-    //thread_local int64_t total_full_searches = 0;
-    
-    //if (full_search) total_full_searches++;
-    
-    //if (call_countB % 1000000 == 0) {
-    //  auto avg_ns = total_timeB.count() / call_countB;
-    //  auto current_avg = durationB.count() / 1;  // Current call's time in ns
-
-    //  std::cout << "[Move - after recursion]"
-    //            << " Average: " << avg_ns << " ns,"
-    //            << " Calls: " << call_countB << std::endl
-    //            << "Full searches: " << total_full_searches
-    //            << " capture extension: " << capture_extension_count
-    //            << " check extension: " << check_extension_count << std::endl;
-    //}
-  }
-  //static std::atomic<int64_t> total_checkmates_found = 0;
-  //auto startC = std::chrono::high_resolution_clock::now();
+  }
 
   if (!fail_low && best_move) {  // Add null check for best_move
     int8_t from_row = best_move->FromRow();
@@ -731,42 +966,38 @@ std::optional<std::tuple<int, std::optional<Move>>> AlphaBetaPlayer::Search(
     int bonus = 1 + (fail_high ? (depth << 2) : depth);
     if (bonus > 16383) bonus = 16383;  // Cap for int16_t
 
-    // [224][224] some values unused
-    int from_sq = (from_row << 4) + from_col;
-    int to_sq = (to_row << 4) + to_col;
-    int queen_idx = (piece.GetPieceType() == QUEEN) ? 1 : 0;
-    auto* hh = thread_state.GetHistoryHeuristic();
-    hh[queen_idx * 224 * 224 + from_sq * 224 + to_sq] += bonus;
-    hh[queen_idx * 224 * 224 + from_sq * 224 + to_sq] =
-    (hh[queen_idx * 224 * 224 + from_sq * 224 + to_sq] >> 1) | (rand() & 0x7);
+    const int from_sq = nnue::SquareIndex(from_row, from_col);
+    const int to_sq = nnue::SquareIndex(to_row, to_col);
+    int16_t& history =
+      thread_state.GetHistory(player_color)[from_sq * nnue::kNumSquares + to_sq];
+    history = (history + bonus) >> 1;
+    if (continuation_history != nullptr) {
+      int16_t& continuation = continuation_history[
+          piece.GetPieceType() * nnue::kNumSquares + to_sq];
+      continuation = (continuation + bonus) >> 1;
+    }
   }
 
   int score = alpha;
   if (!has_legal_moves) {
       score = -kMateValue;
-      score = maximizing_player ? score : -score;
 
       // Track unique checkmate positions
-      Board checkmateboard = board;
-      //Move last_move = board.GetLastMove();
-      checkmateboard.UndoMove();
-      int64_t hash_key = checkmateboard.HashKey();
-
-      bool is_new_checkmate = false;
-
-      // First try a read-only check with shared lock
-      {
-        std::shared_lock<std::shared_mutex> lock(checkmate_mutex_);
-        is_new_checkmate = (checkmate_positions_.find(hash_key) == checkmate_positions_.end());
-      }
-
-      // If it's a new checkmate, take exclusive lock to update
-      if (is_new_checkmate) {
-        std::unique_lock<std::shared_mutex> lock(checkmate_mutex_);
-        // Double-check in case another thread added it between our check and now
-        auto [it, inserted] = checkmate_positions_.insert(hash_key);
-        is_new_checkmate = inserted;
-        //total_checkmates_found++;     // Increment total checkmate counter
+      int64_t hash_key = board.HashKeyBeforeLastMove();
+
+      checkmate_positions_.Insert(hash_key);
+
+      // Checkmate discovery mode: hand the position to the writer
+      if (checkmate_discovery_ != nullptr
+          && board.KingPresent(player_color)
+          && board.IsAttackedByTeam(other_team,
+                                    board.GetKingRow(player_color),
+                                    board.GetKingCol(player_color))
+          && checkmate_discovery_->Add(thread_state.GetThreadId(), board)) {
+        CancelEvaluation();
+        std::cout << "Checkmate discovery complete: found "
+                  << checkmate_discovery_->NumDiscovered() << " checkmates"
+                  << std::endl;
       }
   }
   //ScoreBound bound = beta <= alpha ? LOWER_BOUND : is_pv_node &&
@@ -786,39 +1017,87 @@ std::optional<std::tuple<int, std::optional<Move>>> AlphaBetaPlayer::Search(
   }
 
   thread_state.ReleaseMoveBufferPartition();
-  //auto endC = std::chrono::high_resolution_clock::now();
-  //auto durationC = std::chrono::duration_cast<std::chrono::nanoseconds>(endC - startC);
-  //total_timeC += durationC;
-  //call_countC++;
-  //if (call_countC % 1000000 == 0) {
-  //  auto avg_ns = total_timeC.count() / call_countC;
-  //  auto current_avg = durationC.count() / 1;  // Current call's time in ns
-
-  //  std::cout << "[Search - after move]"
-  //            << " Average: " << avg_ns << " ns,"
-  //            << " Call count: " << call_countC
-  //            << ", Checkmates: " 
-  //            << total_checkmates_found << std::endl;
-  //}
 
   return std::make_tuple(score, best_move);
 }
 
+int64_t AlphaBetaPlayer::GetNumEvaluations() const {
+  int64_t nodes = returned_nodes_;
+  for (size_t i = 0; i < thread_states_.size(); i++) {
+    nodes += thread_states_[i]->GetNumNodes() - counts_at_borrow_[i].nodes;
+  }
+  return nodes;
+}
+
+std::vector<ThreadSearchCounts> AlphaBetaPlayer::GetThreadSearchCounts() const {
+  std::vector<ThreadSearchCounts> counts;
+  for (size_t i = 0; i < thread_states_.size(); i++) {
+    const ThreadState& thread_state = *thread_states_[i];
+    const ThreadSearchCounts& at_borrow = counts_at_borrow_[i];
+    counts.push_back({thread_state.GetNumNodes() - at_borrow.nodes,
+                      thread_state.GetNumTTProbes() - at_borrow.tt_probes,
+                      thread_state.GetNumTTHits() - at_borrow.tt_hits});
+  }
+  return counts;
+}
+
+void AlphaBetaPlayer::PonderHit() {
+  // From now on a clock waits for the search.
+  time_manager_.PonderHit();
+  may_yield_ = false;
+  if (options_.search_pool != nullptr) {
+    // The search may be waiting for searchers behind the others.
+    options_.search_pool->Interrupt();
+  }
+}
+
+void AlphaBetaPlayer::SetCanceled(bool canceled) {
+  stopped_.store(canceled, std::memory_order_release);
+  canceled_.store(canceled, std::memory_order_release);
+  if (canceled && options_.search_pool != nullptr) {
+    // The search may be waiting for searchers.
+    options_.search_pool->Interrupt();
+  }
+}
+
+SearchStatsTotals AlphaBetaPlayer::GetSearchStats() const {
+  SearchStatsTotals totals;
+  totals.nodes = GetNumEvaluations() - nodes_at_stats_clear_;
+  for (const auto& thread_state : thread_states_) {
+    totals.Add(thread_state->Stats());
+  }
+  return totals;
+}
+
+void AlphaBetaPlayer::ClearSearchStats() {
+  nodes_at_stats_clear_ = GetNumEvaluations();
+  for (auto& thread_state : thread_states_) {
+    thread_state->Stats().Clear();
+  }
+}
+
 void AlphaBetaPlayer::ResetHistoryHeuristics() {
-  // History heuristic is now thread-local in ThreadState
-  // Each thread's heuristic is zero-initialized in ThreadState constructor
+  for (auto& thread_state : own_thread_states_) {
+    thread_state->ClearHistory();
+  }
+  // Searchers of a pool clear theirs when they are borrowed next.
+  history_owner_ = NewHistoryOwner();
 }
 
 void AlphaBetaPlayer::AgeHistoryHeuristics() {
-  // History heuristic is now thread-local in ThreadState
-  // Aging would need to be done per-thread if needed
+  // The tables are halved lazily, by each thread on its own, in
+  // MakeMoveSingleThread.
+  history_generation_++;
 }
 
-void AlphaBetaPlayer::ResetMobilityScores(ThreadState& thread_state, Board& board) {
-  // reset pseudo-mobility scores
-  for (int i = 0; i < 4; i++) {
-    Player player(static_cast<PlayerColor>(i));
-    UpdateMobilityEvaluation(thread_state, board, player);
+void AlphaBetaPlayer::UpdateQuietStats(
+    ThreadState& thread_state, Stack* ss, const Move& move) {
+  if (options_.enable_killers && ss->killers[0] != move) {
+    ss->killers[1] = ss->killers[0];
+    ss->killers[0] = move;
+  }
+  if (options_.enable_counter_move_heuristic) {
+    thread_state.CounterMove((ss-1)->current_move) = move;
   }
 }
 
@@ -826,78 +1105,137 @@ std::optional<std::tuple<int, std::optional<Move>, int>>
 AlphaBetaPlayer::MakeMove(
     Board& board,
     int max_depth) {
+  SearchLimits limits;
+  limits.depth = max_depth;
+  return MakeMove(board, limits);
+}
 
-  int num_threads = 1;
-  if (options_.enable_multithreading) {
-    num_threads = options_.num_threads;
-  }
-  assert(num_threads >= 1);
+bool AlphaBetaPlayer::SearchLimitReached() const {
+  return time_manager_.HardLimitReached()
+    || (node_limit_.has_value()
+        && GetNumEvaluations() - nodes_at_search_start_ >= *node_limit_);
+}
 
-  // Get PV moves for helper threads
-  std::vector<Move> pv_moves;
-  PVInfo* current = &pv_info_;
-  while (current) {
-    auto move = current->GetBestMove();
-    if (move.has_value()) {
-      pv_moves.push_back(*move);
-      current = current->GetChild().get();
-    } else {
-      break;
+std::optional<int> AlphaBetaPlayer::PliesAlongLastPV(const Board& board) const {
+  if (last_root_ == nullptr) {
+    return std::nullopt;
+  }
+  Board position = *last_root_;
+  const int max_plies = std::min(pv_info_.GetDepth(), kMaxReusePlies);
+  for (int ply = 0; ; ply++) {
+    if (position.HashKey() == board.HashKey()) {
+      return ply;
     }
+    if (ply == max_plies) {
+      return std::nullopt;
+    }
+    position.MakeMove(pv_info_.GetMove(ply));
   }
+}
 
-  // Generate root moves for remaining helper threads
-  const auto& pieces = board.GetPieceList()[board.GetTurn().GetColor()];
-  Move root_moves_buffer[256];
-  auto root_result = board.GetPseudoLegalMoves2(
-    root_moves_buffer,
-    256,
-    pieces,
-    std::nullopt);
-  int num_root_moves = root_result.count;
-
-  std::vector<ThreadState> thread_states;
-  thread_states.reserve(num_threads);
-  for (int i = 0; i < num_threads; i++) {
-    PlayerOptions thread_options = options_;
-
-    Board* board_for_thread = &board;
-    int moves_to_apply = 0;
-    
-    // Helper threads get a board with their assigned moves made
-    if (i > 0) {
-      static std::vector<std::unique_ptr<Board>> helper_boards;
-      if (helper_boards.size() < static_cast<size_t>(num_threads - 1)) {
-        helper_boards.push_back(std::make_unique<Board>(board));
-      } else {
-        helper_boards[i - 1] = std::make_unique<Board>(board);
-      }
-      
-      int pv_depth = max_depth - i;
-      if (pv_depth > 0 && !pv_moves.empty()) {
-        //moves_to_apply = std::clamp((max_depth - pv_depth) + 1, 1, static_cast<int>(pv_moves.size()));
-        moves_to_apply = std::clamp(pv_depth - (max_depth/2) - 6, 1, static_cast<int>(pv_moves.size()));
-        for (int j = 0; j < moves_to_apply; j++) {
-          helper_boards[i - 1]->MakeMove(pv_moves[j]);
-        }
-      } else if ((i - 1) < num_root_moves) {
-        moves_to_apply = 1;
-        helper_boards[i - 1]->MakeMove(root_moves_buffer[i - 1]);
-      }
-      board_for_thread = helper_boards[i - 1].get();
-
-      auto pv_copy = std::make_shared<PVInfo>();
+std::optional<std::tuple<int, std::optional<Move>, int>>
+AlphaBetaPlayer::MakeMove(
+    Board& board,
+    const SearchLimits& limits,
+    const IterationCallback& on_iteration) {
+  time_manager_.Start(limits, board.GetTurn().GetColor());
+  node_limit_ = limits.nodes;
+  nodes_at_search_start_ = GetNumEvaluations();
+  on_iteration_ = on_iteration ? &on_iteration : nullptr;
+  const int max_depth = std::clamp(limits.depth.value_or(kMaxSearchDepth), 1,
+                                   kMaxSearchDepth);
+
+  auto res = options_.search_pool == nullptr
+    ? SearchRoot(board, limits, max_depth)
+    : SearchWithPool(board, limits, max_depth);
+
+  on_iteration_ = nullptr;
+  time_manager_.Finish();
+  SetCanceled(false);
+  return res;
+}
 
-      thread_states.emplace_back(thread_options, *board_for_thread, *pv_copy);
-      auto& thread_state = thread_states.back();
-      ResetMobilityScores(thread_state, *board_for_thread);
-    } else {
+std::optional<std::tuple<int, std::optional<Move>, int>>
+AlphaBetaPlayer::SearchWithPool(
+    Board& board, const SearchLimits& limits, int max_depth) {
+  SearchPool& pool = *options_.search_pool;
+  const int wanted = std::clamp<int>(
+      limits.threads.value_or(helper_results_.size()), 1,
+      helper_results_.size());
+  const SearchPool::YieldRequest yield = [this] {
+    if (!may_yield_.exchange(false)) {
+      return false;
+    }
+    yielded_ = true;
+    canceled_.store(true, std::memory_order_release);
+    return true;
+  };
 
-      thread_states.emplace_back(thread_options, board, pv_info_);
-      auto& thread_state = thread_states.back();
-      ResetMobilityScores(thread_state, board);
+  std::optional<std::tuple<int, std::optional<Move>, int>> res;
+  while (true) {
+    // Only while no clock runs. A yielded search borrows again and, at the
+    // same root, continues where it was. Set before the clock is checked,
+    // as PonderHit starts the clock before it clears the flag.
+    may_yield_ = limits.infinite || limits.ponder;
+    if (!limits.infinite && time_manager_.ClockRunning()) {
+      may_yield_ = false;
+    }
+    yielded_ = false;
+    const std::vector<int> searchers =
+        pool.Acquire(wanted, canceled_, &may_yield_, yield);
+    if (searchers.empty()) {
+      break;
+    }
+    for (int searcher : searchers) {
+      ThreadState& thread_state = pool.GetThreadState(searcher);
+      thread_state.SetHistoryOwner(history_owner_, history_generation_);
+      thread_states_.push_back(&thread_state);
+      counts_at_borrow_.push_back({thread_state.GetNumNodes(),
+                                   thread_state.GetNumTTProbes(),
+                                   thread_state.GetNumTTHits()});
     }
+    searchers_ = searchers;
+
+    auto round = SearchRoot(board, limits, max_depth);
+
+    may_yield_ = false;
+    returned_nodes_ = GetNumEvaluations();
+    thread_states_.clear();
+    counts_at_borrow_.clear();
+    searchers_.clear();
+    pool.Release(searchers);
+    if (round.has_value()) {
+      res = round;
+    }
+    if (!yielded_ || stopped_) {
+      break;
+    }
+    canceled_.store(false, std::memory_order_release);
+  }
+  return res;
+}
+
+std::optional<std::tuple<int, std::optional<Move>, int>>
+AlphaBetaPlayer::SearchRoot(
+    Board& board, const SearchLimits& limits, int max_depth) {
+  // A position the last search expected, such as the one after our move
+  // and the predicted replies, continues that search: the rest of its PV
+  // is the hint and iterative deepening starts about as deep as the table
+  // still has it.
+  PVInfo pv_hint;
+  start_depth_ = 1;
+  const std::optional<int> plies = PliesAlongLastPV(board);
+  if (plies.has_value()) {
+    pv_hint = pv_info_;
+    pv_hint.DropFront(*plies);
+    start_depth_ = std::max(1, last_search_depth_ - *plies);
+  }
 
+  // Lazy SMP: every thread searches the root position and they share work
+  // through the transposition table. Helpers start from the same PV hint as
+  // the main thread and skip some depths so the threads spread out.
+  for (auto& thread_state : thread_states_) {
+    thread_state->NewSearch(board, pv_hint);
   }
 
   root_team_ = board.GetTurn().GetTeam();
@@ -911,101 +1249,116 @@ AlphaBetaPlayer::MakeMove(
     asp_sum_sq_ = 0;
 
     // Increment generation counter for new search
-    if (hash_key != last_board_key_) {
-      thread_states[0].GetTranspositionTable()->NewSearch();
+    if (transposition_table_ != nullptr) {
+      transposition_table_->NewSearch();
     }
+    AgeHistoryHeuristics();
   }
   last_board_key_ = hash_key;
 
-  SetCanceled(false);
-  std::atomic_thread_fence(std::memory_order_seq_cst);
-  // Use Alpha-Beta search with iterative deepening
-  auto start = std::chrono::system_clock::now();
-
   if (options_.max_search_depth.has_value()) {
     max_depth = std::min(max_depth, *options_.max_search_depth);
   }
-
-  std::vector<std::unique_ptr<std::thread>> threads;
-  for (int i = 1; i < num_threads; i++) {
-    // Only create helper thread if it has a move assigned
-    int pv_depth = max_depth - i;
-    bool has_move = (pv_depth > 0 && !pv_moves.empty()) || ((i - 1) < num_root_moves);
-    if (!has_move) {
-      break;
+  start_depth_ = std::min(start_depth_, max_depth);
+
+  // Helpers deepen up to the same max_depth, staggered by SkipDepth, until
+  // the main thread is done.
+  {
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    pool_max_depth_ = max_depth;
+    for (auto& result : helper_results_) {
+      result.reset();
     }
-    threads.push_back(std::make_unique<std::thread>([
-      this, i, &thread_states, max_depth, &pv_moves, &root_moves_buffer] {
-          //int helper_depth = std::max(1, max_depth - 0);
-
-          int helper_depth;
-          if (max_depth > 11) {
-            helper_depth = 1000;
-          } else {
-            helper_depth = 0;
-          }
-          int pv_depth = max_depth - i;
-          if (pv_depth > 0 && !pv_moves.empty()) {
-            int moves_to_apply = std::min(pv_depth, static_cast<int>(pv_moves.size()));
-            //std::cout << "starting " << i << " pv_depth: " << moves_to_apply << " depth: " << max_depth << std::endl;
-          } else {
-            Move move = root_moves_buffer[i - 1];
-            //std::cout << "starting " << i << " move: " << move.PrettyStr() << " depth: " << max_depth << std::endl;
-          }
-          
-          struct timespec cpu_start, cpu_end;
-          
-          auto result = MakeMoveSingleThread(i, thread_states[i], helper_depth);
-          
-          //if (result.has_value()) {
-          //  auto [score, move, depth] = *result;
-          //  std::string pv = GetPVStrFromPVInfo(thread_states[i].GetPVInfo());
-          //  std::cout << "Thread " << i << " result: score=" << score
-          //            << " depth=" << depth
-          //            << " move=" << (move.has_value() ? move->PrettyStr() : "none")
-          //            << " pv=" << pv
-          //            << std::endl;
-          //} else {
-          //  std::string pv = GetPVStrFromPVInfo(thread_states[i].GetPVInfo());
-          //  std::cout << "Thread " << i << " result: canceled pv=" << pv << std::endl;
-          //}
-    }));
-  }
-
-  auto res = MakeMoveSingleThread(0, thread_states[0], max_depth);
-
-  SetCanceled(true);
-  
-  for (auto& thread : threads) {
-    thread->join();
+    pool_num_helpers_ = std::clamp<size_t>(
+        limits.threads.value_or(thread_states_.size()) - 1, 0,
+        thread_states_.size() - 1);
+    num_busy_helpers_ = pool_num_helpers_;
+    pool_search_id_++;
   }
-
-  // Merge main thread's TT entries into helper thread 1's TT
-  if (thread_states.size() > 1) {
-    auto* tt0 = thread_states[0].GetTranspositionTable();
-    auto* tt1 = thread_states[1].GetTranspositionTable();
-    if (tt0 != nullptr && tt1 != nullptr) {
-      tt1->Merge(*tt0);
+  if (options_.search_pool == nullptr) {
+    pool_start_cv_.notify_all();
+  } else {
+    for (size_t i = 1; i <= pool_num_helpers_; i++) {
+      options_.search_pool->Run(searchers_[i], [this, i, max_depth] {
+        RunHelper(i, max_depth);
+      });
     }
   }
 
-  if (res.has_value()) {
-      pv_info_ = thread_states[0].GetPVInfo();
+  auto res = MakeMoveSingleThread(0, *thread_states_[0], max_depth);
+
+  // Ends the helpers.
+  canceled_.store(true, std::memory_order_release);
+
+  {
+    std::unique_lock<std::mutex> lock(pool_mutex_);
+    pool_done_cv_.wait(lock, [this] { return num_busy_helpers_ == 0; });
   }
 
-  SetCanceled(false);
+  // The main thread's answer, unless a helper completed a deeper iteration,
+  // which can only be one within max_depth.
+  size_t best_thread = 0;
+  if (res.has_value()) {
+    for (size_t i = 1; i <= pool_num_helpers_; i++) {
+      if (helper_results_[i].has_value()
+          && std::get<2>(*helper_results_[i]) > std::get<2>(*res)) {
+        res = helper_results_[i];
+        best_thread = i;
+      }
+    }
+    pv_info_ = thread_states_[best_thread]->GetPVInfo();
+    last_root_ = std::make_unique<Board>(board);
+    last_search_depth_ = std::get<2>(*res);
+  } else {
+    last_root_.reset();
+  }
   return res;
 }
 
+void AlphaBetaPlayer::HelperLoop(size_t thread_id) {
+  uint64_t search_id = 0;
+  while (true) {
+    int max_depth = 0;
+    {
+      std::unique_lock<std::mutex> lock(pool_mutex_);
+      pool_start_cv_.wait(lock, [this, thread_id, search_id] {
+          return pool_quit_ || (pool_search_id_ != search_id
+                                && thread_id <= pool_num_helpers_);
+      });
+      if (pool_quit_) {
+        return;
+      }
+      search_id = pool_search_id_;
+      max_depth = pool_max_depth_;
+    }
+    RunHelper(thread_id, max_depth);
+  }
+}
+
+void AlphaBetaPlayer::RunHelper(size_t thread_id, int max_depth) {
+  auto result = MakeMoveSingleThread(
+      thread_id, *thread_states_[thread_id], max_depth);
+
+  std::lock_guard<std::mutex> lock(pool_mutex_);
+  helper_results_[thread_id] = result;
+  if (--num_busy_helpers_ == 0) {
+    pool_done_cv_.notify_one();
+  }
+}
+
 std::optional<std::tuple<int, std::optional<Move>, int>>
 AlphaBetaPlayer::MakeMoveSingleThread(
     size_t thread_id,
     ThreadState& thread_state,
     int max_depth) {
+  thread_state.AgeHistory(history_generation_);
   Board board = thread_state.GetRootBoard();
+  board.SetPieceSquareTable(
+      options_.enable_piece_square_table ? &piece_square_table_ : nullptr);
+  board.SetNetwork(options_.network.get());
   PVInfo& pv_info = thread_state.GetPVInfo();
 
-  int next_depth = std::min(1 + pv_info.GetDepth(), max_depth);
+  int next_depth = start_depth_;
   std::optional<std::tuple<int, std::optional<Move>>> res;
   int alpha = -kMateValue;
   int beta = kMateValue;
@@ -1013,6 +1366,29 @@ AlphaBetaPlayer::MakeMoveSingleThread(
   int searched_depth = 0;
   Stack stack[kMaxPly + 10];
   Stack* ss = stack + 7;
+  // PV of the last completed iteration; a canceled one may have changed
+  // pv_info since.
+  PVInfo completed_pv;
+
+  // A search that continues the last one starts deep, counting on the table
+  // to still have the tree. Entries may have been evicted since, so the
+  // main thread gets a depth 1 result first, in case the limit comes before
+  // the first deep iteration is done.
+  if (thread_id == 0 && next_depth > 1) {
+    const PVInfo pv_hint = pv_info;
+    res = Search(ss, Root, thread_state, board, 1, 1, -kMateValue, kMateValue,
+                 maximizing_player, pv_info, false);
+    if (res.has_value()) {
+      searched_depth = 1;
+      completed_pv = pv_info;
+      pv_info_ = pv_info;
+      if (on_iteration_ != nullptr) {
+        const int evaluation = std::get<0>(*res);
+        (*on_iteration_)(1, maximizing_player ? evaluation : -evaluation);
+      }
+    }
+    pv_info = pv_hint;
+  }
 
   //PVInfo warmup_pvinfo;
   //auto warmup_res = Search(
@@ -1022,6 +1398,7 @@ AlphaBetaPlayer::MakeMoveSingleThread(
     while (next_depth <= max_depth) {
 
       std::optional<std::tuple<int, std::optional<Move>>> move_and_value;
+      int64_t nodes_at_root_search = 0;
 
       if (thread_id == 0) {
           int prev = average_root_eval_;
@@ -1035,6 +1412,7 @@ AlphaBetaPlayer::MakeMoveSingleThread(
           int fail_cnt = 0;
 
           while (true) {
+            nodes_at_root_search = thread_state.GetNumNodes();
             //move_and_value = SearchM(
             //  ss, Root, thread_state, thread_id, board, 1, next_depth, alpha, beta, maximizing_player,
             //  pv_info, false);
@@ -1077,9 +1455,15 @@ AlphaBetaPlayer::MakeMoveSingleThread(
             delta += delta / 3;
           }
       } else {
+          // max_depth itself is never skipped, so that every helper ends on
+          // the last depth.
+          if (next_depth < max_depth && SkipDepth(thread_id, next_depth)) {
+            next_depth++;
+            continue;
+          }
           // Helper threads use a full window
-          move_and_value = SearchM(
-            ss, Root, thread_state, thread_id, board, 1, next_depth, -kMateValue, kMateValue, maximizing_player,
+          move_and_value = Search(
+            ss, Root, thread_state, board, 1, next_depth, -kMateValue, kMateValue, maximizing_player,
             pv_info, false);
 
       }
@@ -1089,15 +1473,35 @@ AlphaBetaPlayer::MakeMoveSingleThread(
       }
       res = move_and_value;
       searched_depth = next_depth;
+      completed_pv = pv_info;
       next_depth++;
       int evaluation = std::get<0>(*move_and_value);
+      if (thread_id == 0) {
+        pv_info_ = pv_info;
+        if (on_iteration_ != nullptr) {
+          (*on_iteration_)(
+              searched_depth, maximizing_player ? evaluation : -evaluation);
+        }
+      }
       if (std::abs(evaluation) == kMateValue) {
         break;  // Proven win/loss
       }
+      const auto& best_move = std::get<1>(*move_and_value);
+      if (thread_id == 0 && best_move.has_value()) {
+        // Share of the last root search's nodes below the best move
+        const double effort =
+          static_cast<double>(thread_state.GetRootBestMoveNodes())
+          / std::max<int64_t>(
+              thread_state.GetNumNodes() - nodes_at_root_search, 1);
+        if (time_manager_.IterationDone(*best_move, effort)) {
+          break;
+        }
+      }
     }
 
 
   if (res.has_value()) {
+    pv_info = completed_pv;
     int eval = std::get<0>(*res);
     if (!maximizing_player) {
       eval = -eval;
@@ -1108,694 +1512,4 @@ AlphaBetaPlayer::MakeMoveSingleThread(
   return std::nullopt;
 }
 
-int PVInfo::GetDepth() const {
-  if (best_move_.has_value()) {
-    if (child_ == nullptr) {
-      return 1;
-    }
-    return 1 + child_->GetDepth();
-  }
-  return 0;
-}
-
-void AlphaBetaPlayer::UpdateMobilityEvaluation(
-    ThreadState& thread_state, Board& board, Player player) {
-    
-    /*
-    // Get move and threat counts for all players in one go
-    const auto& pieces = board.GetPieceList()[board.GetTurn().GetColor()];
-    auto result = board.GetPseudoLegalMoves2(nullptr, 0, pieces);
-    
-    // Update thread state for all players
-    for (int i = 0; i < 4; i++) {
-        thread_state.TotalMoves()[i] = result.mobility_counts[i];
-        thread_state.NThreats()[i] = result.threat_counts[i];
-    }
-    */
-    thread_state.TotalMoves()[player.GetColor()] = 1;
-    thread_state.NThreats()[player.GetColor()] = 1;
-}
-
-std::shared_ptr<PVInfo> PVInfo::Copy() const {
-  std::shared_ptr<PVInfo> copy = std::make_shared<PVInfo>();
-  if (best_move_.has_value()) {
-    copy->SetBestMove(*best_move_);
-  }
-  std::shared_ptr<PVInfo> child = child_;
-  if (child != nullptr) {
-    child = child->Copy();
-  }
-  copy->SetChild(child);
-  return copy;
-}
-
-std::shared_ptr<PVInfo> PVInfo::SkipMoves(int n) const {
-  if (n <= 0) {
-    return Copy();
-  }
-  std::shared_ptr<PVInfo> current = child_;
-  for (int i = 1; i < n && current != nullptr; i++) {
-    current = current->GetChild();
-  }
-  if (current == nullptr) {
-    return std::make_shared<PVInfo>();
-  }
-  return current->Copy();
-}
-
-std::optional<std::tuple<int, std::optional<Move>>> AlphaBetaPlayer::SearchM(
-    Stack* ss,
-    NodeType node_type,
-    ThreadState& thread_state,
-    size_t thread_id,
-    Board& board,
-    int ply,
-    int depth,
-    int alpha,
-    int beta,
-    bool maximizing_player,
-    PVInfo& pvinfo,
-    bool is_cut_node) {
-
-
-  //num_nodes_++;
-  if (canceled_.load(std::memory_order_acquire)) {
-    return std::nullopt;
-  }
-
-
-  int64_t key = board.HashKey();
-
-  auto startA = std::chrono::high_resolution_clock::now();
-
-  Player player = board.GetTurn();
-  PlayerColor player_color = player.GetColor();
-  Team other_team = OtherTeam(player.GetTeam());
-
-  bool is_root_node = ply == 1;
-  bool is_pv_node = node_type != NonPV;
-
-  //~20ns
-  std::optional<Move> tt_move;
-  const HashTableEntry* tte = nullptr;
-  bool tt_hit = false;
-  auto* tt = thread_state.GetTranspositionTable();
-  if (tt != nullptr) {
-    tte = tt->Get(key);
-  }
-  if (tte != nullptr) {
-    if (tte->key == key) { // valid entry
-      tt_hit = true;
-      //if (tte->depth >= depth) {
-      //  // at non-PV nodes check for an early TT cutoff
-      //  if (!is_root_node
-      //      && !is_pv_node
-      //      && (tte->bound == EXACT
-      //        || (tte->bound == LOWER_BOUND && tte->score >= beta)
-      //        || (tte->bound == UPPER_BOUND && tte->score <= alpha))
-      //      ) {
-
-      //    if (tte->packed_move != 0) {
-      //        return std::make_tuple(
-      //            std::min(beta, std::max(alpha, tte->score)),
-      //            Move::Unpack(tte->packed_move, board));
-      //    }
-      //    return std::make_tuple(
-      //      std::min(beta, std::max(alpha, tte->score)), std::nullopt);
-      //  }
-      //}
-      if (tte->packed_move != 0) {
-        tt_move = Move::Unpack(tte->packed_move, board);
-      }
-    }
-  }
-  auto capture_info = board.CanCaptureKing();
-  if (capture_info.from_row != -1) {
-    bool is_new_checkmate = false;
-
-    // First try a read-only check with shared lock
-    {
-      std::shared_lock<std::shared_mutex> lock(checkmate_mutex_);
-      is_new_checkmate = (checkmate_positions_.find(key) == checkmate_positions_.end());
-    }
-
-    // If it's a new checkmate, take exclusive lock to update
-    if (is_new_checkmate) {
-      std::unique_lock<std::shared_mutex> lock(checkmate_mutex_);
-      // Double-check in case another thread added it between our check and now
-      auto [it, inserted] = checkmate_positions_.insert(key);
-      is_new_checkmate = inserted;
-    }
-
-    int eval = kMateValue;
-    eval = maximizing_player ? eval : -eval;
-
-    // Construct the king capture move
-    const auto& target_piece = board.GetPiece(capture_info.to_row, capture_info.to_col);
-    int8_t capture_raw = target_piece.GetRaw();
-    Move move(capture_info.from_row, capture_info.from_col,
-              capture_info.to_row, capture_info.to_col, capture_raw);
-
-    if (tt != nullptr) {
-      tt->Save(key, 100, move, eval, eval, EXACT, false /*is_pv_node*/);
-    }
-    
-    return std::make_tuple(eval, move);
-  }
-
-  //~20ns
-    
-  int eval = 0;
-  if (tt_hit) {
-    if (tte->bound == UPPER_BOUND) {
-      eval = board.PieceEvaluation();
-      eval = maximizing_player ? eval : -eval;
-    } else {
-      eval = tte->eval;
-    }
-  } else {
-      eval = board.PieceEvaluation();
-    static const uint8_t LOG2_MOVES[256] = {
-        0, 0, 0, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3,
-        4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
-        5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
-        5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
-        6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
-        6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
-        6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
-        6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
-        7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
-        7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
-        7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
-        7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
-        7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
-        7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
-        7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
-        7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7
-    };
-
-    static const uint8_t LOG2_THREATS[64] = {
-        0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3, 4,
-        4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 5,
-        5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
-        5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5
-    };
-
-    static const int8_t THREAT_SCORE[64] = {
-        -8, -8, -8, -8, -8, -8, -8, -8,
-        -8, -8, -8, -8, -8, -8, -8, -8,
-        -8, -8,
-        8, 16, 24, 32, 40, 48, 56,
-        -56, -48, -40, -32, -24, -16,
-        -50, -50, -50, -50, -50, -50, -50, -50,
-        -50, -50, -50, -50, -50, -50, -50, -50,
-        -50, -50, -50, -50, -50, -50, -50, -50,
-        -50, -50, -50, -50, -50, -50, -50, -50
-    };
-
-    int moves_eval;
-    int threat_eval;
-
-    int logR = LOG2_MOVES[thread_state.TotalMoves()[RED]];
-    int logY = LOG2_MOVES[thread_state.TotalMoves()[YELLOW]];
-    int logB = LOG2_MOVES[thread_state.TotalMoves()[BLUE]];
-    int logG = LOG2_MOVES[thread_state.TotalMoves()[GREEN]];
-
-    int logRY = (logR + logY) << 2;  // 4 * sum
-    int logBG = (logB + logG) << 2;
-
-    int lb, sign;
-    if (logRY > logBG) {
-      lb = logRY + 1;
-      sign = (other_team != RED_YELLOW) ? 1 : -1;
-    } else if (logBG > logRY) {
-      lb = logBG + 1;
-      sign = (other_team != RED_YELLOW) ? -1 : 1;
-    } else {
-      lb = logRY + 1;
-      sign = 0;
-    }
-    moves_eval = sign * (lb < 27 ? 10 : 5 * (lb - 25));
-
-    int logtR = LOG2_THREATS[thread_state.NThreats()[RED] & 63];
-    int logtY = LOG2_THREATS[thread_state.NThreats()[YELLOW] & 63];
-    int logtB = LOG2_THREATS[thread_state.NThreats()[BLUE] & 63];
-    int logtG = LOG2_THREATS[thread_state.NThreats()[GREEN] & 63];
-
-    int logtRY = (logtR + logtY) << 2;
-    int logtBG = (logtB + logtG) << 2;
-
-    int len_idx;
-    int threat_sign;
-    if (logtRY > logtBG) {
-      len_idx = logtRY;
-      threat_sign = (other_team != RED_YELLOW) ? 1 : -1;
-    } else if (logtBG > logtRY) {
-      len_idx = logtBG;
-      threat_sign = (other_team != RED_YELLOW) ? -1 : 1;
-    } else {
-      len_idx = 0;
-      threat_sign = 0;
-    }
-
-    len_idx = (len_idx < 0) ? 0 : (len_idx > 63 ? 63 : len_idx);
-    threat_eval = threat_sign * THREAT_SCORE[len_idx];
-
-    eval += moves_eval + threat_eval;
-
-    eval = maximizing_player ? eval : -eval;
-  }
-  ss->static_eval = eval;
-  ss->move_count = 0;
-
-  std::optional<Move> best_move;
-  std::optional<Move> pv_move = pvinfo.GetBestMove();
-  Move* moves = thread_state.GetNextMoveBufferPartition();
-
-  // Generate moves with pieces
-  const auto& pieces = board.GetPieceList()[board.GetTurn().GetColor()];
-  auto result = board.GetPseudoLegalMoves2(
-    moves,
-    kBufferPartitionSize,
-    pieces,
-    pv_move);
-  thread_state.TotalMoves()[player_color] = result.mobility_counts[player_color];
-  thread_state.NThreats()[player_color] = result.threat_counts[player_color];
-  //bool in_check = result.in_check;
-
-
-
-  //~10ns
-  // Then initialize the move picker with the generated moves
-  MovePicker2 picker;
-  const Move* pv_ptr = (result.pv_index >= 0) ? &moves[result.pv_index] : nullptr;
-  size_t move_count2 = result.count;
-  const Move* tt_ptr = nullptr;
-  if (move_count2 > 0 && tt_move.has_value()) {
-    tt_ptr = &(*tt_move);
-  }
-
-  //~10ns
-  InitMovePicker2(
-    &picker,
-    &board,
-    moves,
-    move_count2,
-    pv_ptr,
-    tt_ptr,
-    reinterpret_cast<int16_t(*)[224][224]>(thread_state.GetHistoryHeuristic()));
-
-  auto endA = std::chrono::high_resolution_clock::now();
-  auto durationA = std::chrono::duration_cast<std::chrono::nanoseconds>(endA - startA);
-  total_timeA += durationA;
-  call_countA++;
-  if (call_countA % 200000 == 0) {
-    auto avg_ns = total_timeA.count() / call_countA;
-
-    //std::cout << "--- [Search - before move]"
-    //          << "Average: " << avg_ns << " ns, "
-    //          << "Call count: " << call_countA << ", " 
-    //          << "cache hits: " << num_cache_hits_
-    //          << std::endl;
-  }
-  
-  bool has_legal_moves = false;
-  int move_count = 0;
-  int invalid_moves = 0;
-  bool fail_low = true;
-  bool fail_high = false;
-
-  while (true) {
-    const Move* move_ptr = GetNextMove2(&picker);
-    if (move_ptr == nullptr) {
-      break;
-    }
-    const Move& move = *move_ptr;
-    //auto startA2 = std::chrono::high_resolution_clock::now();
-
-    std::optional<std::tuple<int, std::optional<Move>>> value_and_move_or;
-
-    const int8_t old_king_row = board.GetKingRow(player_color);
-    const int8_t old_king_col = board.GetKingCol(player_color);
-    //~20ns
-    board.MakeMove(move);
-
-    const int8_t king_row = board.GetKingRow(player_color);
-    const int8_t king_col = board.GetKingCol(player_color);
-    if (king_row == old_king_row && king_col == old_king_col) {
-      const int8_t from_row = move.FromRow();
-      const int8_t from_col = move.FromCol();
-      const int8_t row_diff = king_row - from_row;
-      const int8_t col_diff = king_col - from_col;
-      const bool aligned_with_king = 
-        row_diff == 0 ||                     // same row
-        col_diff == 0 ||                     // same column
-        row_diff * row_diff == col_diff * col_diff;  // diagonal
-
-      if (aligned_with_king) { // possible pinned or king move
-        int8_t rd = (row_diff > 0) - (row_diff < 0);  // sign of row_diff: -1, 0, or 1
-        int8_t cd = (col_diff > 0) - (col_diff < 0);   // sign of col_diff
-        bool is_king_in_check = board.IsAttackedByTeamAligned(
-          other_team, from_row, from_col,  // scan from piece location
-          rd, cd
-        );
-        if (is_king_in_check) { // invalid move
-          board.UndoMove();
-          continue;
-        }
-      }
-    } else { // king moved
-        bool is_king_in_check = board.IsAttackedByTeam(
-          other_team, king_row, king_col
-        );
-        if (is_king_in_check) { // invalid move
-          board.UndoMove();
-          continue;
-        }
-    }
-
-    has_legal_moves = true;
-
-    ss->current_move = move;
-
-    std::shared_ptr<PVInfo> child_pvinfo;
-    if (move_count == 0 && pvinfo.GetChild() != nullptr) {
-      child_pvinfo = pvinfo.GetChild();
-    } else {
-      child_pvinfo = std::make_shared<PVInfo>();
-    }
-
-    ss->move_count = move_count++;
-
-    int r = 1;
-    if (depth >= 5
-        && tt_hit
-        && (tte->bound == LOWER_BOUND)
-        && tte->depth >= depth >> 1
-        ) {
-      num_singular_extension_searches_.fetch_add(1, std::memory_order_relaxed);
-      
-      int beta = tte->score;
-
-      PVInfo pvinfo;
-      auto res = SearchM(ss, NonPV, thread_state, thread_id, board, ply+1,
-        depth - 2,// - (depth/2),
-        beta - 100, beta,
-        maximizing_player, pvinfo, is_cut_node);
-
-      if (res.has_value()) {
-        int score = std::get<0>(*res);
-        // If the search fails low, we didn't find a better move
-        if (score < beta) {
-          num_singular_extensions_.fetch_add(1, std::memory_order_relaxed);
-          r = -1;
-        }
-      }
-    }
-
-    //auto endA2 = std::chrono::high_resolution_clock::now();
-    //auto durationA2 = std::chrono::duration_cast<std::chrono::nanoseconds>(endA2 - startA2);
-    //total_timeA2 += durationA2;
-    //call_countA2++;
-    //if (call_countA2 % 1000 == 0) {
-    //  auto avg_ns = total_timeA2.count() / call_countA2;
-
-    //  //std::cout << "---[Move - before recursion]"
-    //  //          << "Average: " << avg_ns << " ns, "
-    //  //          << "Call count: " << call_countA2 << std::endl
-    //  //          << "Singular searches: " << GetNumSingularExtensionSearches() << std::endl
-    //  //          << "Singular hits: " << GetNumSingularExtensions() << std::endl;
-    //  //          //<< "CM skips: " << cm_skip_count << std::endl;
-    //}
-
-    constexpr int kMaxExtensionsPerPath = 1;
-    if (depth < 2 && (move.IsCapture() || (ss-2)->current_move.IsCapture()) && ss->extension_count < kMaxExtensionsPerPath) {
-        //capture_extension_count++;
-        r = -1;
-    }
-
-    //static std::atomic<int64_t> capture_extension_count{0};
-    ////static std::atomic<int64_t> check_extension_count{0};
-    //const int is_capture = move.IsCapture();
-    //  int new_depth = depth - 1 + is_capture;
-
-
-    //// lmr
-    //if (move_count >= 1) {
-    //  if (is_capture) {
-    //    new_depth = depth;
-    //  } else {
-    //    if (depth < 2) {
-    //      new_depth = 0;
-    //    } else if (depth > 2) {
-    //      new_depth = 2;
-    //    } else {
-    //      new_depth = depth - 1;
-    //    }
-    //  }
-    //  //new_depth = depth - 1 - (depth/2)*(depth>3)*(!is_capture) + (is_capture);
-    //      SEARCH_OR_EVAL_M(value_and_move_or, new_depth,
-    //        ss+1, NonPV, thread_state, thread_id, board, ply + 1, new_depth,
-    //        -beta, -alpha, !maximizing_player,
-    //        *child_pvinfo, is_cut_node);
-    //}
-
-    //// For PV nodes only, do a full PV search on the first move or after a fail
-    //// high (in the latter case search only if value < beta), otherwise let the
-    //// parent node fail low with value <= alpha and try another move.
-    //bool full_search =
-    //  move_count < 1
-    //      || (value_and_move_or.has_value()
-    //      && -std::get<0>(*value_and_move_or) > alpha
-    //      && (is_root_node
-    //          || -std::get<0>(*value_and_move_or) < beta)
-    //      );
-
-    //if (full_search) {
-
-    //  SEARCH_OR_EVAL_M(value_and_move_or, new_depth,
-    //      ss+1, PV, thread_state, thread_id, board, ply + 1, new_depth,
-    //      -beta, -alpha, !maximizing_player,
-    //      *child_pvinfo, is_cut_node);
-    //}
-    ////auto startB = std::chrono::high_resolution_clock::now();
-
-    // lmr
-    if (move_count >= 1) {
-      // First search with reduced depth and null window
-      (ss+1)->extension_count = ss->extension_count + (r < 0 ? 1 : 0);
-      int new_depth = depth - 1
-          - (depth/2)*(r > 0)*(depth>3)
-          - (depth/4)*(r > 0)*(depth>7)
-          //- (depth/8)*(r > 0)*(depth>15)
-          //- (depth/16)*(r > 0)*(depth>31)
-          + (r < 0);
-      SEARCH_OR_EVAL_M(value_and_move_or, new_depth,
-          ss+1, NonPV, thread_state, thread_id, board, ply + 1, new_depth,
-          -alpha-1, -alpha, !maximizing_player,
-          *child_pvinfo, is_cut_node);
-          
-      if (value_and_move_or.has_value()) {
-        int score = -std::get<0>(*value_and_move_or);
-        
-        // If the reduced search fails high, we need to research
-        if (score > alpha) {
-          
-          // If the score is not failing high by much, try a reduced-window search first
-          if (score < alpha + 100) {
-            (ss+1)->extension_count = ss->extension_count;
-            int new_depth = depth - 1
-                - (depth/2)*(r > 0)*(depth>3)
-                - (depth/4)*(r > 0)*(depth>7)
-                //- (depth/8)*(r > 0)*(depth>15)
-                //- (depth/16)*(r > 0)*(depth>31)
-                + (r < 0);
-            SEARCH_OR_EVAL_M(value_and_move_or, new_depth,
-                ss+1, NonPV, thread_state, thread_id, board, ply + 1, new_depth,
-                -alpha-50, -alpha, !maximizing_player,
-                *child_pvinfo, is_cut_node);
-                
-            if (value_and_move_or && -std::get<0>(*value_and_move_or) > alpha) {
-              // If the reduced window search still fails high, do a full search
-              (ss+1)->extension_count = ss->extension_count;
-              int new_depth = depth - 1
-                - (depth/3)*(r > 0)*(depth>2)
-                //- (depth/6)*(r > 0)*(depth>6)
-                + (r < 0);
-              SEARCH_OR_EVAL_M(value_and_move_or, new_depth,
-                ss+1, NonPV, thread_state, thread_id, board, ply + 1, new_depth,
-                -beta, -alpha, !maximizing_player,
-                *child_pvinfo, is_cut_node);
-            }
-          } else {
-            // Failing high by a lot, do a full search immediately
-            (ss+1)->extension_count = ss->extension_count;
-            int new_depth = depth - 1
-              - (depth/3)*(r > 0)*(depth>2)
-              //- (depth/6)*(r > 0)*(depth>6)
-              + (r < 0);
-            SEARCH_OR_EVAL_M(value_and_move_or, new_depth,
-              ss+1, NonPV, thread_state, thread_id, board, ply + 1, new_depth,
-              -beta, -alpha, !maximizing_player,
-              *child_pvinfo, is_cut_node);
-          }
-        }
-      }
-    }
-
-    // For PV nodes only, do a full PV search on the first move or after a fail
-    // high (in the latter case search only if value < beta), otherwise let the
-    // parent node fail low with value <= alpha and try another move.
-    bool full_search =
-      move_count == 0
-          || (value_and_move_or.has_value()
-              && -std::get<0>(*value_and_move_or) > alpha
-              && (is_root_node
-                  || -std::get<0>(*value_and_move_or) < beta)
-              );
-
-    if (full_search) {
-      (ss+1)->extension_count = ss->extension_count + (r < 0 ? 1 : 0);
-      int new_depth = depth - 1 + (r < 0);
-      SEARCH_OR_EVAL_M(value_and_move_or, new_depth,
-          ss+1, PV, thread_state, thread_id, board, ply + 1, new_depth,
-          -beta, -alpha, !maximizing_player,
-          *child_pvinfo, is_cut_node);
-    }
-
-    board.UndoMove();
-
-    if (!value_and_move_or.has_value()) {
-      thread_state.ReleaseMoveBufferPartition();
-      return std::nullopt; // stop canceled search
-    }
-
-    int score = -std::get<0>(*value_and_move_or);
-
-    if (score >= beta) {
-      alpha = beta;
-      best_move = move;
-      pvinfo.SetChild(child_pvinfo);
-      pvinfo.SetBestMove(move);
-      fail_low = false;
-      fail_high = true;
-      is_cut_node = true;
-
-      break; // cutoff
-    }
-    if (score > alpha) {
-      fail_low = false;
-      alpha = score;
-      best_move = move;
-      pvinfo.SetChild(child_pvinfo);
-      pvinfo.SetBestMove(move);
-    }
-
-    if (!best_move.has_value()) {
-      best_move = move;
-      pvinfo.SetChild(child_pvinfo);
-      pvinfo.SetBestMove(move);
-    }
-    //auto endB = std::chrono::high_resolution_clock::now();
-    //auto durationB = std::chrono::duration_cast<std::chrono::nanoseconds>(endB - startB);
-    //total_timeB += durationB;
-    //call_countB++;
-    
-    //if (call_countB % 2000 == 0) {
-    //  auto avg_ns = total_timeB.count() / call_countB;
-    //  auto current_avg = durationB.count() / 1;  // Current call's time in ns
-
-    //  std::cout << "--- [Move - after recursion]"
-    //            << " Average: " << avg_ns << " ns,"
-    //            << " Calls: " << call_countB << std::endl
-    //            << " capture extension: " << capture_extension_count << std::endl;
-    //}
-  }
-
-
-  static std::atomic<int64_t> total_checkmates_found = 0;
-  //auto startC = std::chrono::high_resolution_clock::now();
-
-  if (!fail_low && best_move) {  // Add null check for best_move
-    int8_t from_row = best_move->FromRow();
-    int8_t from_col = best_move->FromCol();
-    int8_t to_row = best_move->ToRow();
-    int8_t to_col = best_move->ToCol();
-    Piece piece = board.GetPiece(from_row, from_col);
-
-    int bonus = 1 + (fail_high ? (depth << 3) : depth << 2);
-    if (bonus > 16383) bonus = 16383;  // Cap for int16_t
-
-    // [224][224] some values unused
-    int from_sq = (from_row << 4) + from_col;
-    int to_sq = (to_row << 4) + to_col;
-    int queen_idx = (piece.GetPieceType() == QUEEN) ? 1 : 0;
-    auto* hh = thread_state.GetHistoryHeuristic();
-    hh[queen_idx * 224 * 224 + from_sq * 224 + to_sq] += bonus;
-    hh[queen_idx * 224 * 224 + from_sq * 224 + to_sq] =
-    (hh[queen_idx * 224 * 224 + from_sq * 224 + to_sq] >> 1) | (rand() & 0x7);
-  }
-
-  int score = alpha;
-  if (!has_legal_moves) {
-      score = -kMateValue;
-      score = maximizing_player ? score : -score;
-
-      // Track unique checkmate positions
-      Board checkmateboard = board;
-      //Move last_move = board.GetLastMove();
-      checkmateboard.UndoMove();
-      int64_t hash_key = checkmateboard.HashKey();
-
-      bool is_new_checkmate = false;
-
-      // First try a read-only check with shared lock
-      {
-        std::shared_lock<std::shared_mutex> lock(checkmate_mutex_);
-        is_new_checkmate = (checkmate_positions_.find(hash_key) == checkmate_positions_.end());
-      }
-
-      // If it's a new checkmate, take exclusive lock to update
-      if (is_new_checkmate) {
-        std::unique_lock<std::shared_mutex> lock(checkmate_mutex_);
-        // Double-check in case another thread added it between our check and now
-        auto [it, inserted] = checkmate_positions_.insert(hash_key);
-        is_new_checkmate = inserted;
-        total_checkmates_found++;     // Increment total checkmate counter
-      }
-  }
-
-  ScoreBound bound;
-  if (!has_legal_moves) {
-    bound = EXACT;
-  } else if (beta <= alpha) {
-    bound = LOWER_BOUND;
-  } else if (is_pv_node && best_move.has_value()) {
-    bound = EXACT;
-  } else {
-    bound = UPPER_BOUND;
-  }
-  if (tt != nullptr) {
-    tt->Save(board.HashKey(), depth+1, best_move, score, ss->static_eval, bound, is_pv_node);
-  }
-
-  thread_state.ReleaseMoveBufferPartition();
-  //auto endC = std::chrono::high_resolution_clock::now();
-  //auto durationC = std::chrono::duration_cast<std::chrono::nanoseconds>(endC - startC);
-  //total_timeC += durationC;
-  //call_countC++;
-  //if (call_countC % 1000000 == 0) {
-  //  auto avg_ns = total_timeC.count() / call_countC;
-  //  auto current_avg = durationC.count() / 1;  // Current call's time in ns
-
-  //  std::cout << "[Search - after move]"
-  //            << " Average: " << avg_ns << " ns,"
-  //            << " Call count: " << call_countC << std::endl
-  //            << "> > > Checkmates: "
-  //            << total_checkmates_found << std::endl;
-  //}
-
-  return std::make_tuple(score, best_move);
-}
-
 }  // namespace chess
@@ -1,52 +1,81 @@
 #ifndef _PLAYER_H_
 #define _PLAYER_H_
 
+#include <algorithm>
 #include <array>
 #include <atomic>
 #include <cassert>
 #include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <cstdlib>
 #include <fstream>
+#include <functional>
 #include <limits>
 #include <memory>
 #include <mutex>
 #include <optional>
-#include <shared_mutex>
+#include <thread>
 #include <tuple>
 #include <type_traits>
 #include <unordered_map>
-#include <unordered_set>
 #include <utility>
 #include <vector>
 
+#include "analysis_cache.h"
 #include "board.h"
+#include "checkmate_discovery.h"
+#include "key_set.h"
+#include "stats.h"
+#include "time_manager.h"
 #include "transposition_table.h"
 
 namespace chess {
 
+class SearchPool;
+
 constexpr int kMateValue = 1000000'00;  // mate value (centipawns)
 
+constexpr int kMaxPly = 300;
+
+// Principal variation as a flat line of moves. Search nodes fill rows of the
+// per-thread triangular table in ThreadState, so no line is ever allocated.
 class PVInfo {
  public:
   PVInfo() = default;
 
-  const std::optional<Move>& GetBestMove() const { return best_move_; }
-  std::shared_ptr<PVInfo> GetChild() const { return child_; }
-  void SetBestMove(Move move) { best_move_ = std::move(move); }
-  void SetChild(std::shared_ptr<PVInfo> child) { child_ = std::move(child); }
-  int GetDepth() const;
-
-  std::shared_ptr<PVInfo> Copy() const;
-  std::shared_ptr<PVInfo> SkipMoves(int n) const;
+  std::optional<Move> GetBestMove() const {
+    if (length_ == 0) {
+      return std::nullopt;
+    }
+    return moves_[0];
+  }
+  const Move& GetMove(int i) const { return moves_[i]; }
+  int GetDepth() const { return length_; }
+  void Clear() { length_ = 0; }
+  void Truncate(int length) { length_ = std::min(length_, length); }
+  // Removes the first `n` moves.
+  void DropFront(int n) {
+    n = std::min(n, length_);
+    std::copy(moves_ + n, moves_ + length_, moves_);
+    length_ -= n;
+  }
+  // Sets the line to `move` followed by the line of the child node.
+  void Update(const Move& move, const PVInfo& child) {
+    const int n = std::min(child.length_, kMaxPly - 1);
+    moves_[0] = move;
+    std::copy(child.moves_, child.moves_ + n, moves_ + 1);
+    length_ = n + 1;
+  }
 
  private:
-  std::optional<Move> best_move_ = std::nullopt;
-  std::shared_ptr<PVInfo> child_ = nullptr;
+  Move moves_[kMaxPly];
+  int length_ = 0;
 };
 
 constexpr size_t kTranspositionTableSize = 2'000'000;
-constexpr int kMaxPly = 300;
+// Positions remembered as checkmates; later ones are not remembered.
+constexpr size_t kMaxKnownCheckmates = 1 << 16;
 constexpr int kKillersPerPly = 3;
 
 struct PlayerOptions {
@@ -64,19 +93,29 @@ struct PlayerOptions {
   bool enable_history_heuristic = true;
   bool enable_killers = true;
   bool enable_counter_move_heuristic = true;
+  bool enable_continuation_history = true;
 
   // for evaluation
   bool enable_piece_activation = true;
   bool enable_king_safety = true;
-  bool enable_pawn_shield = true;
   bool enable_attacking_king_zone = true;
   bool enable_mobility_evaluation = true;
   bool enable_piece_imbalance = true;
   bool enable_lazy_eval = true;
-  bool enable_piece_square_table = true;
+  // Off by default: the current table has not shown a gain in self-play.
+  bool enable_piece_square_table = false;
+  // Not tuned in self-play yet either.
+  bool enable_pawn_shield = false;
   bool enable_knight_bonus = true;
+  // Replaces the material and mobility terms when set (setoption EvalFile).
+  std::shared_ptr<const nnue::Network> network;
+  // Probed in the first plies before the table when set (setoption CacheFile).
+  std::shared_ptr<const AnalysisCache> analysis_cache;
   Team engine_team = CURRENT_TEAM;
 
+  // resolve captures at the horizon instead of using the static eval
+  bool enable_qsearch = true;
+
   // for pruning / reduction
   bool enable_futility_pruning = true;
   bool enable_late_move_reduction = true;
@@ -86,9 +125,16 @@ struct PlayerOptions {
   // for multithreading
   bool enable_multithreading = true;
   int num_threads = 8;
+  // If set, each search borrows up to num_threads thread states and threads
+  // from it instead of the player keeping its own (search_pool.h). Must
+  // search with the pool's table.
+  std::shared_ptr<SearchPool> search_pool;
 
   // transposition table
   size_t transposition_table_size = kTranspositionTableSize;
+  // Used instead of a table of the player's own when set. Other players
+  // search with it at the same time, so it is never cleared.
+  std::shared_ptr<TranspositionTable> shared_transposition_table;
   std::optional<int> max_search_depth;
 
   // checkmate discovery mode
@@ -101,7 +147,8 @@ struct Stack {
   bool tt_pv = false;
   int move_count = 0;
   bool in_check = false;
-  Move current_move;
+  Move current_move{};
+  Move killers[2] = {};  // Last quiet moves that failed high at this ply
   int root_depth = 0;
   int static_eval = 0;
   int extension_count = 0;
@@ -116,59 +163,202 @@ enum NodeType {
 constexpr size_t kBufferPartitionSize = 512; // number of elements per buffer partition
 constexpr size_t kBufferNumPartitions = 1000; // number of recursive calls
 
-// Manages state of worker threads during search
+// Manages state of worker threads during search. A ThreadState lives as long
+// as its player, so the history tables and counter-moves carry over from one
+// search to the next.
 class ThreadState {
  public:
-  ThreadState(
-      PlayerOptions options, const Board& board, const PVInfo& pv_info);
+  ThreadState(PlayerOptions options, TranspositionTable* transposition_table,
+              size_t thread_id = 0);
   ~ThreadState();
   ThreadState(const ThreadState&) = delete;
   ThreadState& operator=(const ThreadState&) = delete;
-  ThreadState(ThreadState&& other) noexcept;
-  ThreadState& operator=(ThreadState&& other) noexcept;
+  // Sets the root of the next search. `board` must outlive the search.
+  void NewSearch(const Board& board, const PVInfo& pv_info);
   Move* GetNextMoveBufferPartition();
   void ReleaseMoveBufferPartition();
-  int* NThreats() { return n_threats; }
-  int* TotalMoves() { return total_moves_; }
   PVInfo& GetPVInfo() { return pv_info_; }
   const Board& GetRootBoard() { return *root_board_; }
-
-  int n_threats[4] = {0, 0, 0, 0};
+  // Halves the history scores once for each new root position since the
+  // last call, `generation` being the count of new roots. Each thread ages
+  // its own tables when it starts searching.
+  void AgeHistory(uint32_t generation);
+  // Forgets history and counter-moves, for a new game.
+  void ClearHistory();
+  // Records that the search of `owner` borrows the state, as a searcher of
+  // a search pool. The history of another owner is cleared first, since it
+  // is of another game. `generation` is the owner's, for AgeHistory.
+  void SetHistoryOwner(uint64_t owner, uint32_t generation);
+
+  size_t GetThreadId() const { return thread_id_; }
   Move* GetMoveGenBuffer() { return move_gen_buffer_; }
-  TranspositionTable* GetTranspositionTable() { return transposition_table_.get(); }
-  std::unique_ptr<TranspositionTable> ReleaseTranspositionTable();
-  void SetTranspositionTable(std::unique_ptr<TranspositionTable> tt);
-  int16_t* GetHistoryHeuristic() { return history_heuristic_[0][0]; }
+  TranspositionTable* GetTranspositionTable() { return transposition_table_; }
+  // History of the quiet moves of `color`, [from][to].
+  int16_t* GetHistory(PlayerColor color) {
+    return history_.butterfly[color][0];
+  }
+  // Continuation history of the replies to `previous`, the move that led to
+  // `board`, [piece_type][to]; nullptr if there is no previous move.
+  int16_t* GetContinuationHistory(const Board& board, const Move& previous) {
+    const int to_sq = nnue::SquareIndex(previous.ToRow(), previous.ToCol());
+    if (to_sq < 0) {
+      return nullptr;
+    }
+    const Piece piece = board.GetPiece(previous.ToRow(), previous.ToCol());
+    return history_.continuation[piece.GetPieceType()][to_sq][0];
+  }
+  // Zeros, read instead of a continuation history.
+  const int16_t* GetNoContinuationHistory() const {
+    return history_.no_continuation[0];
+  }
+  // Row of the triangular PV table that the node at `ply` fills.
+  PVInfo& GetPVAtPly(int ply) { return pv_table_[ply]; }
+  // The root PV at the start of the search is followed as a hint for as long
+  // as the search keeps descending through first moves.
+  void SetPVHint(const PVInfo& pv) { pv_hint_ = pv; }
+  std::optional<Move> GetPVHint(int ply) const {
+    if (ply > pv_hint_.GetDepth()) {
+      return std::nullopt;
+    }
+    return pv_hint_.GetMove(ply - 1);
+  }
+  void LeavePVHint(int ply) { pv_hint_.Truncate(ply); }
+  // Quiet reply that last refuted `previous`, indexed by its squares. The
+  // root, which has no previous move, has an entry of its own.
+  Move& CounterMove(const Move& previous) {
+    const int from_sq =
+      nnue::SquareIndex(previous.FromRow(), previous.FromCol());
+    if (from_sq < 0) {
+      return no_previous_counter_move_;
+    }
+    return counter_moves_[from_sq]
+        [nnue::SquareIndex(previous.ToRow(), previous.ToCol())];
+  }
+  // Nodes are counted in every build and per thread, so that the threads do
+  // not contend for one counter.
+  void CountNode() {
+    num_nodes_.store(num_nodes_.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+  }
+  int64_t GetNumNodes() const {
+    return num_nodes_.load(std::memory_order_relaxed);
+  }
+  // Transposition table probes, and those that found the position, counted
+  // the same way.
+  void CountTTProbe(bool hit) {
+    num_tt_probes_.store(num_tt_probes_.load(std::memory_order_relaxed) + 1,
+                         std::memory_order_relaxed);
+    if (hit) {
+      num_tt_hits_.store(num_tt_hits_.load(std::memory_order_relaxed) + 1,
+                         std::memory_order_relaxed);
+    }
+  }
+  int64_t GetNumTTProbes() const {
+    return num_tt_probes_.load(std::memory_order_relaxed);
+  }
+  int64_t GetNumTTHits() const {
+    return num_tt_hits_.load(std::memory_order_relaxed);
+  }
+  // Pawn shield score for red-yellow cached by Board::PawnKingKey(), or
+  // nullptr if the key is not cached.
+  const int* GetPawnShield(int64_t key) const {
+    const auto& entry = pawn_shield_cache_[key & (kPawnShieldCacheSize - 1)];
+    return entry.key == key ? &entry.score : nullptr;
+  }
+  void SavePawnShield(int64_t key, int score) {
+    pawn_shield_cache_[key & (kPawnShieldCacheSize - 1)] = {key, score};
+  }
+  SearchStats& Stats() { return stats_; }
+  const SearchStats& Stats() const { return stats_; }
+  // Nodes below the current best move of the root search, for the time
+  // manager.
+  void SetRootBestMoveNodes(int64_t nodes) { root_best_move_nodes_ = nodes; }
+  int64_t GetRootBestMoveNodes() const { return root_best_move_nodes_; }
 
  private:
   PlayerOptions options_;
-  const Board* root_board_;
+  size_t thread_id_ = 0;  // 0 for the main thread
+  const Board* root_board_ = nullptr;
   PVInfo pv_info_;
   Move move_gen_buffer_[kBufferPartitionSize];  // Buffer for move generation
-  std::unique_ptr<TranspositionTable> transposition_table_;
-  int16_t history_heuristic_[2][224][224] = {0};
+  // Shared by all threads, owned by the AlphaBetaPlayer.
+  TranspositionTable* transposition_table_ = nullptr;
+  // Squares are nnue::SquareIndex, so that the cut corners take no room.
+  // Lookups for one node stay within a row of each table: a 51 KB butterfly
+  // row and a 1.9 KB continuation row. The continuation table is the larger,
+  // 1.8 MB next to 200 KB, but only the rows of recent moves are read.
+  struct HistoryTables {
+    int16_t butterfly[4][nnue::kNumSquares][nnue::kNumSquares];
+    // By the piece type and square of the previous move, then of the reply.
+    int16_t continuation[6][nnue::kNumSquares][6][nnue::kNumSquares];
+    int16_t no_continuation[6][nnue::kNumSquares];
+    int16_t padding;  // The AVX2 scoring reads one entry past each lookup.
+  };
+  HistoryTables history_ = {};
+  uint32_t history_generation_ = 0;  // Of the last AgeHistory call
+  uint64_t history_owner_ = 0;  // 0 for a player's own state
+  Move counter_moves_[nnue::kNumSquares][nnue::kNumSquares] = {};
+  Move no_previous_counter_move_;
+
+  PVInfo pv_hint_;
+  // kMaxPly + 1 rows, indexed by ply.
+  PVInfo* pv_table_ = nullptr;
 
   // Buffer used to store moves per node.
   Move* move_buffer_ = nullptr;
   // Id within move_buffer_
   size_t buffer_id_ = 0;
 
-  int total_moves_[4] = {0, 0, 0, 0};
+  std::atomic<int64_t> num_nodes_ = 0;
+  std::atomic<int64_t> num_tt_probes_ = 0;
+  std::atomic<int64_t> num_tt_hits_ = 0;
+  SearchStats stats_;
+
+  struct PawnShieldEntry {
+    int64_t key = 0;
+    int score = 0;
+  };
+  static constexpr size_t kPawnShieldCacheSize = 1 << 14;
+  PawnShieldEntry pawn_shield_cache_[kPawnShieldCacheSize];
+  int64_t root_best_move_nodes_ = 0;
+};
 
+// Counters of one search thread since its player was created.
+struct ThreadSearchCounts {
+  int64_t nodes = 0;
+  int64_t tt_probes = 0;
+  int64_t tt_hits = 0;  // Probes that found the position
 };
 
+// Called on the main search thread after each completed iteration, with
+// its depth and its score for red-yellow. GetPVInfo() has its PV.
+using IterationCallback = std::function<void(int depth, int score)>;
+
 class AlphaBetaPlayer {
  public:
   AlphaBetaPlayer(
       std::optional<PlayerOptions> options = std::nullopt);
   ~AlphaBetaPlayer();
 
+  // Iterative deepening search of `board` until a limit is reached or the
+  // search is canceled. Returns (score for red-yellow, best move, depth of
+  // the last completed iteration), or nullopt if no iteration completed.
+  std::optional<std::tuple<int, std::optional<Move>, int>> MakeMove(
+      Board& board,
+      const SearchLimits& limits,
+      const IterationCallback& on_iteration = nullptr);
+  // Starts the clock of a running ponder search (SearchLimits::ponder).
+  void PonderHit();
+  // Same, limited by depth only.
   std::optional<std::tuple<int, std::optional<Move>, int>> MakeMove(
       Board& board,
       int max_depth = 100);
-  void CancelEvaluation() { canceled_.store(true, std::memory_order_release); }
+  // Forgets everything learned from earlier searches. Must not be called
+  // while a search is running.
+  void NewGame();
+  void CancelEvaluation() { SetCanceled(true); }
   // NOTE: Should wait until evaluation is done before resetting this to true.
-  void SetCanceled(bool canceled) { canceled_.store(canceled, std::memory_order_release); }
+  void SetCanceled(bool canceled);
   bool IsCanceled() { return canceled_.load(std::memory_order_acquire); }
   const PVInfo& GetPVInfo() const { return pv_info_; }
 
@@ -185,11 +375,13 @@ class AlphaBetaPlayer {
       PVInfo& pv_info,
       bool is_cut_node = false);
 
-  std::optional<std::tuple<int, std::optional<Move>>> SearchM(
+  // Capture-only search below the horizon, with the same arguments as Search
+  // so that leaves can call either. Captures that lose material by static
+  // exchange are skipped. Never cancels.
+  std::optional<std::tuple<int, std::optional<Move>>> QSearch(
       Stack* ss,
       NodeType node_type,
       ThreadState& thread_state,
-      size_t thread_id,
       Board& board,
       int ply,
       int depth,
@@ -199,37 +391,27 @@ class AlphaBetaPlayer {
       PVInfo& pv_info,
       bool is_cut_node = false);
 
+  int Evaluate(ThreadState& thread_state, Board& board,
+               bool maximizing_player);
+  // Bonus for the own pawns in front of each king, for red-yellow.
+  static int PawnShieldEvaluation(const Board& board);
+
   int GetNumLegalMoves(Board& board);
 
-  int64_t GetNumEvaluations() { return num_nodes_; }
-  int64_t GetNumCacheHits() { return num_cache_hits_; }
-  int64_t GetNumFutilityMovesPruned() { return num_futility_moves_pruned_; }
-  int64_t GetNumLmrSearches() { return num_lmr_searches_; }
-  int64_t GetNumLmrResearches() { return num_lmr_researches_; }
-  int64_t GetNumSingularExtensionSearches() {
-    return num_singular_extension_searches_;
-  }
-  int64_t GetNumSingularExtensions() {
-    return num_singular_extensions_;
+  const TranspositionTable* GetTranspositionTable() const {
+    return transposition_table_.get();
   }
 
-  // Performance monitoring
-  static std::chrono::nanoseconds total_time;
-  static size_t call_count;
-  static std::chrono::nanoseconds total_timeA;
-  static size_t call_countA;
-  static std::chrono::nanoseconds total_timeB;
-  static size_t call_countB;
-  static std::chrono::nanoseconds total_timeA2;
-  static size_t call_countA2;
-  static std::chrono::nanoseconds total_timeC;
-  static size_t call_countC;
-  int64_t GetNumLateMovesPruned() { return num_lm_pruned_; }
-  int64_t GetNumFailHighReductions() { return num_fail_high_reductions_; }
-  int64_t GetNumCheckExtensions() { return num_check_extensions_; }
-  int64_t GetNumLazyEval() { return num_lazy_eval_; }
-  int64_t GetLmrReductionsMade() { return lmr_reductions_made_; }
-  int64_t GetLmrReductionsEffective() { return lmr_reductions_effective_; }
+  // Nodes searched by all threads since the player was created.
+  int64_t GetNumEvaluations() const;
+  // The same per thread, with the table probes, the main thread first. With
+  // a search pool, those of the running search only.
+  std::vector<ThreadSearchCounts> GetThreadSearchCounts() const;
+  // Statistics of all threads since the last ClearSearchStats. Apart from
+  // the node count they stay zero unless built with CHESS_STATS, and with a
+  // search pool they are those of the searchers of the running search.
+  SearchStatsTotals GetSearchStats() const;
+  void ClearSearchStats();
 
   // Check if the current board position is a known checkmate
   bool IsKnownCheckmate(const Board& board) const {
@@ -238,27 +420,11 @@ class AlphaBetaPlayer {
   
   // Check if a specific hash key corresponds to a known checkmate position
   bool IsKnownCheckmate(int64_t hash_key) const {
-    std::shared_lock<std::shared_mutex> lock(checkmate_mutex_);
-    return checkmate_positions_.find(hash_key) != checkmate_positions_.end();
+    return checkmate_positions_.Contains(hash_key);
   }
 
   void EnableDebug(bool enable) { enable_debug_ = enable; }
 
-  // for debugging
-  std::atomic<int64_t> test1_ = 0;
-  std::atomic<int64_t> test2_ = 0;
-  std::atomic<int64_t> test3_ = 0;
-
-  // Search timing statistics
-  struct SearchTiming {
-    std::chrono::nanoseconds totalSearchTime{0};
-    std::chrono::nanoseconds moveGenerationTime{0};
-    std::chrono::nanoseconds makeMoveTime{0};
-    std::chrono::nanoseconds evalTime{0};
-    std::chrono::nanoseconds ttLookupTime{0};
-    std::atomic<int64_t> nodes{0};
-  } searchTiming_;
-
  private:
 
   std::optional<std::tuple<int, std::optional<Move>, int>>
@@ -267,35 +433,81 @@ class AlphaBetaPlayer {
       ThreadState& state,
       int max_depth = 20);
 
-  void ResetMobilityScores(ThreadState& thread_state, Board& board);
+  void InitPieceSquareTable();
   void ResetHistoryHeuristics();
   void AgeHistoryHeuristics();
-  void UpdateStats(Stack* ss, ThreadState& thread_state, const Board& board,
-                   const Move& move, int depth, bool fail_high,
-                   const std::vector<Move>& searched_moves);
-  void UpdateQuietStats(Stack* ss, const Move& move);
-  void UpdateMobilityEvaluation(ThreadState& thread_state, Board& board, Player turn);
-
-  std::atomic<int64_t> num_nodes_ = 0; // debugging
-  std::atomic<int64_t> num_cache_hits_ = 0;
-  std::atomic<int64_t> num_futility_moves_pruned_ = 0;
-  std::atomic<int64_t> num_lmr_searches_ = 0;
-  std::atomic<int64_t> num_lmr_researches_ = 0;
-  std::atomic<int64_t> num_singular_extension_searches_ = 0;
-  std::atomic<int64_t> num_singular_extensions_ = 0;
-  std::atomic<int64_t> num_lm_pruned_ = 0;
-  std::atomic<int64_t> num_fail_high_reductions_ = 0;
-  std::atomic<int64_t> num_check_extensions_ = 0;
-  std::atomic<int64_t> num_lazy_eval_ = 0;
-  std::atomic<int64_t> lmr_reductions_made_ = 0;
-  std::atomic<int64_t> lmr_reductions_effective_ = 0;
+  void UpdateQuietStats(ThreadState& thread_state, Stack* ss, const Move& move);
+  // The root search of MakeMove on thread_states_, once its limits are set.
+  std::optional<std::tuple<int, std::optional<Move>, int>> SearchRoot(
+      Board& board, const SearchLimits& limits, int max_depth);
+  // SearchRoot on searchers borrowed from options_.search_pool, as many
+  // times as the search yields them.
+  std::optional<std::tuple<int, std::optional<Move>, int>> SearchWithPool(
+      Board& board, const SearchLimits& limits, int max_depth);
+  // Runs helper searches on thread_states_[thread_id] as they are posted.
+  void HelperLoop(size_t thread_id);
+  // One helper search, reported to helper_results_.
+  void RunHelper(size_t thread_id, int max_depth);
+  // Whether the time or node limit of the running search is reached.
+  bool SearchLimitReached() const;
+  // Plies from the root of the last search along its PV to `board`, if
+  // `board` is on the first kMaxReusePlies of it.
+  std::optional<int> PliesAlongLastPV(const Board& board) const;
+
+  int64_t nodes_at_stats_clear_ = 0;
+
+  // Limits of the running search, set before the threads start. During the
+  // search only the main thread reports iterations to the time manager.
+  TimeManager time_manager_;
+  std::optional<int64_t> node_limit_;
+  int64_t nodes_at_search_start_ = 0;
+  const IterationCallback* on_iteration_ = nullptr;
+  int start_depth_ = 1;  // First iteration of all threads
+
+  // Root and depth of the last search, whose PV is pv_info_
+  std::unique_ptr<Board> last_root_;
+  int last_search_depth_ = 0;
 
   std::atomic<bool> canceled_ = false;
+  // Set by SetCanceled, unlike canceled_ when the search ends its helpers or
+  // yields to the pool.
+  std::atomic<bool> stopped_ = false;
+  // Whether the searchers of the running search may be asked to yield, and
+  // whether they were.
+  std::atomic<bool> may_yield_ = false;
+  std::atomic<bool> yielded_ = false;
   int piece_move_order_scores_[6];
   PlayerOptions options_;
   int location_evaluations_[14][14];
 
   PVInfo pv_info_;
+  std::shared_ptr<TranspositionTable> transposition_table_;
+
+  // Search thread pool. thread_states_[0] belongs to the thread that calls
+  // MakeMove, the others to the helpers, which park between searches. They
+  // are the player's own, or with a search pool those borrowed for the
+  // running search.
+  std::vector<std::unique_ptr<ThreadState>> own_thread_states_;
+  std::vector<ThreadState*> thread_states_;
+  std::vector<int> searchers_;  // Ids of the borrowed ones in the pool
+  // Counters of thread_states_ when they were borrowed, and the nodes of
+  // the searchers given back, for counting the player's own nodes.
+  std::vector<ThreadSearchCounts> counts_at_borrow_;
+  int64_t returned_nodes_ = 0;
+  // Tells the player's searches from those of other players to the
+  // searchers of a pool. A new game takes a new one.
+  uint64_t history_owner_ = 0;
+  std::vector<std::thread> helpers_;
+  std::vector<std::optional<std::tuple<int, std::optional<Move>, int>>>
+    helper_results_;
+  std::mutex pool_mutex_;
+  std::condition_variable pool_start_cv_;
+  std::condition_variable pool_done_cv_;
+  uint64_t pool_search_id_ = 0;  // Bumped to start the helpers
+  int pool_max_depth_ = 0;
+  size_t pool_num_helpers_ = 0;  // Helpers taking part in this search
+  size_t num_busy_helpers_ = 0;
+  bool pool_quit_ = false;
 
   bool enable_debug_ = false;
 
@@ -304,6 +516,8 @@ class AlphaBetaPlayer {
   int asp_sum_sq_ = 0;
   int asp_sum_ = 0;
   int64_t last_board_key_ = 0;
+  // New root positions so far. The threads age their history up to it.
+  uint32_t history_generation_ = 0;
 
   // King safety evaluation
   static constexpr int kMaxProtectors = 4;
@@ -314,23 +528,19 @@ class AlphaBetaPlayer {
   // For evaluation
   int king_attack_weight_[30];
   int king_attacker_values_[6];
-  // color x piece type x row x col
-  int piece_square_table_[4][6][14][14];
+  // color x piece type x row x col, installed on the search boards
+  Board::PieceSquareTable piece_square_table_ = {};
   // number of moves a piece needs to have to be considered active
   int piece_activation_threshold_[7];
   bool knight_to_king_[14][14][14][14];
   Team root_team_ = NO_TEAM;
 
-  // Checkmate position tracking
-  std::unordered_set<int64_t> checkmate_positions_;
-  mutable std::shared_mutex checkmate_mutex_;  // mutable allows const methods to lock it
+  // Checkmate position tracking. Searched at every move, so kept small
+  // enough to mostly stay in the cache.
+  ConcurrentKeySet checkmate_positions_{kMaxKnownCheckmates};
 
   // Checkmate discovery mode
-  std::atomic<int> checkmates_discovered_ = 0;
-  std::unique_ptr<std::ofstream> checkmate_file_;
-  std::mutex checkmate_file_mutex_;
-  std::unordered_set<std::string> discovered_fens_;
-  std::mutex discovered_fens_mutex_;
+  std::unique_ptr<CheckmateDiscovery> checkmate_discovery_;
 };
 
 }  // namespace chess
@@ -0,0 +1,138 @@
+#include "search_pool.h"
+
+#include <algorithm>
+
+namespace chess {
+
+SearchPool::SearchPool(
+    int num_searchers, TranspositionTable* transposition_table) {
+  for (int i = 0; i < std::max(num_searchers, 1); i++) {
+    auto searcher = std::make_unique<Searcher>();
+    searcher->state = std::make_unique<ThreadState>(
+        PlayerOptions(), transposition_table, i);
+    searchers_.push_back(std::move(searcher));
+  }
+  num_free_ = Size();
+  for (auto& searcher : searchers_) {
+    searcher->thread =
+        std::thread(&SearchPool::SearcherLoop, this, std::ref(*searcher));
+  }
+}
+
+SearchPool::~SearchPool() {
+  {
+    std::lock_guard lock(mutex_);
+    quit_ = true;
+  }
+  task_cv_.notify_all();
+  for (auto& searcher : searchers_) {
+    searcher->thread.join();
+  }
+}
+
+std::vector<int> SearchPool::Acquire(
+    int wanted, const std::atomic<bool>& canceled,
+    const std::atomic<bool>* may_yield, YieldRequest yield) {
+  std::unique_lock lock(mutex_);
+  // Whether the search is counted in num_waiting_
+  bool waiting = false;
+  while (!canceled) {
+    const bool yielding = may_yield != nullptr && *may_yield;
+    if (waiting == yielding) {
+      num_waiting_ += yielding ? -1 : 1;
+      waiting = !yielding;
+    }
+    if (num_free_ > 0 && (!yielding || num_waiting_ == 0)) {
+      break;
+    }
+    if (!yielding && num_free_ == 0) {
+      AskToYield();
+    }
+    acquire_cv_.wait(lock);
+  }
+  if (waiting) {
+    num_waiting_--;
+  }
+  // Yielding searches wait for num_waiting_ to drop to 0.
+  acquire_cv_.notify_all();
+  if (canceled) {
+    return {};
+  }
+
+  std::vector<int> taken;
+  const int num_taken = std::clamp(wanted, 1, num_free_);
+  for (int i = 0; i < Size() && static_cast<int>(taken.size()) < num_taken;
+       i++) {
+    if (!searchers_[i]->borrowed) {
+      searchers_[i]->borrowed = true;
+      taken.push_back(i);
+    }
+  }
+  num_free_ -= num_taken;
+  if (may_yield != nullptr && *may_yield && yield != nullptr) {
+    yielding_loans_.push_back({taken[0], std::move(yield)});
+  }
+  return taken;
+}
+
+void SearchPool::Release(const std::vector<int>& searchers) {
+  if (searchers.empty()) {
+    return;
+  }
+  {
+    std::lock_guard lock(mutex_);
+    for (int i : searchers) {
+      searchers_[i]->borrowed = false;
+    }
+    num_free_ += searchers.size();
+    std::erase_if(yielding_loans_, [&](const YieldingLoan& loan) {
+      return loan.first_searcher == searchers[0];
+    });
+  }
+  acquire_cv_.notify_all();
+}
+
+void SearchPool::Interrupt() {
+  { std::lock_guard lock(mutex_); }
+  acquire_cv_.notify_all();
+}
+
+void SearchPool::Run(int searcher, std::function<void()> task) {
+  {
+    std::lock_guard lock(mutex_);
+    searchers_[searcher]->task = std::move(task);
+  }
+  task_cv_.notify_all();
+}
+
+void SearchPool::SearcherLoop(Searcher& searcher) {
+  std::unique_lock lock(mutex_);
+  while (true) {
+    task_cv_.wait(lock, [&] { return quit_ || searcher.task != nullptr; });
+    if (quit_) {
+      return;
+    }
+    auto task = std::move(searcher.task);
+    searcher.task = nullptr;
+    lock.unlock();
+    task();
+    lock.lock();
+  }
+}
+
+void SearchPool::AskToYield() {
+  if (std::any_of(yielding_loans_.begin(), yielding_loans_.end(),
+                  [](const YieldingLoan& loan) { return loan.asked; })) {
+    return;
+  }
+  // A loan that can not yield any more is not asked again.
+  for (auto it = yielding_loans_.begin(); it != yielding_loans_.end();) {
+    if (it->yield()) {
+      it->asked = true;
+      return;
+    }
+    it = yielding_loans_.erase(it);
+  }
+}
+
+}  // namespace chess
@@ -0,0 +1,97 @@
+#ifndef _SEARCH_POOL_H_
+#define _SEARCH_POOL_H_
+
+// Search threads shared by all the players of a server (server.h).
+//
+// The pool owns a fixed number of searchers, each a ThreadState with a thread
+// of its own that parks between searches. A player made with
+// PlayerOptions::search_pool keeps no thread states: each search borrows
+// searchers, runs its main search on the calling thread in the first one's
+// state and its helpers on the others' threads, and gives them back when it
+// is done. The memory and the threads of all searches together so stay
+// those of the pool, however many players there are.
+//
+// A search that no clock waits for, "go infinite" or a ponder search before
+// ponderhit, borrows on the condition that it yields: when another search
+// finds no searcher free, the pool asks it to end and give its searchers
+// back, and it borrows again behind the waiting searches.
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "player.h"
+#include "transposition_table.h"
+
+namespace chess {
+
+class SearchPool {
+ public:
+  // Asks a search to end soon and release its searchers. Called with the
+  // pool locked, so it must not call into the pool. Returns false if the
+  // search can not yield any more, such as a ponder search after ponderhit.
+  using YieldRequest = std::function<bool()>;
+
+  // The searchers search with `transposition_table`, which has to be the
+  // table of every player that borrows from the pool.
+  SearchPool(int num_searchers, TranspositionTable* transposition_table);
+  ~SearchPool();
+  SearchPool(const SearchPool&) = delete;
+  SearchPool& operator=(const SearchPool&) = delete;
+
+  int Size() const { return static_cast<int>(searchers_.size()); }
+
+  // Borrows up to `wanted` searchers, waiting until at least one is free.
+  // Returns their ids, or none if `canceled` was set while waiting. While
+  // `may_yield` is set the search waits behind the others, and once it has
+  // the searchers the pool may call `yield`. Clearing it while the search
+  // waits has to be followed by Interrupt.
+  std::vector<int> Acquire(int wanted, const std::atomic<bool>& canceled,
+                           const std::atomic<bool>* may_yield = nullptr,
+                           YieldRequest yield = nullptr);
+  void Release(const std::vector<int>& searchers);
+  // Wakes the waiting Acquire calls to check their flags.
+  void Interrupt();
+
+  ThreadState& GetThreadState(int searcher) {
+    return *searchers_[searcher]->state;
+  }
+  // Runs `task` on the thread of `searcher`, which the caller borrowed.
+  void Run(int searcher, std::function<void()> task);
+
+ private:
+  struct Searcher {
+    std::unique_ptr<ThreadState> state;
+    std::thread thread;
+    std::function<void()> task;  // Posted by Run, cleared when it starts
+    bool borrowed = false;
+  };
+  struct YieldingLoan {
+    int first_searcher;
+    YieldRequest yield;
+    bool asked = false;
+  };
+
+  void SearcherLoop(Searcher& searcher);
+  // Asks one yielding loan to yield, unless one was asked already.
+  void AskToYield();
+
+  std::mutex mutex_;
+  std::condition_variable acquire_cv_;
+  std::condition_variable task_cv_;
+  std::vector<std::unique_ptr<Searcher>> searchers_;
+  int num_free_ = 0;
+  // Acquire calls that wait and may not yield; the yielding ones wait for
+  // them.
+  int num_waiting_ = 0;
+  std::vector<YieldingLoan> yielding_loans_;
+  bool quit_ = false;
+};
+
+}  // namespace chess
+
+#endif  // _SEARCH_POOL_H_
@@ -0,0 +1,164 @@
+#include "server.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <thread>
+#include <unordered_map>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "command_line.h"
+#include "search_pool.h"
+#include "transposition_table.h"
+
+namespace chess {
+
+namespace {
+
+constexpr int kListenBacklog = 64;
+
+// Reads and writes the client's socket. Output is collected per thread and
+// sent in whole lines, so that the search thread and the command thread of
+// a session can write at the same time, as they do to std::cout.
+class SocketStreamBuf : public std::streambuf {
+ public:
+  explicit SocketStreamBuf(int fd) : fd_(fd) {
+    setg(input_, input_, input_);
+  }
+
+ protected:
+  int_type underflow() override {
+    ssize_t n;
+    do {
+      n = read(fd_, input_, sizeof(input_));
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+      return traits_type::eof();
+    }
+    setg(input_, input_, input_ + n);
+    return traits_type::to_int_type(input_[0]);
+  }
+
+  int_type overflow(int_type c) override {
+    if (traits_type::eq_int_type(c, traits_type::eof())) {
+      return traits_type::not_eof(c);
+    }
+    const char ch = traits_type::to_char_type(c);
+    xsputn(&ch, 1);
+    return c;
+  }
+
+  std::streamsize xsputn(const char* s, std::streamsize n) override {
+    std::lock_guard lock(output_mutex_);
+    const auto it =
+        output_.try_emplace(std::this_thread::get_id()).first;
+    std::string& output = it->second;
+    output.append(s, n);
+    const size_t end = output.rfind('\n');
+    if (end != std::string::npos) {
+      // A client that went away shows up as EOF on the next read.
+      size_t sent = 0;
+      while (sent <= end) {
+        const ssize_t k = send(fd_, output.data() + sent, end + 1 - sent,
+                               MSG_NOSIGNAL);
+        if (k < 0 && errno == EINTR) {
+          continue;
+        }
+        if (k <= 0) {
+          break;
+        }
+        sent += k;
+      }
+      output.erase(0, end + 1);
+    }
+    if (output.empty()) {
+      // Every search thread writes, so keep only unfinished lines.
+      output_.erase(it);
+    }
+    return n;
+  }
+
+ private:
+  const int fd_;
+  char input_[4096];
+  std::mutex output_mutex_;
+  // Unsent end of the last line of the threads that have one
+  std::unordered_map<std::thread::id, std::string> output_;
+};
+
+void ServeSession(int fd, SharedResources shared) {
+  {
+    SocketStreamBuf buf(fd);
+    std::istream in(&buf);
+    std::ostream out(&buf);
+    CommandLine session(in, out, std::move(shared));
+    session.Run();
+  }
+  close(fd);
+}
+
+}  // namespace
+
+bool RunServer(const ServerOptions& options) {
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  if (options.socket_path.empty()
+      || options.socket_path.size() >= sizeof(address.sun_path)) {
+    std::cout << "Invalid socket path: " << options.socket_path << std::endl;
+    return false;
+  }
+  std::strcpy(address.sun_path, options.socket_path.c_str());
+
+  const int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd < 0) {
+    std::cout << "Can not create socket: " << std::strerror(errno)
+              << std::endl;
+    return false;
+  }
+  // A socket file left by an earlier server would make bind fail.
+  unlink(options.socket_path.c_str());
+  if (bind(listen_fd, reinterpret_cast<const sockaddr*>(&address),
+           sizeof(address)) != 0
+      || listen(listen_fd, kListenBacklog) != 0) {
+    std::cout << "Can not listen on " << options.socket_path << ": "
+              << std::strerror(errno) << std::endl;
+    close(listen_fd);
+    return false;
+  }
+
+  SharedResources shared;
+  shared.transposition_table = std::make_shared<TranspositionTable>(
+      options.hash_mb * 1000000 / TranspositionTable::kEntrySize,
+      options.num_threads);
+  shared.search_pool = std::make_shared<SearchPool>(
+      options.num_threads, shared.transposition_table.get());
+  std::cout << "listening on " << options.socket_path << " threads "
+            << options.num_threads << " hash " << options.hash_mb
+            << std::endl;
+
+  while (true) {
+    const int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      std::cout << "accept failed: " << std::strerror(errno) << std::endl;
+      break;
+    }
+    // Sessions hold on to the shared resources, so they can outlive the
+    // loop.
+    std::thread(ServeSession, fd, shared).detach();
+  }
+  close(listen_fd);
+  return true;
+}
+
+}  // namespace chess
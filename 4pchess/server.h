@@ -0,0 +1,32 @@
+#ifndef _SERVER_H_
+#define _SERVER_H_
+
+// Many UCI sessions in one engine process.
+//
+// Every client connected to the Unix socket gets a session of its own, with
+// its own board, player and options, that speaks the same protocol as the
+// command line. The sessions share one transposition table and one pool of
+// searchers, the thread states and threads that searches run on, so that
+// memory and threads do not grow with the number of clients (search_pool.h).
+// A session's player keeps only its options and the results of its last
+// search. A search waits, with its clock running, until searchers are free;
+// infinite and ponder searches give theirs up to searches that wait.
+
+#include <cstddef>
+#include <string>
+
+namespace chess {
+
+struct ServerOptions {
+  std::string socket_path;
+  int num_threads = 1;      // Searchers of all sessions together
+  size_t hash_mb = 256;     // Size of the shared table
+};
+
+// Serves clients on `options.socket_path` until accepting fails. Returns
+// false, after printing why, if the socket can not be set up.
+bool RunServer(const ServerOptions& options);
+
+}  // namespace chess
+
+#endif  // _SERVER_H_
@@ -0,0 +1,61 @@
+#include "stats.h"
+
+namespace chess {
+
+namespace {
+
+constexpr const char* kStatNames[NUM_SEARCH_STATS] = {
+  "qsearch_nodes",
+  "tt_hits",
+  "tt_cutoffs",
+  "cache_cutoffs",
+  "illegal_moves",
+  "known_checkmates",
+  "singular_searches",
+  "singular_extensions",
+  "lmr_searches",
+  "lmr_researches",
+  "qsearch_delta_pruned",
+  "qsearch_see_pruned",
+};
+
+}  // namespace
+
+void SearchStats::Clear() {
+  for (auto& count : counts) {
+    count.store(0, std::memory_order_relaxed);
+  }
+  for (auto& count : cutoffs) {
+    count.store(0, std::memory_order_relaxed);
+  }
+}
+
+void SearchStatsTotals::Add(const SearchStats& stats) {
+  for (int i = 0; i < NUM_SEARCH_STATS; i++) {
+    counts[i] += stats.counts[i].load(std::memory_order_relaxed);
+  }
+  for (int i = 0; i < kNumCutoffSlots; i++) {
+    cutoffs[i] += stats.cutoffs[i].load(std::memory_order_relaxed);
+  }
+}
+
+void PrintSearchStats(const SearchStatsTotals& totals, std::ostream& out) {
+  out << "info string nodes " << totals.nodes << std::endl;
+  for (int i = 0; i < NUM_SEARCH_STATS; i++) {
+    out << "info string " << kStatNames[i] << " " << totals.counts[i]
+        << std::endl;
+  }
+  uint64_t num_cutoffs = 0;
+  for (uint64_t count : totals.cutoffs) {
+    num_cutoffs += count;
+  }
+  out << "info string cutoffs " << num_cutoffs << " by move index";
+  for (int i = 0; i < kNumCutoffSlots; i++) {
+    out << " " << (i == kNumCutoffSlots - 1 ? ">=" : "") << i << ":"
+        << (num_cutoffs == 0 ? 0 : totals.cutoffs[i] * 1000 / num_cutoffs / 10.0)
+        << "%";
+  }
+  out << std::endl;
+}
+
+}  // namespace chess
@@ -0,0 +1,82 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+// Search statistics for finding out where the search spends its effort.
+//
+// Counting is compiled in only with -DCHESS_STATS (make STATS=1). In other
+// builds the SEARCH_STAT macros expand to nothing. Each search thread has
+// its own SearchStats on its own cache lines and is the only one to write
+// it. Readers add the threads up whenever they like, since the counters are
+// relaxed atomics; a single writer updates them with a load and a store,
+// which compiles to a plain add.
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+namespace chess {
+
+#ifdef CHESS_STATS
+constexpr bool kSearchStatsEnabled = true;
+#define SEARCH_STAT(thread_state, stat) (thread_state).Stats().Increment(stat)
+#define SEARCH_CUTOFF(thread_state, move_index) \
+  (thread_state).Stats().Cutoff(move_index)
+#else
+constexpr bool kSearchStatsEnabled = false;
+#define SEARCH_STAT(thread_state, stat) ((void)0)
+#define SEARCH_CUTOFF(thread_state, move_index) ((void)0)
+#endif
+
+enum SearchStat {
+  QSEARCH_NODES,
+  TT_HITS,             // Entry found for the position
+  TT_CUTOFFS,          // Search returned the table score
+  CACHE_CUTOFFS,       // Search returned an exact analysis cache score
+  ILLEGAL_MOVES,       // Generated moves that left the king attacked
+  KNOWN_CHECKMATES,    // Moves skipped into known checkmate positions
+  SINGULAR_SEARCHES,
+  SINGULAR_EXTENSIONS,
+  LMR_SEARCHES,        // Reduced null window searches of later moves
+  LMR_RESEARCHES,      // ... that failed high and were searched again
+  QSEARCH_DELTA_PRUNED,
+  QSEARCH_SEE_PRUNED,
+  NUM_SEARCH_STATS,
+};
+
+// Beta cutoffs are counted by the index of the move that caused them, the
+// last slot for all moves from there on.
+constexpr int kNumCutoffSlots = 8;
+
+struct alignas(64) SearchStats {
+  std::atomic<uint64_t> counts[NUM_SEARCH_STATS] = {};
+  std::atomic<uint64_t> cutoffs[kNumCutoffSlots] = {};
+
+  void Increment(SearchStat stat) { Bump(counts[stat]); }
+  void Cutoff(int move_index) {
+    Bump(cutoffs[move_index < kNumCutoffSlots ? move_index
+                                              : kNumCutoffSlots - 1]);
+  }
+  void Clear();
+
+ private:
+  static void Bump(std::atomic<uint64_t>& counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+  }
+};
+
+// Sum of the statistics of all search threads.
+struct SearchStatsTotals {
+  uint64_t nodes = 0;
+  uint64_t counts[NUM_SEARCH_STATS] = {};
+  uint64_t cutoffs[kNumCutoffSlots] = {};
+
+  void Add(const SearchStats& stats);
+};
+
+// One "info string" line per statistic.
+void PrintSearchStats(const SearchStatsTotals& totals, std::ostream& out);
+
+}  // namespace chess
+
+#endif  // _STATS_H_
@@ -0,0 +1,74 @@
+#include "time_manager.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace chess {
+
+namespace {
+
+// Kept back on every move for the GUI and the pipe.
+constexpr int64_t kMoveOverheadMs = 30;
+// Moves the remaining time is spread over when the GUI does not say.
+constexpr int kDefaultMovesToGo = 30;
+// Scale of the soft limit by the number of iterations in a row that kept
+// the best move.
+constexpr double kStabilityScale[] = {2.0, 1.4, 1.1, 0.9, 0.8};
+constexpr int kMaxStability = std::size(kStabilityScale) - 1;
+
+}  // namespace
+
+void TimeManager::Start(const SearchLimits& limits, PlayerColor color) {
+  soft_ms_.reset();
+  hard_ms_.reset();
+  last_best_move_.reset();
+  stability_ = 0;
+  start_ = kNotStarted;
+  if (!limits.ponder || ponder_hit_) {
+    StartClock();
+  }
+
+  if (limits.infinite) {
+    return;
+  }
+  if (limits.movetime.has_value()) {
+    hard_ms_ = std::max(*limits.movetime, 1);
+    return;
+  }
+  const auto& time = limits.time[color];
+  if (!time.has_value()) {
+    return;
+  }
+  const int64_t inc = limits.inc[color].value_or(0);
+  const int64_t moves_to_go = std::clamp(
+      limits.moves_to_go.value_or(kDefaultMovesToGo), 1, kDefaultMovesToGo);
+  const int64_t usable = std::max<int64_t>(*time - kMoveOverheadMs, 1);
+  const int64_t max_ms = std::max<int64_t>(usable * 3 / 4, 1);
+  soft_ms_ = std::min(usable / moves_to_go + inc * 3 / 4, max_ms);
+  hard_ms_ = std::min(*soft_ms_ * 4, max_ms);
+}
+
+void TimeManager::PonderHit() {
+  ponder_hit_ = true;
+  StartClock();
+}
+
+bool TimeManager::IterationDone(const Move& best_move, double best_move_effort) {
+  if (last_best_move_ == best_move) {
+    stability_ = std::min(stability_ + 1, kMaxStability);
+  } else {
+    stability_ = 0;
+  }
+  last_best_move_ = best_move;
+  if (!soft_ms_.has_value() || start_ == kNotStarted) {
+    return false;
+  }
+  // From 0.6 when the best move took all nodes to 1.6 when it took none.
+  const double effort_scale = 1.6 - std::clamp(best_move_effort, 0.0, 1.0);
+  const double target = *soft_ms_ * kStabilityScale[stability_] * effort_scale;
+  // The next iteration takes about as long as all earlier ones together, so
+  // it is not started once it would end well past the target.
+  return ElapsedMs() >= 0.6 * target;
+}
+
+}  // namespace chess
@@ -0,0 +1,96 @@
+#ifndef _TIME_MANAGER_H_
+#define _TIME_MANAGER_H_
+
+// How long one search may take.
+//
+// A search with a clock has a soft and a hard limit. The soft limit is the
+// time the move is planned to take. It is checked between iterations and
+// stretched or shrunk by how settled the search looks: a best move that
+// keeps changing gets more time, one that stays the same over several
+// iterations and takes most of the nodes gets less. The hard limit stops the
+// search in the middle of an iteration, so that the clock never runs out.
+//
+// A ponder search runs without limits until PonderHit, which starts the
+// clock with the limits the search was given.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+#include "board.h"
+
+namespace chess {
+
+// Limits of one search, as given by "go".
+struct SearchLimits {
+  std::optional<int> depth;
+  std::optional<int> movetime;  // Search exactly this long, in ms
+  std::optional<int64_t> nodes;
+  // Remaining clock time and increment of each color, in ms
+  std::optional<int> time[4];
+  std::optional<int> inc[4];
+  std::optional<int> moves_to_go;
+  bool infinite = false;
+  bool ponder = false;  // Limits apply from PonderHit on
+  // Threads to search with, at most those of the player. All if not set.
+  std::optional<int> threads;
+};
+
+class TimeManager {
+ public:
+  // Starts the clock of a search by `color`, unless it is a ponder search.
+  void Start(const SearchLimits& limits, PlayerColor color);
+
+  // Starts the clock of a ponder search. Safe to call from any thread, also
+  // just before the search calls Start.
+  void PonderHit();
+
+  // Called when the search is over.
+  void Finish() { ponder_hit_ = false; }
+
+  // Called after each completed iteration with its best move and the share
+  // of the iteration's nodes spent below that move. Returns true if the next
+  // iteration should not be started.
+  bool IterationDone(const Move& best_move, double best_move_effort);
+
+  // Whether the search has to stop now. Safe to call from any thread while
+  // the search runs.
+  bool HardLimitReached() const {
+    return hard_ms_.has_value() && ElapsedMs() >= *hard_ms_;
+  }
+
+  // False while a ponder search waits for ponderhit.
+  bool ClockRunning() const { return start_ != kNotStarted; }
+
+  // Time since the clock started, 0 while pondering.
+  int64_t ElapsedMs() const {
+    const Clock::rep start = start_;
+    if (start == kNotStarted) {
+      return 0;
+    }
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        Clock::now() - Clock::time_point(Clock::duration(start))).count();
+  }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+  static constexpr Clock::rep kNotStarted = 0;
+
+  void StartClock() { start_ = Clock::now().time_since_epoch().count(); }
+
+  // Set by Start before the search threads run.
+  std::optional<int64_t> soft_ms_;
+  std::optional<int64_t> hard_ms_;
+  // A ponder hit can come before or after Start. Either PonderHit sets
+  // ponder_hit_ before Start reads it, or it starts the clock after Start
+  // cleared it.
+  std::atomic<Clock::rep> start_ = kNotStarted;
+  std::atomic<bool> ponder_hit_ = false;
+  std::optional<Move> last_best_move_;
+  int stability_ = 0;  // Iterations in a row with the same best move
+};
+
+}  // namespace chess
+
+#endif  // _TIME_MANAGER_H_
@@ -1,29 +1,133 @@
+#include <algorithm>
 #include <cassert>
+#include <cstdlib>
+#include <cstring>
 #include <optional>
 #include <iostream>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include <sys/mman.h>
 
 #include "transposition_table.h"
 
 namespace chess {
 
-TranspositionTable::TranspositionTable(size_t table_size) {
+namespace {
+
+constexpr int kGenerationBits = 5;
+constexpr uint8_t kGenerationMask = (1 << kGenerationBits) - 1;
+constexpr uint64_t kCheckMask = 0xFFFF;
+constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+
+uint16_t Fold16(uint64_t x) {
+  x ^= x >> 32;
+  x ^= x >> 16;
+  return static_cast<uint16_t>(x);
+}
+
+// The check ties the high key bits to both words of the entry, so entries
+// whose words come from different writes are rejected.
+uint16_t Check(int64_t key, uint64_t word0, uint64_t word1) {
+  return static_cast<uint16_t>(static_cast<uint64_t>(key) >> 48)
+    ^ Fold16(word0 & ~kCheckMask) ^ Fold16(word1);
+}
+
+int EntryDepth(uint64_t word0) { return (word0 >> 16) & 0xFF; }
+
+uint8_t EntryGeneration(uint64_t word0) {
+  return (word0 >> 27) & kGenerationMask;
+}
+
+// How many searches ago the entry was written.
+int RelativeAge(uint64_t word0, uint8_t generation) {
+  return (generation - EntryGeneration(word0)) & kGenerationMask;
+}
+
+}  // namespace
+
+TranspositionTable::TranspositionTable(size_t table_size, int num_threads) {
   assert((table_size > 0) && "transposition table_size = 0");
   // Round up to next power of 2 for bitmask hashing
-  table_size_ = 1;
-  while (table_size_ < table_size) {
-    table_size_ <<= 1;
+  size_t num_clusters = std::max<size_t>(1, table_size / kClusterSize);
+  num_clusters_ = 1;
+  while (num_clusters_ < num_clusters) {
+    num_clusters_ <<= 1;
+  }
+
+  // Large tables are mapped directly and backed by transparent huge pages
+  // where the kernel allows it, which saves most TLB misses on probes. A
+  // failed madvise just leaves the mapping on normal pages.
+  size_t bytes = num_clusters_ * sizeof(Cluster);
+  allocated_bytes_ = (bytes + kHugePageSize - 1) & ~(kHugePageSize - 1);
+  void* memory = mmap(nullptr, allocated_bytes_, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory != MAP_FAILED) {
+    mmapped_ = true;
+#ifdef MADV_HUGEPAGE
+    madvise(memory, allocated_bytes_, MADV_HUGEPAGE);
+#endif
+  } else {
+    allocated_bytes_ = bytes;
+    memory = std::aligned_alloc(alignof(Cluster), allocated_bytes_);
+  }
+  if (memory == nullptr) {
+    std::cout << "Can't create transposition table. Try using a smaller size."
+              << std::endl;
+    abort();
+  }
+  clusters_ = static_cast<Cluster*>(memory);
+  Clear(num_threads);
+}
+
+TranspositionTable::~TranspositionTable() {
+  if (mmapped_) {
+    munmap(clusters_, allocated_bytes_);
+  } else {
+    free(clusters_);
   }
-  hash_table_ = (HashTableEntry*) malloc(table_size_ * sizeof(HashTableEntry));
-  assert(
-      (hash_table_ != nullptr) && 
-      "Can't create transposition table. Try using a smaller size.");
 }
 
-const HashTableEntry* TranspositionTable::Get(int64_t key) {
-  size_t n = key & (table_size_ - 1);
-  HashTableEntry* entry = hash_table_ + n;
-  if (entry->key == key) {
-    return entry;
+void TranspositionTable::Clear(int num_threads) {
+  num_threads = std::clamp<int>(
+      num_threads, 1, std::max<size_t>(1, num_clusters_ / 1024));
+  size_t chunk = (num_clusters_ + num_threads - 1) / num_threads;
+  auto clear_chunk = [this, chunk](size_t begin) {
+    begin = std::min(num_clusters_, begin);
+    size_t end = std::min(num_clusters_, begin + chunk);
+    std::memset(static_cast<void*>(clusters_ + begin), 0,
+                (end - begin) * sizeof(Cluster));
+  };
+
+  std::vector<std::thread> threads;
+  for (int i = 1; i < num_threads; i++) {
+    threads.emplace_back(clear_chunk, i * chunk);
+  }
+  clear_chunk(0);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+const HashTableEntry* TranspositionTable::Get(
+    int64_t key, HashTableEntry& entry) const {
+  const Cluster* cluster = GetCluster(key);
+  for (const Entry& e : cluster->entries) {
+    uint64_t word0 = e.word[0].load(std::memory_order_relaxed);
+    uint64_t word1 = e.word[1].load(std::memory_order_relaxed);
+    if (word0 == 0 || (word0 & kCheckMask) != Check(key, word0, word1)) {
+      continue;
+    }
+    entry.key = key;
+    entry.depth = EntryDepth(word0);
+    entry.bound = static_cast<ScoreBound>((word0 >> 24) & 0x3);
+    entry.is_pv = (word0 >> 26) & 0x1;
+    entry.generation = EntryGeneration(word0);
+    entry.packed_move = static_cast<uint32_t>(word0 >> 32);
+    entry.score = static_cast<int32_t>(word1);
+    entry.eval = static_cast<int32_t>(word1 >> 32);
+    return &entry;
   }
   return nullptr;
 }
@@ -31,52 +135,62 @@ const HashTableEntry* TranspositionTable::Get(int64_t key) {
 void TranspositionTable::Save(
     int64_t key, int depth, std::optional<Move> move, int score, int eval,
     ScoreBound bound, bool is_pv) {
-  size_t n = key & (table_size_ - 1);
-  HashTableEntry& entry = hash_table_[n];
-  if (bound == EXACT
-      || entry.key != key
-      || entry.depth <= depth
-      || entry.generation != generation_) { // Replace old generation entries
-    entry.key = key;
-    entry.depth = depth;
-    if (move.has_value()) {
-      entry.packed_move = move->Pack();
-    } else {
-      entry.packed_move = 0;  // 0 means no move
+  Cluster* cluster = GetCluster(key);
+  uint8_t generation = generation_.load(std::memory_order_relaxed)
+    & kGenerationMask;
+
+  // Use the entry already holding this position if there is one, otherwise
+  // replace the entry with the lowest depth, preferring older generations.
+  Entry* replace = nullptr;
+  uint64_t replace_word0 = 0;
+  int replace_value = 0;
+  bool same_key = false;
+  for (Entry& e : cluster->entries) {
+    uint64_t word0 = e.word[0].load(std::memory_order_relaxed);
+    uint64_t word1 = e.word[1].load(std::memory_order_relaxed);
+    if (word0 != 0 && (word0 & kCheckMask) == Check(key, word0, word1)) {
+      replace = &e;
+      replace_word0 = word0;
+      same_key = true;
+      break;
+    }
+    int value = word0 == 0 ? std::numeric_limits<int>::min()
+      : EntryDepth(word0) - 8 * RelativeAge(word0, generation);
+    if (replace == nullptr || value < replace_value) {
+      replace = &e;
+      replace_word0 = word0;
+      replace_value = value;
     }
-    entry.score = score;
-    entry.eval = eval;
-    entry.bound = bound;
-    entry.is_pv = is_pv;
-    entry.generation = generation_;
   }
-}
 
-void TranspositionTable::NewSearch() {
-  generation_++;
-}
-
-void TranspositionTable::Merge(const TranspositionTable& source) {
-  // Iterate through all entries in source table
-  for (size_t i = 0; i < source.table_size_; i++) {
-    const HashTableEntry& src_entry = source.hash_table_[i];
-    // Only merge valid entries (non-zero key indicates valid entry)
-    if (src_entry.key != 0) {
-      size_t n = src_entry.key & (table_size_ - 1);
-      HashTableEntry& entry = hash_table_[n];
-      // Only add completely new entries - don't touch existing entries
-      if (entry.key == 0) {
-        entry.key = src_entry.key;
-        entry.depth = src_entry.depth;
-        entry.packed_move = src_entry.packed_move;
-        entry.score = src_entry.score;
-        entry.eval = src_entry.eval;
-        entry.bound = src_entry.bound;
-        entry.is_pv = src_entry.is_pv;
-        entry.generation = generation_;
-      }
+  uint32_t packed_move = move.has_value() ? move->Pack() : 0;
+  if (same_key) {
+    if (bound != EXACT
+        && EntryDepth(replace_word0) > depth
+        && EntryGeneration(replace_word0) == generation) {
+      return;
+    }
+    // Keep the old move rather than forgetting it.
+    if (packed_move == 0) {
+      packed_move = static_cast<uint32_t>(replace_word0 >> 32);
     }
   }
+
+  uint64_t word0 =
+      (static_cast<uint64_t>(std::clamp(depth, 0, 255)) << 16)
+    | (static_cast<uint64_t>(bound) << 24)
+    | (static_cast<uint64_t>(is_pv) << 26)
+    | (static_cast<uint64_t>(generation) << 27)
+    | (static_cast<uint64_t>(packed_move) << 32);
+  uint64_t word1 = static_cast<uint64_t>(static_cast<uint32_t>(score))
+    | (static_cast<uint64_t>(static_cast<uint32_t>(eval)) << 32);
+  word0 |= Check(key, word0, word1);
+  replace->word[0].store(word0, std::memory_order_relaxed);
+  replace->word[1].store(word1, std::memory_order_relaxed);
+}
+
+void TranspositionTable::NewSearch() {
+  generation_.fetch_add(1, std::memory_order_relaxed);
 }
 
-}  // namespace chess
\ No newline at end of file
+}  // namespace chess
@@ -16,6 +16,8 @@ enum ScoreBound {
   EXACT = 0, LOWER_BOUND = 1, UPPER_BOUND = 2,
 };
 
+// Decoded copy of a table entry. Get() hands out copies so that other search
+// threads can keep writing the shared table while the caller uses the entry.
 struct HashTableEntry {
   int64_t key;
   uint32_t packed_move;  // Packed move representation (0 = no move)
@@ -27,29 +29,70 @@ struct HashTableEntry {
   uint8_t generation;
 };
 
+// Transposition table shared by all search threads.
+//
+// The table is an array of 64-byte clusters holding kClusterSize entries of
+// two 64-bit words each. The low bits of the key select the cluster and each
+// entry keeps a 16-bit check made of the high key bits xor-folded with the
+// rest of the entry. The table is lockless: a reader that races with a writer
+// sees a mix of old and new words, which fails the check and reads as a miss.
+// Since 16 bits can still collide, moves read from the table have to be
+// validated against the position before they are played.
 class TranspositionTable {
  public:
-   TranspositionTable(size_t table_size);
+   static constexpr size_t kClusterSize = 4;
+   // Size of one entry in bytes, used to convert the UCI hash size.
+   static constexpr size_t kEntrySize = 2 * sizeof(uint64_t);
 
-   const HashTableEntry* Get(int64_t key);
+   // `table_size` is the number of entries. The memory is zeroed using
+   // `num_threads` threads, so that on NUMA machines the pages end up spread
+   // over the nodes of the threads that search.
+   TranspositionTable(size_t table_size, int num_threads = 1);
+   ~TranspositionTable();
+   TranspositionTable(const TranspositionTable&) = delete;
+   TranspositionTable& operator=(const TranspositionTable&) = delete;
+
+   // Copies the entry for `key` into `entry` and returns a pointer to it, or
+   // returns nullptr if the table holds no (consistent) entry for `key`.
+   const HashTableEntry* Get(int64_t key, HashTableEntry& entry) const;
    void Save(int64_t key, int depth, std::optional<Move> move,
              int score, int eval, ScoreBound bound, bool is_pv);
    void NewSearch();
-   void Merge(const TranspositionTable& source);
+   // Zeroes all entries in parallel. Must not race with Get/Save.
+   void Clear(int num_threads);
 
-  ~TranspositionTable() {
-    if (hash_table_ != nullptr) {
-      free(hash_table_);
-    }
-  }
+   // Starts loading the cluster for `key` into the cache, so that the Get()
+   // for a child position overlaps with the work done before it.
+   void Prefetch(int64_t key) const {
+     __builtin_prefetch(GetCluster(key));
+   }
 
  private:
-  HashTableEntry* hash_table_ = nullptr;
-  size_t table_size_ = 0;
-  uint8_t generation_ = 0;
+  // word[0]: check (bits 0-15), depth (16-23), bound (24-25), is_pv (26),
+  //          generation (27-31), packed move (32-63)
+  // word[1]: score (bits 0-31), eval (32-63)
+  struct Entry {
+    std::atomic<uint64_t> word[2];
+  };
+  struct alignas(64) Cluster {
+    Entry entries[kClusterSize];
+  };
+  static_assert(sizeof(Entry) == kEntrySize);
+  static_assert(sizeof(Cluster) == 64);
+
+  Cluster* GetCluster(int64_t key) const {
+    return &clusters_[key & (num_clusters_ - 1)];
+  }
+
+  Cluster* clusters_ = nullptr;
+  size_t num_clusters_ = 0;
+  // Size of the allocation backing clusters_, and whether it was mmap'd.
+  size_t allocated_bytes_ = 0;
+  bool mmapped_ = false;
+  std::atomic<uint8_t> generation_ = 0;
 };
 
 
 }  // namespace chess
 
-#endif  // _TRANSPOSITION_TABLE_H_
\ No newline at end of file
+#endif  // _TRANSPOSITION_TABLE_H_
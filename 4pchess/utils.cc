@@ -8,6 +8,7 @@
 #include <optional>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "board.h"
@@ -71,14 +72,14 @@ std::optional<std::vector<bool>> ParseCastlingAvailability(
   return availability;
 }
 
-std::optional<std::pair<int8_t, int8_t>> ParseEnpLocation(const std::string& enp) {
+std::optional<std::pair<int8_t, int8_t>> ParseEnpLocation(std::string_view enp) {
   size_t pos = enp.find(':');
-  if (pos == std::string::npos) {
+  if (pos == std::string_view::npos) {
     return std::nullopt;
   }
-  std::string to = enp.substr(pos + 1);
+  std::string_view to = enp.substr(pos + 1);
   if (!to.empty() && to[to.size() - 1] == '\'') {
-    to = to.substr(0, to.size() - 1);
+    to.remove_suffix(1);
   }
   if (to.size() < 2 || to.size() > 3) {
     return std::nullopt;
@@ -102,12 +103,135 @@ std::optional<std::pair<int8_t, int8_t>> ParseEnpLocation(const std::string& enp
   return std::make_pair(row, col);
 }
 
-std::shared_ptr<Board> ParseBoardFromFEN(const std::string& fen) {
-  std::vector<std::string> parts = SplitStr(fen, "-");
-  if (parts.size() < 7 || parts.size() > 8) {
-    return nullptr;  // invalid format
+namespace {
+
+// Returns the text up to the next `delimiter` and drops it, with the
+// delimiter, from `rest`.
+std::string_view NextToken(std::string_view& rest, char delimiter) {
+  const size_t pos = rest.find(delimiter);
+  const std::string_view token = rest.substr(0, pos);
+  rest.remove_prefix(pos == std::string_view::npos ? rest.size() : pos + 1);
+  return token;
+}
+
+// Four comma-separated 0s and 1s.
+bool ParseCastlingBits(std::string_view part, bool bits[4]) {
+  for (int i = 0; i < 4; i++) {
+    const std::string_view bit = NextToken(part, ',');
+    if (bit != "0" && bit != "1") {
+      return false;
+    }
+    bits[i] = bit == "1";
+  }
+  return part.empty();
+}
+
+std::optional<PlayerColor> ParseColor(char ch) {
+  switch (ch) {
+  case 'r': case 'R': return RED;
+  case 'b': case 'B': return BLUE;
+  case 'y': case 'Y': return YELLOW;
+  case 'g': case 'G': return GREEN;
+  default: return std::nullopt;
+  }
+}
+
+std::optional<PieceType> ParsePieceType(char ch) {
+  switch (ch) {
+  case 'P': return PAWN;
+  case 'R': return ROOK;
+  case 'N': return KNIGHT;
+  case 'B': return BISHOP;
+  case 'K': return KING;
+  case 'Q': return QUEEN;
+  default: return std::nullopt;
+  }
+}
+
+bool ParseEnpassant(std::string_view enpassant, EnpassantInitialization& enp) {
+  const size_t lbrace_pos = enpassant.find('(');
+  const size_t rbrace_pos = enpassant.rfind(')');
+  if (lbrace_pos == std::string_view::npos
+      || rbrace_pos == std::string_view::npos || rbrace_pos < lbrace_pos) {
+    return false;
+  }
+  std::string_view rest =
+    enpassant.substr(lbrace_pos + 1, rbrace_pos - lbrace_pos - 1);
+  for (int i = 0; i < 4; i++) {
+    if (rest.empty() && i > 0) {
+      return false;
+    }
+    auto enp_location = ParseEnpLocation(NextToken(rest, ','));
+    if (enp_location.has_value()) {
+      auto& to = *enp_location;
+      int8_t from_row = to.first;
+      int8_t from_col = to.second;
+      switch (static_cast<PlayerColor>(i)) {
+      case RED:
+        from_row += 2;
+        break;
+      case BLUE:
+        from_col -= 2;
+        break;
+      case YELLOW:
+        from_row -= 2;
+        break;
+      case GREEN:
+        from_col += 2;
+        break;
+      default:
+        break;
+      }
+      enp.enp_moves[i] = Move(from_row, from_col, to.first, to.second, 0);
+    }
   }
+  return rest.empty();
+}
 
+bool ParsePlacement(std::string_view placement, Board& board) {
+  for (int row = 0; row < 14; row++) {
+    if (placement.empty()) {
+      return false;
+    }
+    std::string_view cells = NextToken(placement, '/');
+    int col = 0;
+    bool more = true;
+    while (more) {
+      more = cells.find(',') != std::string_view::npos;
+      const std::string_view cell = NextToken(cells, ',');
+      if (cell.empty()) {
+        return false;
+      }
+      const auto color = ParseColor(cell[0]);
+      if (color.has_value() && cell[0] >= 'a') {
+        const auto piece_type =
+          cell.size() == 2 ? ParsePieceType(cell[1]) : std::nullopt;
+        if (!piece_type.has_value()
+            || !board.AddPiece(row, col, Piece(*color, *piece_type))) {
+          return false;
+        }
+        col++;
+      } else if (cell[0] == 'x') {
+        col++;
+      } else {
+        int num_empty = 0;
+        for (char ch : cell) {
+          if (ch < '0' || ch > '9' || num_empty > 14) {
+            return false;
+          }
+          num_empty = 10 * num_empty + (ch - '0');
+        }
+        if (num_empty <= 0) {
+          return false;
+        }
+        col += num_empty;
+      }
+    }
+  }
+  return placement.empty();
+}
+
+bool ParseFENParts(std::string_view fen, Board& board) {
   // Not used for teams chess: eliminated players, points
   // Also, currently we don't use the halfmove clock since we don't expect the
   // 50-move rule to apply in real games.
@@ -119,189 +243,67 @@ std::shared_ptr<Board> ParseBoardFromFEN(const std::string& fen) {
   // 5: Halfmove clock (unused)
   // 6 (optional?): En-passant
   // 7: Piece placement
-
-  const auto& player_str = parts[0];
-  const auto& castling_availability_kingside = parts[2];
-  const auto& castling_availability_queenside = parts[3];
-  const auto& piece_placement = parts.back();
-
-  std::string enpassant;
-  if (parts.size() == 8) {
-    enpassant = parts[6];
-  }
-
-  // Parse player
-  if (player_str.size() != 1) {
-    return nullptr;  // invalid format
+  std::string_view parts[8];
+  size_t num_parts = 0;
+  while (!fen.empty() && num_parts < 8) {
+    parts[num_parts++] = NextToken(fen, '-');
   }
-  char pchar = player_str[0];
-  Player player;
-  switch (pchar) {
-  case 'R':
-    player = Player(RED);
-    break;
-  case 'B':
-    player = Player(BLUE);
-    break;
-  case 'Y':
-    player = Player(YELLOW);
-    break;
-  case 'G':
-    player = Player(GREEN);
-    break;
-  default:
-    return nullptr;  // invalid format
+  if (!fen.empty() || num_parts < 7) {
+    return false;  // invalid format
   }
 
-  // Parse castling availability
-  std::optional<std::vector<bool>> kingside = ParseCastlingAvailability(
-      castling_availability_kingside);
-  if (!kingside.has_value()) {
-    return nullptr;  // invalid format
+  if (parts[0].size() != 1 || parts[0][0] < 'A' || parts[0][0] > 'Z') {
+    return false;
   }
-  std::optional<std::vector<bool>> queenside = ParseCastlingAvailability(
-      castling_availability_queenside);
-  if (!queenside.has_value()) {
-    return nullptr;  // invalid format
+  const auto player_color = ParseColor(parts[0][0]);
+  if (!player_color.has_value()) {
+    return false;
   }
+  board.Clear(Player(*player_color));
 
-  std::unordered_map<Player, CastlingRights> castling_rights;
-  for (int player_color = 0; player_color < 4; player_color++) {
-    Player pl(static_cast<PlayerColor>(player_color));
-    castling_rights[pl] = CastlingRights((*kingside)[player_color],
-                                         (*queenside)[player_color]);
+  bool kingside[4];
+  bool queenside[4];
+  if (!ParseCastlingBits(parts[2], kingside)
+      || !ParseCastlingBits(parts[3], queenside)) {
+    return false;
+  }
+  for (int color = 0; color < 4; color++) {
+    board.SetCastlingRights(static_cast<PlayerColor>(color),
+                            CastlingRights(kingside[color], queenside[color]));
   }
 
-  // Parse enpassant
-  EnpassantInitialization enp;
-  if (!enpassant.empty()) {
-    size_t lbrace_pos = enpassant.find('(');
-    size_t rbrace_pos = enpassant.rfind(')');
-    if (lbrace_pos == std::string::npos || rbrace_pos == std::string::npos) {
-      // invalid enpassant string
-      return nullptr;
-    }
-    auto parts = SplitStr(
-        enpassant.substr(lbrace_pos + 1, rbrace_pos - lbrace_pos), ",");
-    if (parts.size() != 4) { // invalid
-      return nullptr;
-    }
-    for (int i = 0; i < 4; i++) {
-      auto enp_location = ParseEnpLocation(parts[i]);
-      if (enp_location.has_value()) {
-        auto& to = *enp_location;
-        int8_t from_row = to.first;
-        int8_t from_col = to.second;
-        switch (static_cast<PlayerColor>(i)) {
-        case RED:
-          from_row += 2;
-          break;
-        case BLUE:
-          from_col -= 2;
-          break;
-        case YELLOW:
-          from_row -= 2;
-          break;
-        case GREEN:
-          from_col += 2;
-          break;
-        default:
-          break;
-        }
-        enp.enp_moves[i] = Move(from_row, from_col, to.first, to.second, 0);
-      }
+  if (num_parts == 8) {
+    EnpassantInitialization enp;
+    if (!ParseEnpassant(parts[6], enp)) {
+      return false;
     }
+    board.SetEnpassantInitialization(enp);
   }
 
-  // Parse piece placement
-  std::vector<std::string> rows = SplitStr(piece_placement, "/");
-  if (rows.size() != 14) {
-    return nullptr;  // invalid format
+  if (!ParsePlacement(parts[num_parts - 1], board)) {
+    return false;
   }
-  std::unordered_map<std::pair<int8_t, int8_t>, Piece> location_to_piece;
-  for (size_t row = 0; row < rows.size(); row++) {
-    std::vector<std::string> cols = SplitStr(rows[row], ",");
-    int col = 0;
-    for (const auto& col_str : cols) {
-
-      if (col_str.empty()) {
-        return nullptr;  // invalid format
-      }
-
-      char ch = col_str[0];
-      if (ch == 'r' || ch == 'b' || ch == 'y' || ch == 'g') {
-        // Parse piece
-        if (col_str.size() != 2) {
-          return nullptr;  // invalid format
-        }
-        std::pair<int8_t, int8_t> location(row, col);
-
-        PlayerColor player_color;
-        switch (ch) {
-        case 'r':
-          player_color = RED;
-          break;
-        case 'b':
-          player_color = BLUE;
-          break;
-        case 'y':
-          player_color = YELLOW;
-          break;
-        case 'g':
-          player_color = GREEN;
-          break;
-        default:
-          return nullptr;  // invalid format
-        }
-
-        PieceType piece_type;
-        switch (col_str[1]) {
-        case 'P':
-          piece_type = PAWN;
-          break;
-        case 'R':
-          piece_type = ROOK;
-          break;
-        case 'N':
-          piece_type = KNIGHT;
-          break;
-        case 'B':
-          piece_type = BISHOP;
-          break;
-        case 'K':
-          piece_type = KING;
-          break;
-        case 'Q':
-          piece_type = QUEEN;
-          break;
-        default:
-          return nullptr;  // invalid format
-        }
-
-        Player player(player_color);
-        Piece piece(player, piece_type);
-
-        location_to_piece[location] = piece;
+  board.FinishSetup();
+  return true;
+}
 
-        col++;
-      } else if (ch == 'x') {
-        // parse empty square
-        col += 1;
-      } else {
-        // Parse empty spaces
-        std::optional<int> num_empty = ParseInt(col_str);
-        if (!num_empty.has_value() || *num_empty <= 0) {
-          return nullptr;  // invalid format
-        }
-        col += *num_empty;
-      }
+}  // namespace
 
-    }
+bool ParseFEN(std::string_view fen, Board& board) {
+  if (!ParseFENParts(fen, board)) {
+    board.Clear(Player(RED));
+    return false;
   }
+  return true;
+}
 
-  return std::make_shared<Board>(
-      std::move(player), std::move(location_to_piece),
-      std::move(castling_rights), std::move(enp));
+std::shared_ptr<Board> ParseBoardFromFEN(const std::string& fen) {
+  auto board = std::make_shared<Board>(
+      Player(RED), std::unordered_map<std::pair<int8_t, int8_t>, Piece>());
+  if (!ParseFEN(fen, *board)) {
+    return nullptr;  // invalid format
+  }
+  return board;
 }
 
 void SendInfoMessage(const std::string& message) {
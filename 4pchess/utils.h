@@ -5,6 +5,7 @@
 #include <optional>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "board.h"
@@ -32,13 +33,17 @@ std::optional<std::vector<bool>> ParseCastlingAvailability(
 
 std::shared_ptr<Board> ParseBoardFromFEN(const std::string& fen);
 
+// Sets up `board` in place from `fen`, without allocating. Returns false if
+// `fen` is invalid, in which case the board is left cleared.
+bool ParseFEN(std::string_view fen, Board& board);
+
 void SendInfoMessage(const std::string& message);
 
 void SendInvalidCommandMessage(const std::string& line);
 
 std::optional<Move> ParseMove(Board& board, const std::string& move_str);
 
-std::optional<std::pair<int8_t, int8_t>> ParseEnpLocation(const std::string& enp);
+std::optional<std::pair<int8_t, int8_t>> ParseEnpLocation(std::string_view enp);
 
 }  // namespace chess
 